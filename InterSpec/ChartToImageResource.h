@@ -29,6 +29,7 @@
 namespace Wt
 {
   class WObject;
+  class WAbstractItemModel;
   namespace Chart
   {
     class WCartesianChart;
@@ -56,7 +57,19 @@ private:
   virtual void handleRequest( const Wt::Http::Request& request,
                               Wt::Http::Response& response );
   
+  //The chart is only re-painted if its state (model data, axis ranges, series,
+  //  etc) has changed since the last request; otherwise the previous image is
+  //  sent again.
+  std::string chartStateKey() const;
+  void connectToModel();
+  void modelChanged();
+  
   int m_width, m_height;
+  
+  Wt::WAbstractItemModel *m_model;
+  size_t m_modelRevision;
+  std::string m_cachedKey;
+  std::string m_cachedImage;
 };//class ChartToImageResource
 
 
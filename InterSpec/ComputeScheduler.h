@@ -0,0 +1,251 @@
+#ifndef ComputeScheduler_h
+#define ComputeScheduler_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+
+//ComputeScheduler: a single, process-wide, set of worker threads that all
+//  computationally expensive work (peak searches and fits, shielding/source
+//  fits, nuclide searches, etc.) is ran on, so one session doing a lot of work
+//  cant starve the other sessions.
+//
+//  Each session has its own queues (one per Priority).  When a worker thread
+//  becomes free, the highest priority work queued by any session is ran; for
+//  work of the same priority, the session with the fewest jobs currently
+//  running (relative to its weight) goes first, and then the session that has
+//  used the least compute time (relative to its weight).  Background work may
+//  not use the last worker thread, so there is always one available for
+//  interactive work.
+//
+//  Work that wants to run in parallel should use a TaskGroup (instead of
+//  creating threads, or a SpecUtilsAsync::ThreadPool); its tasks are queued
+//  to the same session and priority as the work creating it, and join() runs
+//  tasks that havent been started yet on the calling thread, so nested
+//  parallelism never deadlocks, and never creates more threads than
+//  maxThreads().
+//
+//  Only uses Wt to find the session of the calling thread, when not called
+//  from a job (define COMPUTE_SCHEDULER_NO_WT to build without Wt); results
+//  should be posted back to the session using WServer::post(...), same as
+//  before.
+class ComputeScheduler
+{
+public:
+  enum class Priority
+  {
+    //The user is actively waiting on the result (e.g., fitting peaks they
+    //  just dragged over).
+    Interactive,
+
+    //Work the user asked for, but that may take a while (e.g., an automated
+    //  peak search, or shielding/source fit).
+    Normal,
+
+    //Precomputation the user didnt explicitly ask for (e.g., hint peaks).
+    Background,
+
+    NumPriorities
+  };//enum class Priority
+
+
+  //CancellationToken: jobs whose token is cancelled before they start are
+  //  discarded; jobs already running can check isCurrentJobCancelled().
+  class CancellationToken
+  {
+  public:
+    CancellationToken();
+    void cancel();
+    bool isCancelled() const;
+
+  private:
+    std::atomic<bool> m_cancelled;
+  };//class CancellationToken
+
+
+  //TaskGroup: a group of tasks to run in parallel, that the creating thread
+  //  waits on with join().  If join() isnt called, the destructor will call
+  //  it (but not rethrow exceptions).
+  class TaskGroup
+  {
+  public:
+    //Uses the session, priority, and cancellation token of the job running on
+    //  the current thread; if not called from a job, uses the session of the
+    //  current WApplication (if any) and Priority::Interactive (i.e., someone
+    //  is waiting on this thread).
+    TaskGroup();
+
+    TaskGroup( const std::string &sessionId, const Priority priority );
+
+    ~TaskGroup();
+
+    void post( std::function<void()> task );
+
+    //join(): runs the tasks that havent been started by a worker yet, waits
+    //  for the rest to finish, then rethrows the first exception (if any) a
+    //  task threw.
+    void join();
+
+  private:
+    TaskGroup( const TaskGroup & ) = delete;
+    TaskGroup &operator=( const TaskGroup & ) = delete;
+
+    struct Task
+    {
+      std::function<void()> work;
+      std::shared_ptr<std::atomic<bool>> claimed;
+    };//struct Task
+
+    struct State
+    {
+      State();
+
+      std::mutex mutex;
+      std::condition_variable finished;
+      size_t numOutstanding;
+      std::exception_ptr error;
+    };//struct State
+
+    static void run( const std::shared_ptr<Task> &task,
+                     const std::shared_ptr<State> &state );
+
+    const std::string m_sessionId;
+    const Priority m_priority;
+    std::shared_ptr<CancellationToken> m_token;
+    std::vector<std::shared_ptr<Task>> m_tasks;
+    std::shared_ptr<State> m_state;
+  };//class TaskGroup
+
+
+  //instance(): the single, process-wide, instance.
+  static ComputeScheduler &instance();
+
+  ~ComputeScheduler();
+
+  //post(...): queues 'work' to run on a worker thread for the session.
+  //  Returns the cancellation token of the job ('token', if one was passed
+  //  in).  Exceptions thrown by 'work' are caught and logged.
+  std::shared_ptr<CancellationToken> post( const std::string &sessionId,
+                                std::function<void()> work,
+                                const Priority priority = Priority::Normal,
+                                std::shared_ptr<CancellationToken> token = nullptr );
+
+  //cancelSession(...): cancels, and removes, all queued jobs of the session,
+  //  and cancels its running jobs (which will finish, unless they check
+  //  isCurrentJobCancelled()); should be called when a session ends.
+  void cancelSession( const std::string &sessionId );
+
+  //setSessionWeight(...): relative share of the worker threads the session
+  //  gets when sessions are contending; defaults to 1.0.
+  void setSessionWeight( const std::string &sessionId, const double weight );
+
+  //maxThreads(): the maximum number of worker threads.  Defaults to
+  //  MAX_COMPUTE_THREADS, if defined and non-zero, otherwise the number of
+  //  hardware threads (but at least two).  Threads are only created as needed.
+  size_t maxThreads() const;
+  void setMaxThreads( const size_t nthreads );
+
+  //numQueued(), numRunning(): number of jobs, of all sessions, waiting to
+  //  run, or running.
+  size_t numQueued() const;
+  size_t numRunning() const;
+
+  //currentSessionId(), currentPriority(), isCurrentJobCancelled(): of the job
+  //  running on the calling thread; if not called from a job, the session ID
+  //  of the current WApplication (or empty if there isnt one), Interactive,
+  //  and false.
+  static std::string currentSessionId();
+  static Priority currentPriority();
+  static bool isCurrentJobCancelled();
+
+protected:
+  ComputeScheduler();
+
+  struct Job
+  {
+    std::function<void()> work;
+    std::shared_ptr<CancellationToken> token;
+
+    //claimed: for TaskGroup tasks; set by whichever of a worker, or
+    //  TaskGroup::join(), runs the task first.
+    std::shared_ptr<std::atomic<bool>> claimed;
+  };//struct Job
+
+  struct SessionState
+  {
+    SessionState();
+
+    std::deque<Job> queues[static_cast<int>(Priority::NumPriorities)];
+    size_t numRunning;
+
+    //consumed: seconds of worker time used; when a session goes from idle to
+    //  having work, this is raised to the minimum of the active sessions, so
+    //  idle time doesnt bank credit.
+    double consumed;
+    double weight;
+
+    //running: the tokens of the jobs currently running, for cancelSession().
+    std::vector<std::shared_ptr<CancellationToken>> running;
+  };//struct SessionState
+
+  //isIdle(...): true if the session has no running or queued jobs.
+  static bool isIdle( const SessionState &state );
+
+  //enqueue(...): queues the job, and starts another worker thread if needed.
+  void enqueue( const std::string &sessionId, Job &&job,
+                const Priority priority );
+
+  //nextJob(...): called with m_mutex locked; removes the next job to run from
+  //  the queues, or returns false if nothing can run now.
+  bool nextJob( Job &job, std::string &sessionId, Priority &priority );
+
+  void workerLoop();
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_workAvailable;
+
+  std::map<std::string,SessionState> m_sessions;
+  std::map<std::string,double> m_weights;
+
+  std::vector<std::thread> m_threads;
+  size_t m_maxThreads;
+  size_t m_numIdle;
+  size_t m_numRunning;
+  size_t m_numQueued;
+  bool m_stopping;
+};//class ComputeScheduler
+
+#endif //ComputeScheduler_h
@@ -26,6 +26,8 @@ static_assert( RENDER_REFERENCE_PHOTOPEAKS_SERVERSIDE, "RENDER_REFERENCE_PHOTOPE
 #endif
 
 //Forward declarations
+class PeakDef;
+struct PeakContinuum;
 class SpecMeas;
 class PeakModel;
 class SpectrumChart;
@@ -380,6 +382,13 @@ protected:
   //  y-axis to be auto-range
   void chartXRangeChangedCallback( double x, double y, double chart_width_px, double chart_height_px );
   
+  /** Returns the JSON for the foreground ROIs, the same as
+     PeakDef::peak_json(...), but re-using the JSON of ROIs whose peaks are
+     unchanged since the last call, so refitting one ROI only serializes that
+     ROI.
+   */
+  std::string foregroundPeakJson( const std::vector<std::shared_ptr<const PeakDef>> &peaks );
+  
   /** The javascript variable name used to refer to the SpecrtumChartD3 object.
       Currently is `jsRef() + ".chart"`.
    */
@@ -429,6 +438,17 @@ protected:
    */
   std::vector<std::string> m_pendingJs;
   
+  /** The foreground peaks last sent to the client; used to avoid re-sending
+     the peak JSON when the peaks havent actually changed.
+   */
+  std::vector<std::shared_ptr<const PeakDef>> m_foregroundPeaksOnClient;
+  
+  /** The peaks, and their JSON, of each foreground ROI last sent to the
+     client; see foregroundPeakJson(...).
+   */
+  std::map<std::shared_ptr<const PeakContinuum>,
+           std::pair<std::vector<std::shared_ptr<const PeakDef>>,std::string>> m_foregroundRoiJson;
+  
 #if( INCLUDE_ANALYSIS_TEST_SUITE )
   friend class SpectrumViewerTester;
 #endif
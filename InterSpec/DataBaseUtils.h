@@ -28,6 +28,7 @@
 #include <mutex>
 #include <string>
 #include <memory>
+#include <functional>
 
 namespace  Wt
 {
@@ -145,6 +146,47 @@ namespace DataBaseUtils
 #endif
   };//class DbSession
   
+  //queueDbWrite(...): queues 'work' to be executed on a background writer
+  //  thread, so that database writes the GUI doesnt need to wait on (user
+  //  preferences, spectrum files and their peaks, etc.) dont block the event
+  //  loop of this session, or, since they share a connection pool, of other
+  //  sessions.
+  //  'work' should do all its database interactions within a DbTransaction of
+  //  'sql', and should throw an exception on failure.
+  //  If there is already work with the same 'key' for 'sql' waiting to be
+  //  executed, it is replaced by 'work'; e.g., if a preference is changed
+  //  multiple times quickly, only the final value is written.
+  //  Consecutive 'batchable' work for a given 'sql' that is pending when the
+  //  writer gets to it is committed in a single transaction; if that
+  //  transaction fails, each piece of work is re-tried in its own transaction.
+  //  Non-batchable work (e.g., larger writes with side effects outside the
+  //  database) is always executed by itself, and batches are not merged across
+  //  it, so work for a given 'sql' is executed in the order it was queued
+  //  (with replaced work taking the place of the work it replaced).
+  //  If 'work' fails, 'onerror' is called (on the writer thread) with the error
+  //  message, or if 'onerror' is empty, the message is printed to stderr.
+  //  The queue is bounded; if it is full, this function blocks until there is
+  //  room.
+  void queueDbWrite( std::shared_ptr<DbSession> sql,
+                     const std::string &key,
+                     std::function<void()> work,
+                     const bool batchable,
+                     std::function<void(const std::string &)> onerror );
+  
+  //flushDbWrites(): blocks until all work queued by queueDbWrite(...) before
+  //  this call has been executed.  Should be called before explicit saves
+  //  (ex. saving the app state) or shutting down, so these are as durable as
+  //  if the writes had been done synchronously.
+  //  If the calling thread holds a DbTransaction, returns false without
+  //  waiting (and logs an error), as the writer may need that DbSession to
+  //  finish; code that saves while holding a transaction should flush before
+  //  opening it.  Returns true if the pending writes were flushed.
+  bool flushDbWrites();
+  
+  //currentThreadHoldsDbTransaction(): returns true if the calling thread has
+  //  a DbTransaction open (in which case flushDbWrites() cant flush).
+  bool currentThreadHoldsDbTransaction();
+  
 #if( USE_MYSQL_DB )
   //getMySqlDatabaseConnectionInfo(): A helper function to retrive
   void getMySqlDatabaseConnectionInfo( std::string &db,
@@ -68,6 +68,7 @@ class InterSpec;
 class CsvDownloadGui;
 class PeakCsvResource;
 class DecayChainChart;
+class DecayCurveEngine;
 class DecayActivityChart;
 class DecayActivityModel;
 class DecaySelectNuclide;
@@ -162,6 +163,13 @@ public:
   int m_width, m_height;
   
   SandiaDecay::NuclideMixture            *m_currentMixture;
+  
+  //Evaluates the decay curves of m_currentMixture; rebuilt along with
+  //  m_currentMixture by updateInitialMixture() only when m_nuclides changes.
+  mutable std::unique_ptr<DecayCurveEngine> m_decayEngine;
+  
+  //The m_nuclides information m_currentMixture was last built for.
+  mutable std::string m_currentMixtureSignature;
 
 
   //Functions for dealing with adding new nuclides
@@ -80,12 +80,88 @@ public:
                      const float fractionAdHydrogen,
                      const std::vector<float> &binning ) const;
   
+  /** Calculates the scattered continuum for many gamma lines through the
+   * same shielding, adding the results into a caller owned buffer.
+   *
+   * The areal density and atomic number interpolation of the scatter table is
+   * only done once for all lines, and no memory is allocated per line, so this
+   * should be preferred over calling #getContinuum for each line of sources
+   * with many gammas (e.g., aged U or Pu).
+   *
+   * \param answer Buffer the continuum of each line is added into; must
+   *        already be sized to #binning.size().  Is not zeroed out first.
+   * \param uncollided Will be resized to the number of lines, and filled with
+   *        the number of un-collided gammas for each line.
+   * \param sourceEnergies Energies of incomming gammas, in keV.
+   * \param sourceIntensities Number of gammas emmited from the source for each
+   *        energy.
+   * \param atomicNumber Atomic number of shielding.
+   * \param arealDensity Areal density of shielding, in g/cm2.
+   * \param fractionAdHydrogen Fractional areal density of hydrogen in shield
+   * \param binning The binning structure of #answer.
+   *
+   * Values added into #answer are the same as summing the results of
+   * #getContinuum for each line.
+   *
+   * Throws exception if input vectors are of different sizes, or #answer is
+   * not the same size as #binning.
+   */
+  void addContinuum( std::vector<double> &answer,
+                     std::vector<float> &uncollided,
+                     const std::vector<float> &sourceEnergies,
+                     const std::vector<float> &sourceIntensities,
+                     const float atomicNumber,
+                     const float arealDensity,
+                     const float fractionAdHydrogen,
+                     const std::vector<float> &binning ) const;
+  
 protected:
   static const int sm_num_areal_density = 9;
   static const int sm_num_atomic_number = 6;
   static const int sm_num_input_energy = 16;
   static const int sm_num_out_energy = 32;
   
+  /** The scatter table interpolated to a specific shielding; only the
+   incomming energy dimension is left to be interpolated for each line.
+   */
+  struct ShieldingInterpolation
+  {
+    float atomicNumber;
+    float arealDensity;
+    float fracHydrogen;
+    
+    /** Fraction of continuum to take from the polyethylene table, to account
+     for hydrogen content beyond what the atomic number interpolation covers.
+     */
+    float fracPe;
+    
+    float data[sm_num_input_energy][sm_num_out_energy];    //[incomming energy][fractional output continuum energy]
+    float peData[sm_num_input_energy][sm_num_out_energy];  //only filled if fracPe > 0
+  };//struct ShieldingInterpolation
+  
+  /** Interpolates #m_data in areal density and atomic number. */
+  void interpolateShielding( ShieldingInterpolation &interp,
+                             const float atomicNumber,
+                             const float arealDensity,
+                             const float fracHydrogen ) const;
+  
+  /** Computes continuum for a single line using an already interpolated
+   shielding.
+   
+   \param f Scratch buffer of size #sm_num_out_energy
+   \param orig_binning Scratch buffer of size #sm_num_out_energy
+   \param answer Must already be sized to #binning; will be overwritten.
+   
+   \returns number of un-collided gammas.
+   */
+  float lineContinuum( const ShieldingInterpolation &interp,
+                       const float sourceEnergy,
+                       const float sourceIntensity,
+                       std::vector<float> &f,
+                       std::vector<float> &orig_binning,
+                       const std::vector<float> &binning,
+                       std::vector<float> &answer ) const;
+  
   float m_data[9][6][16][32];  //[areal density][atomic number][incomming energy][fractional output continuum energy]
 };//class GadrasScatterTable
 
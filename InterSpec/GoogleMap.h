@@ -35,6 +35,7 @@
 #include <Wt/WGoogleMap>
 
 #include "InterSpec/AuxWindow.h"
+#include "InterSpec/GpsCountRateIndex.h"
 
 class SrbGoogleMap;
 class MeasurementInfo;
@@ -47,9 +48,19 @@ public:
   
   void addMarker( double latitude, double longitude );
   void addInfoBox( double latitude, double longitude, const Wt::WString &html );
+
+  //addMeasurment(...): if there are only a few GPS locations, a marker is
+  //  placed at each of them, otherwise the samples are aggregated, using a
+  //  GpsCountRateIndex, into at most sm_maxCircles cells, that are re-queried
+  //  (at a finer level) as the map is zoomed in, if the map extent is tracked.
   void addMeasurment( std::shared_ptr<const MeasurementInfo> meas,
                       const Wt::WString &title,
                       const std::set<int> &displayed );
+
+  //countRateResource(...): a resource (owned by this widget) to download the
+  //  GPS location and count rate of each sample added by addMeasurment(...)
+  //  as CSV, or GeoJSON; returns nullptr if there were no GPS tagged samples.
+  Wt::WResource *countRateResource( const bool geoJson );
   std::string getStaticMapFromMeas( std::shared_ptr<const MeasurementInfo> meas,
                              const Wt::WString &title );
   std::string getStaticMap();
@@ -67,8 +78,23 @@ protected:
   void init();
   void updateMapGpsCoords( const double , const double ,
                            const double , const double );
-  
+
+  //showCells(...): adds a marker, or circle, for each cell.
+  void showCells( const std::vector<GpsCountRateIndex::Cell> &cells,
+                  const bool useMarkers );
+
+  //sm_maxCircles: the most circles shown on the map at once.
+  static const size_t sm_maxCircles;
+
   SrbGoogleMap *m_map;
+
+  std::shared_ptr<const GpsCountRateIndex> m_index;
+  std::set<int> m_displayed;
+
+  //m_shownLevel: level of the cells currently shown as circles, or -1 if
+  //  markers (or nothing) are shown; m_shownCells is the geohashes of them.
+  int m_shownLevel;
+  std::vector<std::uint64_t> m_shownCells;
   
   const bool m_trackMapExtent;
   float m_mapExtents[4];
@@ -0,0 +1,182 @@
+#ifndef GpsCountRateIndex_h
+#define GpsCountRateIndex_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+class MeasurementInfo;
+
+
+//GpsCountRateIndex: a spatial index of the GPS tagged samples of a spectrum
+//  file (e.g., a drive or walk survey in search-mode), that aggregates the
+//  gamma and neutron count rates into cells, at any of sm_maxLevel levels of
+//  detail, so maps dont need a marker per GPS location.
+//
+//  Samples are indexed by a geohash (bits of longitude and latitude
+//  interleaved, longitude first); a cell at level L is all the samples that
+//  share the first 2*L bits, so it spans 360/2^L degrees of longitude and
+//  180/2^L degrees of latitude.  Since samples are sorted by geohash, the
+//  samples in a cell are contiguous in samples().  Cells are computed the
+//  first time a level is asked for, and cached.
+//
+//  Independent of Wt (and the map widget), so it can be used headless, e.g.,
+//  to export the count rates to CSV or GeoJSON from the command line.  Not
+//  thread safe (the cell caches are built lazily).
+class GpsCountRateIndex
+{
+public:
+  struct SamplePoint
+  {
+    int sampleNumber;
+
+    //Mean position of the measurements of the sample that have GPS info.
+    double latitude, longitude;
+
+    boost::posix_time::ptime startTime;
+
+    //Live and real times are the maximum of the measurements of the sample
+    //  (the detectors are measuring at the same time); counts are the sum.
+    double liveTime, realTime;
+    double gammaCounts, neutronCounts;
+    bool hasNeutrons;
+
+    std::uint64_t geohash;
+
+    double gammaCps() const;
+  };//struct SamplePoint
+
+
+  struct Cell
+  {
+    int level;
+
+    //geohash: the first 2*level bits of the geohash of the samples in the
+    //  cell (i.e., the geohash shifted right by 64 - 2*level).
+    std::uint64_t geohash;
+
+    //Mean position of the samples in the cell, which (unlike the center of
+    //  the cell) is always near the data.
+    double latitude, longitude;
+
+    size_t numSamples;
+    double liveTime, realTime;
+    double gammaCounts, neutronCounts;
+
+    //Highest count rate of any single sample in the cell, so a hot spot
+    //  isnt hidden by averaging with the samples around it.
+    double maxSampleGammaCps;
+    bool hasNeutrons;
+
+    //Range [beginSample,endSample) of the samples in the cell in samples().
+    size_t beginSample, endSample;
+
+    double gammaCps() const;
+  };//struct Cell
+
+
+  //Extent: a latitude/longitude box; if west > east, the box crosses the
+  //  antimeridian.
+  struct Extent
+  {
+    double south, west, north, east;
+
+    bool contains( const double latitude, const double longitude ) const;
+  };//struct Extent
+
+
+  //sm_maxLevel: the finest level; cells are about a centimeter.
+  static const int sm_maxLevel;
+
+  //Indexes the samples of 'meas' with GPS coordinates; intrinsic activity
+  //  measurements are not included.
+  explicit GpsCountRateIndex( const std::shared_ptr<const MeasurementInfo> &meas );
+
+  //samples(): all the indexed samples, sorted by geohash.
+  const std::vector<SamplePoint> &samples() const;
+
+  //cells(...): all the non-empty cells at 'level' (0 to sm_maxLevel), sorted
+  //  by geohash.
+  const std::vector<Cell> &cells( const int level ) const;
+
+  //extent(): bounding box of all the samples; all zeros if no samples.
+  Extent extent() const;
+
+  //finestLevelWithAtMost(...): the finest level with no more than 'maxCells'
+  //  cells (i.e., the most detail that can be shown with that many markers).
+  //  Does not build, or cache, the cells of the levels it checks.
+  int finestLevelWithAtMost( const size_t maxCells ) const;
+
+  //levelForViewport(...): the level whose cells are about 1/cellsAcross of
+  //  the width, or height, of 'viewport' (whichever gives the coarser level).
+  static int levelForViewport( const Extent &viewport, const size_t cellsAcross );
+
+  //query(...): the cells at 'level' whose sample centroid is within
+  //  'viewport'.  If there are more than 'maxCells' of them (and maxCells is
+  //  non-zero), coarser levels are used until there arent; 'level' is set to
+  //  the level actually used.
+  std::vector<Cell> query( const Extent &viewport, int &level,
+                           const size_t maxCells = 0 ) const;
+
+  //gammaCpsPercentile(...): fraction of samples with a count rate less than
+  //  or equal to 'cps'; used to color cells on maps.
+  double gammaCpsPercentile( const double cps ) const;
+
+  //writeCsv(...) / writeGeoJson(...): writes the cells at 'level', or if
+  //  level is negative, each sample individually.  Returns false if there
+  //  were no GPS tagged samples (a header, or empty feature collection, is
+  //  still written).
+  bool writeCsv( std::ostream &output, const int level = -1 ) const;
+  bool writeGeoJson( std::ostream &output, const int level = -1 ) const;
+
+  //geohash(...): interleaves 32 bits of longitude and 32 bits of latitude;
+  //  the same bit order as the standard base-32 geohash.
+  static std::uint64_t geohash( const double latitude, const double longitude );
+
+  //geohashString(...): the standard base-32 geohash string, with 'nchars'
+  //  (at most 12) characters.
+  static std::string geohashString( const std::uint64_t geohash,
+                                    const size_t nchars );
+
+protected:
+  //numCells(...): number of cells at 'level', without building them.
+  size_t numCells( const int level ) const;
+
+  std::vector<SamplePoint> m_samples;
+
+  //m_sortedCps: the count rate of every sample, sorted.
+  std::vector<double> m_sortedCps;
+
+  //m_cells: lazily filled cache of cells; index is the level.
+  mutable std::vector<std::unique_ptr<std::vector<Cell>>> m_cells;
+};//class GpsCountRateIndex
+
+#endif //GpsCountRateIndex_h
@@ -25,6 +25,8 @@
 
 #include "InterSpec_config.h"
 
+#include <memory>
+
 #include <Wt/WObject>
 #include <Wt/WMessageResourceBundle>
 
@@ -41,6 +43,10 @@ namespace Wt
   class WPopupWidget;
   class WContainerWidget;
   class WMessageResourceBundle;
+  namespace Json
+  {
+    class Value;
+  }
 }//namespace Wt
 
 namespace HelpSystem
@@ -63,7 +69,10 @@ namespace HelpSystem
     Wt::WLineEdit *m_searchText;
     
     
-    std::string m_helpLookupTable;
+    /** The parsed help.json contents; shared between all sessions, see
+        ResourceRegistry::helpJson().  Will be null if it couldn't be loaded.
+     */
+    std::shared_ptr<const Wt::Json::Value> m_helpJson;
     
     void setPathVisible( Wt::WTreeNode *parent );
     
@@ -79,7 +88,7 @@ namespace HelpSystem
      */
     std::string getHelpContents( const std::string &tag ) const;
     
-    void populateTree(Wt::Json::Array &res, Wt::WTreeNode* parent);
+    void populateTree(const Wt::Json::Array &res, Wt::WTreeNode* parent);
     void initialize();
     void handleArrowPress( const Wt::WKeyEvent e );
     void handleKeyPressInSearch( const Wt::WKeyEvent e );
@@ -47,6 +47,8 @@ class MaterialDB;
 struct ColorTheme;
 class UserFileInDb;
 class Recalibrator;
+class UndoRedoManager;
+class SampleSumCache;
 class SrbMySqlUtil;
 class PopupDivMenu;
 class SpectrumChart;
@@ -513,9 +515,10 @@ public:
   void initMaterialDbAndSuggestions();
   
 
-  //fillMaterialDb(): populates materialDB, and then calls the provided
-  //  'update' function by posting to the WServer thread pool for 'sessionid'
-  //  so it will be executed in its event loop.
+  //fillMaterialDb(): populates materialDB with the materials shared between
+  //  all sessions (see ResourceRegistry::materialDB(); parsed on first use),
+  //  and then calls the provided 'update' function by posting to the WServer
+  //  thread pool for 'sessionid' so it will be executed in its event loop.
   static void fillMaterialDb( std::shared_ptr<MaterialDB> materialDB,
                               const std::string sessionid,
                               boost::function<void(void)> update );
@@ -554,6 +557,9 @@ public:
   SpecMeasManager *fileManager();
   
   PeakModel *peakModel();
+  
+  //undoRedoManager(): the journal of undoable user actions for this session.
+  UndoRedoManager *undoRedoManager();
 
   //detectorChanged(): signal emited when the detector is changed to a
   //  completely new detector.  Note that the object pointed to stays the same
@@ -701,6 +707,24 @@ protected:
   void displaySecondForegroundData();
   void displayBackgroundData();
   void displayTimeSeriesData( bool updateHighlightRegionsDisplay );
+  
+  //accountSpectrumFiles(): reports the memory of newly displayed spectrum
+  //  files to MemoryAccountant, and removes files no longer displayed; called
+  //  when a file is loaded, so each file is only sized once.
+  void accountSpectrumFiles();
+  
+  //accountPeaks(): reports the memory used by the peaks of the displayed
+  //  files; called when the peaks change.
+  void accountPeaks();
+  
+  //accountSampleSumCache(...): reports the size of the sample sum cache for
+  //  'type'; called after it is summed from (and so may have inserted) or
+  //  cleared.
+  void accountSampleSumCache( const SpectrumType type );
+  
+  //evictSampleSumCache(...): releases the cached sums for 'type'; called (in
+  //  this session) when MemoryAccountant is over budget.
+  void evictSampleSumCache( const SpectrumType type );
 
   static ShrdConstFVecPtr getBinning( std::set<int> sample_numbers,
                                       const std::vector<bool> det_to_use,
@@ -1300,6 +1324,18 @@ protected:
   std::shared_ptr<const ColorTheme> m_colorTheme;
   
   bool m_findingHintPeaks;
+  
+  std::unique_ptr<UndoRedoManager> m_undoRedo;
+  
+  //Caches to speed up summing the displayed samples of files with many
+  //  samples, as the user steps through them.
+  std::unique_ptr<SampleSumCache> m_foregroundSumCache;
+  std::unique_ptr<SampleSumCache> m_secondSumCache;
+  std::unique_ptr<SampleSumCache> m_backgroundSumCache;
+  
+  //m_accountedSpectra: the files reported to MemoryAccountant by
+  //  accountSpectrumFiles(), so they can be removed once no longer displayed.
+  std::vector<const SpecMeas *> m_accountedSpectra;
   std::deque<boost::function<void()> > m_hintQueue;
   
   static std::mutex sm_staticDataDirectoryMutex;
@@ -1312,6 +1348,7 @@ protected:
 
   
   friend class Recalibrator; // Recalibrator needs to be able access whatever
+  friend class UndoRedoManager; //Needs to refresh the Recalibrator on undo
 
 #if( INCLUDE_ANALYSIS_TEST_SUITE )
   friend class SpectrumViewerTester;
@@ -232,7 +232,9 @@ public:
   T preferenceValue( const std::string &name ) const;
   
   //setPreferenceValue(): Sets preference value for named preference to both
-  //  the InterSpecUser in memorry and the database.
+  //  the InterSpecUser in memorry and the database.  The in-memory value is
+  //  updated immediately, while the database write is queued to the
+  //  background writer (see DataBaseUtils::queueDbWrite(...)).
   //  If the preference isnt already in memory, and its not in
   //  data/default_preferences.xml then will throw an exception
   template<typename T>
@@ -581,6 +583,8 @@ public:
   
 public:
   UserFileInDbData();
+  ~UserFileInDbData();
+  
   Wt::Dbo::ptr<UserFileInDb> fileInfo;
   
   //gzipCompressed: only set true when writing if ALLOW_SAVE_TO_DB_COMPRESSION
@@ -600,14 +604,19 @@ public:
   //  Will throw FileToLargeForDbException if serialization is larger than
   //  UserFileInDb::sm_maxFileSizeBytes.
   //  Will throw runtime_error if any other issues.
+  //  The memory of fileData is attributed to 'sessionId' in MemoryAccountant
+  //  until this object is destructed; it must be passed explicitly, since
+  //  this function is often called from worker threads.
   void setFileData( std::shared_ptr<const SpecMeas> spectrumFile,
-                    const SerializedFileFormat format );
+                    const SerializedFileFormat format,
+                    const std::string &sessionId );
 
   //setFileData(...): same as other setFileData(...) function, but instead
   //  sets the data from a file on the filesystem.  Will throw if the file
   //  reading fails for any reason.
   void setFileData( const std::string &path,
-                    const SerializedFileFormat format );
+                    const SerializedFileFormat format,
+                    const std::string &sessionId );
   
   //decodeSpectrum(): de-serializes data currently in fileData.
   //  Will throw if de-serialization fails, otherwise will always return
@@ -1103,49 +1112,20 @@ void InterSpecUser::setPreferenceValue( Wt::Dbo::ptr<InterSpecUser> user,
     throw std::runtime_error( "InterSpecUser::setPreferenceValue() must be called"
                              " with same db session as user" );
   
-  std::vector< Wt::Dbo::ptr<UserOption> > options;
-  {//begin interacting with the database
-    DataBaseUtils::DbTransaction transaction( *sql );
-    Wt::Dbo::collection< Wt::Dbo::ptr<UserOption> > optioncol
-                                    = user->m_dbPreferences.find()
-                                         .where( "name=?" ).bind( name );
-    std::copy( optioncol.begin(), optioncol.end(), std::back_inserter(options) );
-    transaction.commit();
-  }//end interacting with the database
-  
-  Wt::Dbo::ptr<UserOption> option;
-  const size_t noptions = options.size();
-  if( noptions == 0 )
-  {
-    UserOption *newoption = new UserOption();
-    newoption->m_name = name;
-    newoption->m_user = user;
-    
-    if( typeid(value) == typeid(std::string) )
-      newoption->m_type = UserOption::String;
-    else if( typeid(value) == typeid(double) || typeid(value) == typeid(float) )
-      newoption->m_type = UserOption::Decimal;
-    else if( typeid(value) == typeid(int)
-            || typeid(value) == typeid(unsigned int)
-            || typeid(value) == typeid(long long) )
-      newoption->m_type = UserOption::Integer;
-    else if( typeid(value) == typeid(bool) )
-      newoption->m_type = UserOption::Boolean;
-    else
-    {
-      delete newoption;
-      throw std::runtime_error( "setPreferenceValue(...): invalid type: "
-                               + std::string(typeid(value).name()) );
-    }
-    
-    DataBaseUtils::DbTransaction transaction( *sql );
-    option = sql->session()->add( newoption );
-    transaction.commit();
-  }else if( noptions == 1 )
-    option = options.front();
+  UserOption::DataType type;
+  if( typeid(value) == typeid(std::string) )
+    type = UserOption::String;
+  else if( typeid(value) == typeid(double) || typeid(value) == typeid(float) )
+    type = UserOption::Decimal;
+  else if( typeid(value) == typeid(int)
+          || typeid(value) == typeid(unsigned int)
+          || typeid(value) == typeid(long long) )
+    type = UserOption::Integer;
+  else if( typeid(value) == typeid(bool) )
+    type = UserOption::Boolean;
   else
-    throw std::runtime_error( "Invlaid number of preferences for " + name
-                             + " for user " + user->userName() );
+    throw std::runtime_error( "setPreferenceValue(...): invalid type: "
+                             + std::string(typeid(value).name()) );
   
   std::stringstream valuestrm;
   valuestrm << value;
@@ -1153,16 +1133,49 @@ void InterSpecUser::setPreferenceValue( Wt::Dbo::ptr<InterSpecUser> user,
   if( strval.size() > UserOption::sm_max_value_str_len )
     strval = strval.substr( 0, UserOption::sm_max_value_str_len );
   
-  {//begin interacting with the database
+  {//begin update in-memory value
+    UserOption option;
+    option.m_name = name;
+    option.m_type = type;
+    option.m_value = strval;
+    user->m_preferences[name] = option.value();
+  }//end update in-memory value
+  
+  //The database is updated by the background writer; if this preference is
+  //  changed again before then, only the latest value is written.
+  const long long userid = user.id();
+  const std::string key = "pref:" + std::to_string(userid) + ":" + name;
+  
+  DataBaseUtils::queueDbWrite( sql, key, [sql,userid,name,type,strval](){
     DataBaseUtils::DbTransaction transaction( *sql );
-    option.modify()->m_value = strval;
+    
+    Wt::Dbo::ptr<InterSpecUser> dbuser = sql->session()->load<InterSpecUser>( userid );
+    
+    std::vector< Wt::Dbo::ptr<UserOption> > options;
+    Wt::Dbo::collection< Wt::Dbo::ptr<UserOption> > optioncol
+                                    = dbuser->m_dbPreferences.find()
+                                         .where( "name=?" ).bind( name );
+    std::copy( optioncol.begin(), optioncol.end(), std::back_inserter(options) );
+    
+    if( options.empty() )
+    {
+      UserOption *newoption = new UserOption();
+      newoption->m_name = name;
+      newoption->m_user = dbuser;
+      newoption->m_type = type;
+      newoption->m_value = strval;
+      sql->session()->add( newoption );
+    }else if( options.size() == 1 )
+    {
+      options.front().modify()->m_value = strval;
+    }else
+    {
+      throw std::runtime_error( "Invlaid number of preferences for " + name
+                                + " for user " + dbuser->userName() );
+    }
+    
     transaction.commit();
-//    std::cerr << "Commited " << option->m_name << " value of "
-//              << option->m_value << " to user " << option->m_user.id()
-//              << " with ID=" << option.id() << std::endl;
-  }//end interacting with the database
-  
-  user->m_preferences[name] = option->value();
+  }, true, std::function<void(const std::string &)>() );
 }//setPreferenceValue//(...)
 
 #endif //InterSpecUser_h
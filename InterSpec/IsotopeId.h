@@ -25,6 +25,7 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <deque>
 #include <string>
 #include <vector>
@@ -78,6 +79,51 @@ void suggestNuclides( PeakToNuclideMatch &answer,
                       std::shared_ptr<const Measurement> data,
                       std::shared_ptr<const DetectorPeakResponse> response );
 
+
+//suggestNuclidesCached(...): same as suggestNuclides(...), but results are
+//  memoized on the identity of the inputs (the peak, every peak in
+//  'all_peaks', and the channel counts and energies objects), the live and
+//  real times, and the detector response hash, so repeated requests (e.g.,
+//  from the right-click menu, and then the whole-spectrum nuclide ID) re-use
+//  previous results.  Peaks and spectra must not be modified after being
+//  passed in (changes should create new objects, as PeakModel does).  The
+//  cache only holds weak references to the inputs, and is limited to a few
+//  MB.  Simultaneous requests for the same inputs share a single computation.
+//Throws same exceptions as suggestNuclides(...).
+void suggestNuclidesCached( PeakToNuclideMatch &answer,
+                            std::shared_ptr<const PeakDef> peak,
+                            std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks,
+                            std::shared_ptr<const Measurement> data,
+                            std::shared_ptr<const DetectorPeakResponse> response );
+
+//suggestNuclides(...): suggests nuclides for each of 'peaks', using cached
+//  results when available, and evaluating the rest in parallel using a
+//  ComputeScheduler::TaskGroup.  'answers' will be resized to the same size as
+//  'peaks'.
+//If suggestions for a peak fail, its entry in 'answers' will be left empty.
+void suggestNuclides( std::vector<PeakToNuclideMatch> &answers,
+                      const std::vector< std::shared_ptr<const PeakDef> > &peaks,
+                      std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks,
+                      std::shared_ptr<const Measurement> data,
+                      std::shared_ptr<const DetectorPeakResponse> response );
+
+
+//characteristicGammaMatches(...): for each nuclide that has a line listed in
+//  "data/CharacteristicGammas.txt" within the energy range (+-1.5 sigma, or
+//  the ROI for non-Gaussian peaks) of any of 'peaks', returns the number of
+//  (peak, line) matches.  All peaks are matched in a single sweep over the
+//  lines, which are only read from disk once per process.
+//Used by suggestNuclides(...) to up-weight characteristic nuclides.
+std::map<const SandiaDecay::Nuclide *, int> characteristicGammaMatches(
+                      const std::deque< std::shared_ptr<const PeakDef> > &peaks );
+
+
+//gammasNearInEnergy(...): returns nuclides (with half-lives, or long-lived
+//  parents, longer than 100 minutes) that have a gamma within 'dx' of energy
+//  'x', sorted by weight, which is the distance in energy from 'x'.  The
+//  long-lived parents of the nuclides with the line are also returned.
+std::vector<NuclideStatWeightPair> gammasNearInEnergy( float x, double dx );
+
   
 //minDetectableCounts(): assumes no peak was detected, and that the entire
 //  contribution to data is background.  We will return the number of counts,
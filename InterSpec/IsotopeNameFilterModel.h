@@ -79,7 +79,9 @@ public:
                                          std::vector<std::string> &alphastrs,
                                          std::vector<std::string> &numericstrs );
 
-  //XXX - filter(...) may be fairly inefficient, and should be cleaned up
+  //filter(...): updates the suggestions for what the user has typed in.  The
+  //  element, nuclide, and reaction lookups use a process-wide index that is
+  //  built the first time any IsotopeNameFilterModel filters text.
   virtual void filter( const Wt::WString &text );
 //  Wt::WFlags<Wt::ItemFlag> flags( const Wt::WModelIndex & index ) const;
   
@@ -115,6 +115,7 @@ public:
   
 protected:
   void handleSourcesUpdates();
+  void handleEffEqnOrderChanged();
   void handleSqrtEqnOrderChange();
   void handleFwhmTypeChanged();
   void handleShowFwhmPointsToggled();
@@ -190,6 +191,21 @@ protected:
   double m_effEqnChi2;
   std::vector<float> m_effEqnCoefs, m_effEqnCoefUncerts;
   
+  /** The last successfully fit coefficients, and the equation type/units they
+   are for; used as the starting point for the next fit, since the user will
+   usually only have changed the inputs a little (e.g., toggled a peak).
+   */
+  std::vector<float> m_prevFwhmCoefs, m_prevEffEqnCoefs;
+  int m_prevFwhmForm;
+  bool m_prevEffEqnInMeV;
+  
+  /** Until the user explicitly selects the number of efficiency equation
+   terms, or the FWHM equation form, the fits will try each option (in
+   parallel), and select the best one according to the BIC.
+   */
+  bool m_userSelectedEffOrder;
+  bool m_userSelectedFwhmForm;
+  
   friend class MakeDrfWindow;
 };//class MakeDrf
 
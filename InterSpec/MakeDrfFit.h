@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <deque>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -79,6 +80,11 @@ namespace MakeDrfFit
       energy is greater than 30; if so, in keV, else MeV.  Returned coefficients
       will be in the same energy units as DetEffDataPoint::energy.
    
+      If result passed in has fcnOrder entries (e.g., the previous solution
+      when the user has slightly changed the input data), it will be used as
+      the starting point of the fit if it is better than the least linear
+      squares solution.
+   
       return value is chi2/dof.
    
       Throws exception on error with a kinda explanatory message.
@@ -88,6 +94,71 @@ namespace MakeDrfFit
                              std::vector<float> &result,
                              std::vector<float> &uncerts );
   
+  
+  /** The result of fitting one functional form to the data, as part of
+      choosing between forms by an information criteria.
+   */
+  struct FitCandidate
+  {
+    /** For FWHM fits, the functional form; kNumResolutionFnctForm for
+        efficiency fits.
+     */
+    DetectorPeakResponse::ResolutionFnctForm fwhmForm;
+    
+    /** Number of efficiency equation terms, or for kSqrtPolynomial the number
+        of terms in the sqrt; -1 for kGadrasResolutionFcn.
+     */
+    int order;
+    
+    int numParameters;
+    double chi2, aic, bic;
+    std::vector<float> coefficients, uncertainties;
+    
+    /** Non-empty if fit failed. */
+    std::string error;
+    
+    /** Sets aic (chi2 + 2k) and bic (chi2 + k*ln(n)) from chi2. */
+    void setInformationCriteria( const size_t numDataPoints );
+  };//struct FitCandidate
+  
+  
+  /** Returns index of the successful candidate with the lowest BIC.
+      Throws exception if no candidates were successful.
+   */
+  size_t best_candidate_by_bic( const std::vector<FitCandidate> &candidates );
+  
+  
+  /** Fits the efficiency with each number of terms from minOrder to maxOrder
+      (limited to eight terms, and the number of data points), in parallel.
+   
+      @param previous If it has the same number of terms as a candidate, is
+             used as the starting point for that candidate (see
+             #performEfficiencyFit).
+      @returns The index of the best candidate by BIC.
+   
+      Throws exception if none of the fits were successful.
+   */
+  size_t performEfficiencyFitScan( const std::vector<DetEffDataPoint> &data,
+                                   int minOrder, int maxOrder,
+                                   const std::vector<float> &previous,
+                                   std::vector<FitCandidate> &candidates );
+  
+  /** Fits the FWHM to kGadrasResolutionFcn, and kSqrtPolynomial with from
+      one to maxSqrtEqnOrder terms (limited to the number of peaks), in
+      parallel.
+   
+      @param previousGadras If it has three coefficients, is used as the
+             starting point for the kGadrasResolutionFcn fit.
+      @returns The index of the best candidate by BIC.
+   
+      Throws exception if none of the fits were successful.
+   */
+  size_t performResolutionFitScan( std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > peaks,
+                                   const size_t num_gamma_channels,
+                                   const int maxSqrtEqnOrder,
+                                   const std::vector<float> &previousGadras,
+                                   std::vector<FitCandidate> &candidates );
+  
 }//namespace MakeDrfFit
 
 #endif  //MakeDrfFit_h
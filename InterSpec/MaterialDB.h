@@ -28,7 +28,9 @@
 #include <mutex>
 #include <string>
 #include <vector>
+#include <memory>
 #include <utility>
+#include <unordered_set>
 #include <istream>
 #include <condition_variable>
 
@@ -79,6 +81,15 @@ struct Material
                              const SandiaDecay::SandiaDecayDataBase *db );
 
 
+  //addSharedMaterials(...): adds all the materials of 'shared' to this
+  //  database, without copying them; 'shared' is kept alive as long as this
+  //  database is.  This lets each session have its own database (so it can add
+  //  materials through parseChemicalFormula(...)), while all sessions share the
+  //  same parsed materials (see ResourceRegistry::materialDB()).
+  //  Will throw exception if 'shared' is null or not initialized.
+  void addSharedMaterials( std::shared_ptr<const MaterialDB> shared );
+
+
   //writeGadrasStyleMaterialFile(...):
   //  Writes the materials back out to a GADRAS compatible format, using Windows
   //  line endings.
@@ -210,6 +221,15 @@ protected:
   std::vector<const Material *> m_materials;
   std::vector<std::string> m_materialNames;  //one-to-one correspondance to m_materials
   
+  //m_sharedDatabases: databases whose materials were added using
+  //  addSharedMaterials(); these materials are owned by those databases, and
+  //  not deleted by this one.
+  std::vector<std::shared_ptr<const MaterialDB> > m_sharedDatabases;
+  
+  //m_sharedMaterials: the materials of m_sharedDatabases, so the destructor
+  //  can tell which materials this database owns.
+  std::unordered_set<const Material *> m_sharedMaterials;
+  
   //m_initFailure: if a timeout while waiting for the database to be initialized
   //  has occured, then skip the waiting for subsequent calls.
   mutable bool m_initFailure;
@@ -0,0 +1,186 @@
+#ifndef MemoryAccountant_h
+#define MemoryAccountant_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+
+//MemoryAccountant: process-wide accounting of the memory used by each
+//  session, broken down by the kind of data (spectra, peaks, caches, etc.),
+//  and enforcement of a global memory budget across all sessions.
+//
+//  Objects that hold a significant amount of memory report their current size
+//  using setUsage(...), keyed by their own address.  Entries whose memory can
+//  be released without losing anything (caches that can be recomputed, or
+//  spectra that can be written to disk and read back when needed) also pass
+//  an evict function.  Whenever the total exceeds budget(), evict functions
+//  are called for the least recently used entries (across all sessions) until
+//  enough memory will be freed; it is the evict functions responsibility to
+//  run in the correct session (e.g., using WServer::post(...)), free the
+//  memory, and then report the new size.
+//
+//  When eviction happens (at most once a minute), or a session ends, a
+//  summary of the footprint of each session is written to stderr, so server
+//  operators can see what is using memory; summary() can also be called at
+//  any time.
+//
+//  Owners should report their size when it changes (e.g., when a file is
+//  loaded, or a cache entry inserted), rather than periodically; setUsage(...)
+//  and sessionBytes(...) are O(log n), as a running total is kept for each
+//  session.
+//
+//  Does not depend on Wt, and is thread safe.  Evict functions are never
+//  called while the internal lock is held.
+class MemoryAccountant
+{
+public:
+  enum class Category
+  {
+    //Spectrum files currently displayed (SpecMeas::memmorysize()).
+    Spectra,
+
+    //User and automated-search (hint) peaks.
+    Peaks,
+
+    //Cached sums of sample numbers (SampleSumCache).
+    SampleSums,
+
+    //Spectrum files kept in memory, but not displayed, so they dont have to
+    //  be re-read from disk (SpecMeasManager::m_tempSpectrumInfoCache).
+    InactiveSpectra,
+
+    //Temporary buffers of files being written to the database.
+    DatabaseBlobs,
+
+    NumCategories
+  };//enum class Category
+
+  static const char *toString( const Category category );
+
+  //instance(): the single, process-wide, instance.
+  static MemoryAccountant &instance();
+
+  //setUsage(...): sets the number of bytes 'owner' (typically the address of
+  //  the object holding the memory) is using; replaces any previous value for
+  //  'owner'.  If 'evict' is non-empty, the entry may be evicted when over
+  //  budget.  Marks the entry as most recently used.  The entry being set is
+  //  never evicted by this call, even if it alone is over budget.
+  //  'sessionId' must be passed explicitly (not taken from the current
+  //  thread), as owners may report their size from worker threads; all
+  //  entries of a session are removed by removeSession(...).
+  void setUsage( const std::string &sessionId, const void *owner,
+                 const Category category, const size_t bytes,
+                 std::function<void()> evict = std::function<void()>() );
+
+  //touch(...): marks 'owner' as most recently used (e.g., a cache was
+  //  accessed, but didnt change size).
+  void touch( const void *owner );
+
+  //remove(...): removes 'owner' from accounting; should be called from the
+  //  owners destructor.
+  void remove( const void *owner );
+
+  //removeSession(...): removes all entries of the session, after logging its
+  //  footprint.
+  void removeSession( const std::string &sessionId );
+
+  //totalBytes(): total bytes currently accounted for, all sessions.
+  size_t totalBytes() const;
+
+  //sessionBytes(...): total bytes accounted for by the session.
+  size_t sessionBytes( const std::string &sessionId ) const;
+
+  //budget(): total bytes all sessions may use before evicting; 0 means no
+  //  limit.  Defaults to MAX_TOTAL_SESSION_MEMORY_SIZE_MB, if defined.
+  size_t budget() const;
+  void setBudget( const size_t bytes );
+
+  //summary(): a human readable summary of the memory used by each session,
+  //  broken down by category, as well as the high-water mark of each
+  //  session.  One line per session.
+  std::string summary() const;
+
+protected:
+  MemoryAccountant();
+
+  struct Entry
+  {
+    Entry();
+    
+    std::string sessionId;
+    Category category;
+    size_t bytes;
+    std::uint64_t lastUse;
+    std::function<void()> evict;
+
+    //evictPending: true if evict has been called, but the owner hasnt yet
+    //  reported its new size; these entries are not evicted again, and their
+    //  memory is considered already freed when deciding what to evict.
+    bool evictPending;
+  };//struct Entry
+
+  //enforceBudget(...): called with m_mutex locked; returns the evict
+  //  functions to call (after unlocking) to get back under budget.  The
+  //  entry of 'justSet' (if non-null) is not evicted.
+  std::vector<std::function<void()>> enforceBudget( const void *justSet );
+
+  //addToSession(...): adds 'bytes' to the running total of the session, and
+  //  updates its high-water mark; called with m_mutex locked.
+  void addToSession( const std::string &sessionId, const size_t bytes );
+
+  //subtractFromSession(...): removes 'bytes' from the running total of the
+  //  session; called with m_mutex locked.
+  void subtractFromSession( const std::string &sessionId, const size_t bytes );
+
+  std::string summaryInternal() const;
+
+  mutable std::mutex m_mutex;
+  std::map<const void *,Entry> m_entries;
+
+  //m_sessionBytes: the current total of each sessions entries.
+  std::map<std::string,size_t> m_sessionBytes;
+
+  //m_sessionPeakBytes: the high-water mark of each sessions usage.
+  std::map<std::string,size_t> m_sessionPeakBytes;
+
+  size_t m_totalBytes;
+  size_t m_budget;
+  std::uint64_t m_useCounter;
+  
+  //m_lastOverBudgetLog: when we last logged being over budget, so we dont
+  //  log on every update; m_numEvictsSinceLog is the number of entries
+  //  evicted since then, that werent logged.
+  std::chrono::steady_clock::time_point m_lastOverBudgetLog;
+  size_t m_numEvictsSinceLog;
+};//class MemoryAccountant
+
+#endif //MemoryAccountant_h
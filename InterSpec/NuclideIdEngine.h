@@ -0,0 +1,200 @@
+#ifndef NuclideIdEngine_h
+#define NuclideIdEngine_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Forward Declarations
+struct Material;
+class PeakDef;
+class Measurement;
+class DetectorPeakResponse;
+namespace SandiaDecay{ struct Nuclide; }
+
+
+/** Whole-spectrum nuclide identification, based on how well a non-negative
+ mixture of candidate nuclides explains the observed data.
+
+ For each candidate nuclide (nuclides with a gamma line near one of the fitted
+ peaks), at a few ages and shielding configurations, the expected counts per
+ becquerel are predicted for each fitted peak (or each spectrum channel, if
+ fitting the full spectrum), taking into account the detector efficiency and
+ shielding attenuation.  Strong lines of a candidate that dont have a peak
+ are included as observations of zero counts, so nuclides are penalized for
+ predicting peaks that arent there.  Mixtures of candidates are then fit to
+ the observations using non-negative least squares (NNLS), by forward
+ selection, and hypotheses are ranked by their likelihood ratio relative to
+ there being no source present (penalized for the number of nuclides).
+
+ Does not depend on Wt, so can be used headless (e.g., from the command line
+ against the files in example_spectra).  Candidates are evaluated in
+ parallel using ComputeScheduler::TaskGroup.
+ */
+namespace NuclideIdEngine
+{
+  /** Shielding between source and detector; either generic (atomic number and
+   areal density), or a material with a thickness.  Defaults to no shielding.
+   */
+  struct Shielding
+  {
+    Shielding();
+    Shielding( const double atomic_number, const double areal_density );
+    Shielding( const Material *material, const double thickness );
+
+    //transmission(...): fraction of gammas at 'energy' that make it through.
+    double transmission( const double energy ) const;
+
+    std::string description() const;
+
+    double atomicNumber;
+    double arealDensity;
+    const Material *material;
+    double thickness;
+  };//struct Shielding
+
+
+  struct Options
+  {
+    Options();
+
+    /** Shielding configurations to evaluate; every nuclide in a mixture has
+     the same shielding.  Defaults to none, 10 g/cm2 of iron, and 25 g/cm2 of
+     tungsten (same as IsotopeId::suggestNuclides(...)).
+     */
+    std::vector<Shielding> shieldings;
+
+    /** Ages to evaluate, as multiples of PeakDef::defaultDecayTime(...) of
+     each nuclide.  Defaults to {0.1, 1.0, 5.0}.
+     */
+    std::vector<double> ageMultiples;
+
+    /** Maximum number of candidate nuclides to consider; candidates that
+     explain the most peaks are kept.  Defaults to 30.
+     */
+    size_t maxCandidates;
+
+    /** Maximum number of nuclides in a mixture.  Defaults to 4. */
+    size_t maxNuclidesInMixture;
+
+    /** Number of peak sigmas a gamma line can be from a peak to be considered
+     a candidate for it, or contribute to it.  Defaults to 1.5.
+     */
+    double numSigmaWindow;
+
+    /** Lines expected to contribute less than this fraction of the counts of
+     a candidates strongest line are not added as "missing peak"
+     observations.  Defaults to 0.05.
+     */
+    double minRelativeLineIntensity;
+
+    /** If true, the continuum subtracted spectrum, in the regions around the
+     candidates gamma lines, is fit, instead of the fitted peak areas.
+     Requires the spectrum.  Defaults to false.
+     */
+    bool fitFullSpectrum;
+
+    /** Source to detector distance used with the detector efficiency;
+     defaults to 1 m.
+     */
+    double distance;
+  };//struct Options
+
+
+  struct NuclideContribution
+  {
+    const SandiaDecay::Nuclide *nuclide;
+    double age;
+
+    /** Fit activity, in SandiaDecay units (i.e., becquerel=1.0), at
+     Options::distance; if no detector response is given, this is only a
+     relative quantity.
+     */
+    double activity;
+    double activityUncertainty;
+  };//struct NuclideContribution
+
+
+  struct Hypothesis
+  {
+    Hypothesis();
+
+    std::vector<NuclideContribution> nuclides;
+
+    /** Index into Options::shieldings. */
+    size_t shieldingIndex;
+    std::string shieldingDescription;
+
+    double chi2;
+    size_t numObservations;
+
+    /** ln( L(hypothesis) / L(no source) ), with Gaussian likelihoods. */
+    double logLikelihoodRatio;
+
+    /** Score hypotheses are ranked by; logLikelihoodRatio penalized by
+     0.5*ln(numObservations) per nuclide (i.e., the BIC).
+     */
+    double score;
+
+    /** ln( L(hypothesis) / L(top ranked hypothesis) ), i.e., this
+     hypothesis' logLikelihoodRatio minus that of the top ranked hypothesis.
+     Zero for the top ranked hypothesis, and negative for hypotheses that fit
+     the data worse than it.  Since hypotheses are ranked by #score, which
+     penalizes each nuclide, a lower ranked hypothesis with more nuclides than
+     the top ranked one may fit the data better, and so have a positive value.
+     */
+    double logLikelihoodRatioToBest;
+
+    /** e.g., "Ba133 (age 2.1 y, 1.2 uCi) + Cs137 (...); shielding: none" */
+    std::string description() const;
+  };//struct Hypothesis
+
+
+  /** Identifies the nuclides that best explain 'peaks' (and/or 'data', if
+   Options::fitFullSpectrum).
+
+   \param peaks The fitted peaks of the spectrum; must not be empty.
+   \param data The spectrum the peaks were fit from; used for the live time,
+          for the expected counts where there are no peaks, and when fitting
+          the full spectrum.  May be null if not fitting the full spectrum.
+   \param response Detector response; if null or invalid, an efficiency of 1
+          is used, and (if not fitting the full spectrum) resolution is
+          estimated from the peaks.
+   \param options Options for the identification.
+   \returns Hypotheses, sorted best first.
+
+   Throws std::exception on invalid input.
+   */
+  std::vector<Hypothesis> identify(
+                  const std::deque< std::shared_ptr<const PeakDef> > &peaks,
+                  std::shared_ptr<const Measurement> data,
+                  std::shared_ptr<const DetectorPeakResponse> response,
+                  const Options &options = Options() );
+}//namespace NuclideIdEngine
+
+#endif //NuclideIdEngine_h
@@ -598,6 +598,12 @@ public:
   
   bool operator==( const PeakDef &rhs ) const;
 
+  //identicalTo(...): like operator==, but also compares the user label,
+  //  uncertainties, fit-for flags, skew type, x-ray and reaction sources,
+  //  candidate nuclides, and the continuum; i.e., returns true only if there
+  //  is no observable difference between the two peaks.
+  bool identicalTo( const PeakDef &rhs ) const;
+
 
   //gaus_integral(): Calculates the area of a Gaussian with specified mean,
   //  sigma, and amplitude, between x0 and x1.
@@ -136,7 +136,12 @@ public:
   //  Does not assign currently showing reference gamma lines to peaks
   void addPeaks( const std::vector<PeakDef> &peaks );
   
-  //setPeaks(...): removes all old peaks and adds peaks passed in
+  //setPeaks(...): removes all old peaks and adds peaks passed in.
+  //  Old and new peaks are matched up by ROI, so ROIs that are unchanged keep
+  //  their existing PeakDef objects (and no signals are emitted for them),
+  //  refit ROIs are updated in place (dataChanged()) where possible, and only
+  //  the remaining peaks are individually removed/inserted.  If most of the
+  //  peaks changed, the model is reset as a whole instead.
   void setPeaks( std::vector<PeakDef> peaks );
 
   //setPeaks(...): a convience function that calls the setPeaks(vector<PeakDef>)
@@ -27,6 +27,7 @@
 
 #include <mutex>
 #include <string>
+#include <stdint.h>
 #include <vector>
 #include <memory>
 
@@ -72,10 +73,22 @@ public:
    */
   static void set_xml_file_location( const std::string &filename );
   
+  /** Sets the location of the binary image of the parsed reaction data; the
+      image should be in a per-user directory (InterSpec sets this to
+      "InterSpec_reactiongamma.bin" in the writable user data directory, for
+      builds that have one).  If not called, no binary image is used.
+      Passing an empty string disables the binary image.  Must be called before
+      ReactionGammaServer::database() is ever called, or else an exception
+      will be thrown.
+   */
+  static void set_binary_cache_location( const std::string &filename );
+  
 private:
   ReactionGammaServer();
 
   static std::string sm_xmlFileLocation; //defaults to data/sandia.reactiongamma.xml
+  static std::string sm_binaryCacheLocation;
+  static bool sm_binaryCacheLocationSet;
   static std::mutex sm_dataBaseMutex;
   static std::unique_ptr<ReactionGamma> sm_dataBase;
 };
@@ -140,9 +153,14 @@ public:
   };//struct ReactionPhotopeak
 
   //ReactionGamma(...): will throw exception on mis-formed XML or invalid
-  //  xml file name or database pointer
+  //  xml file name or database pointer.
+  //  If 'binary_cache' is non-empty, and that file is a binary image made from
+  //  the same XML contents (checked using a hash of the XML), the reactions
+  //  will be read from it instead of parsing the XML; otherwise the XML is
+  //  parsed and the binary image (re-)written, if possible.
   ReactionGamma( const std::string &sandia_reaction_xml,
-                 const SandiaDecay::SandiaDecayDataBase *database );
+                 const SandiaDecay::SandiaDecayDataBase *database,
+                 const std::string &binary_cache = std::string() );
   ~ReactionGamma();
 
   //gammas(...): fills 'answer' out w/ reactions described by names similar to
@@ -178,6 +196,10 @@ public:
 
   //Access reactions of a given type
   const std::vector<const Reaction *> &reactions( ReactionType type ) const;
+  
+  //loadedFromBinaryCache(): returns true if the reactions were read from the
+  //  binary image, rather than by parsing the XML.
+  bool loadedFromBinaryCache() const;
 
   //reactions(...): looks through all reactions and returns results in 'answer'
   //  for every reaction with a gamma in the energy range specified.
@@ -211,14 +233,31 @@ public:
 
 
 protected:
-  void init( const std::string &sandia_reaction_xml );
+  void init( const std::string &sandia_reaction_xml,
+             const std::string &binary_cache );
   void populate_reaction( const rapidxml::xml_node<char> *node,
                           ReactionType type,
                           std::vector<const Reaction *>  &results );
+  
+  //read_binary_cache(...): fills m_reactions (except for the annihilation
+  //  reaction) from a binary image made from XML data with the given hash.
+  //  Returns false, leaving m_reactions empty, if the file doesnt exist, is
+  //  from a different XML file or format version, or is otherwise invalid.
+  //  On POSIX systems the file must also be owned by the current user, and
+  //  not writable by group or others, since anyone able to write it could
+  //  change the reaction data we display.
+  bool read_binary_cache( const std::string &filename,
+                          const uint64_t xml_hash );
+  
+  //write_binary_cache(...): writes m_reactions to a binary image that
+  //  read_binary_cache(...) can read.  Throws on error.
+  void write_binary_cache( const std::string &filename,
+                           const uint64_t xml_hash ) const;
 
 protected:
   const SandiaDecay::SandiaDecayDataBase *m_decayDatabase;
   std::vector<const Reaction *> m_reactions[NumReactionType];
+  bool m_loadedFromBinaryCache;
 };//class ReactionGamma
 
 #endif   //ReactionGamma
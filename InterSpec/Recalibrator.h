@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <set>
 #include <vector>
 #include <time.h>
 #include <utility>
@@ -347,6 +348,40 @@ protected:
   };//class PolyCalibCoefMinFcn
 
   
+  /** Chi2 function for fitting a single set of calibration coefficients to
+      peaks from a number of files at once.  Each peaks bin number should be
+      found using the calibration of the file it came from.
+      Parameters are {c0, c1, c2, offset_1, ..., offset_{nfile-1}}, where the
+      offsets are additional energy offsets (in keV) applied to the files
+      other than the first; pass fitting offsets as fixed parameters if you
+      dont want per-file offsets.
+   */
+  class MultiFileCalibCoefMinFcn
+      : public ROOT::Minuit2::FCNBase
+  {
+  public:
+    //fileDevpairs: the deviation pairs of each file, indexed the same as the
+    //  values of peakFile; each file keeps its own deviation pairs.
+    MultiFileCalibCoefMinFcn( const std::vector<RecalPeakInfo> &peakInfo,
+                              const std::vector<size_t> &peakFile,
+                              const size_t nfile,
+                              const size_t nbin,
+                              Measurement::EquationType eqnType,
+                              const std::vector< std::vector< std::pair<float,float> > > &fileDevpairs );
+    virtual ~MultiFileCalibCoefMinFcn();
+    virtual double Up() const;
+    virtual double operator()( const std::vector<double> &x ) const;
+    
+  protected:
+    size_t m_nbin;
+    size_t m_nfile;
+    Measurement::EquationType m_eqnType;
+    std::vector<RecalPeakInfo> m_peakInfo;
+    std::vector<size_t> m_peakFile;
+    std::vector< std::vector< std::pair<float,float> > > m_fileDevpairs;
+  };//class MultiFileCalibCoefMinFcn
+
+  
   class GraphicalRecalConfirm : public AuxWindow
   {
   public:
@@ -375,8 +410,11 @@ protected:
   
   //MultiFileCalibFit and MultiFileModel are to allow the user to calibrate
   //  a number of spectrum files simultaneously using peaks from each file.
-  //  As of 20131213 this capability is only roughed in and not tested very well
-  //XXX - applying the calibration parameters does not shift peaks!
+  //  All files with selected peaks, that have the same number of channels as
+  //  the first of them, are fit jointly for a shared set of coefficients, with
+  //  optional per-file energy offsets.  Each file keeps its own deviation
+  //  pairs and calibration type (polynomial or full range fraction); the
+  //  shared coefficients are converted to each files type when applied.
   class MultiFileCalibFit : public AuxWindow
   {
   public:
@@ -391,11 +429,21 @@ protected:
     Recalibrator *m_calibrator;
     MultiFileModel *m_model;
     Wt::WCheckBox *m_fitFor[3];
+    Wt::WCheckBox *m_perFileOffsets;
     Wt::WLineEdit *m_coefvals[3];
     Wt::WPushButton *m_use, *m_cancel, *m_fit;
     Wt::WTextArea *m_fitSumary;
+    //m_eqnType and m_nbin: the calibration type, and number of channels, the
+    //  fit coefficients in m_calVal are for (those of the first file fit).
     Measurement::EquationType m_eqnType;
+    size_t m_nbin;
     double m_calVal[3], m_calUncert[3];
+    
+    /** Energy offset (keV), added to m_calVal[0], for each file that went into
+        the last fit; keyed by row in the SpectraFileModel.  Files fit without
+        per-file offsets will have an entry with an offset of zero.
+     */
+    std::map<int,double> m_fileOffsets;
   };//class MultiFileCalibFit
   
   class MultiFileModel : public  Wt::WAbstractItemModel
@@ -421,7 +469,12 @@ protected:
                                    int role = Wt::DisplayRole) const;
     void refreshData();
   protected:
+    //m_peaks, m_fileIndex, and m_sampleNums are all indexed by the top-level
+    //  row; there is a row for each set of sample numbers, of each file, that
+    //  has peaks.
     std::vector<std::vector< std::pair<bool,std::shared_ptr<const PeakDef> > > > m_peaks;
+    std::vector<int> m_fileIndex;
+    std::vector< std::set<int> > m_sampleNums;
     Recalibrator *m_calibrator;
     SpectraFileModel *m_fileModel;
     
@@ -25,8 +25,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <list>
+#include <memory>
 #include <string>
 #include <vector>
+#include <functional>
 
 #include <Wt/WColor>
 #include <Wt/WContainerWidget>
@@ -258,6 +262,95 @@ protected:
    */
   std::map<std::string,std::vector<Wt::WColor>> currentlyUsedPeakColors();
   
+  /** The decay lines (gammas, xrays, alphas, betas, and positron annihilation)
+   of a nuclide, along with which chain member, transition, and intensity
+   contribute to each line, so the branching ratios at a given age are just a
+   few multiply-adds per line, rather than a walk through the whole decay chain.
+   
+   The lines are built, and their branching ratios evaluated, in exactly the
+   same order as the original loop in #updateDisplayChange, so the results are
+   identical.
+   */
+  struct DecayLineTemplate
+  {
+    struct Term
+    {
+      size_t chainIndex;
+      double intensity;
+      double branchRatio;
+    };//struct Term
+  
+    struct Line
+    {
+      const SandiaDecay::Transition *transition;
+      double energy;
+      SandiaDecay::ProductType type;
+      DecayParticleModel::RowData row;
+      std::vector<Term> terms;
+    };//struct Line
+  
+    const SandiaDecay::Nuclide *nuclide;
+    bool promptOnly;
+    std::vector<SandiaDecay::ProductType> types;
+  
+    SandiaDecay::NuclideMixture mixture;
+  
+    /** The nuclides of the mixture, in the order returned by
+     mixture.activity(age); Term::chainIndex indexes into this.
+     */
+    std::vector<const SandiaDecay::Nuclide *> chain;
+  
+    std::vector<Line> lines;
+  
+    DecayParticleModel::RowData positronRow;
+    std::vector<Term> positronTerms;
+    const SandiaDecay::Transition *positronTransition;
+  
+  
+    DecayLineTemplate( const SandiaDecay::Nuclide *nuc, const bool prompt,
+                       const std::vector<SandiaDecay::ProductType> &ptypes,
+                       const double age );
+  
+    /** Appends the lines, with their branching ratios at 'age', to the passed in
+     vectors.  Returns false, without appending anything, if the nuclides of the
+     mixture at 'age' dont match #chain.
+     */
+    bool evaluate( const double age,
+                   std::vector<const SandiaDecay::Transition *> &transistions,
+                   std::vector<double> &energies, std::vector<double> &branchratios,
+                   std::vector<SandiaDecay::ProductType> &particle_type,
+                   std::vector<DecayParticleModel::RowData> &inforows ) const;
+  };//struct DecayLineTemplate
+  
+  /** Returns the line template for the nuclide, particle types, and
+   prompt-only option, building it (with the decay chain present at 'age') if
+   it isnt in #m_decayLineTemplates.
+   */
+  std::shared_ptr<const DecayLineTemplate> decayLineTemplate(
+                               const SandiaDecay::Nuclide *nuc,
+                               const bool promptOnly,
+                               const std::vector<SandiaDecay::ProductType> &types,
+                               const double age );
+  
+  /** Per-energy multiplicative factors (detector efficiency, shielding
+   transmission, or resolution width), valid for the DRF or shielding
+   described by #key.
+   */
+  struct LineFactorCache
+  {
+    std::string key;
+    std::map<double,double> values;
+  };//struct LineFactorCache
+  
+  /** Returns the factor for 'energy' from 'cache', calling 'fcn' and storing
+   its result if it hasnt been computed for 'key' yet.  The cache is cleared
+   whenever 'key' is different from the last call.
+   */
+  static double cachedLineFactor( LineFactorCache &cache,
+                                  const std::string &key,
+                                  const double energy,
+                                  const std::function<double(double)> &fcn );
+  
 #if ( USE_SPECTRUM_CHART_D3 )
   D3SpectrumDisplayDiv *m_chart;
 #else
@@ -298,6 +391,20 @@ protected:
   std::vector<ReferenceLineInfo> m_persisted;
   ReferenceLineInfo m_currentlyShowingNuclide;
   
+  /** Most recently used decay line templates, with the most recent first, so
+   changing the age of a nuclide, or going back to a previous nuclide, only
+   has to re-evaluate the chain activities.
+   */
+  std::list<std::shared_ptr<const DecayLineTemplate>> m_decayLineTemplates;
+  
+  /** Detector efficiency, shielding transmission, and detector resolution
+   factors by energy; these are shared by all nuclides, so changing the
+   shielding or detector only recomputes the one set of factors.
+   */
+  LineFactorCache m_efficiencyCache;
+  LineFactorCache m_attenuationCache;
+  LineFactorCache m_resolutionCache;
+  
   ColorSelect *m_colorSelect;
   void userColorSelectCallback( const Wt::WColor &color );
   
@@ -0,0 +1,84 @@
+#ifndef ResourceRegistry_h
+#define ResourceRegistry_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <string>
+
+class MaterialDB;
+class GadrasScatterTable;
+namespace Wt
+{
+  namespace Json
+  {
+    class Value;
+  }
+}//namespace Wt
+
+
+//Large read-only data files (the material database, GADRAS scatter table,
+//  help index, etc) are the same for every session, so instead of each session
+//  parsing its own copy, they are loaded once (lazily, on first request) and
+//  shared between all sessions/threads through this class.
+//  All functions are thread safe; if multiple threads request a resource that
+//  isnt loaded yet, one will parse it while the others wait.  If loading
+//  fails, the exception is propagated to the callers, and loading will be
+//  attempted again on the next request.
+class ResourceRegistry
+{
+public:
+  enum Resource
+  {
+    MaterialDataBase,
+    GadrasScatter,
+    HelpJson,
+    NumResources
+  };//enum Resource
+  
+  //materialDB(): the materials from MaterialDataBase.txt, in
+  //  InterSpec::staticDataDirectory().  Sessions that need to add materials
+  //  (e.g., user entered chemical formulas) should create their own
+  //  MaterialDB, and call MaterialDB::addSharedMaterials().
+  static std::shared_ptr<const MaterialDB> materialDB();
+  
+  //gadrasScatterTable(): the scatter table from GadrasContinuum.lib, in
+  //  InterSpec::staticDataDirectory().
+  static std::shared_ptr<const GadrasScatterTable> gadrasScatterTable();
+  
+  //helpJson(): the parsed InterSpec_resources/static_text/help.json.
+  static std::shared_ptr<const Wt::Json::Value> helpJson();
+  
+  //numTimesLoaded(): number of times a resource has been successfully loaded;
+  //  will be zero or one, unless release() has been called.
+  static size_t numTimesLoaded( const Resource resource );
+  
+  //release(): drops the registries reference to a resource, so it will be
+  //  re-loaded on next request (e.g., if the file on disk has been updated).
+  //  Sessions that already have the resource keep their copy.
+  static void release( const Resource resource );
+};//class ResourceRegistry
+
+#endif //ResourceRegistry_h
@@ -0,0 +1,164 @@
+#ifndef SampleSumCache_h
+#define SampleSumCache_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <memory>
+#include <vector>
+
+class SpecMeas;
+class Measurement;
+
+
+//SampleSumCache: speeds up summing the displayed sample numbers of a file with
+//  many samples (e.g., portal or search-mode data), where the user steps
+//  through the samples, or changes the range of samples, one click at a time.
+//
+//  sum(...) gives the same result as SpecMeas::sum_measurements(...), but:
+//    - if the requested samples are close to the previously requested samples
+//      (e.g., sliding a window by one sample), the previous sum is updated by
+//      adding the new samples and subtracting the removed ones, and
+//    - otherwise, the samples are summed using cached sums of fixed-size
+//      blocks of consecutive samples, so arbitrary ranges cost roughly
+//      (number of blocks + samples at the range edges), instead of the number
+//      of samples.
+//  Sums are accumulated in double precision with Neumaier (compensated)
+//  summation, so results agree with sum_measurements(...) to float
+//  precision, and repeated add/subtracts dont accumulate round-off error;
+//  the running sum is still periodically recomputed from the blocks.
+//
+//  The cache is only used when the file has a reasonable number of samples,
+//  all the summed measurements share the same energy binning (so
+//  sum_measurements(...) wouldnt need to rebin anything), and every requested
+//  sample is in the file; otherwise sum_measurements(...) is called directly.
+//  The cache checks the file for changes (new/removed measurements, changed
+//  counts, or changed energy calibration) on each call, so it never needs to
+//  be explicitly invalidated.
+//
+//  Not thread safe; each displayed spectrum type of InterSpec has its own.
+class SampleSumCache
+{
+public:
+  SampleSumCache();
+  ~SampleSumCache();
+
+  //sum(...): returns the same as meas->sum_measurements(samples,detectors).
+  std::shared_ptr<Measurement> sum( const std::shared_ptr<SpecMeas> &meas,
+                                    const std::set<int> &samples,
+                                    const std::vector<bool> &detectors );
+
+  //clear(): releases all cached sums and references to the file.
+  void clear();
+  
+  //memorySize(): approximate number of bytes used by the cached sums and
+  //  index; does not include the file itself.
+  size_t memorySize() const;
+
+  //sm_minNumSamples: files with fewer sample numbers than this are always
+  //  summed directly.
+  static const size_t sm_minNumSamples;
+
+  //sm_maxBlockMemory: the (approximate) maximum memory, in bytes, used to
+  //  store the block sums; the block size is increased for large files to
+  //  stay under this.
+  static const size_t sm_maxBlockMemory;
+
+protected:
+  //CompensatedSum: per-channel Neumaier summation.  The last three entries,
+  //  after the gamma channels, hold the live time, real time, and neutron
+  //  counts.
+  struct CompensatedSum
+  {
+    std::vector<double> sum;
+    std::vector<double> compensation;
+
+    void reset( const size_t nentries );
+    void add( const size_t index, const double value );
+    double value( const size_t index ) const;
+  };//struct CompensatedSum
+
+  //isIndexValid(...): checks that the file, detectors, measurements, counts,
+  //  and binnings are the same as when the index was built.
+  bool isIndexValid( const std::shared_ptr<SpecMeas> &meas,
+                     const std::vector<bool> &detectors ) const;
+
+  //buildIndex(...): indexes the measurements of the file by sample, and
+  //  determines if the cache can be used for it; clears all cached sums.
+  void buildIndex( const std::shared_ptr<SpecMeas> &meas,
+                   const std::vector<bool> &detectors );
+
+  //addSample(...): adds (sign=1) or subtracts (sign=-1) the sample at
+  //  'sampleIndex' (index into m_sampleNumbers) to 'sum'.
+  void addSample( CompensatedSum &sum, const size_t sampleIndex,
+                  const double sign ) const;
+
+  //block(...): returns the sum of block 'blockIndex', computing it if needed.
+  const std::vector<double> &block( const size_t blockIndex );
+
+  //sumFromBlocks(...): sets m_current to the sum of the samples with the
+  //  passed in indexes (sorted, unique) using the block sums.
+  void sumFromBlocks( const std::vector<size_t> &indexes );
+
+  //setSumMetadata(...): sets the start time, title, and GPS position of
+  //  'answer' from all the measurements of the samples with the passed in
+  //  indexes, the same way sum_measurements(...) does.  Read from the
+  //  measurements on each call, since editing these values doesnt change the
+  //  measurements counts or binning, which is what the index checks.
+  void setSumMetadata( Measurement &answer, const std::vector<size_t> &indexes ) const;
+
+  //costFromBlocks(...): approximate number of spectra that would need to be
+  //  added to sum 'indexes' using sumFromBlocks(...).
+  size_t costFromBlocks( const std::vector<size_t> &indexes ) const;
+
+  std::weak_ptr<SpecMeas> m_meas;
+  std::vector<bool> m_detectors;
+
+  //m_usable: false if the binning isnt consistent, or too few samples; in
+  //  which case sum_measurements(...) is always used.
+  bool m_usable;
+  size_t m_nchannel;
+
+  //Snapshot of the files measurements, used to detect changes.
+  std::vector<std::shared_ptr<const Measurement>> m_measurements;
+  std::vector<std::shared_ptr<const std::vector<float>>> m_counts;
+  std::vector<std::shared_ptr<const std::vector<float>>> m_binnings;
+
+  //m_sampleNumbers: sorted sample numbers of the file, and for each of them,
+  //  the indexes into m_measurements of the measurements to sum.
+  std::vector<int> m_sampleNumbers;
+  std::vector<std::vector<size_t>> m_sampleMeasurements;
+
+  size_t m_blockSize;
+  std::vector<std::vector<double>> m_blocks;
+
+  //The most recently returned sum, and what it was of.
+  bool m_currentValid;
+  std::vector<size_t> m_currentIndexes;
+  CompensatedSum m_current;
+  size_t m_numUpdatesSinceSum;
+};//class SampleSumCache
+
+#endif //SampleSumCache_h
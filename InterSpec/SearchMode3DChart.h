@@ -102,6 +102,11 @@ protected:
   /** Function that gets called when the user loads a new spectrum. */
   void newSpectralDataSet();
   
+  /** Function that gets called when the model finishes computing data in the
+      background (e.g., for large files); updates the color map and ranges.
+   */
+  void modelDataUpdated();
+  
   
 protected:
   InterSpec *m_viewer;
@@ -26,14 +26,18 @@
 #include "InterSpec_config.h"
 
 #include <vector>
+#include <memory>
 
 #include <boost/multi_array.hpp>
 
+#include <Wt/WSignal>
 #include <Wt/WModelIndex>
 #include <Wt/WAbstractTableModel>
 
-//a forward declaration
+//Some forward declarations
 class InterSpec;
+class CountsRangeTable;
+struct TimeEnergyPyramid;
 
 class SearchMode3DDataModel : public Wt::WAbstractTableModel
 {
@@ -115,7 +119,8 @@ public:
                                  Wt::Orientation orientation = Wt::Horizontal,
                                  int role = Wt::DisplayRole) const;
   
-  //minTime()/maxTime() return the min/max x-axis values of current data
+  //minTime()/maxTime() return the min/max x-axis values of the whole file;
+  //  the current data may only cover part of this (see setTimeWindow(...)).
   float minTime() const;
   float maxTime() const;
 
@@ -129,6 +134,8 @@ public:
   
   
   //Returns the min and max counts within a given time and energy range.
+  //  Uses a precomputed range table, so is constant time for the default
+  //  number of samples and channels.
   //  20180131 - NOT TESTED WELL, and there apears to be a Wt bug for toggling between log and linear views
   std::pair<float,float> minMaxCounts( const float time_min, const float time_max,
                                        const float e_min, const float e_max ) const;
@@ -136,9 +143,9 @@ public:
   
   
   //maxNumTimeSamples(): returns the maximum number of time samples the model
-  //  is currently configured to allow.  If there are more time samples than
-  //  this for the current data, then they are combined according to the
-  //  comments for m_maxNumSamples.
+  //  is currently configured to allow within the displayed time window.  If
+  //  there are more time samples than this in the window, then they are
+  //  combined according to the comments for m_maxNumSamples.
   int maxNumTimeSamples() const;
   
   //setMaxNumTimeSamples(): sets the maximum number of time samples this model
@@ -146,9 +153,18 @@ public:
   //  'num' must be 1 or greater, or an exception will be thrown.
   //SearchMode3DDataModel::update(InterSpec*) must be called before changes
   //  will take effect.
-  //Default value is 60.
+  //Default value is 256.
   void setMaxNumTimeSamples( const int num );
   
+  //setTimeWindow(): sets the range of time (in seconds since the start of the
+  //  first sample) to display; only the samples overlapping this range are
+  //  put in the model, combined so there are at most m_maxNumSamples of them,
+  //  so zooming in on part of a long file shows its individual samples.  If
+  //  'maxTime' is not greater than 'minTime', the whole file is displayed.
+  //  Re-fills the model (which is cheap, since the summed counts are cached)
+  //  and returns true if the window changed and there is data to display.
+  bool setTimeWindow( const float minTime, const float maxTime );
+  
   //maxNumEnergyChannels(): returns the maximum number of energy channels the
   //  model is currently configured to allow.  If the data contains more energy
   //  channels than this number, they are combined as explained in the comments
@@ -167,8 +183,32 @@ public:
   //  of the passed in InterSpec by first removing all the data (and
   //  emmitting appropriate signals to this effect) and then adding all the new
   //  data (again with appropriate signals being emmitted).
+  //  The summed counts of the file are cached (see m_pyramid), so calling this
+  //  function again for the same data, after changing the number of samples or
+  //  channels, is cheap.  For large files the summing is done in the
+  //  background, in which case the model will be empty when this function
+  //  returns, and dataUpdated() will be emitted once the data is available.
   void update( InterSpec *viewer );
   
+  //dataUpdated(): signal emitted when data that was computed in the background
+  //  has been filled into the model.
+  Wt::Signal<> &dataUpdated();
+  
+protected:
+  //clearData(): removes all the data from the model, emitting the appropriate
+  //  signals.
+  void clearData();
+  
+  //fillFromPyramid(): fills m_times, m_energies, and m_counts from m_pyramid,
+  //  for the samples within the current time window, according to
+  //  m_maxNumSamples and m_maxNumChannels, and emits the appropriate signals.
+  //  Model must be empty when called.
+  void fillFromPyramid();
+  
+  //pyramidBuilt(): called, within the applications event loop, when a
+  //  background computation of the summed counts finishes.
+  void pyramidBuilt( std::shared_ptr<TimeEnergyPyramid> pyramid,
+                     const int buildNumber );
   
 protected:
   //m_minCounts: holds the current minimum number of counts of any data bin
@@ -185,13 +225,22 @@ protected:
   int m_maxNumChannels;
   
   //m_maxNumSamples: the maximum number of time samples that the chart should
-  //  display.  If the data has more data samples that this, then the channels
-  //  will be combined to have as close to this number as possible; this may
-  //  mean the last time row will have a differnt number of actual time samples
-  //  than the rest.
-  //Defaults to 60 samples.
+  //  display within the current time window.  If the window has more data
+  //  samples that this, then the samples will be combined to have as close to
+  //  this number as possible; this may mean the last time row will have a
+  //  differnt number of actual time samples than the rest.
+  //Defaults to 256 samples.
   int m_maxNumSamples;
   
+  //m_windowStart, m_windowEnd: the range of time, in seconds since the start
+  //  of the first sample, to display.  If m_windowEnd isnt greater than
+  //  m_windowStart, the whole file is displayed.
+  float m_windowStart;
+  float m_windowEnd;
+  
+  //m_totalTime: the summed real time of all the samples of the file.
+  float m_totalTime;
+  
   //m_times: holds the time in seconds (starting from when first sample was
   //  started), of each sample start time.  Indexed as m_times[row/2].  Note
   //  that this vector will have one more element than the number of samples
@@ -209,6 +258,26 @@ protected:
   //  and energy channel.  Indexed as m_counts[row/2][column/2],
   //  or equivalently m_counts[sample_number][energy_channel]
   boost::multi_array<float, 2> m_counts;
+  
+  //m_countsRange: table to lookup min/max of m_counts over rectangular ranges
+  //  in constant time.  May be null if m_counts is empty, or too large to
+  //  make the table for.
+  std::shared_ptr<const CountsRangeTable> m_countsRange;
+  
+  //m_pyramid: summed counts, for every sample and (possibly combined) channel,
+  //  of the currently displayed file, as a summed area table so counts for any
+  //  range of samples and channels can be looked up in constant time.
+  std::shared_ptr<const TimeEnergyPyramid> m_pyramid;
+  
+  //m_pendingPyramid: the pyramid currently being computed in the background,
+  //  if any; used to avoid starting the same computation multiple times.
+  std::shared_ptr<const TimeEnergyPyramid> m_pendingPyramid;
+  
+  //m_pyramidBuildNumber: incremented each time a background computation is
+  //  started, so results from out of date computations can be ignored.
+  int m_pyramidBuildNumber;
+  
+  Wt::Signal<> m_dataUpdated;
 };//class SearchMode3DDataModel
 
 
@@ -128,6 +128,26 @@ public:
   
   virtual std::shared_ptr< ::rapidxml::xml_document<char> > create_2012_N42_xml() const;
   
+  //write_2012_N42_streaming(...): writes the same N42 2012 file as
+  //  write_2012_N42(...), but directly to 'ostr', one <RadMeasurement> at a
+  //  time, instead of first building the whole XML document (with a string for
+  //  every channel count) in memory; for files with many thousands of samples
+  //  this greatly reduces peak memory, and the first bytes are written
+  //  immediately.  Peaks, detector response, and the shielding/source model
+  //  are written identically to write_2012_N42(...).
+  //  Falls back to write_2012_N42(...) when canWrite2012N42Streaming()
+  //  returns false.
+  //  Used by save2012N42File(...).
+  virtual bool write_2012_N42_streaming( std::ostream &ostr ) const;
+  
+  //canWrite2012N42Streaming(): returns true if write_2012_N42_streaming(...)
+  //  will write the file itself.  Returns false for information it does not
+  //  handle: full range fraction calibration, RIID analysis results, detectors
+  //  without a valid XML ID as a name, a detector whose description differs
+  //  between samples, or multiple detectors of a sample with differing start
+  //  times, real times, source types, occupancy, speeds, or GPS positions.
+  bool canWrite2012N42Streaming() const;
+  
   
   //guessDetectorTypeFromFileName(...): not called by default
   static DetectorType guessDetectorTypeFromFileName( std::string name );
@@ -181,6 +201,10 @@ public:
   
   std::set<std::set<int> > sampleNumsWithPeaks() const;
   
+  //peaksMemorySize(): approximate number of bytes used by the user and
+  //  automated search peaks, for all sample numbers.
+  size_t peaksMemorySize() const;
+  
   //removeAllPeaks(): removes all peaks for all samplenumbers.
   //  Note: does not notify PeakModel, or anywhere else.
   void removeAllPeaks();
@@ -205,6 +229,18 @@ public:
   //peaksHaveBeenAdded(): marks this MeasurementInfo object as
   void setModified();
 
+  //rebinByEqn(...): gives the same result as MeasurementInfo::rebin_by_eqn(...)
+  //  (the channel counts are moved to the energy binning given by the
+  //  equation, assuming counts are uniform across each original channel), but
+  //  the fraction of each original channel falling in each new channel is
+  //  computed once for each distinct original binning, and then applied to
+  //  every Measurement with that binning as a sparse matrix.  Measurements
+  //  that had the same binning also share the new binning.
+  //  Peaks are not shifted.
+  void rebinByEqn( const std::vector<float> &eqn,
+                   const std::vector< std::pair<float,float> > &devpairs,
+                   const Measurement::EquationType type );
+  
   //shiftPeaksForRecalibration: shift the peaks for when you apply a
   //  recalibration to the spectrum, for instance after calling
   //  MeasurementInfo::recalibrate_by_eqn(...).  Note that the PeakModel is not
@@ -255,6 +255,12 @@ public:
   //  later access (to avoid doing this from within the SpecMeas destructor).
   void removeFromSpectrumInfoCache( std::shared_ptr<const SpecMeas> meas,
                                     bool saveToDisk ) const;
+  
+  //updateMemoryAccounting(): reports the memory used by the spectra in
+  //  m_tempSpectrumInfoCache that arent currently displayed to
+  //  MemoryAccountant; if over the global budget, the cache may be cleared
+  //  (see clearTempSpectrumInfoCache()).
+  void updateMemoryAccounting() const;
 
   //serializeToTempFile(...): intended to be called right before a
   //  SpecMeas object is expected to be destructed in order to save it to a
@@ -349,6 +355,13 @@ public:
                               AuxWindow *window,
                               Wt::WModelIndex index );
   
+  //openAllFromZip: extracts and parses all the files in the zip (in parallel),
+  //  adding each spectrum file to the file manager, and displaying the first
+  //  one as the type checked in 'group'.  Deletes 'window' when done.
+  void openAllFromZip( const std::string &spoolName,
+                       Wt::WButtonGroup *group,
+                       AuxWindow *window );
+  
 #endif
   
   //Handles a file dropped onto the application, or finishes opening files from
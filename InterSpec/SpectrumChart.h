@@ -566,6 +566,32 @@ protected:
   virtual void iterateSpectrum( SpectrumRenderIterator *iterator,
                                 Wt::WPainter &painter ) const;
   
+  //DecimatedSeries: a series reduced to at most four points (first, min, max,
+  //  last) per pixel column, so that spectra with many more channels than
+  //  pixels are drawn in time proportional to the chart width.  Drawing the
+  //  decimated points gives the same picture as drawing every channel.
+  struct DecimatedSeries
+  {
+    size_t modelRevision;
+    int xColumn, yColumn;
+    int minRow, maxRow, numPixels;
+    double minX, maxX;
+    std::vector< std::pair<double,double> > points;
+  };//struct DecimatedSeries
+  
+  //decimatedSeries(...): returns the cached decimation of the series in
+  //  'yColumn' if the model data and displayed range havent changed since it
+  //  was computed, otherwise computes (and caches) it.
+  const DecimatedSeries &decimatedSeries( const SpectrumDataModel *model,
+                                          const int xColumn, const int yColumn,
+                                          const int minRow, const int maxRow,
+                                          const double minX, const double maxX,
+                                          const int numPixels ) const;
+  
+  //m_decimatedSeries: one entry per model column that has been drawn
+  //  decimated.
+  mutable std::vector<DecimatedSeries> m_decimatedSeries;
+  
   //since we cant access WCartesianChar::chartArea_ ... (stupid Wt not allowing access)
   //  Note that providing a default WRectF() is a hack and will lead to
   //  rendering
@@ -186,6 +186,17 @@ public:
   //Simplified convenience functions to grab data without futzing around with
   // either WModelIndex or boost::any
   virtual double data( int row, int column ) const;
+  
+  //columnValues(...), rowLowEdges(), rowWidths(): typed access to the same
+  //  values data(...), rowLowEdge(...), and rowWidth(...) give, for all rows at
+  //  once, with rebinning, scale factors, and background subtraction already
+  //  applied.  The arrays are computed the first time they are requested after
+  //  the underlying spectra (or how they are displayed) change, and are cached
+  //  until then; data(...), rowLowEdge(...) and rowWidth(...) are served from
+  //  them as well.  A column without data gives an empty array.
+  const std::vector<double> &columnValues( const ColumnType column ) const;
+  const std::vector<double> &rowLowEdges() const;
+  const std::vector<double> &rowWidths() const;
 
   //displayBinValue(...): returns the data value for the display bin (e.g.
   //  taking m_rebinFactor into account) of the respective column.
@@ -209,7 +220,37 @@ public:
   //  changed.
   Wt::Signal<ColumnType> &dataSet();
   
+  //revision(): incremented every time this model emits a change signal
+  //  (dataChanged, modelReset, rows or columns inserted/removed, etc.), so
+  //  things derived from the model data can tell if they are out of date.
+  size_t revision() const;
+  
 protected:
+  void incrementRevision();
+  
+  //displayBinValue(...): same as the public version, but returns false instead
+  //  of an empty boost::any if data is not avaliable.
+  bool displayBinValue( int row, ColumnType column, double &value ) const;
+  
+  //updateColumnCache(): re-computes m_columnCache if any of the spectra, or
+  //  how they are displayed, have changed since it was last computed.
+  void updateColumnCache() const;
+  
+  struct ColumnCache
+  {
+    //What the cached values were computed from; if any of these change the
+    //  cache is re-computed.
+    std::vector<const void *> sourcePointers;
+    std::vector<double> sourceParameters;
+    
+    std::vector<double> lowEdges;
+    std::vector<double> widths;
+    std::vector<double> values[4];  //indexed by ColumnType
+  };//struct ColumnCache
+  
+  mutable ColumnCache m_columnCache;
+  
+
   int        m_rebinFactor;
   std::shared_ptr<Measurement> m_data;
   std::shared_ptr<Measurement> m_secondData;
@@ -235,8 +276,10 @@ protected:
   
   Wt::Signal<ColumnType> m_dataSet;
   
-  //Foreground==0, Background==1, Secondary==2
+  //Foreground==0, Background==1, Secondary==2
   Wt::WColor m_seriesColors[3];
+  
+  size_t m_revision;
 };//class SpectrumDataModel
 
 #endif
@@ -128,6 +128,10 @@ public:  // Function methods (for parser, can combine with expressions)
     double gammaMax();
     double gammaMaxFor( const std::string& histogram );
     
+    // Channel expressions: arithmetic over whole spectra, like "(fg - 2*bg)/sqrt(fg)", see ChannelExpression in TerminalModel.cpp
+    double channelExpressionSum( const std::string& expression, const double startBin, const double endBin );
+    double channelExpressionIntegral( const std::string& expression, double energyLow, double energyHigh );
+    
 protected:  /* Command methods (complete actions on Spectrum, cannot be used with parser)
              To add a new command in the Terminal tool:
                  1. Add the corresponding CommandType enum inside the TerminalModel Header file.
@@ -210,6 +214,12 @@ protected:  // Internal helper methods
     
     bool energyIsWithinPeak( PeakModel::PeakShrdPtr peak, const double energy );
     
+    // Channel expression helpers
+    struct ChannelExpression;
+    std::shared_ptr<const ChannelExpression> compiledChannelExpression( const std::string& expression );
+    std::shared_ptr<const Measurement> channelExpressionValues( const std::string& expression, const double startBin,
+                                                                const double endBin, size_t& firstChannel, std::vector<double>& values );
+    
 private:
     // Terminal Model Members
     std::unique_ptr<mup::ParserX>   m_parser;
@@ -221,6 +231,9 @@ private:
     std::shared_ptr<const Measurement> m_backgroundHistogram;
     std::shared_ptr<const Measurement> m_secondaryHistogram;
     
+    // Channel expressions already parsed, keyed by their text, so re-evaluating an expression doesn't re-parse it
+    std::map<std::string, std::shared_ptr<const ChannelExpression>> m_channelExpressions;
+    
     /* To add a new command/function into the Drop-Down helper list:
      FOR COMMANDS ONLY:
             1.  Inside the void TerminalModel::addCommand(const std::string& command, CommandType type) method, create a new case inside the 
@@ -0,0 +1,140 @@
+#ifndef Tracing_h
+#define Tracing_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+//Tracing: low overhead timing of the expensive operations (file parsing, peak
+//  searching and fitting, shielding/source fits, summing samples, sending
+//  spectra to the client), so it can be seen where time goes in a real
+//  session, and exported as Chrome trace-event JSON (viewable using
+//  chrome://tracing, or https://ui.perfetto.dev).
+//
+//  Use the macros, not the classes directly, so everything compiles away when
+//  INTERSPEC_ENABLE_TRACING is off (the default):
+//
+//    INTERSPEC_TRACE_SPAN("fitPeaksInRange");  //times until end of scope
+//    INTERSPEC_TRACE_SESSION(sessionID);       //spans on this thread, until
+//                                              //  end of scope, are
+//                                              //  attributed to sessionID
+//
+//  Each thread records into its own fixed-size ring buffer, so recording only
+//  takes an uncontended lock and a clock read or two; when a buffer fills up,
+//  the oldest spans of that thread are overwritten.  The name passed to
+//  INTERSPEC_TRACE_SPAN must be a string literal (only the pointer is kept).
+//
+//  Does not depend on Wt; InterSpecApp::notify(...) sets the session for
+//  spans in the Wt event loop, and worker functions that are passed the
+//  session ID set it themselves.
+
+#if( INTERSPEC_ENABLE_TRACING )
+
+#include <chrono>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#define INTERSPEC_TRACE_CONCAT_IMPL(a,b) a##b
+#define INTERSPEC_TRACE_CONCAT(a,b) INTERSPEC_TRACE_CONCAT_IMPL(a,b)
+
+#define INTERSPEC_TRACE_SPAN(name) \
+  Tracing::ScopedSpan INTERSPEC_TRACE_CONCAT(trace_span_,__LINE__)( name )
+
+#define INTERSPEC_TRACE_SESSION(session) \
+  Tracing::SessionScope INTERSPEC_TRACE_CONCAT(trace_session_,__LINE__)( session )
+
+namespace Tracing
+{
+  struct Event
+  {
+    const char *name;
+
+    //Nanoseconds since the process started tracing.
+    std::int64_t start;
+    std::int64_t duration;
+
+    //Session ID, null terminated; empty if recorded on a thread not
+    //  associated with a session.  Wt session IDs are 16 characters by default
+    //  (session-id-length in wt_config.xml), plus any session-id-prefix, so
+    //  this fits them with lots of room; longer IDs are truncated, and
+    //  writeChromeTrace(...) then matches on the truncated prefix.
+    char session[64];
+  };//struct Event
+
+
+  //ScopedSpan: records an Event from construction to destruction.
+  class ScopedSpan
+  {
+  public:
+    explicit ScopedSpan( const char *name );
+    ~ScopedSpan();
+
+  private:
+    ScopedSpan( const ScopedSpan & ) = delete;
+    ScopedSpan &operator=( const ScopedSpan & ) = delete;
+
+    const char *m_name;
+    std::chrono::steady_clock::time_point m_start;
+  };//class ScopedSpan
+
+
+  //SessionScope: sets the session ID spans on the current thread are recorded
+  //  with, restoring the previous value on destruction.
+  class SessionScope
+  {
+  public:
+    explicit SessionScope( const std::string &sessionId );
+    ~SessionScope();
+
+  private:
+    SessionScope( const SessionScope & ) = delete;
+    SessionScope &operator=( const SessionScope & ) = delete;
+
+    std::string m_previous;
+  };//class SessionScope
+
+
+  //writeChromeTrace(...): writes the currently buffered spans, of all
+  //  threads, as Chrome trace-event JSON ("X" complete events, with the
+  //  session in "args").  If sessionId is non-empty, only that sessions spans
+  //  are written (so a user can only download their own trace).
+  void writeChromeTrace( std::ostream &output,
+                         const std::string &sessionId = std::string() );
+
+  //clear(): discards all buffered spans.
+  void clear();
+
+  //sm_eventsPerThread: the capacity of each threads ring buffer.
+  extern const size_t sm_eventsPerThread;
+}//namespace Tracing
+
+#else
+
+#define INTERSPEC_TRACE_SPAN(name) do{}while(0)
+#define INTERSPEC_TRACE_SESSION(session) do{}while(0)
+
+#endif //INTERSPEC_ENABLE_TRACING
+
+#endif //Tracing_h
@@ -0,0 +1,259 @@
+#ifndef UndoRedoManager_h
+#define UndoRedoManager_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "SpecUtils/SpectrumDataStructs.h"
+
+class PeakDef;
+class SpecMeas;
+class InterSpec;
+
+
+//UndoRedoManager: the per-session journal of user actions that can be undone
+//  (Ctrl-Z) and redone (Ctrl-Y or Ctrl-Shift-Z).
+//
+//  Each step in the journal is a pair of functions, one to undo the action,
+//  and one to redo it.  Peak edits (adding, fitting, editing, deleting), energy
+//  recalibrations, and changes to the displayed sample numbers are recorded
+//  automatically by the RAII classes below, which are placed in PeakModel,
+//  Recalibrator, and InterSpec.
+//
+//  Peaks are immutable (std::shared_ptr<const PeakDef>), so a peak step only
+//  holds the peaks that were removed and added, sharing them with the
+//  SpecMeas; a step costs memory and time proportional to the number of peaks
+//  changed, not the number of peaks in the spectrum.  The total (approximate) memory
+//  held by the journal is kept under memoryBudget() by dropping the oldest
+//  steps.
+//
+//  Steps are only recorded from the main (Wt event loop) thread.
+class UndoRedoManager
+{
+public:
+  UndoRedoManager( InterSpec *viewer );
+  ~UndoRedoManager();
+
+  //instance(): returns the UndoRedoManager of the current sessions InterSpec,
+  //  or nullptr if there is no current session, or it has no InterSpec yet.
+  static UndoRedoManager *instance();
+
+  //addUndoRedoStep(...): adds a step to the journal, clearing any steps that
+  //  could have been redone.  'approx_bytes' is the memory held by the
+  //  functions (used for enforcing the memory budget).
+  //  If called while another step is being undone/redone, or inside of a
+  //  BlockUndoRedoInserts, the step is discarded.  If called inside of a
+  //  StepGroup, the step will be combined with the others of the group.
+  void addUndoRedoStep( std::function<void()> undo,
+                        std::function<void()> redo,
+                        const std::string &description,
+                        const size_t approx_bytes = 0 );
+
+  bool canUndo() const;
+  bool canRedo() const;
+
+  //undo()/redo(): undoes or redoes the most recent step; does nothing if
+  //  there is no step available.  If the step throws an exception, the
+  //  journal is cleared (since the application state is then unknown) and a
+  //  message is shown to the user.
+  void undo();
+  void redo();
+
+  //clearHistory(): removes all undo and redo steps.
+  void clearHistory();
+
+  //clearRedoSteps(): removes the steps that could be redone.  Called when the
+  //  state is modified without a step being recorded (e.g., inside of a
+  //  BlockUndoRedoInserts), since the redo steps would then be applied to a
+  //  state they were not recorded against.  Does nothing while a step is
+  //  being undone or redone.
+  void clearRedoSteps();
+
+  //isInUndoOrRedo(): true while a step is being undone or redone.
+  bool isInUndoOrRedo() const;
+
+  size_t numUndoSteps() const;
+  size_t numRedoSteps() const;
+
+  //memoryBudget(): the maximum (approximate) bytes the journal will hold;
+  //  setting a smaller budget will immediately drop the oldest steps.
+  size_t memoryBudget() const;
+  void setMemoryBudget( const size_t bytes );
+  size_t memoryUsed() const;
+
+  //maxSteps(): the maximum number of undo steps kept, regardless of memory.
+  size_t maxSteps() const;
+  void setMaxSteps( const size_t nsteps );
+
+
+  //BlockUndoRedoInserts: while one of these is in scope, no steps will be
+  //  recorded; use when making a change that will be recorded some other way,
+  //  or shouldnt be undoable (e.g., loading a new spectrum file).
+  class BlockUndoRedoInserts
+  {
+  public:
+    BlockUndoRedoInserts();
+    ~BlockUndoRedoInserts();
+
+  private:
+    UndoRedoManager *m_manager;
+  };//class BlockUndoRedoInserts
+
+
+  //StepGroup: all steps added while one of these is in scope are combined
+  //  into a single step, so a single user action that makes many changes
+  //  (e.g., a peak fit that removes and then adds peaks) is undone at once.
+  //  May be nested; only the outermost group creates the step.
+  class StepGroup
+  {
+  public:
+    StepGroup( const std::string &description );
+    ~StepGroup();
+
+  private:
+    UndoRedoManager *m_manager;
+  };//class StepGroup
+
+
+  //PeakModelChange: records the changes to the foreground peaks made while
+  //  in scope, as a step that removes/adds back just the changed peaks.
+  //  Placed in each of the PeakModel functions that modify peaks, which report
+  //  each row they touch with peakRemoved(...)/peakAdded(...); nested
+  //  instances pass these on to the outermost instance, which creates the
+  //  step.  If the changes can not be recorded (e.g., inside of a
+  //  BlockUndoRedoInserts), the redo steps are cleared instead.
+  class PeakModelChange
+  {
+  public:
+    PeakModelChange();
+    ~PeakModelChange();
+
+    //peakRemoved(...)/peakAdded(...): to be called as a peak is removed from,
+    //  or added to, the PeakModel; modifying a peak is a removal of the old
+    //  peak, and an addition of the new one.
+    void peakRemoved( const std::shared_ptr<const PeakDef> &peak );
+    void peakAdded( const std::shared_ptr<const PeakDef> &peak );
+
+  private:
+    UndoRedoManager *m_manager;
+    bool m_outermost;
+    bool m_recording;
+    bool m_changed;
+    std::weak_ptr<SpecMeas> m_meas;
+    std::set<int> m_samples;
+    std::vector<std::shared_ptr<const PeakDef>> m_removed;
+    std::vector<std::shared_ptr<const PeakDef>> m_added;
+  };//class PeakModelChange
+
+
+  //EnergyCalibrationChange: records a change to the energy calibration of the
+  //  foreground, background, and/or secondary spectrum made while in scope.
+  //  Since recalibrating shifts all the peaks of a SpecMeas, the peaks (all
+  //  sample numbers) are recorded as well, and peak changes are not
+  //  separately recorded while in scope.  Nested instances do nothing.
+  class EnergyCalibrationChange
+  {
+  public:
+    struct SpecState
+    {
+      std::vector<float> coefficients;
+      std::vector< std::pair<float,float> > deviationpairs;
+      Measurement::EquationType type;
+      std::map< std::set<int>, std::vector<std::shared_ptr<const PeakDef>> > peaks;
+    };//struct SpecState
+
+    EnergyCalibrationChange();
+    ~EnergyCalibrationChange();
+
+  private:
+    UndoRedoManager *m_manager;
+    bool m_recording;
+    std::vector< std::pair<SpectrumType,std::weak_ptr<SpecMeas>> > m_specs;
+    std::vector<SpecState> m_startingStates;
+  };//class EnergyCalibrationChange
+
+
+  //sampleNumbersChanged(...): records a change of the displayed sample
+  //  numbers; called from InterSpec::changeDisplayedSampleNums(...).
+  void sampleNumbersChanged( const SpectrumType type,
+                             std::shared_ptr<SpecMeas> meas,
+                             const std::set<int> &oldSamples,
+                             const std::set<int> &newSamples );
+
+protected:
+  struct Step
+  {
+    std::function<void()> undo;
+    std::function<void()> redo;
+    std::string description;
+    size_t approx_bytes;
+  };//struct Step
+
+  void enforceBudget();
+  void executeStep( const bool isUndo );
+
+  //restorePeaks(...): sets the peaks of 'meas' for 'samples' to be the
+  //  current peaks, minus 'remove', plus 'add', and updates the PeakModel if
+  //  they are for the displayed foreground.
+  void restorePeaks( std::shared_ptr<SpecMeas> meas,
+                     const std::set<int> &samples,
+                     const std::vector<std::shared_ptr<const PeakDef>> &remove,
+                     const std::vector<std::shared_ptr<const PeakDef>> &add );
+
+  //restoreCalibration(...): sets the calibration, and all peaks, of the
+  //  SpecMeas objects to the passed in states.
+  void restoreCalibration(
+        const std::vector< std::pair<SpectrumType,std::weak_ptr<SpecMeas>> > &specs,
+        const std::vector<EnergyCalibrationChange::SpecState> &states );
+
+  InterSpec *m_viewer;
+
+  std::deque<Step> m_undoSteps;
+  std::deque<Step> m_redoSteps;
+
+  size_t m_memoryBudget;
+  size_t m_maxSteps;
+  size_t m_memoryUsed;
+
+  bool m_inUndoRedo;
+  int m_blockDepth;
+
+  int m_groupDepth;
+  std::string m_groupDescription;
+  std::vector<Step> m_groupSteps;
+
+  PeakModelChange *m_peakChange;
+  int m_calibrationChangeDepth;
+};//class UndoRedoManager
+
+#endif //UndoRedoManager_h
@@ -30,6 +30,7 @@
 #include <memory>
 #include <iostream>
 #include <stdint.h>
+#include <functional>
 
 /** ZipArchive opens a ZIP file and allows you to extract files it contains.
    Its not incredibly well tested, and could definetly stand to use more error
@@ -73,5 +74,57 @@ namespace ZipArchive
   size_t read_file_from_zip( std::istream &instrm,
                              std::shared_ptr<const ZipFileHeader> header,
                              std::ostream &output );
+  
+  
+  /** A read-only memory mapping of a ZIP file on disk.  Files within the
+      archive are inflated directly from the mapping, so multiple files can be
+      extracted at once, from any number of threads, without seeking a shared
+      stream or copying the compressed data.
+   */
+  class MappedZipFile
+  {
+  public:
+    //Maps the file and reads the central directory; throws std::exception
+    //  with descriptive message upon error, or no files found.
+    explicit MappedZipFile( const std::string &filename );
+    ~MappedZipFile();
+    
+    //headers(): the files in the archive; garunteed to have at least one entry.
+    const FilenameToZipHeaderMap &headers() const;
+    
+    //read_file(): inflates the file cooresponding to 'header' into 'output',
+    //  which will be resized to exactly the uncompressed size of the file,
+    //  plus an additional zero byte if 'null_terminate' is true (not included
+    //  in the returned size).  Throws std::exception upon error.
+    //  Thread safe.
+    size_t read_file( std::shared_ptr<const ZipFileHeader> header,
+                      std::vector<char> &output,
+                      const bool null_terminate = false ) const;
+    
+    //read_files(): inflates the specified files in parallel, calling
+    //  'callback' with the index (into 'files') and contents of each one, from
+    //  the worker thread the file was inflated on.  Files that fail to inflate
+    //  are logged, and 'callback' is not called for them.  Returns once all
+    //  files have been processed.
+    void read_files( const std::vector<std::shared_ptr<const ZipFileHeader> > &files,
+                     const std::function<void(size_t,std::vector<char> &)> &callback,
+                     const bool null_terminate = false ) const;
+    
+  protected:
+    MappedZipFile( const MappedZipFile & ) = delete;
+    MappedZipFile &operator=( const MappedZipFile & ) = delete;
+    
+    void unmap();
+    
+    const char *m_data;
+    size_t m_size;
+    
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+    
+    FilenameToZipHeaderMap m_headers;
+  };//class MappedZipFile
 }//namespace ZipArchive
 #endif
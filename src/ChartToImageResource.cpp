@@ -1,5 +1,7 @@
 #include "InterSpec/ChartToImageResource.h"
 
+#include <string>
+#include <sstream>
 #include <fstream>
 
 #include <Wt/WLength>
@@ -7,6 +9,7 @@
 #include <Wt/WResource>
 #include <Wt/Http/Request>
 #include <Wt/Http/Response>
+#include <Wt/WAbstractItemModel>
 #include <Wt/Chart/WCartesianChart>
 
 #if( MAKE_PNG_RESOURCE )
@@ -18,13 +21,16 @@
 #endif
 
 
+using namespace std;
 using namespace Wt;
 
 ChartToImageResource::ChartToImageResource( Chart::WCartesianChart *chart,
                                             WObject *parentParam )
-  : WResource(parentParam), m_chart( chart ), m_width( 1600 ), m_height( 1200 )
+  : WResource(parentParam), m_chart( chart ), m_width( 1600 ), m_height( 1200 ),
+    m_model( NULL ), m_modelRevision( 0 )
 
 {
+  connectToModel();
 }
 
 
@@ -45,38 +51,104 @@ const char *ChartToImageResource::imageType() const
 }//const char *imageType() const
 
 
-void ChartToImageResource::handleRequest( const Http::Request& request,
-                                        Http::Response& response)
+void ChartToImageResource::connectToModel()
 {
-#if( MAKE_PNG_RESOURCE )
-  Wt::WRasterImage pngImage( "png", m_width, m_height );
+  WAbstractItemModel *model = m_chart->model();
+  if( model == m_model )
+    return;
+  
+  m_model = model;
+  ++m_modelRevision;
+  
+  if( !m_model )
+    return;
+  
+  m_model->dataChanged().connect( this, &ChartToImageResource::modelChanged );
+  m_model->headerDataChanged().connect( this, &ChartToImageResource::modelChanged );
+  m_model->layoutChanged().connect( this, &ChartToImageResource::modelChanged );
+  m_model->modelReset().connect( this, &ChartToImageResource::modelChanged );
+  m_model->rowsInserted().connect( this, &ChartToImageResource::modelChanged );
+  m_model->rowsRemoved().connect( this, &ChartToImageResource::modelChanged );
+  m_model->columnsInserted().connect( this, &ChartToImageResource::modelChanged );
+  m_model->columnsRemoved().connect( this, &ChartToImageResource::modelChanged );
+}//void connectToModel()
+
+
+void ChartToImageResource::modelChanged()
+{
+  ++m_modelRevision;
+}//void modelChanged()
 
+
+std::string ChartToImageResource::chartStateKey() const
+{
+  std::ostringstream key;
+  key << m_width << "x" << m_height << ";" << m_modelRevision << ";"
+      << m_chart->title().toUTF8() << ";";
+  
+  const Chart::Axis axes[] = { Chart::XAxis, Chart::YAxis, Chart::Y2Axis };
+  for( const Chart::Axis axisid : axes )
   {
-    Wt::WPainter p( &pngImage );
-    m_chart->paint( p );
+    const Chart::WAxis &axis = m_chart->axis( axisid );
+    key << axis.isVisible() << "," << axis.minimum() << "," << axis.maximum()
+        << "," << axis.scale() << "," << axis.title().toUTF8() << ";";
   }
-
-  response.setMimeType( "image/png" );
-  pngImage.write( response.out() );
-#elif( defined(WT_HAS_WPDFIMAGE) )
-
-  WPdfImage pdfImage( width, height );
-
+  
+#if( WT_VERSION >= 0x3030800 )
+  for( const Chart::WDataSeries *series : m_chart->series() )
   {
-    Wt::WPainter p( &pdfImage );
-    m_chart->paint( p );
+    key << series->modelColumn() << "," << series->isHidden() << ","
+        << series->type() << "," << series->pen().color().cssText() << ";";
   }
-
-  response.setMimeType( "application/pdf" );
-  pdfImage.write( response.out() );
 #else
-  WSvgImage img( width, height );
+  for( const Chart::WDataSeries &series : m_chart->series() )
   {
-    Wt::WPainter p( &img );
-    m_chart->paint( p );
+    key << series.modelColumn() << "," << series.isHidden() << ","
+        << series.type() << "," << series.pen().color().cssText() << ";";
   }
+#endif
+  
+  return key.str();
+}//std::string chartStateKey() const
 
+
+void ChartToImageResource::handleRequest( const Http::Request& request,
+                                        Http::Response& response)
+{
+  connectToModel();
+  
+  const string key = chartStateKey();
+  
+  if( m_cachedImage.empty() || key != m_cachedKey )
+  {
+    std::ostringstream output;
+    
+#if( MAKE_PNG_RESOURCE )
+    Wt::WRasterImage img( "png", m_width, m_height );
+#elif( defined(WT_HAS_WPDFIMAGE) )
+    WPdfImage img( m_width, m_height );
+#else
+    WSvgImage img( m_width, m_height );
+#endif
+    
+    {
+      Wt::WPainter p( &img );
+      m_chart->paint( p );
+    }
+    
+    img.write( output );
+    
+    m_cachedImage = output.str();
+    m_cachedKey = key;
+  }//if( need to re-render chart )
+  
+#if( MAKE_PNG_RESOURCE )
+  response.setMimeType( "image/png" );
+#elif( defined(WT_HAS_WPDFIMAGE) )
+  response.setMimeType( "application/pdf" );
+#else
   response.setMimeType( "image/svg+xml" );
-  img.write( response.out() );
 #endif
+  
+  response.out().write( m_cachedImage.data(), m_cachedImage.size() );
 }//void handleRequest( const Http::Request &, Http::Response & )
@@ -0,0 +1,628 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <chrono>
+#include <limits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+
+#if( !defined(COMPUTE_SCHEDULER_NO_WT) )
+#include <Wt/WApplication>
+#endif
+
+#include "InterSpec/Tracing.h"
+#include "InterSpec/ComputeScheduler.h"
+
+using namespace std;
+
+namespace
+{
+  //JobContext: what job is running on the current thread.
+  struct JobContext
+  {
+    std::string sessionId;
+    ComputeScheduler::Priority priority;
+    std::shared_ptr<ComputeScheduler::CancellationToken> token;
+  };//struct JobContext
+
+  thread_local const JobContext *t_context = nullptr;
+
+
+  //JobContextScope: sets t_context for the lifetime of the object.
+  class JobContextScope
+  {
+    const JobContext *m_previous;
+  public:
+    JobContextScope( const JobContext &context )
+      : m_previous( t_context )
+    {
+      t_context = &context;
+    }
+
+    ~JobContextScope()
+    {
+      t_context = m_previous;
+    }
+  };//class JobContextScope
+
+
+  size_t default_max_threads()
+  {
+#if( defined(MAX_COMPUTE_THREADS) && MAX_COMPUTE_THREADS > 0 )
+    return static_cast<size_t>( MAX_COMPUTE_THREADS );
+#else
+    return std::max( 2u, std::thread::hardware_concurrency() );
+#endif
+  }//size_t default_max_threads()
+}//namespace
+
+
+ComputeScheduler::CancellationToken::CancellationToken()
+  : m_cancelled( false )
+{
+}
+
+
+void ComputeScheduler::CancellationToken::cancel()
+{
+  m_cancelled = true;
+}
+
+
+bool ComputeScheduler::CancellationToken::isCancelled() const
+{
+  return m_cancelled;
+}
+
+
+ComputeScheduler::TaskGroup::State::State()
+  : numOutstanding( 0 ),
+    error()
+{
+}
+
+
+ComputeScheduler::TaskGroup::TaskGroup()
+  : m_sessionId( currentSessionId() ),
+    m_priority( currentPriority() ),
+    m_token( t_context ? t_context->token : nullptr ),
+    m_tasks(),
+    m_state( std::make_shared<State>() )
+{
+  if( !m_token )
+    m_token = std::make_shared<CancellationToken>();
+}//TaskGroup constructor
+
+
+ComputeScheduler::TaskGroup::TaskGroup( const std::string &sessionId,
+                                        const Priority priority )
+  : m_sessionId( sessionId ),
+    m_priority( priority ),
+    m_token( std::make_shared<CancellationToken>() ),
+    m_tasks(),
+    m_state( std::make_shared<State>() )
+{
+}//TaskGroup constructor
+
+
+ComputeScheduler::TaskGroup::~TaskGroup()
+{
+  try
+  {
+    join();
+  }catch( std::exception &e )
+  {
+    cerr << "ComputeScheduler::TaskGroup: task threw exception: " << e.what()
+         << endl;
+  }catch( ... )
+  {
+    cerr << "ComputeScheduler::TaskGroup: task threw unknown exception" << endl;
+  }
+}//~TaskGroup()
+
+
+void ComputeScheduler::TaskGroup::post( std::function<void()> work )
+{
+  auto task = std::make_shared<Task>();
+  task->work = std::move( work );
+  task->claimed = std::make_shared<std::atomic<bool>>( false );
+
+  {
+    std::lock_guard<std::mutex> lock( m_state->mutex );
+    ++m_state->numOutstanding;
+  }
+
+  m_tasks.push_back( task );
+
+  const std::shared_ptr<State> state = m_state;
+
+  Job job;
+  job.token = m_token;
+  job.claimed = task->claimed;
+  job.work = [task,state](){
+    if( !task->claimed->exchange( true ) )
+      TaskGroup::run( task, state );
+  };
+
+  ComputeScheduler::instance().enqueue( m_sessionId, std::move(job), m_priority );
+}//void TaskGroup::post( std::function<void()> work )
+
+
+void ComputeScheduler::TaskGroup::join()
+{
+  //Run the tasks a worker hasnt started yet ourselves; this is what keeps
+  //  nested groups from deadlocking when all the worker threads are busy
+  //  (likely with the jobs that are waiting on these tasks).
+  if( !m_tasks.empty() )
+  {
+    JobContext context;
+    context.sessionId = m_sessionId;
+    context.priority = m_priority;
+    context.token = m_token;
+    JobContextScope scope( context );
+
+    for( const std::shared_ptr<Task> &task : m_tasks )
+    {
+      if( !task->claimed->exchange( true ) )
+        run( task, m_state );
+    }
+  }//if( !m_tasks.empty() )
+
+  m_tasks.clear();
+
+  std::exception_ptr error;
+
+  {
+    std::unique_lock<std::mutex> lock( m_state->mutex );
+    while( m_state->numOutstanding )
+      m_state->finished.wait( lock );
+
+    error = m_state->error;
+    m_state->error = nullptr;
+  }
+
+  if( error )
+    std::rethrow_exception( error );
+}//void TaskGroup::join()
+
+
+void ComputeScheduler::TaskGroup::run( const std::shared_ptr<Task> &task,
+                                       const std::shared_ptr<State> &state )
+{
+  std::exception_ptr error;
+
+  try
+  {
+    task->work();
+  }catch( ... )
+  {
+    error = std::current_exception();
+  }
+
+  //Release anything the task holds on to before signaling it is done.
+  task->work = std::function<void()>();
+
+  std::lock_guard<std::mutex> lock( state->mutex );
+  if( error && !state->error )
+    state->error = error;
+  --state->numOutstanding;
+  state->finished.notify_all();
+}//void TaskGroup::run(...)
+
+
+ComputeScheduler::SessionState::SessionState()
+  : numRunning( 0 ),
+    consumed( 0.0 ),
+    weight( 1.0 ),
+    running()
+{
+}
+
+
+bool ComputeScheduler::isIdle( const SessionState &state )
+{
+  if( state.numRunning )
+    return false;
+
+  for( const deque<Job> &queue : state.queues )
+  {
+    if( !queue.empty() )
+      return false;
+  }
+
+  return true;
+}//bool isIdle( const SessionState &state )
+
+
+ComputeScheduler &ComputeScheduler::instance()
+{
+  static ComputeScheduler s_instance;
+  return s_instance;
+}//ComputeScheduler &instance()
+
+
+ComputeScheduler::ComputeScheduler()
+  : m_maxThreads( default_max_threads() ),
+    m_numIdle( 0 ),
+    m_numRunning( 0 ),
+    m_numQueued( 0 ),
+    m_stopping( false )
+{
+}//ComputeScheduler constructor
+
+
+ComputeScheduler::~ComputeScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_stopping = true;
+  }
+
+  m_workAvailable.notify_all();
+
+  for( std::thread &thread : m_threads )
+  {
+    if( thread.joinable() )
+      thread.join();
+  }
+}//~ComputeScheduler()
+
+
+std::shared_ptr<ComputeScheduler::CancellationToken> ComputeScheduler::post(
+                                          const std::string &sessionId,
+                                          std::function<void()> work,
+                                          const Priority priority,
+                                          std::shared_ptr<CancellationToken> token )
+{
+  if( !token )
+    token = std::make_shared<CancellationToken>();
+
+  Job job;
+  job.work = std::move( work );
+  job.token = token;
+
+  enqueue( sessionId, std::move(job), priority );
+
+  return token;
+}//post(...)
+
+
+void ComputeScheduler::enqueue( const std::string &sessionId, Job &&job,
+                                const Priority priority )
+{
+  assert( priority != Priority::NumPriorities );
+
+  bool notify = false;
+
+  {//begin lock on m_mutex
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    auto pos = m_sessions.find( sessionId );
+    if( pos == end(m_sessions) )
+    {
+      //Dont let a session bank credit while it had nothing to do; start it at
+      //  the least consumed time of the sessions that currently have work.
+      double minConsumed = std::numeric_limits<double>::infinity();
+      for( const auto &s : m_sessions )
+        minConsumed = std::min( minConsumed, s.second.consumed );
+
+      pos = m_sessions.insert( make_pair(sessionId, SessionState()) ).first;
+      if( minConsumed != std::numeric_limits<double>::infinity() )
+        pos->second.consumed = minConsumed;
+
+      const auto weightpos = m_weights.find( sessionId );
+      if( weightpos != end(m_weights) )
+        pos->second.weight = weightpos->second;
+    }//if( new session, or it was idle )
+
+    pos->second.queues[static_cast<int>(priority)].push_back( std::move(job) );
+    ++m_numQueued;
+
+    if( m_numIdle )
+    {
+      notify = true;
+    }else if( m_threads.size() < m_maxThreads )
+    {
+      m_threads.emplace_back( &ComputeScheduler::workerLoop, this );
+    }
+  }//end lock on m_mutex
+
+  if( notify )
+    m_workAvailable.notify_one();
+}//void enqueue(...)
+
+
+bool ComputeScheduler::nextJob( Job &job, std::string &sessionId,
+                                Priority &priority )
+{
+  if( m_numRunning >= m_maxThreads )
+    return false;
+
+  for( int p = 0; p < static_cast<int>(Priority::NumPriorities); ++p )
+  {
+    //Keep a thread free for Interactive and Normal work.
+    if( p == static_cast<int>(Priority::Background)
+        && m_maxThreads > 1 && (m_numRunning + 1) >= m_maxThreads )
+      continue;
+
+    std::map<std::string,SessionState>::iterator best = end(m_sessions);
+
+    for( auto iter = begin(m_sessions); iter != end(m_sessions); )
+    {
+      SessionState &state = iter->second;
+      deque<Job> &queue = state.queues[p];
+
+      //Discard cancelled jobs, and TaskGroup tasks already ran by join().
+      while( !queue.empty()
+             && ((queue.front().token && queue.front().token->isCancelled())
+                 || (queue.front().claimed && queue.front().claimed->load())) )
+      {
+        queue.pop_front();
+        --m_numQueued;
+      }
+
+      if( queue.empty() )
+      {
+        if( isIdle( state ) )
+          iter = m_sessions.erase( iter );
+        else
+          ++iter;
+        continue;
+      }
+
+      if( best == end(m_sessions) )
+      {
+        best = iter++;
+        continue;
+      }
+
+      const SessionState &bestState = best->second;
+      const double running = state.numRunning / state.weight;
+      const double bestRunning = bestState.numRunning / bestState.weight;
+
+      if( running < bestRunning
+          || (running == bestRunning
+              && (state.consumed / state.weight) < (bestState.consumed / bestState.weight)) )
+        best = iter;
+      ++iter;
+    }//for( loop over sessions )
+
+    if( best == end(m_sessions) )
+      continue;
+
+    SessionState &state = best->second;
+    deque<Job> &queue = state.queues[p];
+
+    job = std::move( queue.front() );
+    queue.pop_front();
+    --m_numQueued;
+
+    sessionId = best->first;
+    priority = static_cast<Priority>( p );
+
+    ++m_numRunning;
+    ++state.numRunning;
+    state.running.push_back( job.token );
+
+    return true;
+  }//for( loop over priorities )
+
+  return false;
+}//bool nextJob(...)
+
+
+void ComputeScheduler::workerLoop()
+{
+  std::unique_lock<std::mutex> lock( m_mutex );
+
+  while( true )
+  {
+    JobContext context;
+    Job job;
+
+    while( !m_stopping && !nextJob( job, context.sessionId, context.priority ) )
+    {
+      ++m_numIdle;
+      m_workAvailable.wait( lock );
+      --m_numIdle;
+    }
+
+    if( m_stopping )
+      return;
+
+    context.token = job.token;
+
+    lock.unlock();
+
+    const auto start = std::chrono::steady_clock::now();
+
+    {
+      JobContextScope scope( context );
+      INTERSPEC_TRACE_SESSION( context.sessionId );
+
+      try
+      {
+        job.work();
+      }catch( std::exception &e )
+      {
+        cerr << "ComputeScheduler: job for session '" << context.sessionId
+             << "' threw exception: " << e.what() << endl;
+      }catch( ... )
+      {
+        cerr << "ComputeScheduler: job for session '" << context.sessionId
+             << "' threw unknown exception" << endl;
+      }
+    }
+
+    //Destroy whatever the job holds on to before taking the lock.
+    job.work = std::function<void()>();
+
+    const double elapsed = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start ).count();
+
+    lock.lock();
+
+    --m_numRunning;
+
+    const auto pos = m_sessions.find( context.sessionId );
+    if( pos != end(m_sessions) )
+    {
+      SessionState &state = pos->second;
+      --state.numRunning;
+      state.consumed += elapsed;
+
+      const auto tokenpos = std::find( begin(state.running), end(state.running),
+                                       context.token );
+      if( tokenpos != end(state.running) )
+        state.running.erase( tokenpos );
+
+      if( isIdle( state ) )
+        m_sessions.erase( pos );
+    }//if( pos != end(m_sessions) )
+
+    //Freeing up this thread may allow Background work to run on a thread that
+    //  is waiting.
+    if( m_numIdle && m_numQueued )
+      m_workAvailable.notify_one();
+  }//while( true )
+}//void workerLoop()
+
+
+void ComputeScheduler::cancelSession( const std::string &sessionId )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  m_weights.erase( sessionId );
+
+  const auto pos = m_sessions.find( sessionId );
+  if( pos == end(m_sessions) )
+    return;
+
+  SessionState &state = pos->second;
+
+  for( deque<Job> &queue : state.queues )
+  {
+    for( Job &job : queue )
+    {
+      if( job.token )
+        job.token->cancel();
+    }
+
+    m_numQueued -= queue.size();
+    queue.clear();
+  }//for( deque<Job> &queue : state.queues )
+
+  for( const auto &token : state.running )
+  {
+    if( token )
+      token->cancel();
+  }
+
+  if( state.numRunning == 0 )
+    m_sessions.erase( pos );
+}//void cancelSession( const std::string &sessionId )
+
+
+void ComputeScheduler::setSessionWeight( const std::string &sessionId,
+                                         const double weight )
+{
+  if( !(weight > 0.0) )
+    throw runtime_error( "ComputeScheduler::setSessionWeight: weight must be positive" );
+
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  m_weights[sessionId] = weight;
+
+  const auto pos = m_sessions.find( sessionId );
+  if( pos != end(m_sessions) )
+    pos->second.weight = weight;
+}//void setSessionWeight(...)
+
+
+size_t ComputeScheduler::maxThreads() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return m_maxThreads;
+}
+
+
+void ComputeScheduler::setMaxThreads( const size_t nthreads )
+{
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_maxThreads = std::max( nthreads, size_t(1) );
+
+    //Threads already created are kept, but nextJob() wont run more than
+    //  m_maxThreads jobs at once.
+    while( m_numQueued && m_threads.size() < std::min(m_maxThreads, m_numQueued) )
+      m_threads.emplace_back( &ComputeScheduler::workerLoop, this );
+  }
+
+  m_workAvailable.notify_all();
+}//void setMaxThreads( const size_t nthreads )
+
+
+size_t ComputeScheduler::numQueued() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return m_numQueued;
+}
+
+
+size_t ComputeScheduler::numRunning() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return m_numRunning;
+}
+
+
+std::string ComputeScheduler::currentSessionId()
+{
+  if( t_context )
+    return t_context->sessionId;
+
+#if( !defined(COMPUTE_SCHEDULER_NO_WT) )
+  //Called from a thread handling an event for a session (e.g., the user
+  //  clicked a button); work should be attributed to that session.
+  Wt::WApplication *app = Wt::WApplication::instance();
+  if( app )
+    return app->sessionId();
+#endif
+
+  return std::string();
+}//std::string currentSessionId()
+
+
+ComputeScheduler::Priority ComputeScheduler::currentPriority()
+{
+  return t_context ? t_context->priority : Priority::Interactive;
+}
+
+
+bool ComputeScheduler::isCurrentJobCancelled()
+{
+  return (t_context && t_context->token && t_context->token->isCancelled());
+}
@@ -1,6 +1,8 @@
 #include "InterSpec_config.h"
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 #include <utility>
 #include <boost/foreach.hpp>
@@ -40,6 +42,7 @@
 #include "InterSpec/InterSpecUser.h"
 #include "InterSpec/PopupDiv.h"
 #include "InterSpec/PeakModel.h"
+#include "InterSpec/Tracing.h"
 #include "InterSpec/SpectrumChart.h"
 #include "InterSpec/InterSpec.h"
 #include "SpecUtils/UtilityFunctions.h"
@@ -720,14 +723,24 @@ void D3SpectrumDisplayDiv::setYAxisRange( const double minimum,
 void D3SpectrumDisplayDiv::updateForegroundPeaksToClient()
 {
   string js;
+  vector< std::shared_ptr<const PeakDef> > inpeaks;
   
   if( m_peakModel )
   {
     std::shared_ptr<const std::deque< PeakModel::PeakShrdPtr > > peaks = m_peakModel->peaks();
-    vector< std::shared_ptr<const PeakDef> > inpeaks( peaks->begin(), peaks->end() );
-    js = PeakDef::peak_json( inpeaks );
+    if( peaks )
+      inpeaks.insert( inpeaks.end(), peaks->begin(), peaks->end() );
   }
   
+  //PeakModel keeps the same PeakDef objects for peaks that havent changed, so
+  //  if the list of peaks is the same as what the client already has, there
+  //  is no need to re-send them.
+  if( inpeaks == m_foregroundPeaksOnClient )
+    return;
+  
+  m_foregroundPeaksOnClient = inpeaks;
+  js = foregroundPeakJson( inpeaks );
+  
   if( js.empty() )
     js = "[]";
   
@@ -740,6 +753,39 @@ void D3SpectrumDisplayDiv::updateForegroundPeaksToClient()
 }//void updateForegroundPeaksToClient()
 
 
+std::string D3SpectrumDisplayDiv::foregroundPeakJson( const vector<std::shared_ptr<const PeakDef>> &peaks )
+{
+  typedef std::shared_ptr<const PeakContinuum> ContPtr;
+  typedef vector<std::shared_ptr<const PeakDef>> RoiPeaks;
+  
+  //Group by continuum, like PeakDef::peak_json(...)
+  map<ContPtr,RoiPeaks> rois;
+  for( const auto &peak : peaks )
+    rois[peak->continuum()].push_back( peak );
+  
+  map<ContPtr,pair<RoiPeaks,string>> roijson;
+  
+  string json = "[";
+  for( const auto &roi : rois )
+  {
+    const auto prev = m_foregroundRoiJson.find( roi.first );
+    const bool unchanged = (prev != m_foregroundRoiJson.end())
+                           && (prev->second.first == roi.second);
+    
+    const string thisjson = unchanged ? prev->second.second
+                                      : PeakDef::gaus_peaks_to_json( roi.second );
+    
+    json += ((json.size() > 1) ? "," : "") + thisjson;
+    roijson[roi.first] = make_pair( roi.second, thisjson );
+  }//for( const auto &roi : rois )
+  json += "]";
+  
+  m_foregroundRoiJson.swap( roijson );
+  
+  return json;
+}//std::string foregroundPeakJson(...)
+
+
 
 void D3SpectrumDisplayDiv::setData( std::shared_ptr<Measurement> data_hist,
                                  float liveTime,
@@ -754,6 +800,8 @@ void D3SpectrumDisplayDiv::setData( std::shared_ptr<Measurement> data_hist,
   
   // Set the data for the chart
   if ( data_hist ) {
+    INTERSPEC_TRACE_SPAN( "D3SpectrumDisplayDiv: foreground to JSON" );
+    
     // Create the measurement array (should only have one measurement)
     std::ostringstream ostr;
     std::vector< std::pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions> > measurements;
@@ -767,10 +815,12 @@ void D3SpectrumDisplayDiv::setData( std::shared_ptr<Measurement> data_hist,
     foregroundOptions.display_scale_factor = displayScaleFactor( kForeground );
     
     // Set the peak data for the spectrum
+    m_foregroundPeaksOnClient.clear();
     if ( m_peakModel ) {
       std::shared_ptr<const std::deque< PeakModel::PeakShrdPtr > > peaks = m_peakModel->peaks();
       vector< std::shared_ptr<const PeakDef> > inpeaks( peaks->begin(), peaks->end() );
-      foregroundOptions.peaks_json = PeakDef::peak_json( inpeaks );
+      foregroundOptions.peaks_json = foregroundPeakJson( inpeaks );
+      m_foregroundPeaksOnClient = inpeaks;
     }
     
     measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(data_hist.get(),foregroundOptions) );
@@ -784,6 +834,7 @@ void D3SpectrumDisplayDiv::setData( std::shared_ptr<Measurement> data_hist,
     }
   } else {
     js = m_jsgraph + ".removeSpectrumData(" + resetDomain + ", 'FOREGROUND' );";
+    m_foregroundPeaksOnClient.clear();
   }//if ( data_hist )
   
   
@@ -1115,6 +1166,8 @@ void D3SpectrumDisplayDiv::updateBackground()
   
   // Set the data for the chart
   if ( background ) {
+    INTERSPEC_TRACE_SPAN( "D3SpectrumDisplayDiv: background to JSON" );
+    
     // Create the measurement array (should only have one measurement)
     std::ostringstream ostr;
     std::vector< std::pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions> > measurements;
@@ -1160,6 +1213,8 @@ void D3SpectrumDisplayDiv::updateSecondData()
   
   // Set the data for the chart
   if ( hist ) {
+    INTERSPEC_TRACE_SPAN( "D3SpectrumDisplayDiv: secondary to JSON" );
+    
     // Create the measurement array (should only have one measurement)
     std::ostringstream ostr;
     std::vector< std::pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions> > measurements;
@@ -24,7 +24,11 @@
 
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
 #include <iostream>
+#include <condition_variable>
 
 #if( !USE_GLOBAL_DATABASE_CONNECTION_POOL )
 #include <Wt/WTimer>
@@ -64,6 +68,29 @@ namespace
   std::string PreferenceDatabaseFile = "InterSpecUserData.db";
 #endif
 
+#if( USE_SQLITE3_DB )
+  //set_sqlite_pragmas(): sets up SQLite for many small transactions from
+  //  multiple threads.  Write-ahead logging lets readers continue while a
+  //  commit is in progress, and only syncs the log (not the database) on
+  //  commit; journal_mode is persistent in the database file, but the other
+  //  pragmas are per connection.  'synchronous' is left at FULL so commits
+  //  are as durable as before.
+  void set_sqlite_pragmas( Dbo::SqlConnection *connection )
+  {
+    try
+    {
+      connection->executeSql( "PRAGMA journal_mode=WAL" );
+      connection->executeSql( "PRAGMA synchronous=FULL" );
+      connection->executeSql( "PRAGMA busy_timeout=5000" );
+      connection->executeSql( "PRAGMA temp_store=MEMORY" );
+      connection->executeSql( "PRAGMA cache_size=-8000" );
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to set SQLite pragmas: " << e.what() << endl;
+    }//try / catch
+  }//void set_sqlite_pragmas( Dbo::SqlConnection *connection )
+#endif
+  
 #if( USE_GLOBAL_DATABASE_CONNECTION_POOL )
   //We need a mechanism to ensure that the database connection stays alive until
   //  the database is finished being written; this is what DbPoolManager does.
@@ -119,6 +146,19 @@ namespace
           
           Dbo::FixedSqlConnectionPool *pool
                     = new Wt::Dbo::FixedSqlConnectionPool( connection, nconn );
+          
+#if( USE_SQLITE3_DB )
+          {//begin set pragmas on each connection of the pool
+            vector<Dbo::SqlConnection *> connections;
+            for( int i = 0; i < nconn; ++i )
+              connections.push_back( pool->getConnection() );
+            for( Dbo::SqlConnection *conn : connections )
+              set_sqlite_pragmas( conn );
+            for( Dbo::SqlConnection *conn : connections )
+              pool->returnConnection( conn );
+          }//end set pragmas on each connection of the pool
+#endif
+          
           m_numconnection.store( nconn, std::memory_order_seq_cst );
           m_pool.reset( pool );
           
@@ -161,6 +201,229 @@ namespace
   
   DbPoolManager DbConnectionPoolManager;
 #endif
+  
+  
+  //DbWriteQueue: the background writer behind DataBaseUtils::queueDbWrite()
+  //  and flushDbWrites().  A single writer thread is used, since SQLite only
+  //  allows one writer at a time anyway, and so that work for the same key is
+  //  always executed in the order it was queued.
+  class DbWriteQueue
+  {
+  public:
+    struct Work
+    {
+      std::shared_ptr<DataBaseUtils::DbSession> sql;
+      std::string key;
+      std::function<void()> work;
+      bool batchable;
+      std::function<void(const std::string &)> onerror;
+      uint64_t sequence;
+    };//struct Work
+    
+    
+    DbWriteQueue()
+      : m_stop( false ),
+        m_lastQueued( 0 ),
+        m_lastCompleted( 0 )
+    {
+    }
+    
+    
+    ~DbWriteQueue()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+      }
+      m_workCondition.notify_all();
+      
+      //The writer drains the queue before exiting
+      if( m_thread.joinable() )
+        m_thread.join();
+    }//~DbWriteQueue()
+    
+    
+    void queue( Work &&work )
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      
+      if( m_stop )
+      {
+        lock.unlock();
+        execute( work );
+        return;
+      }//if( m_stop )
+      
+      work.sequence = ++m_lastQueued;
+      
+      for( Work &pending : m_pending )
+      {
+        if( pending.sql == work.sql && pending.key == work.key )
+        {
+          pending = std::move( work );
+          return;
+        }
+      }//for( Work &pending : m_pending )
+      
+      //Work queued by the writer itself cant wait for the writer.
+      const bool isWriter = (std::this_thread::get_id() == m_thread.get_id());
+      if( !isWriter )
+        m_spaceCondition.wait( lock, [this](){ return m_pending.size() < sm_maxPending; } );
+      
+      m_pending.push_back( std::move(work) );
+      
+      if( !m_thread.joinable() )
+        m_thread = std::thread( &DbWriteQueue::writerLoop, this );
+      
+      lock.unlock();
+      m_workCondition.notify_one();
+    }//void queue( Work &&work )
+    
+    
+    void flush()
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      
+      if( std::this_thread::get_id() == m_thread.get_id() )
+        return;
+      
+      const uint64_t target = m_lastQueued;
+      m_doneCondition.wait( lock, [this,target](){ return m_lastCompleted >= target; } );
+    }//void flush()
+    
+    
+  protected:
+    void writerLoop()
+    {
+      while( true )
+      {
+        vector<Work> work;
+        uint64_t lastSequence = 0;
+        
+        {//begin lock on m_mutex
+          std::unique_lock<std::mutex> lock( m_mutex );
+          m_workCondition.wait( lock, [this](){ return m_stop || !m_pending.empty(); } );
+          
+          if( m_pending.empty() )
+            return;
+          
+          work.swap( m_pending );
+          lastSequence = m_lastQueued;
+        }//end lock on m_mutex
+        
+        m_spaceCondition.notify_all();
+        
+        executeBatches( work );
+        
+        {
+          std::lock_guard<std::mutex> lock( m_mutex );
+          m_lastCompleted = lastSequence;
+        }
+        m_doneCondition.notify_all();
+      }//while( true )
+    }//void writerLoop()
+    
+    
+    //Executes 'work', grouping runs of batchable work of each DbSession into a
+    //  single transaction.  A batch for a DbSession ends at the next
+    //  non-batchable work for that DbSession (or work without a DbSession), so
+    //  work for a DbSession is always executed in queued order; only work for
+    //  different DbSessions may be executed out of order relative to each other.
+    void executeBatches( vector<Work> &work )
+    {
+      vector<bool> done( work.size(), false );
+      
+      for( size_t i = 0; i < work.size(); ++i )
+      {
+        if( done[i] )
+          continue;
+        
+        if( !work[i].batchable || !work[i].sql )
+        {
+          execute( work[i] );
+          done[i] = true;
+          continue;
+        }//if( !work[i].batchable )
+        
+        vector<size_t> batch;
+        for( size_t j = i; j < work.size(); ++j )
+        {
+          if( done[j] )
+            continue;
+          
+          const bool samesql = (work[j].sql == work[i].sql);
+          if( !work[j].sql || (samesql && !work[j].batchable) )
+            break;
+          
+          if( samesql )
+            batch.push_back( j );
+        }//for( size_t j = i; j < work.size(); ++j )
+        
+        for( const size_t j : batch )
+          done[j] = true;
+        
+        if( batch.size() > 1 )
+        {
+          try
+          {
+            DataBaseUtils::DbTransaction transaction( *work[i].sql );
+            for( const size_t j : batch )
+              work[j].work();
+            transaction.commit();
+            continue;
+          }catch( std::exception &e )
+          {
+            cerr << "DbWriteQueue: batch of " << batch.size() << " writes failed ("
+                 << e.what() << "), will retry individually" << endl;
+          }//try / catch
+        }//if( batch.size() > 1 )
+        
+        for( const size_t j : batch )
+          execute( work[j] );
+      }//for( size_t i = 0; i < work.size(); ++i )
+    }//void executeBatches( vector<Work> &work )
+    
+    
+    //Executes a single piece of work; the work creates its own transaction.
+    static void execute( Work &work )
+    {
+      try
+      {
+        work.work();
+      }catch( std::exception &e )
+      {
+        if( work.onerror )
+          work.onerror( e.what() );
+        else
+          cerr << "DbWriteQueue: error writing '" << work.key << "' to database: "
+               << e.what() << endl;
+      }//try / catch
+    }//static void execute( Work &work )
+    
+    
+    static const size_t sm_maxPending = 256;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_workCondition;
+    std::condition_variable m_spaceCondition;
+    std::condition_variable m_doneCondition;
+    
+    bool m_stop;
+    uint64_t m_lastQueued;
+    uint64_t m_lastCompleted;
+    vector<Work> m_pending;
+    std::thread m_thread;
+  };//class DbWriteQueue
+  
+  
+  //Declared after DbConnectionPoolManager so that it is destructed first, and
+  //  pending writes make it to the database before the pool is closed.
+  DbWriteQueue BackgroundDbWriter;
+  
+  //t_numTransactionsHeld: number of DbTransaction's the current thread has
+  //  open; flushDbWrites() cant wait on the writer while this is non-zero, as
+  //  the writer may need the DbSession the transaction has locked.
+  thread_local size_t t_numTransactionsHeld = 0;
 }//namespace
 
 
@@ -172,12 +435,14 @@ DbTransaction::DbTransaction( DbSession &session )
   : m_lock( session.m_mutex )
 {
   m_transaction = new Dbo::Transaction( *(session.m_session) );
+  ++t_numTransactionsHeld;
 }
   
 DbTransaction::~DbTransaction()
 {
   delete m_transaction;
   m_transaction = 0;
+  --t_numTransactionsHeld;
 }
 
 bool DbTransaction::commit()
@@ -301,6 +566,51 @@ Wt::Dbo::Session *DbSession::session()
 }
   
   
+void queueDbWrite( std::shared_ptr<DbSession> sql,
+                   const std::string &key,
+                   std::function<void()> work,
+                   const bool batchable,
+                   std::function<void(const std::string &)> onerror )
+{
+  if( !work )
+    throw runtime_error( "queueDbWrite(): invalid work" );
+  
+  DbWriteQueue::Work w;
+  w.sql = sql;
+  w.key = key;
+  w.work = std::move( work );
+  w.batchable = batchable;
+  w.onerror = std::move( onerror );
+  w.sequence = 0;
+  
+  BackgroundDbWriter.queue( std::move(w) );
+}//void queueDbWrite(...)
+  
+  
+bool flushDbWrites()
+{
+  if( t_numTransactionsHeld )
+  {
+    const char *msg = "flushDbWrites(): called while holding a DbTransaction;"
+                      " pending database writes were NOT flushed.";
+#if( PERFORM_DEVELOPER_CHECKS )
+    log_developer_error( __func__, msg );
+#endif
+    cerr << msg << endl;
+    return false;
+  }//if( t_numTransactionsHeld )
+  
+  BackgroundDbWriter.flush();
+  return true;
+}//bool flushDbWrites()
+  
+  
+bool currentThreadHoldsDbTransaction()
+{
+  return (t_numTransactionsHeld > 0);
+}//bool currentThreadHoldsDbTransaction()
+  
+  
 #if( USE_GLOBAL_DATABASE_CONNECTION_POOL )
 Wt::Dbo::SqlConnectionPool *databaseConnectionPool()
 {
@@ -23,12 +23,14 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <cmath>
 #include <string>
 #include <vector>
 #include <memory>
 #include <iostream>
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <sys/stat.h>
 
 #include <boost/any.hpp>
@@ -398,6 +400,282 @@ public:
 };//class DecayActivityChart
 
 
+/** Evaluates the activity of every nuclide in a SandiaDecay::NuclideMixture at
+ many times.
+ 
+ The Bateman solution for each nuclide is a sum of exponentials of the decay
+ constants in its chain, and these exponentials are shared between all the
+ nuclides of a mixture.  So the coefficients are extracted from the mixture
+ once, and then for each time each unique exponential is only computed once,
+ with each nuclides activity then being a short dot-product.
+ 
+ Only nuclides with a finite half-life are included.
+ */
+class DecayCurveEngine
+{
+public:
+  explicit DecayCurveEngine( const SandiaDecay::NuclideMixture &mixture )
+  {
+    const vector<SandiaDecay::NuclideTimeEvolution> &evolutions
+                                         = mixture.decayedToNuclidesEvolutions();
+    
+    map<double,size_t> exponent_index;
+    
+    for( const SandiaDecay::NuclideTimeEvolution &evo : evolutions )
+    {
+      if( !evo.nuclide || IsInf(evo.nuclide->halfLife) || IsNan(evo.nuclide->halfLife) )
+        continue;
+      
+      const double lambda = evo.nuclide->decayConstant();
+      
+      vector<Term> terms;
+      for( const SandiaDecay::TimeEvolutionTerm &term : evo.evolutionTerms )
+      {
+        auto pos = exponent_index.find( term.exponentialCoeff );
+        if( pos == end(exponent_index) )
+        {
+          pos = exponent_index.insert( make_pair(term.exponentialCoeff, m_exponents.size()) ).first;
+          m_exponents.push_back( term.exponentialCoeff );
+        }
+        
+        Term t;
+        t.exponent = pos->second;
+        t.coef = lambda * term.termCoeff;
+        terms.push_back( t );
+      }//for( loop over evolution terms )
+      
+      m_nuclides.push_back( evo.nuclide );
+      m_terms.push_back( terms );
+    }//for( loop over evolutions )
+  }//DecayCurveEngine constructor
+  
+  
+  size_t numNuclides() const { return m_nuclides.size(); }
+  
+  const SandiaDecay::Nuclide *nuclide( const size_t index ) const
+  {
+    return m_nuclides.at( index );
+  }
+  
+  
+  /** Fills 'answer' with the activity of each nuclide, at each time; indexed
+   like answer[nuclide][time].
+   */
+  void activities( const vector<double> &times, vector<vector<double>> &answer ) const
+  {
+    const size_t nnuc = m_nuclides.size();
+    const size_t ntimes = times.size();
+    
+    answer.resize( nnuc );
+    for( vector<double> &a : answer )
+      a.resize( ntimes );
+    
+    vector<double> exps( m_exponents.size() );
+    for( size_t t = 0; t < ntimes; ++t )
+    {
+      evalExponentials( times[t], exps );
+      for( size_t n = 0; n < nnuc; ++n )
+        answer[n][t] = nuclideActivity( n, exps );
+    }
+  }//void activities(...)
+  
+  
+  double totalActivity( const double time ) const
+  {
+    vector<double> exps( m_exponents.size() );
+    evalExponentials( time, exps );
+    
+    double total = 0.0;
+    for( size_t n = 0; n < m_nuclides.size(); ++n )
+      total += nuclideActivity( n, exps );
+    return total;
+  }//double totalActivity( const double time ) const
+  
+  
+  /** Returns times to evaluate the curves at, between zero and 'endTime'.
+   
+   There will be 'nbase' evenly spaced times (starting at zero, with spacing
+   endTime/nbase), with up to 'nbase' more added by subdividing intervals where
+   any nuclides activity changes by more than a couple percent of its maximum,
+   so short lived nuclides, or fast ingrowth, still show up smoothly.
+   */
+  vector<double> sampleTimes( const double endTime, const size_t nbase ) const
+  {
+    vector<double> times;
+    if( nbase < 1 || endTime <= 0.0 )
+      return times;
+    
+    const double dt = endTime / nbase;
+    for( size_t i = 0; i < nbase; ++i )
+      times.push_back( i*dt );
+    
+    const size_t nnuc = m_nuclides.size();
+    if( nbase < 2 || !nnuc )
+      return times;
+    
+    vector<vector<double>> base;
+    activities( times, base );
+    
+    vector<double> maxact( nnuc, 0.0 );
+    for( size_t n = 0; n < nnuc; ++n )
+      maxact[n] = *std::max_element( begin(base[n]), end(base[n]) );
+    
+    const double max_frac_change = 0.02;
+    const int max_depth = 10;
+    size_t nextra = 0;
+    
+    vector<double> exps( m_exponents.size() ), lower( nnuc ), upper( nnuc ), mid( nnuc );
+    
+    std::function<void(double,double,const vector<double>&,const vector<double>&,int)> refine;
+    refine = [&]( const double t0, const double t1, const vector<double> &a0,
+                  const vector<double> &a1, const int depth ){
+      if( depth >= max_depth || nextra >= nbase )
+        return;
+      
+      bool fast = false;
+      for( size_t n = 0; !fast && n < nnuc; ++n )
+        fast = (fabs(a1[n] - a0[n]) > max_frac_change*maxact[n]);
+      if( !fast )
+        return;
+      
+      const double tmid = 0.5*(t0 + t1);
+      vector<double> amid( nnuc );
+      evalExponentials( tmid, exps );
+      for( size_t n = 0; n < nnuc; ++n )
+        amid[n] = nuclideActivity( n, exps );
+      
+      times.push_back( tmid );
+      ++nextra;
+      
+      refine( t0, tmid, a0, amid, depth + 1 );
+      refine( tmid, t1, amid, a1, depth + 1 );
+    };//refine lambda
+    
+    for( size_t i = 1; i < nbase; ++i )
+    {
+      for( size_t n = 0; n < nnuc; ++n )
+      {
+        lower[n] = base[n][i-1];
+        upper[n] = base[n][i];
+      }
+      refine( (i-1)*dt, i*dt, lower, upper, 0 );
+    }//for( loop over base intervals )
+    
+    std::sort( begin(times), end(times) );
+    
+    return times;
+  }//vector<double> sampleTimes(...)
+  
+  
+  /** Finds the first time, after 'startTime', where the total activity falls to
+   'fracOfT0' of the activity at time zero, by stepping forward until the
+   fraction is crossed, and then bisecting.
+   
+   If 'startTime' and 'endTime' are not both specified, steps are half the
+   longest half-life in the mixture.
+   */
+  double timeForActivityFrac( const double fracOfT0, const double startTime,
+                              const double endTime ) const
+  {
+    const double epsilon = fracOfT0 * 0.01;
+    
+    double maxHalfLife = 0.0;
+    for( const SandiaDecay::Nuclide *nuc : m_nuclides )
+      maxHalfLife = max( maxHalfLife, nuc->halfLife );
+    
+    const double initialActivty = totalActivity( 0.0 );
+    
+    if( initialActivty == 0.0 )
+      return 0.0;
+    
+    const bool ranged = ( (startTime >= 0.0) && (endTime > 0.0) );
+    const double dt = ( ranged  ? (endTime-startTime)/10.0 : maxHalfLife/2.0 );
+    const double startT = ( ranged ? startTime : 0.0 );
+    
+    int iteration = 0;
+    double frac = 1.0, time = startT, lastTime = startT;
+    
+    while( iteration++ < 5000000 )
+    {
+      frac = totalActivity( time ) / initialActivty;
+      
+      if( fabs( frac - fracOfT0 ) < epsilon )
+        return time;
+      
+      if( frac <= fracOfT0 )
+        break;
+      
+      lastTime = time;
+      time += dt;
+    }//while( frac > fracOfT0 )
+    
+    if( frac > fracOfT0 )
+    {
+      //I doubt we will ever make it here, but just incase put a message in the
+      //  log file, and return an invalid time
+      cerr << "DecayCurveEngine::timeForActivityFrac(...): couldnt find the"
+           << " time to end showing graph; searched "
+           << (startT+iteration*dt)/second << " seconds at a dt=" << dt/second
+           << endl;
+      return -1.0;
+    }//if( frac > fracOfT0 )
+    
+    if( time == startT )
+    {
+      cerr << "DecayCurveEngine::timeForActivityFrac(...): Error, the start"
+           << " time (=" << startTime << ") already has an  activity of "
+           << frac << " times original activity" << endl;
+      return time; //not throwing; maybe the caller to this function got lucky
+    }//if( time == startT )
+    
+    //Bisect between the last time above the wanted fraction, and the first
+    //  one below it.
+    double lowTime = lastTime, highTime = time;
+    for( int i = 0; i < 200; ++i )
+    {
+      time = 0.5*(lowTime + highTime);
+      frac = totalActivity( time ) / initialActivty;
+      
+      if( fabs( frac - fracOfT0 ) < epsilon )
+        break;
+      
+      if( frac > fracOfT0 )
+        lowTime = time;
+      else
+        highTime = time;
+    }//for( bisect )
+    
+    return time;
+  }//double timeForActivityFrac(...)
+  
+  
+protected:
+  void evalExponentials( const double time, vector<double> &exps ) const
+  {
+    for( size_t i = 0; i < m_exponents.size(); ++i )
+      exps[i] = exp( -m_exponents[i] * time );
+  }
+  
+  double nuclideActivity( const size_t index, const vector<double> &exps ) const
+  {
+    double activity = 0.0;
+    for( const Term &t : m_terms[index] )
+      activity += t.coef * exps[t.exponent];
+    return activity;
+  }
+  
+  struct Term
+  {
+    size_t exponent;  //index into m_exponents
+    double coef;      //Bateman coefficient times the nuclides decay constant
+  };
+  
+  vector<const SandiaDecay::Nuclide *> m_nuclides;
+  vector<double> m_exponents;
+  vector<vector<Term>> m_terms;
+};//class DecayCurveEngine
+
+
 
 
 class DateLengthCalculator : public WContainerWidget
@@ -1251,7 +1529,9 @@ DecayActivityDiv::DecayActivityDiv( InterSpec *viewer, Wt::WContainerWidget *par
   m_currentNumXPoints( 250 ),
   m_width( -1 ),
   m_height( -1 ),
-  m_currentMixture( new SandiaDecay::NuclideMixture() )
+  m_currentMixture( new SandiaDecay::NuclideMixture() ),
+  m_decayEngine( nullptr ),
+  m_currentMixtureSignature()
 {
   addStyleClass( "DecayActivityDiv" );
   setLayoutSizeAware( true );
@@ -1958,6 +2238,17 @@ void DecayActivityDiv::updateInitialMixture() const
   using SandiaDecay::NuclideNumAtomsPair;
   const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
 
+  //If the nuclides havent changed since the last time, we can keep the
+  //  mixture (and its already computed decay solution) and decay curves.
+  stringstream signature;
+  signature << setprecision(17);
+  for( const Nuclide &nuc : m_nuclides )
+    signature << nuc.z << "," << nuc.a << "," << nuc.iso << ","
+              << nuc.age << "," << nuc.activity << ";";
+  
+  if( m_decayEngine && (signature.str() == m_currentMixtureSignature) )
+    return;
+  
   m_currentMixture->clear();
 
   for( const Nuclide &nuc : m_nuclides )
@@ -1970,6 +2261,9 @@ void DecayActivityDiv::updateInitialMixture() const
     else
       m_currentMixture->addNuclideByActivity( dbnuclide, activity );
   }//for( each m_nuclides )
+  
+  m_decayEngine.reset( new DecayCurveEngine( *m_currentMixture ) );
+  m_currentMixtureSignature = signature.str();
 }//void updateInitialMixture()
 
 
@@ -1979,11 +2273,6 @@ double DecayActivityDiv::findTimeForActivityFrac(
                                     const double startTime,
                                     const double endTime )
 {
-  //TODO 20110325: This function should be broken up, it is a little long
-  //
-
-  const double epsilon = fracOfT0 * 0.01;
-
   if( (fracOfT0 <= 0.0) || (fracOfT0>1.0) || (startTime > endTime) )
   {
     stringstream msg;
@@ -1992,69 +2281,9 @@ double DecayActivityDiv::findTimeForActivityFrac(
     throw std::runtime_error( msg.str() );
   }//if( invalid input )
 
-  const std::vector<SandiaDecay::NuclideTimeEvolution> &
-                           evolutions = mixture->decayedToNuclidesEvolutions();
-
-  double maxHalfLife = 0.0;
-
-  for( size_t i = 0; i < evolutions.size(); ++i )
-  {
-    const double halfLife = evolutions[i].nuclide->halfLife;
-    if( !IsInf(halfLife) && !IsNan(halfLife) )
-      maxHalfLife = max( maxHalfLife, halfLife );
-  }//for( loop over nuclides )
-
-
-  const double initialActivty = mixture->totalActivity(0.0);
-
-  if( initialActivty == 0.0 )
-    return 0.0;
-
-  const bool ranged = ( (startTime >= 0.0) && (endTime > 0.0) );
-  const double dt = ( ranged  ? (endTime-startTime)/10.0 : maxHalfLife/2.0 );
-  const double startT = ( ranged ? startTime : 0.0 );
-
-  int iteration = 0;
-  double frac = 1.0, time = startT, lastTime = startT;
-
-  while( frac > fracOfT0 && (iteration++ < 5000000) )
-  {
-    const double activity = mixture->totalActivity( time  );
-    frac = activity / initialActivty;
-
-    if( abs( frac - fracOfT0 ) < epsilon )
-      return time;
-
-    if( frac <= fracOfT0 )
-    {
-      if( time == startT )//shouldnt ever happen
-      {
-        stringstream msg;
-        msg << "DecayActivityDiv::findTimeForActivityFrac(...): Error, the start"
-            << " time (=" << startTime << ") already has an  activity of "
-            << frac << " times original activity";
-        cerr << msg.str() << endl;    // throw std::runtime_error( msg );
-        return time; //not throwing; maybe the caller to this function got lucky
-      }//if( time == startT )
-
-      //need to recursively search between the last time range and this one
-      return findTimeForActivityFrac( mixture, fracOfT0, lastTime, time );
-    }//if( frac < fracOfT0 )
-
-    lastTime = time;
-    time += dt;
-  }//while( frac > fracOfT0 )
-
-  //I doubt we will ever make it here, but just incase put a message in the
-  //  apache log file, and return an invalid time
-  stringstream msg;
-  msg << "DecayActivityDiv::findTimeForActivityFrac(...):"
-      << " couldnt find the time to end showing graph; searched "
-     << (startT+iteration*dt)/second << " seconds at a dt=" << dt/second;
-
-  cerr << msg.str() << endl;
-
-  return -1.0;
+  const DecayCurveEngine engine( *mixture );
+  
+  return engine.timeForActivityFrac( fracOfT0, startTime, endTime );
 }//double findTimeForActivityFrac(...)
 
 
@@ -2763,31 +2992,21 @@ void DecayActivityDiv::refreshDecayDisplay()
   //Grab if we should show the nuclides before clearing the model.
   //  Note that the very first and very last column no not contain nuclide info
   map<string,bool> oldShowNuclide;
+  vector<string> oldNuclideColumns;
   for( int column = 0; column < m_decayModel->columnCount(); ++column )
   {
     const string nuc = m_decayModel->nuclide(column);
-    cout << "Nuc:'" << nuc << "'=" << m_decayModel->showSeries( column ) << endl;
     if( nuc != "" )
-      oldShowNuclide[m_decayModel->nuclide(column)] = m_decayModel->showSeries( column );
+    {
+      oldShowNuclide[nuc] = m_decayModel->showSeries( column );
+      oldNuclideColumns.push_back( nuc );
+    }
   }
   
   m_currentNumXPoints = m_decayChart->paintedWidth() / 2;
-  
-  //Remove the series from last time, and reset the model
-#if( WT_VERSION >= 0x3030800 )
-  const std::vector<Wt::Chart::WDataSeries *> &series = m_decayChart->series();
-  for( size_t i = 0; i < series.size(); ++i )
-    m_decayChart->removeSeries( series[i]->modelColumn() );
-#else
-  const std::vector<Wt::Chart::WDataSeries> &series = m_decayChart->series();
-  for( size_t i = 0; i < series.size(); ++i )
-    m_decayChart->removeSeries( series[i].modelColumn() );
-#endif
-  
-  m_decayModel->clear();
   m_currentTimeUnits  = -1.0;
   m_currentTimeRange  = -1.0;
-
+  
   updateInitialMixture();
 
 #if( ADD_PHOTOPEAK_CHART )
@@ -2795,6 +3014,37 @@ void DecayActivityDiv::refreshDecayDisplay()
   refreshPhotopeakDisplay();
 #endif
   
+  const double maxDiplayTime = m_nuclides.empty() ? 0.0 : timeToDisplayTill();
+  
+  const DecayCurveEngine &engine = *m_decayEngine;
+  const int nElements = static_cast<int>( engine.numNuclides() );
+  
+  //If we are showing the same nuclides as before (e.g., only the time range,
+  //  units, or a nuclides activity has changed), we will update the model in
+  //  place, rather than tearing down and re-creating all the chart series and
+  //  legend entries.
+  bool sameColumns = (maxDiplayTime > 0.0)
+                     && (m_decayModel->columnCount() == (nElements + 2))
+                     && (oldNuclideColumns.size() == static_cast<size_t>(nElements));
+  for( int elN = 0; sameColumns && (elN < nElements); ++elN )
+    sameColumns = (oldNuclideColumns[elN] == engine.nuclide(elN)->symbol);
+  
+  if( !sameColumns )
+  {
+    //Remove the series from last time, and reset the model
+#if( WT_VERSION >= 0x3030800 )
+    const std::vector<Wt::Chart::WDataSeries *> &series = m_decayChart->series();
+    for( size_t i = 0; i < series.size(); ++i )
+      m_decayChart->removeSeries( series[i]->modelColumn() );
+#else
+    const std::vector<Wt::Chart::WDataSeries> &series = m_decayChart->series();
+    for( size_t i = 0; i < series.size(); ++i )
+      m_decayChart->removeSeries( series[i].modelColumn() );
+#endif
+    
+    m_decayModel->clear();
+  }//if( !sameColumns )
+  
   if( m_nuclides.empty() )
   {
     m_decayLegend->clear();
@@ -2815,10 +3065,9 @@ void DecayActivityDiv::refreshDecayDisplay()
   }else
   {
     unitStr = "I0";
-    actunit = m_currentMixture->totalActivity(0.0);
+    actunit = engine.totalActivity(0.0);
   }//if( user selected a standard unit ) / else
 
-  const double maxDiplayTime = timeToDisplayTill();
 //  const double endActivity = m_currentMixture->totalActivity( maxDiplayTime );
   
   const YAxisType yaxis = YAxisType( m_yAxisType->currentIndex() );
@@ -2841,23 +3090,57 @@ void DecayActivityDiv::refreshDecayDisplay()
   if( maxDiplayTime <= 0.0 )
     return;
  
-
+  //Evaluate all the nuclides at all the times in one go; more points are put
+  //  where activities change quickly.
+  const vector<double> times = engine.sampleTimes( maxDiplayTime,
+                                     static_cast<size_t>( max(m_currentNumXPoints,2) ) );
+  vector<vector<double>> activities;
+  engine.activities( times, activities );
   
-  const int nRows = m_currentNumXPoints;
-  const vector<SandiaDecay::NuclideTimeEvolution> &origEvolutions
-                              = m_currentMixture->decayedToNuclidesEvolutions();
-  vector<SandiaDecay::NuclideTimeEvolution> evolutions;
-  for( const SandiaDecay::NuclideTimeEvolution &evo : origEvolutions )
+  //The number of particles of the type being displayed, per decay, of each
+  //  nuclide, so we can just multiply activities by these.
+  vector<double> yvalPerActivity( nElements, 1.0/actunit );
+  if( yaxis != ActivityAxis )
   {
-    if( evo.nuclide && !IsInf(evo.nuclide->halfLife) && !IsNan( evo.nuclide->halfLife ) )
-      evolutions.push_back( evo );
-  }//for( const SandiaDecay::NuclideTimeEvolution &evo : origEvolutions )
+    SandiaDecay::ProductType particletype = SandiaDecay::GammaParticle;
+    
+    switch( yaxis )
+    {
+      case ActivityAxis:  case NumYAxisType:                         break;
+      case GammasAxis:    particletype = SandiaDecay::GammaParticle; break;
+      case BetasAxis:     particletype = SandiaDecay::BetaParticle;  break;
+      case AlphasAxis:    particletype = SandiaDecay::AlphaParticle; break;
+    }//switch( yaxis )
+    
+    for( int elN = 0; elN < nElements; ++elN )
+    {
+      double nperdecay = 0.0;
+      for( const SandiaDecay::Transition *trans : engine.nuclide(elN)->decaysToChildren )
+      {
+        for( const SandiaDecay::RadParticle &particle : trans->products )
+        {
+          if( particle.type == particletype )
+            nperdecay += trans->branchRatio * particle.intensity;
+        }
+      }//for( const SandiaDecay::Transition *trans : decays )
+      
+      yvalPerActivity[elN] = nperdecay / SandiaDecay::becquerel;
+    }//for( int elN = 0; elN < nElements; ++elN )
+  }//if( yaxis != ActivityAxis )
   
-  const int nElements = static_cast<int>( evolutions.size() );
+  const int nRows = static_cast<int>( times.size() );
 
-  const double dt = maxDiplayTime / nRows;
-  m_decayModel->insertColumns( 0, nElements + 2 );
-  m_decayModel->insertRows( 0, nRows );
+  if( !sameColumns )
+  {
+    m_decayModel->insertColumns( 0, nElements + 2 );
+    m_decayModel->insertRows( 0, nRows );
+  }else if( m_decayModel->rowCount() < nRows )
+  {
+    m_decayModel->insertRows( m_decayModel->rowCount(), nRows - m_decayModel->rowCount() );
+  }else if( m_decayModel->rowCount() > nRows )
+  {
+    m_decayModel->removeRows( nRows, m_decayModel->rowCount() - nRows );
+  }//if( new model ) / else adjust number of rows
 
   double maxActivity = 0.0, minActivity = DBL_MAX;
   vector<double> totalActivities( nRows, 0.0 );
@@ -2872,49 +3155,26 @@ void DecayActivityDiv::refreshDecayDisplay()
   
   for( int row = 0; row < nRows; ++row )
   {
-    const double row_time = (row * dt);
+    const double row_time = times[row];
 
     //We will set the x-axis data as a formatted string since
     //  WAxis::setLabelFormat( "%.3g" ); doesnt seem to work
     stringstream labelText;
-    labelText << fixed << setprecision(3) << (row * dt)/tunit;
+    labelText << setprecision(6) << row_time/tunit;
     const WString label( labelText.str() );
     m_decayModel->setData( row, 0, boost::any( label ) );
 
     for( int elN = 0; elN < nElements; ++elN )
     {
       const int column = elN + 1;
-      double yval = 0;
-      double activity = evolutions[elN].activity(row_time);
-
-      if( yaxis == ActivityAxis )
-      {
-        yval = activity / actunit;
-      }else
-      {
-        SandiaDecay::ProductType particletype = SandiaDecay::GammaParticle;
-        
-        switch( yaxis )
-        {
-          case ActivityAxis:  case NumYAxisType:                         break;
-          case GammasAxis:    particletype = SandiaDecay::GammaParticle; break;
-          case BetasAxis:     particletype = SandiaDecay::BetaParticle;  break;
-          case AlphasAxis:    particletype = SandiaDecay::AlphaParticle; break;
-        }//switch( yaxis )
-        
-        activity /= SandiaDecay::becquerel;
-        for( const SandiaDecay::Transition *trans : evolutions[elN].nuclide->decaysToChildren )
-        {
-          for( const SandiaDecay::RadParticle &particle : trans->products )
-          {
-            if( particle.type == particletype )
-              yval += activity * trans->branchRatio * particle.intensity;
-          }
-        }//for( const SandiaDecay::Transition *trans : decays )
-      }//if( yaxis == ActivityAxis ) / else
+      const double yval = activities[elN][row] * yvalPerActivity[elN];
 
       if( yval==0.0 || IsInf(yval) || IsNan(yval) )
+      {
+        if( sameColumns )
+          m_decayModel->setData( row, column, boost::any() );
         continue;
+      }
 
       totalActivities[row] += yval;
       maxActivity = std::max( maxActivity, yval );
@@ -2932,13 +3192,16 @@ void DecayActivityDiv::refreshDecayDisplay()
   const WString dateHeader = "Date (" + xUnitsPair.first + ")";
   m_decayModel->setHeaderData( 0, boost::any( dateHeader ) );
 
-  for( int column = 1; column <= nElements; ++column )
+  if( !sameColumns )
   {
-    const WString name = evolutions[column-1].nuclide->symbol;
-    m_decayModel->setNuclide( column, evolutions[column-1].nuclide->symbol ); //duplicating lots here
-    m_decayModel->setHeaderData( column, boost::any( name ) );
-    m_decayModel->setHeaderData( column, Wt::Horizontal, true, Wt::UserRole );
-  }//for( int column = 0; column < nElements; ++column )
+    for( int column = 1; column <= nElements; ++column )
+    {
+      const WString name = engine.nuclide(column-1)->symbol;
+      m_decayModel->setNuclide( column, engine.nuclide(column-1)->symbol ); //duplicating lots here
+      m_decayModel->setHeaderData( column, boost::any( name ) );
+      m_decayModel->setHeaderData( column, Wt::Horizontal, true, Wt::UserRole );
+    }//for( int column = 0; column < nElements; ++column )
+  }//if( !sameColumns )
 
   //Add columns to the chart, and set their header data
   for( int row = 0; row < nRows; ++row )
@@ -2976,35 +3239,37 @@ void DecayActivityDiv::refreshDecayDisplay()
   }//switch( yaxis )
   
   
-  m_decayModel->setHeaderData( nElements+1, Wt::Horizontal,
-                                 boost::any(showsum), Wt::UserRole );
-  std::vector<string> nuclidesset;
-  for( int column = 1; column <= nElements; ++column )
+  if( !sameColumns )
   {
-    //nuclide also containted in m_decayModel->headerData(column, Wt::Horizontal, Wt::UserRole);
-    const string name = evolutions[column-1].nuclide->symbol;
-    nuclidesset.push_back( name );
-  }
-  
-  //Now check if we have the same nuclides as before, and if so, set the
-  //  visability properties for each of the nuclides charts to be the same
-  //  as before.
-  bool sameNuclides = (nuclidesset.size() == oldShowNuclide.size());
-  for( const string &n : nuclidesset )
-    sameNuclides = (sameNuclides && (oldShowNuclide.count(n)>0));
-  
-  if( sameNuclides )
-  {
-    for( int column = 0; column < m_decayModel->columnCount(); ++column )
+    m_decayModel->setHeaderData( nElements+1, Wt::Horizontal,
+                                   boost::any(showsum), Wt::UserRole );
+    std::vector<string> nuclidesset;
+    for( int column = 1; column <= nElements; ++column )
     {
-      string nuc = m_decayModel->nuclide(column);
-      if( nuc != "" )
-        m_decayModel->setShowSeries( column, oldShowNuclide[nuc] );
+      //nuclide also containted in m_decayModel->headerData(column, Wt::Horizontal, Wt::UserRole);
+      const string name = engine.nuclide(column-1)->symbol;
+      nuclidesset.push_back( name );
     }
-  }//if( sameNuclides )
-  
-  
-  addDecaySeries();
+    
+    //Now check if we have the same nuclides as before, and if so, set the
+    //  visability properties for each of the nuclides charts to be the same
+    //  as before.
+    bool sameNuclides = (nuclidesset.size() == oldShowNuclide.size());
+    for( const string &n : nuclidesset )
+      sameNuclides = (sameNuclides && (oldShowNuclide.count(n)>0));
+    
+    if( sameNuclides )
+    {
+      for( int column = 0; column < m_decayModel->columnCount(); ++column )
+      {
+        string nuc = m_decayModel->nuclide(column);
+        if( nuc != "" )
+          m_decayModel->setShowSeries( column, oldShowNuclide[nuc] );
+      }
+    }//if( sameNuclides )
+    
+    addDecaySeries();
+  }//if( !sameColumns )
   
   /*
   {//begin section to add interactive areas
@@ -75,7 +75,7 @@
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/DataBaseUtils.h"
 #include "InterSpec/WarningWidget.h"
-#include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "InterSpec/SpectraFileModel.h"
 #include "SpecUtils/UtilityFunctions.h"
@@ -1464,7 +1464,7 @@ void GadrasDirectory::initDetectors()
     const vector<string> dirs = recursive_list_gadras_drfs( basedir );
     std::vector<std::shared_ptr<DetectorPeakResponse> > dets( dirs.size(), nullptr );
     
-    SpecUtilsAsync::ThreadPool pool;
+    ComputeScheduler::TaskGroup pool;
     for( size_t i = 0; i < dirs.size(); ++i )
       pool.post( [i,&dets,&dirs](){ dets[i] = GadrasDirectory::parseDetector( dirs[i] ); } );
     pool.join();
@@ -1483,9 +1483,8 @@ void GadrasDirectory::initDetectors()
   };//searchpaths lamda
   
   
-  Wt::WServer *server = Wt::WServer::instance();
-  Wt::WIOService &io = server->ioService();
-  io.post( searchpaths );
+  ComputeScheduler::instance().post( sessid, searchpaths,
+                                     ComputeScheduler::Priority::Normal );
 }//void initDetectors()
 
 
@@ -150,37 +150,23 @@ namespace DoseCalc
     
     const double areal_density_g_cm2 = ad*PhysicalUnits::cm2/PhysicalUnits::g;
     
+    //Compute the continuum from all lines at once, so the scatter table only
+    //  gets interpolated for the shielding a single time.
+    const float hydrogen_frac_ad = 0.0f;
+    vector<float> uncollided;
+    scatter.addContinuum( continuum, uncollided, energies, intensity,
+                          an, areal_density_g_cm2, hydrogen_frac_ad,
+                          energy_groups );
+    assert( uncollided.size() == energies.size() );
+    
+    //Add in the dose from the uncoloided gammas, pre geom factor
     double dose_nonscatter = 0.0f;
-    vector< pair<float,float> > uncollided_lines;
-    
     for( size_t energyInd = 0; energyInd < energies.size(); ++energyInd )
-    {
-      const float energy = energies[energyInd];
-      const float I_0 = intensity[energyInd];
-//      const double mu = MassAttenuation::massAttenuationCoeficientFracAN( an, energy );
-//      const double transmittion = exp( -mu * areal_density );
-      
-      const float hydrogen_frac_ad = 0.0f;
-      vector<float> thiscontinuum;
-      const float uncollided
-             = scatter.getContinuum( thiscontinuum, energy, I_0,
-                                     an, areal_density_g_cm2, hydrogen_frac_ad,
-                                     energy_groups );
-      
-      uncollided_lines.push_back( make_pair(energy, uncollided) ) ;
-      
-      assert( thiscontinuum.size() == energy_groups.size() );
-      assert( continuum.size() == thiscontinuum.size() );
-      
-      //Add in the dose from the uncoloided gamma, pre geom factor
-      dose_nonscatter += uncollided * gamma_dose( energy );
-      
-      if( ad > 0 )
-      {
-        for( size_t i = 0; i < thiscontinuum.size(); ++i )
-          continuum[i] += thiscontinuum[i];
-      }
-    }//for( size_t energyGroup = 0; energyGroup < energies.size(); ++energyGroup )
+      dose_nonscatter += uncollided[energyInd] * gamma_dose( energies[energyInd] );
+    
+    //If there is no shielding, the continuum is negligible, and not included
+    if( ad <= 0 )
+      std::fill( continuum.begin(), continuum.end(), 0.0 );
     
     if( false )
     {//begin write a debug output...
@@ -190,12 +176,11 @@ namespace DoseCalc
       vector<double> specoutput = continuum;
       
 //      for( size_t i = 0; i < energies.size(); ++i )
-      for( size_t i = 0; i < uncollided_lines.size(); ++i )
+      for( size_t i = 0; i < uncollided.size(); ++i )
       {
 //        const double mu = MassAttenuation::massAttenuationCoeficient( (int)atomic_number, energies[i] );
-        const double uncollided_intensity = uncollided_lines[i].second; //intensity[i] * exp( -mu * areal_density );
-//        const size_t pos = std::lower_bound( energy_groups.begin(), energy_groups.end(), energies[i] ) - energy_groups.begin();
-        const size_t pos = std::lower_bound( energy_groups.begin(), energy_groups.end(), uncollided_lines[i].first ) - energy_groups.begin();
+        const double uncollided_intensity = uncollided[i]; //intensity[i] * exp( -mu * areal_density );
+        const size_t pos = std::lower_bound( energy_groups.begin(), energy_groups.end(), energies[i] ) - energy_groups.begin();
         specoutput[pos] += uncollided_intensity;
       }//for( size_t i = 0; i < energies.size(); ++i )
       
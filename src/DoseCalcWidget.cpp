@@ -69,6 +69,7 @@
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/ResourceRegistry.h"
 #include "InterSpec/DoseCalcWidget.h"
 #include "InterSpec/GadrasSpecFunc.h"
 #include "SpecUtils/UtilityFunctions.h"
@@ -771,9 +772,7 @@ void DoseCalcWidget::init()
   
   try
   {
-    string continuumData = UtilityFunctions::append_path( InterSpec::staticDataDirectory(), "GadrasContinuum.lib" );
-    
-    m_scatter.reset( new GadrasScatterTable( continuumData ) );
+    m_scatter = ResourceRegistry::gadrasScatterTable();
   }catch( std::exception &e )
   {
     WString msg = "<div><b>Error iniitalizing resources:</b></div><div>";
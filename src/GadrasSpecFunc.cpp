@@ -24,6 +24,7 @@
 #include "InterSpec_config.h"
 
 #include <cmath>
+#include <assert.h>
 #include <string>
 #include <vector>
 #include <fstream>
@@ -131,49 +132,17 @@ GadrasScatterTable::~GadrasScatterTable()
 }
 
 
-float GadrasScatterTable::getContinuum( std::vector<float> &answer,
-                                       const float sourceEnergy,
-                                       const float sourceIntensity,
-                                       const float atomicNumber,
-                                       const float arealDensity,
-                                       const float fracHydrogen,
-                                       const std::vector<float> &output_binning ) const
+void GadrasScatterTable::interpolateShielding( ShieldingInterpolation &interp,
+                                               const float atomicNumber,
+                                               const float arealDensity,
+                                               const float fracHydrogen ) const
 {
-  const float energyMesh[sm_num_input_energy] = { 60.0f, 87.0f, 89.0f, 115.0f, 116.0f, 121.0f, 122.0f, 200.0f, 300.0f, 400.0f, 600.0f, 1000.0f, 1600.0f, 2600.0f, 4000.0f, 9000.0f };
   const float anMesh[sm_num_atomic_number] = { 5.28f, 13.0f, 26.0f, 82.0f, 92.0f, 94.0f }; // J (PE,Al,Fe,Pb,U,Pu)
   const float adMesh[sm_num_areal_density] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f, 128.0f, 256.0f };
-
-  answer.resize( output_binning.size() );
-  for( size_t i = 0; i < output_binning.size(); ++i )
-    answer[i] = 0.0f;
-  
-  
-//Greg T. C# translation used the following to find i
-//  int i = 6;
-//  for( i = 6; i && (energyMesh[i] > sourceEnergy); --i ){}
-
-  int i;
-  if( sourceEnergy < 88.04f ) // Pb K-edge
-		i = 0;
-  else if( sourceEnergy < 115.5f ) // U K-edge
-		i = 2;
-  else if( sourceEnergy < 121.8f ) // Pu K-edge
-		i = 4;
-  else
-  {
-    i = sm_num_input_energy - 2;
-    
-    while( energyMesh[i] > sourceEnergy )
-    {
-      i -= 1;
-      if( i == 6 )
-        break;
-    }
-  }
-  
-  const int ip = i + 1;
-  const float fi = std::max( 0.0f, (sourceEnergy-energyMesh[i])/(energyMesh[ip]-energyMesh[i]) );
   
+  interp.atomicNumber = atomicNumber;
+  interp.arealDensity = arealDensity;
+  interp.fracHydrogen = fracHydrogen;
   
 //Greg T. C# translation used the following to find j
 //  int j = 3;
@@ -220,32 +189,25 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   else
     fk = arealDensity / adMesh[kp];
 
-  const float ri = 1.0f - fi;
   const float rj = 1.0f - fj;
   const float rk = 1.0f - fk;
   
-  vector<float> f( 32 );
-  // get the flux distribution by matrix interpolation.
-  if( k == -1 )
+  // get the flux distribution by matrix interpolation; the incomming energy
+  //  interpolation is left for lineContinuum(...).
+  for( int i = 0; i < sm_num_input_energy; ++i )
   {
-    //No shielding
-    for (int l = 0; l < 32; ++l)
+    if( k == -1 )
     {
-      f[l] = fk*(ri*(rj*m_data[kp][j][i][l] + fj*m_data[kp][jp][i][l]) +
-                 fi*(rj*m_data[kp][j][ip][l] + fj*m_data[kp][jp][ip][l]));
-      f[l] = max( 0.0f, f[l] );
-    }
-  }else
-  {
-    for( int l = 0; l < 32; ++l )
+      //No shielding
+      for( int l = 0; l < sm_num_out_energy; ++l )
+        interp.data[i][l] = fk*(rj*m_data[kp][j][i][l] + fj*m_data[kp][jp][i][l]);
+    }else
     {
-      f[l] = ri*(rj*(rk*m_data[k][j][i][l] + fk*m_data[kp][j][i][l]) +
-                 fj*(rk*m_data[k][jp][i][l] + fk*m_data[kp][jp][i][l]))
-            + fi*(rj*(rk*m_data[k][j][ip][l] + fk*m_data[kp][j][ip][l]) +
-               fj*(rk*m_data[k][jp][ip][l] + fk*m_data[kp][jp][ip][l]));
-      f[l] = std::max( 0.0f, f[l] );
+      for( int l = 0; l < sm_num_out_energy; ++l )
+        interp.data[i][l] = rj*(rk*m_data[k][j][i][l] + fk*m_data[kp][j][i][l])
+                            + fj*(rk*m_data[k][jp][i][l] + fk*m_data[kp][jp][i][l]);
     }
-  }
+  }//for( int i = 0; i < sm_num_input_energy; ++i )
 
   
   //Next section of code following has not been checked.
@@ -258,31 +220,85 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   else
     frac_pe = fracHydrogen / hydrogen_weight_frac_pe;
 
+  interp.fracPe = 0.0f;
+  
   if( frac_pe > 0.0f )
   {
     cerr << "\nWarning: Correction for fraction of Hydrogen has not been checked\n";
     
-    frac_pe = min( 1.0f, frac_pe );
+    interp.fracPe = min( 1.0f, frac_pe );
     j = 0;
-		
-    if( k == -1 )
-    {
-      for( int l = 1; l < 32; ++l )
-      {
-        float fl = fk*(ri*m_data[0][j][i][l] + fi*m_data[0][j][ip][l]);
-        fl = max( 0.0f, fl );
-        f[l] = (1.0f - frac_pe)*f[l]+frac_pe*fl;
-      }//for( int l = 1; l < 32; ++l )
-    }else
+    
+    for( int i = 0; i < sm_num_input_energy; ++i )
     {
-      for( int l = 1; l < 32; ++l )
+      for( int l = 0; l < sm_num_out_energy; ++l )
       {
-        float fl = ri*(rk*m_data[k][j][i][l]+fk*m_data[kp][j][i][l])
-        	         + fi*(rk*m_data[k][j][ip][l]+fk*m_data[kp][j][ip][l]);
-        fl = max(0.0f,fl);
-        f[l] = (1.0f - frac_pe)*f[l] + frac_pe*fl;
+        if( k == -1 )
+          interp.peData[i][l] = fk*m_data[0][j][i][l];
+        else
+          interp.peData[i][l] = rk*m_data[k][j][i][l] + fk*m_data[kp][j][i][l];
       }
-    }//if( k == -1 ) / else
+    }//for( int i = 0; i < sm_num_input_energy; ++i )
+  }//if( frac_pe > 0.0f )
+}//void interpolateShielding(...)
+
+
+float GadrasScatterTable::lineContinuum( const ShieldingInterpolation &interp,
+                                        const float sourceEnergy,
+                                        const float sourceIntensity,
+                                        std::vector<float> &f,
+                                        std::vector<float> &orig_binning,
+                                        const std::vector<float> &output_binning,
+                                        std::vector<float> &answer ) const
+{
+  const float energyMesh[sm_num_input_energy] = { 60.0f, 87.0f, 89.0f, 115.0f, 116.0f, 121.0f, 122.0f, 200.0f, 300.0f, 400.0f, 600.0f, 1000.0f, 1600.0f, 2600.0f, 4000.0f, 9000.0f };
+  
+  const float atomicNumber = interp.atomicNumber;
+  const float arealDensity = interp.arealDensity;
+  const float fracHydrogen = interp.fracHydrogen;
+  
+  assert( f.size() == sm_num_out_energy );
+  assert( orig_binning.size() == sm_num_out_energy );
+  assert( answer.size() == output_binning.size() );
+  
+//Greg T. C# translation used the following to find i
+//  int i = 6;
+//  for( i = 6; i && (energyMesh[i] > sourceEnergy); --i ){}
+
+  int i;
+  if( sourceEnergy < 88.04f ) // Pb K-edge
+		i = 0;
+  else if( sourceEnergy < 115.5f ) // U K-edge
+		i = 2;
+  else if( sourceEnergy < 121.8f ) // Pu K-edge
+		i = 4;
+  else
+  {
+    i = sm_num_input_energy - 2;
+    
+    while( energyMesh[i] > sourceEnergy )
+    {
+      i -= 1;
+      if( i == 6 )
+        break;
+    }
+  }
+  
+  const int ip = i + 1;
+  const float fi = std::max( 0.0f, (sourceEnergy-energyMesh[i])/(energyMesh[ip]-energyMesh[i]) );
+  const float ri = 1.0f - fi;
+  
+  for( int l = 0; l < sm_num_out_energy; ++l )
+    f[l] = std::max( 0.0f, ri*interp.data[i][l] + fi*interp.data[ip][l] );
+  
+  const float frac_pe = interp.fracPe;
+  if( frac_pe > 0.0f )
+  {
+    for( int l = 1; l < sm_num_out_energy; ++l )
+    {
+      const float fl = max( 0.0f, ri*interp.peData[i][l] + fi*interp.peData[ip][l] );
+      f[l] = (1.0f - frac_pe)*f[l] + frac_pe*fl;
+    }
   }//if( frac_pe > 0.0f )
 
   
@@ -290,7 +306,6 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   const float sc = sourceEnergy / 31.0f;
 //  double edge = sourceEnergy - sourceEnergy*(sourceEnergy/255.5)/(1 + sourceEnergy/255.5);
   
-  vector<float> orig_binning(32);
   for (int l = 0; l < 32; ++l)
     orig_binning[l] = sc*l;
   
@@ -358,10 +373,74 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   //C	Attenuate the continuum for HPGe with thin dead layer.
   //
   
+  std::fill( answer.begin(), answer.end(), 0.0f );
   rebin_by_lower_edge( orig_binning, f, output_binning, answer );
   
   for( size_t i = 0; i < answer.size(); ++i)
     answer[i] /= 3.7E10f;
   
   return trans * sourceIntensity;
-}//void getContinuum(...)
+}//float lineContinuum(...)
+
+
+float GadrasScatterTable::getContinuum( std::vector<float> &answer,
+                                       const float sourceEnergy,
+                                       const float sourceIntensity,
+                                       const float atomicNumber,
+                                       const float arealDensity,
+                                       const float fracHydrogen,
+                                       const std::vector<float> &output_binning ) const
+{
+  answer.resize( output_binning.size() );
+  for( size_t i = 0; i < output_binning.size(); ++i )
+    answer[i] = 0.0f;
+  
+  ShieldingInterpolation interp;
+  interpolateShielding( interp, atomicNumber, arealDensity, fracHydrogen );
+  
+  vector<float> f( sm_num_out_energy ), orig_binning( sm_num_out_energy );
+  
+  return lineContinuum( interp, sourceEnergy, sourceIntensity, f,
+                        orig_binning, output_binning, answer );
+}//float getContinuum(...)
+
+
+void GadrasScatterTable::addContinuum( std::vector<double> &answer,
+                                       std::vector<float> &uncollided,
+                                       const std::vector<float> &sourceEnergies,
+                                       const std::vector<float> &sourceIntensities,
+                                       const float atomicNumber,
+                                       const float arealDensity,
+                                       const float fracHydrogen,
+                                       const std::vector<float> &output_binning ) const
+{
+  const size_t nlines = sourceEnergies.size();
+  const size_t nbin = output_binning.size();
+  
+  if( sourceIntensities.size() != nlines )
+    throw runtime_error( "GadrasScatterTable::addContinuum(): number of energies"
+                         " and intensities must be the same" );
+  
+  if( answer.size() != nbin )
+    throw runtime_error( "GadrasScatterTable::addContinuum(): answer must be"
+                         " same size as binning" );
+  
+  uncollided.resize( nlines );
+  
+  ShieldingInterpolation interp;
+  interpolateShielding( interp, atomicNumber, arealDensity, fracHydrogen );
+  
+  //Scratch buffers re-used for every line
+  vector<float> f( sm_num_out_energy ), orig_binning( sm_num_out_energy );
+  vector<float> linecontinuum( nbin, 0.0f );
+  
+  for( size_t line = 0; line < nlines; ++line )
+  {
+    uncollided[line] = lineContinuum( interp, sourceEnergies[line],
+                                      sourceIntensities[line], f, orig_binning,
+                                      output_binning, linecontinuum );
+    
+    for( size_t i = 0; i < nbin; ++i )
+      answer[i] += linecontinuum[i];
+  }//for( size_t line = 0; line < nlines; ++line )
+}//void addContinuum(...)
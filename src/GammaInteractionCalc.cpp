@@ -64,7 +64,7 @@
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "SandiaDecay/SandiaDecay.h"
-#include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "InterSpec/MassAttenuationTool.h"
 #include "InterSpec/DecayDataBaseServer.h"
@@ -2135,7 +2135,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
 
   if( calculators.size() )
   {
-    SpecUtilsAsync::ThreadPool pool;
+    ComputeScheduler::TaskGroup pool;
     for( SelfAttCalc &calculator : calculators )
       pool.post( boost::bind( &PointSourceShieldingChi2Fcn::selfShieldingIntegration, boost::ref(calculator) ) );
     pool.join();
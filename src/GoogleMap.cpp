@@ -26,8 +26,10 @@
 // Disable streamsize <=> size_t warnings in boost
 #pragma warning(disable:4244)
 
+#include <cmath>
 #include <vector>
 #include <limits>
+#include <sstream>
 #include <algorithm>
 #include <stdexcept>
 #include <exception>
@@ -44,6 +46,7 @@
 
 #include "InterSpec/GoogleMap.h"
 #include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/GpsCountRateIndex.h"
 #include "SpecUtils/SpectrumDataStructs.h"
 
 using namespace Wt;
@@ -75,6 +78,122 @@ void wasClicked( const Wt::WGoogleMap::Coordinate &coord,
   signal.emit( coord.latitude(), coord.longitude() );
 }
 
+
+namespace
+{
+  //sm_cellsAcrossViewport: when the map is zoomed or panned, cells are chosen
+  //  so about this many would span the visible map.
+  const size_t sm_cellsAcrossViewport = 24;
+
+  //sm_maxMarkerLocations: at most this many distinct GPS locations get a
+  //  marker each (twice as many if not passthrough data).
+  const size_t sm_maxMarkerLocations = 9;
+
+
+  std::string cell_html( const GpsCountRateIndex &index,
+                         const GpsCountRateIndex::Cell &cell )
+  {
+    const vector<GpsCountRateIndex::SamplePoint> &samples = index.samples();
+
+    char buffer[512];
+    string html = "<div clas=\"MapMeasPoint\">";
+    html += "<div class=\"GpsTimeTxt\">";
+
+    if( cell.numSamples < 2 )
+    {
+      const GpsCountRateIndex::SamplePoint &p = samples[cell.beginSample];
+      if( !p.startTime.is_special() )
+      {
+        const WDateTime t = WDateTime::fromPosixTime( p.startTime );
+        const string timeStr = t.toString(DATE_TIME_FORMAT_STR).toUTF8();
+        html += timeStr + ", ";
+      }//if( !p.startTime.is_special() )
+    }else
+    {
+      snprintf( buffer, sizeof(buffer), "%i samples, ", int(cell.numSamples) );
+      html += buffer;
+    }//if( cell.numSamples < 2 ) / else
+
+    const string ltstr = PhysicalUnits::printToBestTimeUnits( cell.liveTime );
+    html += "LT=" + ltstr + "</div>";
+
+    if( cell.numSamples > 1 )
+      snprintf( buffer, sizeof(buffer), "<div>%.4g cps (max %.4g cps)</div>",
+                cell.gammaCps(), cell.maxSampleGammaCps );
+    else
+      snprintf( buffer, sizeof(buffer), "<div>%.4g cps</div>", cell.gammaCps() );
+    html += buffer;
+
+    if( cell.numSamples == 1 )
+    {
+      snprintf( buffer, sizeof(buffer), "<div>Sample %i</div>",
+                samples[cell.beginSample].sampleNumber );
+      html += buffer;
+    }else if( cell.numSamples > 1 && cell.numSamples < 7 )
+    {
+      set<int> samplenums;
+      for( size_t i = cell.beginSample; i < cell.endSample; ++i )
+        samplenums.insert( samples[i].sampleNumber );
+
+      html += "<div>Sample Nums: ";
+      for( set<int>::const_iterator i = samplenums.begin(); i != samplenums.end(); ++i )
+      {
+        if( i != samplenums.begin() )
+          html += ", ";
+        html += std::to_string(*i);
+      }
+      html += "</div>";
+    }//if( cell.numSamples == 1 ) / else if there is more samples
+
+    snprintf( buffer, sizeof(buffer),
+              "<div class=\"GpsCoordsTxt\">(%.6f, %.6f)</div>",
+              cell.latitude, cell.longitude );
+    html += buffer;
+    html += "</div>";
+
+    return html;
+  }//std::string cell_html(...)
+
+
+  //CountRateResource: downloads the GPS location and count rate of each
+  //  sample, as CSV or GeoJSON.  Only GpsCountRateIndex::samples() is used
+  //  (which is never modified), so serving the request from another thread
+  //  is safe.
+  class CountRateResource : public Wt::WResource
+  {
+    const std::shared_ptr<const GpsCountRateIndex> m_index;
+    const bool m_geoJson;
+
+  public:
+    CountRateResource( const std::shared_ptr<const GpsCountRateIndex> &index,
+                       const bool geoJson, Wt::WObject *parent )
+    : WResource( parent ), m_index( index ), m_geoJson( geoJson )
+    {
+      suggestFileName( m_geoJson ? "count_rates.geojson" : "count_rates.csv",
+                       WResource::Attachment );
+    }
+
+    virtual ~CountRateResource()
+    {
+      beingDeleted();
+    }
+
+    virtual void handleRequest( const Wt::Http::Request &request,
+                                Wt::Http::Response &response )
+    {
+      if( m_geoJson )
+      {
+        response.setMimeType( "application/geo+json" );
+        m_index->writeGeoJson( response.out() );
+      }else
+      {
+        response.setMimeType( "text/csv" );
+        m_index->writeCsv( response.out() );
+      }
+    }//void handleRequest(...)
+  };//class CountRateResource
+}//namespace
+
 class SrbGoogleMap: public Wt::WGoogleMap
 {
 public:
@@ -133,7 +252,8 @@ public:
   //  to the map widget, and even the ability for the user to customize the
   //  coloring.
   void addCircle( const double latitude, const double longitude,
-                  const float intensity = -1.0f, const string &html = "" )
+                  const float intensity = -1.0f, const string &html = "",
+                  const double radius = 15.0 )
   {
     PointInfo info;
     info.longitude = longitude;
@@ -176,7 +296,6 @@ public:
     snprintf(lat, sizeof(lat), "%.8f", latitude );
     snprintf(lng, sizeof(lng), "%.8f", longitude );
   
-    const double radius = 15;
     const int strokeWidth = 6;
     
     const double strokeOpacity = strokeColor.alpha() / 255.0;
@@ -203,6 +322,8 @@ public:
     if( html.size() )
       strm << "var infow = new google.maps.InfoWindow({content: '" << html << "'});"
            << "google.maps.event.addListener(circle, 'click', function(){infow.open(map,circle);});";
+    //Push to overlays, so clearOverlays() will remove the circle.
+    strm << "if(mapLocal.overlays)mapLocal.overlays.push(circle);";
     strm << "})();";
     
     
@@ -440,6 +561,10 @@ public:
 GoogleMap::GoogleMap( const bool trackMapExtent, Wt::WContainerWidget *parent )
   : WContainerWidget( parent ),
     m_map( 0 ),
+    m_index(),
+    m_displayed(),
+    m_shownLevel( -1 ),
+    m_shownCells(),
     m_trackMapExtent( trackMapExtent ),
     m_clicked( this )
 {
@@ -480,7 +605,39 @@ void GoogleMap::updateMapGpsCoords( const double upperLat, const double leftLng,
   m_mapExtents[1] = static_cast<float>( leftLng );
   m_mapExtents[2] = static_cast<float>( lowerLat );
   m_mapExtents[3] = static_cast<float>( rightLng );
-}
+
+  //If the samples are shown as aggregated circles, show the cells appropriate
+  //  for the new zoom level, within the visible area.
+  if( !m_index || m_shownLevel < 0 )
+    return;
+
+  GpsCountRateIndex::Extent viewport;
+  viewport.south = std::min( upperLat, lowerLat );
+  viewport.north = std::max( upperLat, lowerLat );
+  viewport.west = leftLng;
+  viewport.east = rightLng;
+
+  int level = GpsCountRateIndex::levelForViewport( viewport, sm_cellsAcrossViewport );
+  const vector<GpsCountRateIndex::Cell> cells
+                                 = m_index->query( viewport, level, sm_maxCircles );
+
+  vector<std::uint64_t> geohashes;
+  for( const GpsCountRateIndex::Cell &cell : cells )
+    geohashes.push_back( cell.geohash );
+
+  if( cells.empty() || (level == m_shownLevel && geohashes == m_shownCells) )
+    return;
+
+  //Keep the points of the initial (whole data set) view, so
+  //  adjustPanAndZoom() still shows all the data.
+  const vector<PointInfo> points = m_map->m_points;
+  m_map->clearPoints();
+  showCells( cells, false );
+  m_map->m_points = points;
+}//void updateMapGpsCoords(...)
+
+
+const size_t GoogleMap::sm_maxCircles = 250;
 
 
 Wt::Signal<double /*Lat*/, double /*Lng*/> &GoogleMap::mapClicked()
@@ -527,118 +684,88 @@ void GoogleMap::addMeasurment( std::shared_ptr<const MeasurementInfo> meas,
   if( !meas )
     return;
 
-  typedef std::map< std::pair<float,float>, set<int> > GpsToMeas;
-  GpsToMeas gpss;
-  
-  std::vector<float> cps;
-  cps.reserve( meas->measurements().size() );
-  
-  for( const MeasurementConstShrdPtr &m : meas->measurements() )
+  m_index = std::make_shared<GpsCountRateIndex>( meas );
+  m_displayed = displayed;
+  m_shownLevel = -1;
+  m_shownCells.clear();
+
+  if( m_index->samples().empty() )
+    return;
+
+  //Lets make sure we dont load to much information to the client incase there
+  //  are thousands of gps points.
+  const size_t maxMarkers = meas->passthrough() ? sm_maxMarkerLocations
+                                                : 2*sm_maxMarkerLocations;
+  const int finestLevel = GpsCountRateIndex::sm_maxLevel;
+
+  if( m_index->finestLevelWithAtMost( maxMarkers ) == finestLevel )
   {
-    if( !m->has_gps_info() )
-      continue;
-    
-    const pair<float,float> latlon( m->latitude(), m->longitude() );
-    if( m->source_type() != Measurement::IntrinsicActivity )
-    {
-      gpss[latlon].insert( m->sample_number() );
-      cps.push_back( m->gamma_count_sum() / m->live_time() );
-    }
-  }//for( each measurments )
-  
-  std::sort( cps.begin(), cps.end() );
-  
-  char buffer[512];
-  for( const GpsToMeas::value_type &vt : gpss )
+    showCells( m_index->cells( finestLevel ), true );
+  }else
   {
-    const pair<float,float> &latlon = vt.first;
-    const set<int> &samplenums = vt.second;
-    
-    string html = "<div clas=\"MapMeasPoint\">";
-    
-    const vector<MeasurementConstShrdPtr> samples
-                              = meas->sample_measurements( *vt.second.begin() );
-    
-    float lt = 0.0f, sumgammas = 0.0f;
-    for( const MeasurementConstShrdPtr &m : samples )
-    {
-      lt += m->live_time();
-      sumgammas += m->gamma_count_sum();
-    }
-    
-    html += "<div class=\"GpsTimeTxt\">";
-    
-    if( vt.second.size() < 2 )
-    {
-      // !samples[0]->position_time().is_special()
-      if( samples.size() && !samples[0]->start_time().is_special() )
-      {
-        const WDateTime t = WDateTime::fromPosixTime( samples[0]->start_time());
-        const string timeStr = t.toString(DATE_TIME_FORMAT_STR).toUTF8();
-        html += timeStr + ", ";
-      }//if( !m->start_time().is_special() )
-    }else
-    {
-      snprintf( buffer, sizeof(buffer), "%i samples, ", int(vt.second.size()) );
-      html += buffer;
-    }//if( vt.second.size() < 2 ) / else
-  
-  
-    const string ltstr = PhysicalUnits::printToBestTimeUnits( lt );
-    html += "LT=" + ltstr + "</div>";
-    
-    
-    if( samplenums.size() == 1 )
-    {
-      snprintf( buffer, sizeof(buffer), "<div>Sample %i</div>", *samplenums.begin() );
-      html += buffer;
-    }else if( samplenums.size() > 1 && samplenums.size() < 7 )
-    {
-      html += "<div>Sample Nums: ";
-      for( set<int>::const_iterator i = samplenums.begin(); i != samplenums.end(); ++i )
-      {
-        if( i != samplenums.begin() )
-          html += ", ";
-        html += std::to_string(*i);
-      }
-      html += "</div>";
-    }//if( samplenums.size() == 1 ) / else if there is more samples
-    
-    
-    snprintf( buffer, sizeof(buffer),
-              "<div class=\"GpsCoordsTxt\">(%.6f, %.6f)</div>",
-              latlon.first, latlon.second );
-    html += buffer;
-    html += "</div>";
-    
-    
-    //Lets make sure we dont load to much information to the client incase there
-    //  are thousands of gps points.
-    if( (gpss.size() < 10 || (gpss.size() < 20 && !meas->passthrough())) )
+    const int level = m_index->finestLevelWithAtMost( sm_maxCircles );
+    showCells( m_index->cells( level ), false );
+  }
+
+  m_map->adjustPanAndZoom();
+}//void addMeasurment(...)
+
+
+void GoogleMap::showCells( const std::vector<GpsCountRateIndex::Cell> &cells,
+                           const bool useMarkers )
+{
+  const vector<GpsCountRateIndex::SamplePoint> &samples = m_index->samples();
+
+  m_shownCells.clear();
+  m_shownLevel = (useMarkers || cells.empty()) ? -1 : cells.front().level;
+
+  for( const GpsCountRateIndex::Cell &cell : cells )
+  {
+    const string html = cell_html( *m_index, cell );
+    m_shownCells.push_back( cell.geohash );
+
+    if( useMarkers )
     {
       bool isdisplayed = false;
-      for( const int s : samplenums )
-        isdisplayed = (isdisplayed || displayed.count(s));
-      
-      if( isdisplayed && displayed.size() < 10 )
-        m_map->addPoint( PointInfo(latlon.first, latlon.second, html) );
+      for( size_t i = cell.beginSample; !isdisplayed && i < cell.endSample; ++i )
+        isdisplayed = m_displayed.count( samples[i].sampleNumber );
+
+      const PointInfo info( cell.latitude, cell.longitude, html );
+      if( isdisplayed && m_displayed.size() < 10 )
+        m_map->addPoint( info );
       else
-        m_map->addInfoWindow( PointInfo(latlon.first, latlon.second, html) );
+        m_map->addInfoWindow( info );
     }else
     {
-      const std::vector<float>::const_iterator lb = std::upper_bound(cps.begin(),
-                                                    cps.end(), (sumgammas/lt) );
-      const float intensity = static_cast<float>(lb-cps.begin())/cps.size();
-      m_map->addCircle( latlon.first, latlon.second, intensity, html );
-    }
-  }//for( const GpsToMeas::value_type &vt : gpss )
-  
-  m_map->adjustPanAndZoom();
-}//void addMeasurment(...)
+      //Color by the hottest sample in the cell, so hot spots dont get averaged
+      //  away, and size the circle with the cell (cells are 180/2^level
+      //  degrees of latitude tall, and a degree of latitude is ~111 km).
+      const float intensity
+                   = static_cast<float>( m_index->gammaCpsPercentile( cell.maxSampleGammaCps ) );
+      const double cellHeight = 111320.0 * 180.0 / std::pow( 2.0, cell.level );
+      const double radius = std::max( 15.0, 0.35*cellHeight );
+
+      m_map->addCircle( cell.latitude, cell.longitude, intensity, html, radius );
+    }//if( useMarkers ) / else
+  }//for( const GpsCountRateIndex::Cell &cell : cells )
+}//void showCells(...)
+
+
+Wt::WResource *GoogleMap::countRateResource( const bool geoJson )
+{
+  if( !m_index || m_index->samples().empty() )
+    return nullptr;
+
+  return new CountRateResource( m_index, geoJson, this );
+}//Wt::WResource *countRateResource( const bool geoJson )
 
 
 void GoogleMap::clearMeasurments()
 {
+  m_index.reset();
+  m_displayed.clear();
+  m_shownLevel = -1;
+  m_shownCells.clear();
   m_map->clearPoints();
 }//void clearMeasurments()
 
@@ -0,0 +1,634 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/GpsCountRateIndex.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+
+using namespace std;
+
+namespace
+{
+  //quantize(...): maps [0,1] to the full range of a 32 bit unsigned int.
+  std::uint32_t quantize( double frac )
+  {
+    frac = std::max( 0.0, std::min( 1.0, frac ) );
+    const double value = std::floor( frac * 4294967296.0 );
+    if( value >= 4294967295.0 )
+      return 0xFFFFFFFFu;
+    return static_cast<std::uint32_t>( value );
+  }//std::uint32_t quantize( double frac )
+
+
+  //spread_bits(...): moves bit i of 'value' to bit 2*i.
+  std::uint64_t spread_bits( const std::uint32_t value )
+  {
+    std::uint64_t x = value;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+  }//std::uint64_t spread_bits( const std::uint32_t value )
+
+
+  std::uint64_t level_prefix( const std::uint64_t geohash, const int level )
+  {
+    return (level <= 0) ? 0 : (geohash >> (64 - 2*level));
+  }
+
+
+  //Box: the latitude/longitude bounds of a cell.
+  struct Box
+  {
+    double south, west, north, east;
+  };//struct Box
+
+
+  //box_overlaps(...): if any part of 'box' is in 'viewport'.  The box is
+  //  padded a little, so a centroid that rounding put just outside its cell
+  //  isnt missed.
+  bool box_overlaps( const Box &box, const GpsCountRateIndex::Extent &viewport )
+  {
+    const double pad = 1.0E-7;
+    if( (box.north + pad) < viewport.south || (box.south - pad) > viewport.north )
+      return false;
+
+    if( viewport.west <= viewport.east )
+      return !((box.east + pad) < viewport.west || (box.west - pad) > viewport.east);
+
+    return ((box.east + pad) >= viewport.west) || ((box.west - pad) <= viewport.east);
+  }//bool box_overlaps(...)
+
+
+  //box_within(...): if all of 'box' is in 'viewport'.
+  bool box_within( const Box &box, const GpsCountRateIndex::Extent &viewport )
+  {
+    if( box.south < viewport.south || box.north > viewport.north )
+      return false;
+
+    if( viewport.west <= viewport.east )
+      return (box.west >= viewport.west && box.east <= viewport.east);
+
+    return (box.west >= viewport.west) || (box.east <= viewport.east);
+  }//bool box_within(...)
+
+
+  //query_cells(...): appends the cells in [first,last) of 'cells' (all at
+  //  'level', sorted by geohash, and all inside the level 'depth' cell with
+  //  bounds 'box') whose centroid is in 'viewport'.  Descends the quadtree
+  //  the geohash bits define, using binary search to find the cells inside
+  //  each child, so only the cells near the edges of the viewport are
+  //  looked at individually, and empty parts of the viewport cost nothing.
+  void query_cells( const vector<GpsCountRateIndex::Cell> &cells,
+                    const size_t first, const size_t last,
+                    const int depth, const int level, const Box &box,
+                    const GpsCountRateIndex::Extent &viewport,
+                    vector<GpsCountRateIndex::Cell> &answer )
+  {
+    if( first >= last || !box_overlaps( box, viewport ) )
+      return;
+
+    if( depth >= level || box_within( box, viewport ) )
+    {
+      for( size_t i = first; i < last; ++i )
+      {
+        if( viewport.contains( cells[i].latitude, cells[i].longitude ) )
+          answer.push_back( cells[i] );
+      }
+      return;
+    }//if( at the cell level, or all cells in box are candidates )
+
+    //The next two bits of the geohash are longitude (west/east half), then
+    //  latitude (south/north half); children are in geohash order.
+    const int shift = 2*(level - depth - 1);
+    const double midlon = 0.5*(box.west + box.east);
+    const double midlat = 0.5*(box.south + box.north);
+
+    size_t begin = first;
+    for( std::uint64_t child = 0; child < 4; ++child )
+    {
+      size_t end = last;
+      if( child < 3 )
+      {
+        //Cells in this child have the two bits <= 'child', so find the first
+        //  cell with bits > child.
+        const std::uint64_t childbits = child << shift;
+        const std::uint64_t mask = (std::uint64_t(3) << shift);
+        end = std::partition_point( cells.begin() + begin, cells.begin() + last,
+                           [childbits,mask]( const GpsCountRateIndex::Cell &cell ) -> bool {
+                             return (cell.geohash & mask) <= childbits;
+                           } ) - cells.begin();
+      }//if( child < 3 )
+
+      Box childbox = box;
+      if( child & 2 )
+        childbox.west = midlon;
+      else
+        childbox.east = midlon;
+      if( child & 1 )
+        childbox.south = midlat;
+      else
+        childbox.north = midlat;
+
+      query_cells( cells, begin, end, depth + 1, level, childbox, viewport, answer );
+      begin = end;
+    }//for( loop over the four children )
+  }//void query_cells(...)
+
+
+  string time_str( const boost::posix_time::ptime &t )
+  {
+    if( t.is_special() )
+      return "";
+    return UtilityFunctions::to_extended_iso_string( t );
+  }
+
+
+  void write_json_number( std::ostream &output, const char *format, const double value )
+  {
+    //JSON doesnt allow NaN or Inf.
+    if( !std::isfinite(value) )
+    {
+      output << "null";
+      return;
+    }
+
+    char buffer[64];
+    snprintf( buffer, sizeof(buffer), format, value );
+    output << buffer;
+  }//void write_json_number(...)
+}//namespace
+
+
+const int GpsCountRateIndex::sm_maxLevel = 32;
+
+
+double GpsCountRateIndex::SamplePoint::gammaCps() const
+{
+  return (liveTime > 0.0) ? (gammaCounts / liveTime) : 0.0;
+}
+
+
+double GpsCountRateIndex::Cell::gammaCps() const
+{
+  return (liveTime > 0.0) ? (gammaCounts / liveTime) : 0.0;
+}
+
+
+bool GpsCountRateIndex::Extent::contains( const double latitude,
+                                          const double longitude ) const
+{
+  if( latitude < south || latitude > north )
+    return false;
+
+  if( west <= east )
+    return (longitude >= west && longitude <= east);
+
+  return (longitude >= west || longitude <= east);
+}//bool Extent::contains(...)
+
+
+GpsCountRateIndex::GpsCountRateIndex( const std::shared_ptr<const MeasurementInfo> &meas )
+  : m_cells( sm_maxLevel + 1 )
+{
+  if( !meas )
+    return;
+
+  struct SampleSums
+  {
+    SampleSums()
+      : sumLatitude( 0.0 ), sumLongitude( 0.0 ), numGps( 0 ),
+        liveTime( 0.0 ), realTime( 0.0 ), gammaCounts( 0.0 ),
+        neutronCounts( 0.0 ), hasNeutrons( false ), startTime()
+    {}
+
+    double sumLatitude, sumLongitude;
+    size_t numGps;
+    double liveTime, realTime, gammaCounts, neutronCounts;
+    bool hasNeutrons;
+    boost::posix_time::ptime startTime;
+  };//struct SampleSums
+
+  //Single pass over the measurements; detectors of a sample without GPS info
+  //  still contribute their counts, as long as some detector of the sample
+  //  has GPS info.
+  std::map<int,SampleSums> sums;
+
+  for( const MeasurementConstShrdPtr &m : meas->measurements() )
+  {
+    if( !m || m->source_type() == Measurement::IntrinsicActivity )
+      continue;
+
+    SampleSums &s = sums[m->sample_number()];
+
+    if( m->has_gps_info() )
+    {
+      s.sumLatitude += m->latitude();
+      s.sumLongitude += m->longitude();
+      ++s.numGps;
+    }
+
+    s.liveTime = std::max( s.liveTime, static_cast<double>(m->live_time()) );
+    s.realTime = std::max( s.realTime, static_cast<double>(m->real_time()) );
+    s.gammaCounts += m->gamma_count_sum();
+
+    if( m->contained_neutron() )
+    {
+      s.hasNeutrons = true;
+      s.neutronCounts += m->neutron_counts_sum();
+    }
+
+    const boost::posix_time::ptime &start = m->start_time();
+    if( !start.is_special() && (s.startTime.is_special() || start < s.startTime) )
+      s.startTime = start;
+  }//for( loop over measurements )
+
+  for( const auto &sample_sums : sums )
+  {
+    const SampleSums &s = sample_sums.second;
+    if( !s.numGps )
+      continue;
+
+    SamplePoint p;
+    p.sampleNumber = sample_sums.first;
+    p.latitude = s.sumLatitude / s.numGps;
+    p.longitude = s.sumLongitude / s.numGps;
+    p.startTime = s.startTime;
+    p.liveTime = s.liveTime;
+    p.realTime = s.realTime;
+    p.gammaCounts = s.gammaCounts;
+    p.neutronCounts = s.neutronCounts;
+    p.hasNeutrons = s.hasNeutrons;
+    p.geohash = geohash( p.latitude, p.longitude );
+
+    m_samples.push_back( p );
+  }//for( const auto &sample_sums : sums )
+
+  std::stable_sort( begin(m_samples), end(m_samples),
+                   []( const SamplePoint &lhs, const SamplePoint &rhs ) -> bool {
+    return lhs.geohash < rhs.geohash;
+  } );
+
+  m_sortedCps.reserve( m_samples.size() );
+  for( const SamplePoint &p : m_samples )
+    m_sortedCps.push_back( p.gammaCps() );
+  std::sort( begin(m_sortedCps), end(m_sortedCps) );
+}//GpsCountRateIndex constructor
+
+
+const std::vector<GpsCountRateIndex::SamplePoint> &GpsCountRateIndex::samples() const
+{
+  return m_samples;
+}
+
+
+const std::vector<GpsCountRateIndex::Cell> &GpsCountRateIndex::cells( const int level ) const
+{
+  if( level < 0 || level > sm_maxLevel )
+    throw std::runtime_error( "GpsCountRateIndex::cells: invalid level "
+                              + std::to_string(level) );
+
+  std::unique_ptr<vector<Cell>> &cache = m_cells[level];
+  if( cache )
+    return *cache;
+
+  cache.reset( new vector<Cell>() );
+  vector<Cell> &answer = *cache;
+
+  for( size_t i = 0; i < m_samples.size(); )
+  {
+    const std::uint64_t prefix = level_prefix( m_samples[i].geohash, level );
+
+    Cell cell;
+    cell.level = level;
+    cell.geohash = prefix;
+    cell.latitude = cell.longitude = 0.0;
+    cell.numSamples = 0;
+    cell.liveTime = cell.realTime = 0.0;
+    cell.gammaCounts = cell.neutronCounts = 0.0;
+    cell.maxSampleGammaCps = 0.0;
+    cell.hasNeutrons = false;
+    cell.beginSample = i;
+
+    for( ; i < m_samples.size() && level_prefix(m_samples[i].geohash, level) == prefix; ++i )
+    {
+      const SamplePoint &p = m_samples[i];
+      cell.latitude += p.latitude;
+      cell.longitude += p.longitude;
+      cell.numSamples += 1;
+      cell.liveTime += p.liveTime;
+      cell.realTime += p.realTime;
+      cell.gammaCounts += p.gammaCounts;
+      cell.neutronCounts += p.neutronCounts;
+      cell.hasNeutrons = (cell.hasNeutrons || p.hasNeutrons);
+      cell.maxSampleGammaCps = std::max( cell.maxSampleGammaCps, p.gammaCps() );
+    }
+
+    cell.endSample = i;
+    cell.latitude /= cell.numSamples;
+    cell.longitude /= cell.numSamples;
+
+    answer.push_back( cell );
+  }//for( loop over samples )
+
+  return answer;
+}//cells( const int level )
+
+
+size_t GpsCountRateIndex::numCells( const int level ) const
+{
+  if( level >= 0 && level <= sm_maxLevel && m_cells[level] )
+    return m_cells[level]->size();
+
+  size_t n = 0;
+  for( size_t i = 0; i < m_samples.size(); ++i )
+  {
+    if( i == 0 || level_prefix(m_samples[i].geohash, level)
+                  != level_prefix(m_samples[i-1].geohash, level) )
+      ++n;
+  }
+
+  return n;
+}//size_t numCells( const int level ) const
+
+
+GpsCountRateIndex::Extent GpsCountRateIndex::extent() const
+{
+  Extent answer = { 0.0, 0.0, 0.0, 0.0 };
+  if( m_samples.empty() )
+    return answer;
+
+  answer.south = answer.north = m_samples[0].latitude;
+  answer.west = answer.east = m_samples[0].longitude;
+
+  for( const SamplePoint &p : m_samples )
+  {
+    answer.south = std::min( answer.south, p.latitude );
+    answer.north = std::max( answer.north, p.latitude );
+    answer.west = std::min( answer.west, p.longitude );
+    answer.east = std::max( answer.east, p.longitude );
+  }
+
+  return answer;
+}//Extent extent() const
+
+
+int GpsCountRateIndex::finestLevelWithAtMost( const size_t maxCells ) const
+{
+  //The number of cells never decreases with level, so binary search.
+  int lower = 0, upper = sm_maxLevel;
+  if( numCells(upper) <= maxCells )
+    return upper;
+
+  while( (upper - lower) > 1 )
+  {
+    const int mid = (lower + upper) / 2;
+    if( numCells(mid) <= maxCells )
+      lower = mid;
+    else
+      upper = mid;
+  }
+
+  return lower;
+}//int finestLevelWithAtMost( const size_t maxCells ) const
+
+
+int GpsCountRateIndex::levelForViewport( const Extent &viewport,
+                                         const size_t cellsAcross )
+{
+  const double width = (viewport.east >= viewport.west)
+                         ? (viewport.east - viewport.west)
+                         : (viewport.east + 360.0 - viewport.west);
+  const double height = viewport.north - viewport.south;
+  const double n = static_cast<double>( std::max( cellsAcross, size_t(1) ) );
+
+  if( !(width > 0.0) || !(height > 0.0) )
+    return sm_maxLevel;
+
+  const double lonlevel = std::ceil( std::log2( 360.0 * n / width ) );
+  const double latlevel = std::ceil( std::log2( 180.0 * n / height ) );
+  const double level = std::min( lonlevel, latlevel );
+
+  if( !std::isfinite(level) )
+    return sm_maxLevel;
+
+  return static_cast<int>( std::max( 0.0, std::min( double(sm_maxLevel), level ) ) );
+}//int levelForViewport(...)
+
+
+std::vector<GpsCountRateIndex::Cell> GpsCountRateIndex::query(
+                                                const Extent &viewport,
+                                                int &level,
+                                                const size_t maxCells ) const
+{
+  level = std::max( 0, std::min( sm_maxLevel, level ) );
+
+  vector<Cell> answer;
+  const Box world = { -90.0, -180.0, 90.0, 180.0 };
+
+  while( true )
+  {
+    answer.clear();
+    const vector<Cell> &levelcells = cells( level );
+    query_cells( levelcells, 0, levelcells.size(), 0, level, world, viewport, answer );
+
+    if( !maxCells || answer.size() <= maxCells || level == 0 )
+      break;
+
+    --level;
+  }//while( true )
+
+  return answer;
+}//std::vector<Cell> query(...)
+
+
+double GpsCountRateIndex::gammaCpsPercentile( const double cps ) const
+{
+  if( m_sortedCps.empty() )
+    return 0.0;
+
+  const auto pos = std::upper_bound( begin(m_sortedCps), end(m_sortedCps), cps );
+  return static_cast<double>( pos - begin(m_sortedCps) ) / m_sortedCps.size();
+}//double gammaCpsPercentile( const double cps ) const
+
+
+bool GpsCountRateIndex::writeCsv( std::ostream &output, const int level ) const
+{
+  char buffer[512];
+
+  if( level < 0 )
+  {
+    output << "SampleNumber,StartTime,Latitude,Longitude,Geohash,LiveTime(s),"
+              "RealTime(s),GammaCounts,GammaCps,NeutronCounts\r\n";
+
+    for( const SamplePoint &p : m_samples )
+    {
+      snprintf( buffer, sizeof(buffer), "%i,%s,%.7f,%.7f,%s,%.3f,%.3f,%.9g,%.6g,",
+                p.sampleNumber, time_str(p.startTime).c_str(),
+                p.latitude, p.longitude, geohashString(p.geohash,12).c_str(),
+                p.liveTime, p.realTime, p.gammaCounts, p.gammaCps() );
+      output << buffer;
+      if( p.hasNeutrons )
+      {
+        snprintf( buffer, sizeof(buffer), "%.9g", p.neutronCounts );
+        output << buffer;
+      }
+      output << "\r\n";
+    }//for( const SamplePoint &p : m_samples )
+  }else
+  {
+    output << "Level,Latitude,Longitude,NumSamples,FirstSampleNumber,"
+              "LiveTime(s),RealTime(s),GammaCounts,GammaCps,MaxSampleGammaCps,"
+              "NeutronCounts\r\n";
+
+    for( const Cell &cell : cells( level ) )
+    {
+      int firstSample = m_samples[cell.beginSample].sampleNumber;
+      for( size_t i = cell.beginSample; i < cell.endSample; ++i )
+        firstSample = std::min( firstSample, m_samples[i].sampleNumber );
+
+      snprintf( buffer, sizeof(buffer), "%i,%.7f,%.7f,%i,%i,%.3f,%.3f,%.9g,%.6g,%.6g,",
+                cell.level, cell.latitude, cell.longitude,
+                static_cast<int>(cell.numSamples), firstSample,
+                cell.liveTime, cell.realTime, cell.gammaCounts,
+                cell.gammaCps(), cell.maxSampleGammaCps );
+      output << buffer;
+      if( cell.hasNeutrons )
+      {
+        snprintf( buffer, sizeof(buffer), "%.9g", cell.neutronCounts );
+        output << buffer;
+      }
+      output << "\r\n";
+    }//for( const Cell &cell : cells( level ) )
+  }//if( level < 0 ) / else
+
+  return !m_samples.empty();
+}//bool writeCsv(...)
+
+
+bool GpsCountRateIndex::writeGeoJson( std::ostream &output, const int level ) const
+{
+  output << "{\"type\":\"FeatureCollection\",\"features\":[";
+
+  bool first = true;
+  auto start_feature = [&output,&first]( const double latitude, const double longitude ){
+    output << (first ? "\n" : ",\n");
+    first = false;
+    output << "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[";
+    write_json_number( output, "%.7f", longitude );
+    output << ",";
+    write_json_number( output, "%.7f", latitude );
+    output << "]},\"properties\":{";
+  };
+
+  if( level < 0 )
+  {
+    for( const SamplePoint &p : m_samples )
+    {
+      start_feature( p.latitude, p.longitude );
+
+      output << "\"sampleNumber\":" << p.sampleNumber;
+      const string start = time_str( p.startTime );
+      if( !start.empty() )
+        output << ",\"startTime\":\"" << start << "\"";
+      output << ",\"geohash\":\"" << geohashString(p.geohash,12) << "\"";
+      output << ",\"liveTime\":";
+      write_json_number( output, "%.3f", p.liveTime );
+      output << ",\"realTime\":";
+      write_json_number( output, "%.3f", p.realTime );
+      output << ",\"gammaCounts\":";
+      write_json_number( output, "%.9g", p.gammaCounts );
+      output << ",\"gammaCps\":";
+      write_json_number( output, "%.6g", p.gammaCps() );
+      if( p.hasNeutrons )
+      {
+        output << ",\"neutronCounts\":";
+        write_json_number( output, "%.9g", p.neutronCounts );
+      }
+      output << "}}";
+    }//for( const SamplePoint &p : m_samples )
+  }else
+  {
+    for( const Cell &cell : cells( level ) )
+    {
+      start_feature( cell.latitude, cell.longitude );
+
+      output << "\"level\":" << cell.level
+             << ",\"numSamples\":" << cell.numSamples;
+      output << ",\"liveTime\":";
+      write_json_number( output, "%.3f", cell.liveTime );
+      output << ",\"realTime\":";
+      write_json_number( output, "%.3f", cell.realTime );
+      output << ",\"gammaCounts\":";
+      write_json_number( output, "%.9g", cell.gammaCounts );
+      output << ",\"gammaCps\":";
+      write_json_number( output, "%.6g", cell.gammaCps() );
+      output << ",\"maxSampleGammaCps\":";
+      write_json_number( output, "%.6g", cell.maxSampleGammaCps );
+      if( cell.hasNeutrons )
+      {
+        output << ",\"neutronCounts\":";
+        write_json_number( output, "%.9g", cell.neutronCounts );
+      }
+      output << "}}";
+    }//for( const Cell &cell : cells( level ) )
+  }//if( level < 0 ) / else
+
+  output << "\n]}\n";
+
+  return !m_samples.empty();
+}//bool writeGeoJson(...)
+
+
+std::uint64_t GpsCountRateIndex::geohash( const double latitude,
+                                          const double longitude )
+{
+  const std::uint32_t lon = quantize( (longitude + 180.0) / 360.0 );
+  const std::uint32_t lat = quantize( (latitude + 90.0) / 180.0 );
+  return (spread_bits( lon ) << 1) | spread_bits( lat );
+}//std::uint64_t geohash(...)
+
+
+std::string GpsCountRateIndex::geohashString( const std::uint64_t geohash,
+                                              const size_t nchars )
+{
+  static const char * const base32 = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+  string answer;
+  for( size_t i = 0; i < std::min( nchars, size_t(12) ); ++i )
+    answer += base32[(geohash >> (59 - 5*i)) & 0x1F];
+
+  return answer;
+}//std::string geohashString(...)
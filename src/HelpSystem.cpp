@@ -46,6 +46,7 @@
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/InterSpecApp.h"
+#include "InterSpec/ResourceRegistry.h"
 #include "SpecUtils/UtilityFunctions.h"
 
 #if( USE_OSX_NATIVE_MENU )
@@ -221,15 +222,12 @@ namespace HelpSystem
     //"help-xml-phone"
     //"help-xml-tablet"
     
-    const char *help_json = "InterSpec_resources/static_text/help.json";
-    ifstream helpinfo( help_json );
-    if( helpinfo.is_open() )
+    try
     {
-      m_helpLookupTable = string( (std::istreambuf_iterator<char>(helpinfo)),
-                                 std::istreambuf_iterator<char>());
-    }else
+      m_helpJson = ResourceRegistry::helpJson();
+    }catch( std::exception &e )
     {
-      passMessage( "Could not open help JSON file at '" + string(help_json) + "'", "", 2 );
+      passMessage( e.what(), "", 2 );
     }
     
     initialize();
@@ -458,10 +456,11 @@ namespace HelpSystem
     
     try
     {
-      Json::Value jsonResult;
-      Json::parse( m_helpLookupTable, jsonResult );
-      Json::Array res = jsonResult;
-      populateTree( jsonResult, node );
+      if( m_helpJson )
+      {
+        const Json::Array &res = *m_helpJson;
+        populateTree( res, node );
+      }
       
       //Lets show the first result
       const vector<WTreeNode *> &kids = node->childNodes();
@@ -598,7 +597,7 @@ namespace HelpSystem
     return t;
   }//WTemplate *getContent( WTreeNode *node )
   
-  void HelpWindow::populateTree(Json::Array &res, WTreeNode* parent)
+  void HelpWindow::populateTree(const Json::Array &res, WTreeNode* parent)
   {
     InterSpecApp *app = dynamic_cast<InterSpecApp *>(wApp);
     
@@ -717,11 +716,11 @@ namespace HelpSystem
       if( !children.isNull() )
       {
         //has children
-        Json::Array addNodes = children;
+        const Json::Array &addNodes = children;
         populateTree(addNodes,insertNode);
       }//if (!children.isNull())
     }//for( size_t i = 0; i < res.size(); ++i )
-  }//void populateTree(Json::Array &res, WTreeNode* parent, std::map <string, Wt::WTreeNode*> &treeLookup)
+  }//void populateTree(const Json::Array &res, WTreeNode* parent, std::map <string, Wt::WTreeNode*> &treeLookup)
   
   /**
    Recursively set entire path from root to this node to be visible
@@ -59,6 +59,8 @@
 #include <Wt/WServer>
 #include <Wt/Dbo/Dbo>
 #include <Wt/WAnchor>
+#include <Wt/WResource>
+#include <Wt/Http/Response>
 #include <Wt/WSpinBox>
 #include <Wt/WIconPair>
 #include <Wt/WGroupBox>
@@ -119,22 +121,28 @@
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/ColorTheme.h"
 #include "InterSpec/MaterialDB.h"
+#include "InterSpec/ResourceRegistry.h"
 #include "InterSpec/GammaXsGui.h"
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/DecayWindow.h"
 #include "InterSpec/ColorSelect.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/Recalibrator.h"
+#include "InterSpec/ReactionGamma.h"
 #include "InterSpec/DetectorEdit.h"
 #include "InterSpec/DataBaseUtils.h"
 #include "InterSpec/UseInfoWindow.h"
+#include "InterSpec/UndoRedoManager.h"
+#include "InterSpec/SampleSumCache.h"
+#include "InterSpec/MemoryAccountant.h"
+#include "InterSpec/Tracing.h"
 #include "InterSpec/OneOverR2Calc.h"
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/SpectrumChart.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/InterSpecUser.h"
 #include "InterSpec/DoseCalcWidget.h"
-#include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/PeakFitChi2Fcn.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "InterSpec/PeakInfoDisplay.h"
@@ -340,6 +348,34 @@ namespace
     
     return false;
   }//try_update_hint_peak(...)
+  
+  
+#if( INTERSPEC_ENABLE_TRACING )
+  //TraceDownloadResource: downloads the traced spans of a session as Chrome
+  //  trace-event JSON.
+  class TraceDownloadResource : public Wt::WResource
+  {
+    const std::string m_sessionId;
+  public:
+    TraceDownloadResource( const std::string &sessionId, Wt::WObject *parent )
+    : WResource( parent ), m_sessionId( sessionId )
+    {
+      suggestFileName( "InterSpec_trace.json", WResource::Attachment );
+    }
+    
+    virtual ~TraceDownloadResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request,
+                                Wt::Http::Response &response )
+    {
+      response.setMimeType( "application/json" );
+      Tracing::writeChromeTrace( response.out(), m_sessionId );
+    }
+  };//class TraceDownloadResource
+#endif
 }//namespace
 
 
@@ -443,6 +479,11 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_notificationDiv->setId("qtip-growl-container");
   wApp->domRoot()->addWidget( m_notificationDiv );
   
+  m_undoRedo.reset( new UndoRedoManager( this ) );
+  m_foregroundSumCache.reset( new SampleSumCache() );
+  m_secondSumCache.reset( new SampleSumCache() );
+  m_backgroundSumCache.reset( new SampleSumCache() );
+  
   if( !isMobile() )
     initHotkeySignal();
   
@@ -889,6 +930,22 @@ void InterSpec::setWritableDataDirectory( const std::string &dir )
   //if( !serial_db.empty() )
   //  SerialToDetectorModel::set_detector_model_input_csv( serial_db[0] );
   
+  //Keep the binary image of the reaction gamma data with the users data; this
+  //  directory is per-user, so no one else can replace the image.  Without a
+  //  writable data directory no image is used.
+  if( !dir.empty() )
+  {
+    try
+    {
+      const string rctn_bin = UtilityFunctions::append_path( dir, "InterSpec_reactiongamma.bin" );
+      ReactionGammaServer::set_binary_cache_location( rctn_bin );
+    }catch( std::exception &e )
+    {
+      //ReactionGammaServer::database() has already been called; not a problem.
+      cerr << "InterSpec::setWritableDataDirectory(): " << e.what() << endl;
+    }
+  }//if( !dir.empty() )
+  
   sm_writableDataDirectory = dir;
 }//setWritableDataDirectory( const std::string &dir )
 
@@ -913,6 +970,10 @@ InterSpec::~InterSpec()
 
   cerr << "Destructing InterSpec from session '" << (wApp ? wApp->sessionId() : string("")) << "'" << endl;
 
+  MemoryAccountant::instance().removeSession( wApp ? wApp->sessionId() : string("") );
+  if( wApp )
+    ComputeScheduler::instance().cancelSession( wApp->sessionId() );
+
   if( m_licenseWindow )
   {
     delete m_licenseWindow;
@@ -1422,7 +1483,14 @@ void InterSpec::initHotkeySignal()
     function(id,e){
       if(!e||(typeof e.keyCode === 'undefined'))
         return;
-      if(e.metaKey||e.altKey||!e.ctrlKey||e.shiftKey)
+      if(e.metaKey||e.altKey||!e.ctrlKey)
+        return;
+      var undoKey = (e.keyCode===90 || e.keyCode===89);
+      if(e.shiftKey && e.keyCode!==90)
+        return;
+      /* Let text inputs do their own undo/redo */
+      var t = e.target ? e.target.tagName : '';
+      if(undoKey && (t==='INPUT' || t==='TEXTAREA'))
         return;
       var v = 0;
       switch( e.keyCode ){
@@ -1433,6 +1501,8 @@ void InterSpec::initHotkeySignal()
         case 78: case 53: v=5; break; //n
         case 72:          v=6; break; //h
         case 73:          v=7; break; //i
+        case 90:          v=(e.shiftKey ? 9 : 8); break; //z
+        case 89:          v=9; break; //y
         default:
           return;  //show
       }
@@ -1455,6 +1525,15 @@ void InterSpec::initHotkeySignal()
 
 void InterSpec::hotkeyPressed( const unsigned int value )
 {
+  if( value == 8 || value == 9 )
+  {
+    if( m_undoRedo && (value == 8) )
+      m_undoRedo->undo();
+    else if( m_undoRedo )
+      m_undoRedo->redo();
+    return;
+  }//if( undo or redo )
+  
   if( m_toolsTabs )
   {
     string expectedTxt;
@@ -1541,6 +1620,8 @@ std::shared_ptr<const PeakDef> InterSpec::nearestPeak( const double energy ) con
 
 void InterSpec::refitPeakFromRightClick()
 {
+  UndoRedoManager::StepGroup undo_group( "refit peak" );
+  
   std::shared_ptr<const PeakDef> peak = nearestPeak( m_rightClickEnergy );
   if( !peak )
   {
@@ -1640,6 +1721,8 @@ void InterSpec::refitPeakFromRightClick()
 
 void InterSpec::addPeakFromRightClick()
 {
+  UndoRedoManager::StepGroup undo_group( "add peak" );
+  
   std::shared_ptr<const Measurement> dataH = m_spectrum->data();
   std::shared_ptr<const PeakDef> peak = nearestPeak( m_rightClickEnergy );
   if( !peak
@@ -1833,6 +1916,8 @@ void InterSpec::addPeakFromRightClick()
 
 void InterSpec::makePeakFromRightClickHaveOwnContinuum()
 {
+  UndoRedoManager::StepGroup undo_group( "separate peak continuum" );
+  
   const std::shared_ptr<const Measurement> data = m_spectrum->data();
   std::shared_ptr<const PeakDef> peak = nearestPeak( m_rightClickEnergy );
   if( !peak || !data
@@ -1907,6 +1992,8 @@ void InterSpec::makePeakFromRightClickHaveOwnContinuum()
 
 void InterSpec::shareContinuumWithNeighboringPeak( const bool shareWithLeft )
 {
+  UndoRedoManager::StepGroup undo_group( "share peak continuum" );
+  
   std::shared_ptr<const PeakDef> peak = nearestPeak( m_rightClickEnergy );
   if( !peak
      || m_rightClickEnergy < peak->lowerX()
@@ -2253,7 +2340,6 @@ void InterSpec::handleRightClick( double energy, double counts,
           Wt::WServer *server = Wt::WServer::instance();
           if( server )  //this should always be true
           {
-            Wt::WIOService &io = server->ioService();
             std::shared_ptr< vector<string> > candidates
                                        = std::make_shared<vector<string> >();
             boost::function<void(void)> updater = wApp->bind(
@@ -2290,7 +2376,8 @@ void InterSpec::handleRightClick( double energy, double counts,
                       peaks, refLines, detector, session_id, candidates, updater );
             };
             
-            io.post( worker );
+            ComputeScheduler::instance().post( session_id, worker,
+                                           ComputeScheduler::Priority::Interactive );
           }//if( server )
         }//if( menu )
         else
@@ -2558,6 +2645,12 @@ void InterSpec::saveStateToDb( Wt::Dbo::ptr<UserState> entry )
   {
     saveShieldingSourceModelToForegroundSpecMeas();
     
+    //Make sure any pending preference and spectrum writes are committed before
+    //  the state that references them.  Callers that already hold a
+    //  transaction (e.g., the end-of-session save) flush before opening it.
+    if( !DataBaseUtils::currentThreadHoldsDbTransaction() )
+      DataBaseUtils::flushDbWrites();
+    
     DataBaseUtils::DbTransaction transaction( *m_sql );
     entry.modify()->serializeTime = WDateTime::currentDateTime();
   
@@ -6278,6 +6371,12 @@ void InterSpec::addAboutMenu( Wt::WWidget *parent )
 
   Wt::WMenuItem *notifications = m_helpMenuPopup->addMenuItem( "Notification Logs..." , "InterSpec_resources/images/log_file_small.png");
   notifications->triggered().connect( this, &InterSpec::showWarningsWindow );
+  
+#if( INTERSPEC_ENABLE_TRACING )
+  item = m_helpMenuPopup->addMenuItem( "Download Performance Trace" );
+  item->setLink( WLink( new TraceDownloadResource( wApp->sessionId(), item ) ) );
+  item->setLinkTarget( TargetNewWindow );
+#endif
 
   m_helpMenuPopup->addSeparator();
   PopupDivMenu *subPopup = m_helpMenuPopup->addPopupMenuItem( "Options", "InterSpec_resources/images/cog_small.png" );
@@ -6785,6 +6884,21 @@ void InterSpec::createMapWindow( SpectrumType spectrum_type )
     item->triggered().connect( boost::bind( &InterSpec::displayOnlySamplesWithinView, this, googlemap, kSecondForeground, spectrum_type ) );
   }//if( meas->measurements().size() > 10 )
   
+  WResource *csvResource = googlemap->countRateResource( false );
+  WResource *geoJsonResource = googlemap->countRateResource( true );
+  if( csvResource && geoJsonResource )
+  {
+    WPushButton *button = new WPushButton( "Export Count Rates...", window->footer() );
+    WPopupMenu *menu = new WPopupMenu();
+    menu->setAutoHide( true );
+    button->setMenu( menu );
+    WMenuItem *item = menu->addItem( "CSV" );
+    item->setLink( WLink( csvResource ) );
+    item->setLinkTarget( TargetNewWindow );
+    item = menu->addItem( "GeoJSON" );
+    item->setLink( WLink( geoJsonResource ) );
+    item->setLinkTarget( TargetNewWindow );
+  }//if( csvResource && geoJsonResource )
   
   WPushButton *closeButton = window->addCloseButtonToFooter();
   closeButton->clicked().connect( window, &AuxWindow::hide );
@@ -7000,11 +7114,12 @@ void InterSpec::fillMaterialDb( std::shared_ptr<MaterialDB> materialDB,
                                      const std::string sessionid,
                                      boost::function<void(void)> update )
 {
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
   try
   {
-    //materialDB can get destructed if the session ends immediately....
-    materialDB->parseGadrasMaterialFile( "data/MaterialDataBase.txt", db, false );
+    //The materials are parsed once per process, and shared between sessions;
+    //  materialDB just gets the session specific materials (e.g., chemical
+    //  formulas the user enters) on top of those.
+    materialDB->addSharedMaterials( ResourceRegistry::materialDB() );
     
     WServer::instance()->post( sessionid, update );
   }catch( std::exception &e )
@@ -7058,7 +7173,8 @@ void InterSpec::initMaterialDbAndSuggestions()
     
     boost::function<void(void)> worker = boost::bind( &fillMaterialDb,
                                     m_materialDB, wApp->sessionId(), success );
-    WServer::instance()->ioService().post( worker );
+    ComputeScheduler::instance().post( wApp->sessionId(), worker,
+                                       ComputeScheduler::Priority::Background );
   }//if( !m_materialDB )
 }//void InterSpec::initMaterialDbAndSuggestions()
 
@@ -7510,6 +7626,12 @@ PeakModel *InterSpec::peakModel()
 };
 
 
+UndoRedoManager *InterSpec::undoRedoManager()
+{
+  return m_undoRedo.get();
+}//UndoRedoManager *undoRedoManager()
+
+
 Wt::Signal<std::shared_ptr<DetectorPeakResponse> > &InterSpec::detectorChanged()
 {
   return m_detectorChanged;
@@ -7668,10 +7790,15 @@ void InterSpec::changeDisplayedSampleNums( const std::set<int> &samples,
   if( (*sampleset) == samples )
     return;
   
+  const std::set<int> prevSamples = *sampleset;
+  
   (*sampleset) = samples;
   if( sampleset->empty() && !!meas )
     (*sampleset) = meas->sample_numbers();
   
+  if( m_undoRedo )
+    m_undoRedo->sampleNumbersChanged( type, meas, prevSamples, *sampleset );
+  
   //should update the highlighted regions right here
   vector< pair<double,double> > regions = timeRegionsToHighlight( type );
   m_timeSeries->setTimeHighLightRegions( regions, type );
@@ -7995,7 +8122,7 @@ void InterSpec::doFinishupSetSpectrumWork( std::shared_ptr<SpecMeas> meas,
   }//end codeblock to access meas
   cout << "About to do Threadpool" << endl;
   {
-    SpecUtilsAsync::ThreadPool pool;
+    ComputeScheduler::TaskGroup pool;
     for( size_t i = 0; i < workers.size(); ++i )
       pool.post( workers[i] );
     pool.join();
@@ -8070,6 +8197,23 @@ void InterSpec::setSpectrum( std::shared_ptr<SpecMeas> meas,
   
   std::shared_ptr<SpecMeas> previous = measurment(spec_type);
   const bool sameSpec = (meas==previous);
+  
+  //Undo/redo steps are only kept for the currently loaded spectrum files
+  if( !sameSpec && m_undoRedo )
+    m_undoRedo->clearHistory();
+  
+  //Release the cached sums of the previous file (they hold references to its
+  //  spectra); they will be rebuilt for the new file as needed.
+  if( !sameSpec )
+  {
+    switch( spec_type )
+    {
+      case kForeground:       m_foregroundSumCache->clear(); break;
+      case kSecondForeground: m_secondSumCache->clear();     break;
+      case kBackground:       m_backgroundSumCache->clear(); break;
+    }//switch( spec_type )
+  }//if( !sameSpec )
+  
   std::shared_ptr<const Measurement> prev_display = m_spectrum->histUsedForXAxis();
   
 
@@ -8304,6 +8448,7 @@ void InterSpec::setSpectrum( std::shared_ptr<SpecMeas> meas,
       displayBackgroundData();
   };//switch( spec_type )
   
+  accountSpectrumFiles();
   
   deletePreserveCalibWindow();
   
@@ -8404,7 +8549,8 @@ void InterSpec::setSpectrum( std::shared_ptr<SpecMeas> meas,
     boost::function<void(void)> worker = boost::bind(
                                   &InterSpec::doFinishupSetSpectrumWork,
                                   this, meas, furtherworkers );
-    WServer::instance()->ioService().post( worker );
+    ComputeScheduler::instance().post( wApp->sessionId(), worker,
+                                       ComputeScheduler::Priority::Background );
   }//if( meas && furtherworkers.size() )
   
   if( m_mobileBackButton && m_mobileForwardButton )
@@ -9006,6 +9152,8 @@ void InterSpec::overlayCanvasJsExceptionCallback( const std::string &message )
 
 void InterSpec::searchForSinglePeak( const double x )
 {
+  UndoRedoManager::StepGroup undo_group( "peak search" );
+  
   if( !m_peakModel )
     throw runtime_error( "InterSpec::searchForSinglePeak(...): "
                         "shoudnt be called if peak model isnt set.");
@@ -9205,12 +9353,9 @@ void InterSpec::searchForHintPeaks( const std::shared_ptr<SpecMeas> &data,
     m_hintQueue.push_back( worker );
   }else
   {
-    Wt::WServer *server = Wt::WServer::instance();
-    if( server )  //this should always be true
-    {
-      m_findingHintPeaks = true;
-      server->ioService().post( worker );
-    }//if( server )
+    m_findingHintPeaks = true;
+    ComputeScheduler::instance().post( wApp->sessionId(), worker,
+                                       ComputeScheduler::Priority::Background );
   }
 }//void searchForHintPeaks(...)
 
@@ -9232,15 +9377,12 @@ void InterSpec::setHintPeaks( std::weak_ptr<SpecMeas> weak_spectrum,
   
   if( m_hintQueue.size() )
   {
-    Wt::WServer *server = Wt::WServer::instance();
-    if( server )  //this should always be true
-    {
-      m_findingHintPeaks = true;
-      cerr << "InterSpec::setHintPeaks(...): posting queued job" << endl;
-      boost::function<void()> worker = m_hintQueue.back();
-      m_hintQueue.pop_back();
-      server->ioService().post( worker );
-    }//if( server )
+    m_findingHintPeaks = true;
+    cerr << "InterSpec::setHintPeaks(...): posting queued job" << endl;
+    boost::function<void()> worker = m_hintQueue.back();
+    m_hintQueue.pop_back();
+    ComputeScheduler::instance().post( wApp->sessionId(), worker,
+                                       ComputeScheduler::Priority::Background );
   }//if( m_hintQueue.size() )
   
   typedef std::shared_ptr<const PeakDef> PeakPtr;
@@ -9293,6 +9435,8 @@ void InterSpec::setHintPeaks( std::weak_ptr<SpecMeas> weak_spectrum,
   }//if( addedpeaks.size() )
   
   spectrum->setAutomatedSearchPeaks( samplenums, newpeaks );
+  
+  accountPeaks();
 //  existing
 }//void setHintPeaks(...)
 
@@ -9300,6 +9444,8 @@ void InterSpec::setHintPeaks( std::weak_ptr<SpecMeas> weak_spectrum,
 
 void InterSpec::findPeakFromControlDrag( double x0, double x1, int nPeaks )
 {
+  UndoRedoManager::StepGroup undo_group( "fit peaks in range" );
+  
   if( !m_dataMeasurement || nPeaks < 1 )
     return;
   
@@ -9311,7 +9457,8 @@ void InterSpec::findPeakFromControlDrag( double x0, double x1, int nPeaks )
   if( !dataH )
     return;
   
-  std::vector<std::thread> thread_grp;
+  ComputeScheduler::TaskGroup taskgroup( wApp->sessionId(),
+                                         ComputeScheduler::Priority::Interactive );
   
   for( MultiPeakInitialGuesMethod method = MultiPeakInitialGuesMethod(0);
       method < FromInputPeaks;
@@ -9322,17 +9469,14 @@ void InterSpec::findPeakFromControlDrag( double x0, double x1, int nPeaks )
                               dataH, m_dataMeasurement->detector(),
                               boost::ref(answer[method]),
                               boost::ref(chi2[method]) );
-    thread_grp.emplace_back( fctn );
-    //threads.create_thread( fctn );
+    taskgroup.post( fctn );
   }//for( loop over methods )
   
   const int lowbin = dataH->FindFixBin(x0);
   const int highbin = dataH->FindFixBin(x1);
   const int nbin = highbin - lowbin;
   
-  for( auto &thread : thread_grp )
-    if( thread.joinable() )
-      thread.join();
+  taskgroup.join();
   
 //  bestchi2 = *std::min_element( chi2, chi2+FromInputPeaks );
   for( MultiPeakInitialGuesMethod method = MultiPeakInitialGuesMethod(0);
@@ -9680,12 +9824,11 @@ void InterSpec::guessIsotopesForPeaks( WApplication *app )
     }//if( !detector || !detector->isValid() )
   }//end code-block to get input data
   
-  vector<IsotopeId::PeakToNuclideMatch> idd( all_peaks->size() );
+  vector<IsotopeId::PeakToNuclideMatch> idd;
   
-  size_t peakn = 0, rownum = 0;
+  size_t rownum = 0;
   vector<size_t> rownums;
-  SpecUtilsAsync::ThreadPool threadpool;
-//  vector< boost::function<void()> > workers;
+  vector<PeakModel::PeakShrdPtr> peaksToId;
   vector<PeakModel::PeakShrdPtr> inputpeaks;
   vector<PeakDef> modifiedPeaks;
   for( PeakModel::PeakShrdPtr peak : *all_peaks )
@@ -9702,17 +9845,13 @@ void InterSpec::guessIsotopesForPeaks( WApplication *app )
       continue;
     }
     
-    threadpool.post( boost::bind( &IsotopeId::suggestNuclides,
-                                  boost::ref(idd[peakn]), peak, all_peaks,
-                                  data, detector ) );
-//    workers.push_back( boost::bind( &suggestNuclides, boost::ref(idd[peakn]),
-//                                   peak, all_peaks, data, detector ) ) );
+    peaksToId.push_back( peak );
     rownums.push_back( rownum-1 );
-    ++peakn;
   }//for( PeakModel::PeakShrdPtr peak : *all_peaks )
   
-  threadpool.join();
-//  UtilityFunctions::do_asyncronous_work( workers, false );
+  //Suggestions are cached, so peaks the user already right-clicked on (or
+  //  that were previously ID'd with the same peaks/detector) wont be redone.
+  IsotopeId::suggestNuclides( idd, peaksToId, all_peaks, data, detector );
 
     
   for( size_t resultnum = 0; resultnum < rownums.size(); ++resultnum )
@@ -10391,7 +10530,7 @@ void InterSpec::displayForegroundData( const bool current_energy_range )
     m_backgroundSubItems[1]->setHidden( !isSub );
   }//if( m_backgroundSubItems[0]->isHidden() != isSub )
 
-  std::shared_ptr<Measurement> dataH = m_dataMeasurement->sum_measurements( m_displayedSamples, use_gamma );
+  std::shared_ptr<Measurement> dataH = m_foregroundSumCache->sum( m_dataMeasurement, m_displayedSamples, use_gamma );
   
   if( dataH )
     dataH->set_title( "Foreground" );
@@ -10401,6 +10540,8 @@ void InterSpec::displayForegroundData( const bool current_energy_range )
   const float sum_neut = dataH ? dataH->neutron_counts_sum() : 0.0f;
   
   m_spectrum->setData( dataH, lt, rt, sum_neut, current_energy_range );
+  
+  accountSampleSumCache( kForeground );
 }//void displayForegroundData()
 
 
@@ -10464,7 +10605,7 @@ void InterSpec::displaySecondForegroundData()
     
     std::shared_ptr<Measurement> histH;
     if( m_secondDataMeasurement )
-      histH = m_secondDataMeasurement->sum_measurements(m_sectondForgroundSampleNumbers, second_det_use );
+      histH = m_secondSumCache->sum( m_secondDataMeasurement, m_sectondForgroundSampleNumbers, second_det_use );
     if( histH )
       histH->set_title( "Second Foreground" );
     
@@ -10484,6 +10625,8 @@ void InterSpec::displaySecondForegroundData()
     vector< pair<double,double> > regions = timeRegionsToHighlight(kSecondForeground);
     m_timeSeries->setTimeHighLightRegions( regions, kSecondForeground );
   }
+  
+  accountSampleSumCache( kSecondForeground );
 }//void displaySecondForegroundData()
 
 
@@ -10545,7 +10688,7 @@ void InterSpec::displayBackgroundData()
 
     std::shared_ptr<Measurement> backgroundH;
     if( m_backgroundMeasurement )
-      backgroundH = m_backgroundMeasurement->sum_measurements( m_backgroundSampleNumbers, background_det_use );
+      backgroundH = m_backgroundSumCache->sum( m_backgroundMeasurement, m_backgroundSampleNumbers, background_det_use );
     if( backgroundH )
       backgroundH->set_title( "Background" );
     
@@ -10576,8 +10719,117 @@ void InterSpec::displayBackgroundData()
     m_backgroundSubItems[0]->setHidden( isSub );
     m_backgroundSubItems[1]->setHidden( !isSub );
   }//if( m_backgroundSubItems[0]->isHidden() != isSub )
+  
+  accountSampleSumCache( kBackground );
 }//void displayBackgroundData()
 
 
+void InterSpec::accountSpectrumFiles()
+{
+  WApplication *app = wApp;
+  if( !app )
+    return;
+  
+  const string sessionid = app->sessionId();
+  MemoryAccountant &accountant = MemoryAccountant::instance();
+  
+  //Each file is keyed by its own address, so a file displayed as more than
+  //  one type is only counted once; files no longer displayed are removed.
+  const std::shared_ptr<SpecMeas> displayed[] = { m_dataMeasurement, m_secondDataMeasurement, m_backgroundMeasurement };
+  
+  vector<const SpecMeas *> nowDisplayed;
+  for( const std::shared_ptr<SpecMeas> &meas : displayed )
+  {
+    if( meas && std::find(nowDisplayed.begin(), nowDisplayed.end(), meas.get()) == nowDisplayed.end() )
+      nowDisplayed.push_back( meas.get() );
+  }
+  
+  for( const SpecMeas *meas : m_accountedSpectra )
+  {
+    if( std::find(nowDisplayed.begin(), nowDisplayed.end(), meas) == nowDisplayed.end() )
+      accountant.remove( meas );
+  }
+  
+  for( const std::shared_ptr<SpecMeas> &meas : displayed )
+  {
+    if( meas && std::find(m_accountedSpectra.begin(), m_accountedSpectra.end(), meas.get()) == m_accountedSpectra.end() )
+    {
+      accountant.setUsage( sessionid, meas.get(), MemoryAccountant::Category::Spectra, meas->memmorysize() );
+      m_accountedSpectra.push_back( meas.get() );
+    }
+  }//for( const std::shared_ptr<SpecMeas> &meas : displayed )
+  
+  m_accountedSpectra = nowDisplayed;
+  
+  accountPeaks();
+}//void accountSpectrumFiles()
+
+
+void InterSpec::accountPeaks()
+{
+  WApplication *app = wApp;
+  if( !app )
+    return;
+  
+  const std::shared_ptr<SpecMeas> displayed[] = { m_dataMeasurement, m_secondDataMeasurement, m_backgroundMeasurement };
+  size_t peakbytes = 0;
+  for( size_t i = 0; i < 3; ++i )
+  {
+    bool counted = !displayed[i];
+    for( size_t j = 0; j < i; ++j )
+      counted = (counted || displayed[i] == displayed[j]);
+    if( !counted )
+      peakbytes += displayed[i]->peaksMemorySize();
+  }//for( size_t i = 0; i < 3; ++i )
+  
+  MemoryAccountant::instance().setUsage( app->sessionId(), m_peakModel,
+                                 MemoryAccountant::Category::Peaks, peakbytes );
+}//void accountPeaks()
+
+
+void InterSpec::accountSampleSumCache( const SpectrumType type )
+{
+  WApplication *app = wApp;
+  if( !app )
+    return;
+  
+  const SampleSumCache *cache = nullptr;
+  switch( type )
+  {
+    case kForeground:       cache = m_foregroundSumCache.get(); break;
+    case kSecondForeground: cache = m_secondSumCache.get();     break;
+    case kBackground:       cache = m_backgroundSumCache.get(); break;
+  }//switch( type )
+  
+  if( !cache )
+    return;
+  
+  //The sample sum caches can always be rebuilt, so let them be evicted.
+  const string sessionid = app->sessionId();
+  const boost::function<void()> evict
+               = app->bind( boost::bind( &InterSpec::evictSampleSumCache, this, type ) );
+  MemoryAccountant::instance().setUsage( sessionid, cache,
+                        MemoryAccountant::Category::SampleSums, cache->memorySize(),
+                        [sessionid,evict](){
+                          Wt::WServer *server = Wt::WServer::instance();
+                          if( server )
+                            server->post( sessionid, evict );
+                        } );
+}//void accountSampleSumCache( const SpectrumType type )
+
+
+void InterSpec::evictSampleSumCache( const SpectrumType type )
+{
+  switch( type )
+  {
+    case kForeground:       m_foregroundSumCache->clear(); break;
+    case kSecondForeground: m_secondSumCache->clear();     break;
+    case kBackground:       m_backgroundSumCache->clear(); break;
+  }//switch( type )
+  
+  accountSampleSumCache( type );
+}//void evictSampleSumCache( const SpectrumType type )
+
+
 
 
@@ -65,6 +65,7 @@
 #include <Wt/WMessageResourceBundle>
 
 #include "InterSpec/PopupDiv.h"
+#include "InterSpec/Tracing.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/InterSpecUser.h"
@@ -976,6 +977,9 @@ void InterSpecApp::notify( const Wt::WEvent& event )
   try
   {
 #endif
+    //Attribute any traced spans while handling this event to this session.
+    INTERSPEC_TRACE_SESSION( sessionId() );
+    
     const bool userEvent = (event.eventType() == Wt::UserEvent);
     if( userEvent )
     {
@@ -1102,6 +1106,11 @@ void InterSpecApp::prepareForEndOfSession()
         
         Wt::Dbo::ptr<UserState> dbstate;
         std::shared_ptr<DataBaseUtils::DbSession> sql = m_viewer->sql();
+        
+        //The state is saved while holding 'transaction', so saveStateToDb(...)
+        //  cant flush the background writes the state references; do it now.
+        DataBaseUtils::flushDbWrites();
+        
         DataBaseUtils::DbTransaction transaction( *sql );
           
         UserState *state = new UserState();
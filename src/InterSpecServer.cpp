@@ -42,6 +42,7 @@
 
 
 #include "InterSpec/InterSpecApp.h"
+#include "InterSpec/DataBaseUtils.h"
 #include "InterSpec/DbToFilesystemLink.h"
 
 
@@ -226,6 +227,8 @@ namespace InterSpecServer
       ns_server->stop();
       delete ns_server;
       ns_server = 0;
+      
+      DataBaseUtils::flushDbWrites();
       std::cerr << "Stopped and killed server" << std::endl;
     }
   }//void experimental_killServer()
@@ -65,6 +65,7 @@
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/InterSpecUser.h"
 #include "InterSpec/DataBaseUtils.h"
+#include "InterSpec/MemoryAccountant.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "InterSpec/DetectorPeakResponse.h"
 
@@ -205,6 +206,18 @@ namespace
     }
     return option;
   }//UserOption *parseUserOption( rapidxml::xml_node<char> *node )
+  
+  
+  //Attributes the serialized file data (which may be many megabytes) to the
+  //  session, until the UserFileInDbData is destructed.  The session must be
+  //  passed in, as files are often serialized from worker threads, where
+  //  wApp is not set.
+  void account_file_data( const UserFileInDbData *data, const std::string &sessionid )
+  {
+    MemoryAccountant::instance().setUsage( sessionid, data,
+                                          MemoryAccountant::Category::DatabaseBlobs,
+                                          data->fileData.capacity() );
+  }//void account_file_data( const UserFileInDbData *data )
 }//namespace
 
 
@@ -385,7 +398,8 @@ void InterSpecUser::associateWidget( Wt::Dbo::ptr<InterSpecUser> user,
 
 
 void UserFileInDbData::setFileData( const std::string &path,
-                                    const SerializedFileFormat format )
+                                    const SerializedFileFormat format,
+                                    const std::string &sessionId )
 {
   fileData.clear();
 #ifdef _WIN32
@@ -448,6 +462,8 @@ void UserFileInDbData::setFileData( const std::string &path,
   if( format == UserFileInDbData::k2012N42 )
     fileData.push_back( static_cast<unsigned char>(0) );
 #endif
+  
+  account_file_data( this, sessionId );
 }//void setFileData( const std::string &path )
 
 
@@ -663,7 +679,8 @@ void ShieldingSourceModel::removeWriteProtection( Wt::Dbo::ptr<ShieldingSourceMo
 }
 
 void UserFileInDbData::setFileData( std::shared_ptr<const SpecMeas> spectrumFile,
-                          const UserFileInDbData::SerializedFileFormat format )
+                          const UserFileInDbData::SerializedFileFormat format,
+                          const std::string &sessionId )
 {
   namespace io = boost::iostreams;
 
@@ -725,6 +742,8 @@ void UserFileInDbData::setFileData( std::shared_ptr<const SpecMeas> spectrumFile
     fileData.clear();
     throw FileToLargeForDbException( actual, UserFileInDb::sm_maxFileSizeBytes );
   }//if( file is too big to save to database )
+  
+  account_file_data( this, sessionId );
 }//void UserFileInDbData::setFileData( std::shared_ptr<SpecMeas> spectrumFile )
 
 
@@ -815,6 +834,12 @@ UserFileInDbData::UserFileInDbData()
 }
 
 
+UserFileInDbData::~UserFileInDbData()
+{
+  MemoryAccountant::instance().remove( this );
+}
+
+
 boost::any UserOption::value() const
 {
   if( m_value.empty() || m_name.empty() )
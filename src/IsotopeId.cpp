@@ -24,9 +24,21 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <list>
+#include <deque>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
 #include <mutex>
+#include <memory>
+#include <future>
 #include <vector>
 #include <string>
+#include <iterator>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/functional/hash.hpp>
 
 #include <Wt/WServer>
 
@@ -36,7 +48,7 @@
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/IsotopeId.h"
 #include "InterSpec/PhysicalUnits.h"
-#include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "SpecUtils/SpectrumDataStructs.h"
 #include "InterSpec/MassAttenuationTool.h"
@@ -60,6 +72,113 @@ namespace
     return sm_data_dir;
   }
   
+  
+  typedef pair<double,const SandiaDecay::Nuclide*> EnergyNucPair;
+  
+  /** Returns the lines from "CharacteristicGammas.txt", sorted by energy.
+   
+   The file is only read the first time it is needed (or if the data directory
+   is changed), and the result is shared between all sessions and threads.
+   */
+  std::shared_ptr<const vector<EnergyNucPair>> characteristic_lines()
+  {
+    static std::mutex s_mutex;
+    static std::string s_filename;
+    static std::shared_ptr<const vector<EnergyNucPair>> s_lines;
+    
+    const string filename = UtilityFunctions::append_path( dataDirectory(), "CharacteristicGammas.txt" );
+    
+    std::lock_guard<std::mutex> lock( s_mutex );
+    if( s_lines && (filename == s_filename) )
+      return s_lines;
+    
+    auto characlines = std::make_shared<vector<EnergyNucPair>>();
+    
+#ifdef _WIN32
+    const std::wstring wfilename = UtilityFunctions::convert_from_utf8_to_utf16(filename);
+    ifstream characteristicFile( wfilename.c_str(), ios_base::binary|ios_base::in );
+#else
+    ifstream characteristicFile( filename.c_str(), ios_base::binary|ios_base::in );
+#endif
+    
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    
+    string line;
+    while( UtilityFunctions::safe_get_line( characteristicFile, line ) )
+    {
+      vector<string> fields;
+      UtilityFunctions::trim( line );
+      UtilityFunctions::split( fields, line, " \t" );
+      if( fields.size() != 2 )
+        continue;
+      
+      try
+      {
+        const double testenergy = std::stod( fields[1] );
+        const SandiaDecay::Nuclide *testnuc = db->nuclide( fields[0] );
+        if( testnuc )
+          characlines->push_back( EnergyNucPair(testenergy,testnuc) );
+      }catch( std::exception & )
+      {
+        cerr << "Invalid line in CharacteristicGammas.txt: '" << line << "'" << endl;
+      }
+    }//while( getline( characteristicFile, line ) )
+    
+    std::stable_sort( characlines->begin(), characlines->end(), &less_than_by_first<EnergyNucPair> );
+    
+    s_filename = filename;
+    s_lines = characlines;
+    
+    return s_lines;
+  }//characteristic_lines()
+  
+  
+  /** Process-wide index of energy to nuclide used by gammasNearInEnergy(...),
+   along with the long-lived forebearers of each nuclide in it, so they dont
+   have to be re-computed for every match.
+   */
+  struct NearbyGammaIndex
+  {
+    std::shared_ptr< const EnergyToNuclideServer::EnergyNuclidePairVec > energyToNuc;
+    std::unordered_map< const SandiaDecay::Nuclide *, vector<const SandiaDecay::Nuclide *> > parents;
+  };//struct NearbyGammaIndex
+  
+  
+  const NearbyGammaIndex &nearby_gamma_index( const double min_halflife, const double min_br )
+  {
+    static std::mutex s_mutex;
+    static std::unique_ptr<NearbyGammaIndex> s_index;
+    
+    std::lock_guard<std::mutex> lock( s_mutex );
+    if( s_index )
+      return *s_index;
+    
+    std::unique_ptr<NearbyGammaIndex> index( new NearbyGammaIndex() );
+    
+    EnergyToNuclideServer::setLowerLimits( min_halflife, min_br );
+    index->energyToNuc = EnergyToNuclideServer::energyToNuclide();
+    
+    if( index->energyToNuc )
+    {
+      for( const EnergyToNuclideServer::EnergyNuclidePair &enp : *index->energyToNuc )
+      {
+        if( !enp.nuclide || index->parents.count(enp.nuclide) )
+          continue;
+        
+        vector<const SandiaDecay::Nuclide *> &parents = index->parents[enp.nuclide];
+        for( const SandiaDecay::Nuclide *parent : enp.nuclide->forebearers() )
+        {
+          if( parent->halfLife > min_halflife )
+            parents.push_back( parent );
+        }
+      }//for( loop over energyToNuc )
+    }//if( index->energyToNuc )
+    
+    s_index = std::move( index );
+    
+    return *s_index;
+  }//nearby_gamma_index(...)
+  
   bool less_than_by_weight( const IsotopeId::NuclideStatWeightPair &lhs,
                             const IsotopeId::NuclideStatWeightPair &rhs )
   {
@@ -78,6 +197,329 @@ namespace
     return a.first < b.first;
   }
   
+  
+  /** Identifies the inputs of a suggestNuclides(...) computation.
+   
+   Peaks and spectra are not modified once they are shared (a change creates
+   new objects), so the inputs are identified by the objects themselves, which
+   are held as weak pointers so cached entries dont keep the spectra, or peaks,
+   of closed files alive.  The detector response is identified by its hash
+   value, since the same response is often re-created.  'hash' combines all of
+   these, and is used to quickly find candidate entries.
+   */
+  struct SuggestionInputs
+  {
+    std::weak_ptr<const PeakDef> peak;
+    std::vector< std::weak_ptr<const PeakDef> > all_peaks;
+    std::weak_ptr<const std::vector<float>> counts;
+    std::weak_ptr<const std::vector<float>> energies;
+    float live_time;
+    float real_time;
+    uint64_t response_hash;
+    size_t hash;
+  };//struct SuggestionInputs
+  
+  
+  /** The objects a computation that hasnt been ran yet needs; released as
+   soon as the computation starts.
+   */
+  struct SuggestionWork
+  {
+    std::shared_ptr<const PeakDef> peak;
+    std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks;
+    std::shared_ptr<const Measurement> data;
+    std::shared_ptr<const DetectorPeakResponse> response;
+  };//struct SuggestionWork
+  
+  
+  typedef std::shared_future< std::shared_ptr<const IsotopeId::PeakToNuclideMatch> > SuggestionFuture;
+  
+  struct SuggestionEntry
+  {
+    SuggestionInputs inputs;
+    SuggestionFuture result;
+    
+    //run: computes the result, unless it has already been started; called by
+    //  whoever is waiting on the result, so a queued computation never has to
+    //  wait on a worker thread.
+    std::function<void()> run;
+    
+    //bytes: approximate memory used by the entry, for sm_max_suggestion_bytes.
+    size_t bytes;
+  };//struct SuggestionEntry
+  
+  typedef std::list<SuggestionEntry> SuggestionList;
+  
+  //Approximate maximum memory the cached suggestion results may use; entries
+  //  only hold on to their results, and weak pointers to their inputs.
+  const size_t sm_max_suggestion_bytes = 4*1024*1024;
+  
+  //Approximate size of a result; most results have a few dozen nuclides.
+  const size_t sm_approx_suggestion_result_bytes = sizeof(IsotopeId::PeakToNuclideMatch)
+                                      + 32*sizeof(IsotopeId::NuclideStatWeightPair);
+  
+  std::mutex sm_suggestion_cache_mutex;
+  SuggestionList sm_suggestion_cache;  //least recently used at front
+  size_t sm_suggestion_cache_bytes = 0;
+  std::unordered_multimap<size_t,SuggestionList::iterator> sm_suggestion_index;
+  
+  
+  //same_object(...): true if both point to the same, still existing, object.
+  template<class T>
+  bool same_object( const std::weak_ptr<T> &lhs, const std::weak_ptr<T> &rhs )
+  {
+    return !lhs.owner_before(rhs) && !rhs.owner_before(lhs) && !lhs.expired();
+  }
+  
+  
+  //same_peak(...): compares all the PeakDef quantities the suggestion
+  //  computation depends on: shape, continuum, and assigned source.  The
+  //  continuum may be shared, and changed, between peaks, so the peak being
+  //  evaluated is compared by value, in addition to by identity.
+  bool same_peak( const PeakDef &lhs, const PeakDef &rhs )
+  {
+    if( &lhs == &rhs )
+      return true;
+    
+    const std::shared_ptr<const PeakContinuum> lhscont = lhs.continuum();
+    const std::shared_ptr<const PeakContinuum> rhscont = rhs.continuum();
+    
+    return lhs.gausPeak() == rhs.gausPeak()
+           && lhs.mean() == rhs.mean()
+           && lhs.sigma() == rhs.sigma()
+           && lhs.amplitude() == rhs.amplitude()
+           && lhs.lowerX() == rhs.lowerX()
+           && lhs.upperX() == rhs.upperX()
+           && (lhscont == rhscont || (lhscont && rhscont && (*lhscont == *rhscont)))
+           && lhs.parentNuclide() == rhs.parentNuclide()
+           && lhs.nuclearTransition() == rhs.nuclearTransition()
+           && lhs.decayParticle() == rhs.decayParticle()
+           && lhs.sourceGammaType() == rhs.sourceGammaType()
+           && lhs.xrayElement() == rhs.xrayElement()
+           && lhs.xrayEnergy() == rhs.xrayEnergy()
+           && lhs.reaction() == rhs.reaction()
+           && lhs.reactionEnergy() == rhs.reactionEnergy();
+  }//bool same_peak(...)
+  
+  
+  bool same_inputs( const SuggestionInputs &lhs, const SuggestionInputs &rhs,
+                    const PeakDef &rhspeak )
+  {
+    if( lhs.hash != rhs.hash
+        || lhs.live_time != rhs.live_time
+        || lhs.real_time != rhs.real_time
+        || lhs.response_hash != rhs.response_hash
+        || lhs.all_peaks.size() != rhs.all_peaks.size()
+        || !same_object( lhs.peak, rhs.peak )
+        || !same_object( lhs.counts, rhs.counts )
+        || !same_object( lhs.energies, rhs.energies ) )
+      return false;
+    
+    for( size_t i = 0; i < lhs.all_peaks.size(); ++i )
+    {
+      if( !same_object( lhs.all_peaks[i], rhs.all_peaks[i] ) )
+        return false;
+    }
+    
+    const std::shared_ptr<const PeakDef> lhspeak = lhs.peak.lock();
+    return lhspeak && same_peak( *lhspeak, rhspeak );
+  }//bool same_inputs(...)
+  
+  
+  //Same as same_inputs(...) above, but for two existing entries.
+  bool same_inputs( const SuggestionInputs &lhs, const SuggestionInputs &rhs )
+  {
+    const std::shared_ptr<const PeakDef> rhspeak = rhs.peak.lock();
+    return rhspeak && same_inputs( lhs, rhs, *rhspeak );
+  }
+  
+  
+  void hash_peak( size_t &seed, const PeakDef &p )
+  {
+    boost::hash_combine( seed, p.gausPeak() );
+    boost::hash_combine( seed, p.mean() );
+    boost::hash_combine( seed, p.sigma() );
+    boost::hash_combine( seed, p.amplitude() );
+    boost::hash_combine( seed, p.lowerX() );
+    boost::hash_combine( seed, p.upperX() );
+    boost::hash_combine( seed, static_cast<const void *>(p.parentNuclide()) );
+    boost::hash_combine( seed, static_cast<const void *>(p.xrayElement()) );
+    boost::hash_combine( seed, static_cast<const void *>(p.reaction()) );
+  }//void hash_peak(...)
+  
+  
+  /** Fills out everything but 'peak' (and the peaks contribution to 'hash'),
+   which are the same for all peaks of a batch.
+   */
+  SuggestionInputs suggestion_inputs(
+                 const std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > &all_peaks,
+                 const std::shared_ptr<const Measurement> &data,
+                 const std::shared_ptr<const DetectorPeakResponse> &response )
+  {
+    SuggestionInputs inputs;
+    inputs.live_time = data ? data->live_time() : 0.0f;
+    inputs.real_time = data ? data->real_time() : 0.0f;
+    inputs.response_hash = response ? response->hashValue() : uint64_t(0);
+    inputs.hash = 0;
+    
+    std::shared_ptr<const std::vector<float>> counts, energies;
+    if( data )
+    {
+      counts = data->gamma_counts();
+      energies = data->channel_energies();
+    }
+    inputs.counts = counts;
+    inputs.energies = energies;
+    
+    if( all_peaks )
+    {
+      inputs.all_peaks.reserve( all_peaks->size() );
+      for( const std::shared_ptr<const PeakDef> &p : *all_peaks )
+      {
+        inputs.all_peaks.push_back( p );
+        boost::hash_combine( inputs.hash, static_cast<const void *>(p.get()) );
+      }
+    }//if( all_peaks )
+    
+    boost::hash_combine( inputs.hash, static_cast<const void *>(counts.get()) );
+    boost::hash_combine( inputs.hash, static_cast<const void *>(energies.get()) );
+    boost::hash_combine( inputs.hash, inputs.live_time );
+    boost::hash_combine( inputs.hash, inputs.real_time );
+    boost::hash_combine( inputs.hash, inputs.response_hash );
+    
+    return inputs;
+  }//SuggestionInputs suggestion_inputs(...)
+  
+  
+  SuggestionInputs suggestion_inputs( const SuggestionInputs &common,
+                                      const std::shared_ptr<const PeakDef> &peak )
+  {
+    SuggestionInputs inputs = common;
+    inputs.peak = peak;
+    boost::hash_combine( inputs.hash, static_cast<const void *>(peak.get()) );
+    hash_peak( inputs.hash, *peak );
+    return inputs;
+  }//SuggestionInputs suggestion_inputs(...)
+  
+  
+  //Removes the entry from the cache; sm_suggestion_cache_mutex must be locked.
+  void remove_suggestion_entry( const SuggestionList::iterator entry )
+  {
+    const auto range = sm_suggestion_index.equal_range( entry->inputs.hash );
+    for( auto pos = range.first; pos != range.second; ++pos )
+    {
+      if( pos->second == entry )
+      {
+        sm_suggestion_index.erase( pos );
+        break;
+      }
+    }
+    
+    sm_suggestion_cache_bytes -= entry->bytes;
+    sm_suggestion_cache.erase( entry );
+  }//void remove_suggestion_entry(...)
+  
+  
+  /** Returns the cached (or in-progress) suggestion computation for the given
+   inputs, or if there isnt one, creates one (which isnt started until its
+   'run' function is called); 'created' is set to whether a new entry was made.
+   */
+  SuggestionEntry suggestion_entry( const SuggestionInputs &inputs,
+                                    const SuggestionWork &work, bool &created )
+  {
+    typedef std::shared_ptr<const IsotopeId::PeakToNuclideMatch> Result_t;
+    
+    std::lock_guard<std::mutex> lock( sm_suggestion_cache_mutex );
+    
+    const auto range = sm_suggestion_index.equal_range( inputs.hash );
+    for( auto pos = range.first; pos != range.second; )
+    {
+      const SuggestionList::iterator entry = pos->second;
+      
+      if( same_inputs( entry->inputs, inputs, *work.peak ) )
+      {
+        //Mark as most recently used.
+        sm_suggestion_cache.splice( end(sm_suggestion_cache), sm_suggestion_cache, entry );
+        created = false;
+        return *entry;
+      }
+      
+      ++pos;
+      
+      //The spectrum or peaks of this entry no longer exist; it can never be used.
+      if( entry->inputs.peak.expired() || entry->inputs.counts.expired() )
+      {
+        sm_suggestion_cache_bytes -= entry->bytes;
+        sm_suggestion_index.erase( std::prev(pos) );
+        sm_suggestion_cache.erase( entry );
+      }
+    }//for( loop over entries with the same hash )
+    
+    auto pending = std::make_shared<SuggestionWork>( work );
+    
+    auto task = std::make_shared< std::packaged_task<Result_t()> >( [pending]() -> Result_t {
+      //Take the inputs out of 'pending', so they are released once done.
+      const SuggestionWork w = std::move( *pending );
+      *pending = SuggestionWork();
+      
+      auto answer = std::make_shared<IsotopeId::PeakToNuclideMatch>();
+      IsotopeId::suggestNuclides( *answer, w.peak, w.all_peaks, w.data, w.response );
+      return answer;
+    } );
+    
+    auto claimed = std::make_shared< std::atomic<bool> >( false );
+    
+    SuggestionEntry entry;
+    entry.inputs = inputs;
+    entry.result = task->get_future().share();
+    entry.run = [task,claimed](){
+      if( !claimed->exchange( true ) )
+        (*task)();  //packaged_task, so wont throw
+    };
+    entry.bytes = sizeof(SuggestionEntry) + sizeof(SuggestionWork) + 4*sizeof(void *)
+                  + inputs.all_peaks.capacity()*sizeof(std::weak_ptr<const PeakDef>)
+                  + sm_approx_suggestion_result_bytes;
+    
+    sm_suggestion_cache.push_back( entry );
+    sm_suggestion_cache_bytes += entry.bytes;
+    sm_suggestion_index.insert( std::make_pair( inputs.hash, std::prev(end(sm_suggestion_cache)) ) );
+    
+    //Evict the least recently used entries, but never the one just inserted.
+    while( sm_suggestion_cache_bytes > sm_max_suggestion_bytes
+           && sm_suggestion_cache.size() > 1 )
+      remove_suggestion_entry( begin(sm_suggestion_cache) );
+    
+    created = true;
+    return entry;
+  }//SuggestionEntry suggestion_entry(...)
+  
+  
+  /** Waits for the result of a suggestion computation (running it on this
+   thread if it hasnt been started yet); if the computation threw an
+   exception, the entry is removed from the cache, and the exception re-thrown.
+   */
+  std::shared_ptr<const IsotopeId::PeakToNuclideMatch> suggestion_result(
+                                                  const SuggestionEntry &entry )
+  {
+    try
+    {
+      entry.run();
+      return entry.result.get();
+    }catch( ... )
+    {
+      std::lock_guard<std::mutex> lock( sm_suggestion_cache_mutex );
+      const auto range = sm_suggestion_index.equal_range( entry.inputs.hash );
+      for( auto pos = range.first; pos != range.second; ++pos )
+      {
+        if( same_inputs( pos->second->inputs, entry.inputs ) )
+        {
+          remove_suggestion_entry( pos->second );
+          break;
+        }
+      }//for( loop over entries with the same hash )
+      throw;
+    }//try / catch
+  }//suggestion_result(...)
 }//namespace
 
 
@@ -125,64 +567,56 @@ double minDetectableCounts( std::shared_ptr<const PeakDef> peak, std::shared_ptr
 
 
 
-map<const SandiaDecay::Nuclide *, int> characteristics(
-      std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks )
+map<const SandiaDecay::Nuclide *, int> characteristicGammaMatches(
+                    const std::deque< std::shared_ptr<const PeakDef> > &peaks )
 {
-  //Now go through CharacteristicGammas.txt, and possibly augment weights
-  typedef pair<double,const SandiaDecay::Nuclide*> EnergyNucPair;
-  vector<EnergyNucPair > characlines;
-  
-  {//begin codeblock to read characteristic gammas
-    string line;
-    const string filename = UtilityFunctions::append_path( dataDirectory(), "CharacteristicGammas.txt" );
-    
-#ifdef _WIN32
-    const std::wstring wfilename = UtilityFunctions::convert_from_utf8_to_utf16(filename);
-    ifstream characteristicFile( filename.c_str(), ios_base::binary|ios_base::in );
-#else
-    ifstream characteristicFile( filename.c_str(), ios_base::binary|ios_base::in );
-#endif
-    
-    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
-    
-    while( UtilityFunctions::safe_get_line( characteristicFile, line ) )
-    {
-      vector<string> fields;
-      UtilityFunctions::trim( line );
-      UtilityFunctions::split( fields, line, " \t" );
-      if( fields.size() != 2 )
-        continue;
-      
-      const double testenergy = std::stod( fields[1] );
-      
-      const SandiaDecay::Nuclide *testnuc = db->nuclide( fields[0] );
-      
-      if( testnuc )
-        characlines.push_back( pair<double,const SandiaDecay::Nuclide*>(testenergy,testnuc) );
-    }//while( getline( characteristicFile, line ) )
-    
-    std::sort( characlines.begin(), characlines.end(), &less_than_by_first< pair<double,const SandiaDecay::Nuclide*> >  );
-  }//end codeblock to read characteristic gammas
-  
-  
   map<const SandiaDecay::Nuclide *, int> answer;
   
-  for( std::shared_ptr<const PeakDef> peak : *all_peaks )
+  const std::shared_ptr<const vector<EnergyNucPair>> characlines = characteristic_lines();
+  if( !characlines || characlines->empty() || peaks.empty() )
+    return answer;
+  
+  //Get the energy range of each peak, sorted by lower energy, so we can match
+  //  all of the peaks with a single sweep through the (sorted) lines.
+  vector< pair<double,double> > ranges;
+  ranges.reserve( peaks.size() );
+  for( const std::shared_ptr<const PeakDef> &peak : peaks )
   {
+    if( !peak )
+      continue;
     const double lowe = (peak->gausPeak() ? (peak->mean()-1.5*peak->sigma()) : peak->lowerX());
     const double highe = (peak->gausPeak() ? (peak->mean() + 1.5*peak->sigma()) : peak->upperX());
-    for( const EnergyNucPair &enp : characlines )
-    {
-      if( (enp.first>=lowe) && (enp.first<=highe) )
-      {
-        if( answer.find(enp.second) == answer.end() )
-          answer[enp.second] = 0;
-        answer[enp.second] = answer[enp.second] + 1;
-      }
-    }//for( const EnergyNucPair &enp : characlines )
-  }//for( std::shared_ptr<const PeakDef> peak : all_peaks )
+    ranges.push_back( make_pair(lowe, highe) );
+  }//for( const std::shared_ptr<const PeakDef> &peak : peaks )
+  
+  std::sort( ranges.begin(), ranges.end() );
+  
+  const vector<EnergyNucPair> &lines = *characlines;
+  
+  //'first_line' is the first line at or above the lower energy of the current
+  //  peak; since the peaks are sorted by lower energy it only moves forward.
+  //  Peaks may overlap, so each peak scans forward from 'first_line' until
+  //  past its upper energy.
+  size_t first_line = 0;
+  for( const pair<double,double> &range : ranges )
+  {
+    while( first_line < lines.size() && lines[first_line].first < range.first )
+      ++first_line;
+    
+    for( size_t i = first_line; i < lines.size() && lines[i].first <= range.second; ++i )
+      answer[lines[i].second] += 1;
+  }//for( const pair<double,double> &range : ranges )
   
   return answer;
+}//characteristicGammaMatches(...)
+
+
+map<const SandiaDecay::Nuclide *, int> characteristics(
+      std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks )
+{
+  if( !all_peaks )
+    return map<const SandiaDecay::Nuclide *, int>();
+  return characteristicGammaMatches( *all_peaks );
 }//characteristics(...)
 
 
@@ -326,45 +760,33 @@ vector<NuclideStatWeightPair> gammasNearInEnergy( float x, double dx )
   const double min_halflife = 6000.0*second;
   const double min_br = 1.0E-6;
   
-  static std::shared_ptr< const EnergyToNuclideServer::EnergyNuclidePairVec > energyToNuc;
-  static std::mutex energyToNucMutex;
-  {//begin codeblock to ensure thread safety
-    std::lock_guard<std::mutex> lock( energyToNucMutex );
-    if( !energyToNuc )
-    {
-      EnergyToNuclideServer::setLowerLimits( min_halflife, min_br );
-      energyToNuc = EnergyToNuclideServer::energyToNuclide();
-    }
-  }//end codeblock to ensure thread safety
+  const NearbyGammaIndex &index = nearby_gamma_index( min_halflife, min_br );
   
-  vector<const Nuclide *> nucs = EnergyToNuclideServer::nuclidesWithGammaInRange( x-dx, x+dx, *energyToNuc );
+  vector<NuclideStatWeightPair> answer;
+  if( !index.energyToNuc )
+    return answer;
   
-  const EnergyToNuclideServer::EnergyNuclidePairVec::const_iterator begin_nuc = energyToNuc->begin();
-  const EnergyToNuclideServer::EnergyNuclidePairVec::const_iterator end_nuc   = energyToNuc->end();
+  const EnergyToNuclideServer::EnergyNuclidePairVec &energyToNuc = *index.energyToNuc;
   
   EnergyToNuclideServer::EnergyNuclidePairVec::const_iterator lower, upper, iter;
   const EnergyToNuclideServer::EnergyNuclidePair lowerE( x-dx, NULL ), upperE( x+dx, NULL );
   
-  lower = lower_bound( begin_nuc, end_nuc, lowerE );
-  upper = upper_bound( begin_nuc, end_nuc, upperE );
-
-  vector<NuclideStatWeightPair> answer;
+  lower = lower_bound( energyToNuc.begin(), energyToNuc.end(), lowerE );
+  upper = upper_bound( energyToNuc.begin(), energyToNuc.end(), upperE );
   
   for( iter = lower; iter != upper; ++iter )
   {
-    NuclideStatWeightPair thisnuc( iter->nuclide, fabs( iter->energy - x ) );
-    answer.push_back( thisnuc );
+    const double weight = fabs( iter->energy - x );
+    answer.push_back( NuclideStatWeightPair( iter->nuclide, weight ) );
     
     //XXX - should check that the BR to this nuclide is large enough to satisfy
     //      min_br
-    for( const SandiaDecay::Nuclide *parent : iter->nuclide->forebearers() )
+    const auto parents = index.parents.find( iter->nuclide );
+    if( parents != index.parents.end() )
     {
-      if( parent->halfLife > min_halflife )
-      {
-        thisnuc.nuclide = parent;
-        answer.push_back( thisnuc );
-      }//if( parent->halfLife > min_halflife )
-    }//for(...)
+      for( const SandiaDecay::Nuclide *parent : parents->second )
+        answer.push_back( NuclideStatWeightPair( parent, weight ) );
+    }
   }//for( iter = lower; iter != upper; ++iter )
   
   std::sort( answer.begin(), answer.end(), &less_than_by_weight );
@@ -490,6 +912,89 @@ void suggestNuclides(
   answer.nuclideWeightPairs.swap( candidates );
 }//suggestNuclides(...)
 
+
+void suggestNuclidesCached(
+  PeakToNuclideMatch &answer,
+  std::shared_ptr<const PeakDef> peak,
+  std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > peaks,
+  std::shared_ptr<const Measurement> data,
+  std::shared_ptr<const DetectorPeakResponse> response )
+{
+  if( !peak )
+    throw runtime_error( "suggestNuclidesCached(...): invalid input" );
+  
+  const SuggestionInputs inputs
+                = suggestion_inputs( suggestion_inputs( peaks, data, response ), peak );
+  
+  SuggestionWork work;
+  work.peak = peak;
+  work.all_peaks = peaks;
+  work.data = data;
+  work.response = response;
+  
+  bool created;
+  const SuggestionEntry entry = suggestion_entry( inputs, work, created );
+  
+  answer = *suggestion_result( entry );
+}//void suggestNuclidesCached(...)
+
+
+void suggestNuclides( std::vector<PeakToNuclideMatch> &answers,
+                      const std::vector< std::shared_ptr<const PeakDef> > &peaks,
+                      std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks,
+                      std::shared_ptr<const Measurement> data,
+                      std::shared_ptr<const DetectorPeakResponse> response )
+{
+  answers.clear();
+  answers.resize( peaks.size() );
+  
+  const SuggestionInputs common = suggestion_inputs( all_peaks, data, response );
+  
+  SuggestionWork work;
+  work.all_peaks = all_peaks;
+  work.data = data;
+  work.response = response;
+  
+  //Queue up the new computations, so peaks are evaluated in parallel, and
+  //  then collect the results (computations some other thread created, but
+  //  hasnt started, are ran on this thread).
+  vector<SuggestionEntry> entries( peaks.size() );
+  
+  {//begin codeblock to compute new entries
+    ComputeScheduler::TaskGroup group;
+    
+    for( size_t i = 0; i < peaks.size(); ++i )
+    {
+      if( !peaks[i] )
+        continue;
+      
+      work.peak = peaks[i];
+      
+      bool created;
+      entries[i] = suggestion_entry( suggestion_inputs( common, peaks[i] ), work, created );
+      if( created )
+        group.post( entries[i].run );
+    }//for( size_t i = 0; i < peaks.size(); ++i )
+    
+    group.join();
+  }//end codeblock to compute new entries
+  
+  for( size_t i = 0; i < peaks.size(); ++i )
+  {
+    if( !entries[i].result.valid() )
+      continue;
+    
+    try
+    {
+      answers[i] = *suggestion_result( entries[i] );
+    }catch( std::exception &e )
+    {
+      cerr << "suggestNuclides(...): failed for peak at " << peaks[i]->mean()
+           << " keV: " << e.what() << endl;
+    }
+  }//for( size_t i = 0; i < peaks.size(); ++i )
+}//void suggestNuclides(...)
+
 //////--------------------------------------------------------------------//////
 
 
@@ -553,7 +1058,7 @@ void findCandidates( vector<string> &suggestednucs,
     
     
     PeakToNuclideMatch suggestedNucs;
-    suggestNuclides( suggestedNucs, peak, allpeaks, data, detector );
+    suggestNuclidesCached( suggestedNucs, peak, allpeaks, data, detector );
     
     const vector<NuclideStatWeightPair> &sugestions
                                              = suggestedNucs.nuclideWeightPairs;
@@ -1049,7 +1554,7 @@ void populateCandidateNuclides( std::shared_ptr<const Measurement> data,
   set<string> entries;
   vector<string> suggestednucs, characteristicnucs, otherpeaksnucs;
   
-  SpecUtilsAsync::ThreadPool pool;
+  ComputeScheduler::TaskGroup pool;
   
   std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > allpeaks
                                                                     = hintpeaks;
@@ -23,9 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <string>
 #include <vector>
+#include <utility>
 #include <algorithm>
+#include <stdexcept>
 
 #include <boost/any.hpp>
 
@@ -66,6 +69,94 @@ namespace
     const T arr;
   };//struct index_compare
   
+  
+  //NameIndex: lookup tables over the decay and reaction databases, so the
+  //  type-ahead filtering doesnt have to re-scan every element, nuclide, and
+  //  reaction on each keystroke.  Built once per process (see name_index()),
+  //  and never modified afterwards, so is safe to share between sessions.
+  struct NameIndex
+  {
+    //Lowercase element names and symbols, sorted, so all elements starting
+    //  with a given prefix are a contiguous range found by binary search.
+    std::vector<std::pair<std::string,const SandiaDecay::Element *>> elementPrefixes;
+    
+    //Nuclides of each element (in SandiaDecayDataBase::nuclides(el) order)
+    //  that may be suggested (i.e., not stable and have decays), along with
+    //  their mass number as a string.
+    std::map<const SandiaDecay::Element *,
+             std::vector<std::pair<const SandiaDecay::Nuclide *,std::string>>> elementNuclides;
+    
+    //Suggestable nuclides by mass number, in SandiaDecayDataBase::nuclides()
+    //  order.
+    std::map<int,std::vector<const SandiaDecay::Nuclide *>> massNumberNuclides;
+    
+    //Reactions by the atomic number of their target element or nuclide, and by
+    //  their target nuclide.
+    std::map<int,std::vector<const ReactionGamma::Reaction *>> elementReactions;
+    std::map<const SandiaDecay::Nuclide *,std::vector<const ReactionGamma::Reaction *>> nuclideReactions;
+    
+    NameIndex()
+    {
+      const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+      if( !db )
+        throw runtime_error( "NameIndex: invalid decay database" );
+      
+      for( const SandiaDecay::Element *el : db->elements() )
+      {
+        elementPrefixes.emplace_back( UtilityFunctions::to_lower_copy( el->name ), el );
+        elementPrefixes.emplace_back( UtilityFunctions::to_lower_copy( el->symbol ), el );
+        
+        auto &nucs = elementNuclides[el];
+        for( const SandiaDecay::Nuclide *nuc : db->nuclides( el ) )
+        {
+          if( !IsInf(nuc->halfLife) && !nuc->decaysToChildren.empty() )
+            nucs.emplace_back( nuc, std::to_string(nuc->massNumber) );
+        }
+      }//for( const SandiaDecay::Element *el : db->elements() )
+      
+      std::sort( elementPrefixes.begin(), elementPrefixes.end() );
+      
+      for( const SandiaDecay::Nuclide *nuc : db->nuclides() )
+      {
+        if( !IsInf(nuc->halfLife) && !nuc->decaysToChildren.empty() )
+          massNumberNuclides[nuc->massNumber].push_back( nuc );
+      }
+      
+      const ReactionGamma *reactionDb = NULL;
+      try
+      {
+        reactionDb = ReactionGammaServer::database();
+      }catch(...)
+      {
+        cerr << "NameIndex: Failed to open gamma reactions XML file" << endl;
+      }
+      
+      for( ReactionType type = ReactionType(0);
+           reactionDb && type < NumReactionType;
+           type = ReactionType(type+1) )
+      {
+        for( const ReactionGamma::Reaction *rctn : reactionDb->reactions(type) )
+        {
+          const SandiaDecay::Nuclide *nuc = rctn->targetNuclide;
+          const SandiaDecay::Element *el = rctn->targetElement;
+          
+          if( el )
+            elementReactions[el->atomicNumber].push_back( rctn );
+          if( nuc && (!el || nuc->atomicNumber != el->atomicNumber) )
+            elementReactions[nuc->atomicNumber].push_back( rctn );
+          if( nuc )
+            nuclideReactions[nuc].push_back( rctn );
+        }//for( const Reaction *rctn : reactions(type) )
+      }//for( loop over ReactionType )
+    }//NameIndex()
+  };//struct NameIndex
+  
+  
+  const NameIndex &name_index()
+  {
+    static const NameIndex index;
+    return index;
+  }
 }//namespace
 
 IsotopeNameFilterModel::IsotopeNameFilterModel( WObject *parent )
@@ -493,23 +584,19 @@ std::set<const SandiaDecay::Element *> IsotopeNameFilterModel::possibleElements(
                                         const std::vector<string> &alphastrs )
 {
   std::set<const SandiaDecay::Element *> candidate_elements;
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
-  
-  //suggest based off of alphastrs
-  const std::vector<const SandiaDecay::Element *> &elements = db->elements();
+  const auto &prefixes = name_index().elementPrefixes;
   
-  for( const SandiaDecay::Element *el : elements )
+  //suggest based off of alphastrs; alphastrs are already lowercase
+  for( const string &str : alphastrs )
   {
-    const string name   = UtilityFunctions::to_lower_copy( el->name );
-    const string symbol = UtilityFunctions::to_lower_copy( el->symbol );
-    
-    for( string str : alphastrs )
+    const pair<string,const SandiaDecay::Element *> key( str, nullptr );
+    for( auto pos = std::lower_bound( prefixes.begin(), prefixes.end(), key );
+         pos != prefixes.end() && UtilityFunctions::starts_with( pos->first, str.c_str() );
+         ++pos )
     {
-      if( UtilityFunctions::starts_with( symbol, str.c_str() )
-         || UtilityFunctions::starts_with( name, str.c_str() ) )
-        candidate_elements.insert( el );
-    }//for( const string &str : alphastrs )
-  }//for( const SandiaDecay::Element *el : elements )
+      candidate_elements.insert( pos->second );
+    }
+  }//for( const string &str : alphastrs )
   
   return candidate_elements;
 }//possibleElements
@@ -522,7 +609,7 @@ void IsotopeNameFilterModel::suggestNuclides(
                                           vector<const SandiaDecay::Nuclide *> &suggestions,
                                           vector< const SandiaDecay::Element * > &suggest_elements )
 {
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  const NameIndex &index = name_index();
   
   for( const SandiaDecay::Element *el : candidate_elements )
   {
@@ -544,16 +631,17 @@ void IsotopeNameFilterModel::suggestNuclides(
       if( numericstrs.empty() && is_exact_element )
         suggest_elements.push_back( el );
       
-      const vector<const SandiaDecay::Nuclide *> nuclides = db->nuclides( el );
+      const auto nucpos = index.elementNuclides.find( el );
+      if( nucpos == index.elementNuclides.end() )
+        continue;
       
-      for( const SandiaDecay::Nuclide *nuc : nuclides )
+      for( const auto &nuc_mass : nucpos->second )
       {
-        if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
-          continue;
+        const SandiaDecay::Nuclide *nuc = nuc_mass.first;
         
         bool numeric_compat = false;
         for( const string &str : numericstrs )
-          numeric_compat |= UtilityFunctions::contains( std::to_string(nuc->massNumber), str.c_str() );
+          numeric_compat |= UtilityFunctions::contains( nuc_mass.second, str.c_str() );
         
         if( metalevel > 0 && metalevel!=nuc->isomerNumber )
           numeric_compat = false;
@@ -567,23 +655,21 @@ void IsotopeNameFilterModel::suggestNuclides(
   
   if( alphastrs.empty() )
   {
-    const std::vector<const SandiaDecay::Nuclide *> &nucs = db->nuclides();
-    std::vector<const SandiaDecay::Nuclide *>::const_iterator pos;
-    for( pos = nucs.begin(); pos != nucs.end(); ++pos )
+    for( const string &str : numericstrs )
     {
-      const SandiaDecay::Nuclide *nuc = (*pos);
-      if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
-        continue;
-      
-      for( string str : numericstrs )
+      int massNumber = -1;
+      try
       {
-        try
-        {
-          if( nuc->massNumber==std::stoi(str) )
-            suggestions.push_back( nuc );
-        }catch(...){ cerr << "Shouldnt ever be here" << endl; }
-      }//for( string str : numericstrs )
-    }//for( pos = nucs.begin(); pos != nucs.end(); ++pos )
+        massNumber = std::stoi( str );
+      }catch(...)
+      {
+        continue;  //number too large to be a mass number
+      }
+      
+      const auto pos = index.massNumberNuclides.find( massNumber );
+      if( pos != index.massNumberNuclides.end() )
+        suggestions.insert( suggestions.end(), pos->second.begin(), pos->second.end() );
+    }//for( const string &str : numericstrs )
   }//if( the user has only typed in numbers )
 
 }//suggestNuclides(...)
@@ -632,12 +718,22 @@ std::vector<const ReactionGamma::Reaction *>
   if( testTxt.empty() || !reactionDb )
     return suggest_reactions;
   
+  const NameIndex &index = name_index();
   for( const SandiaDecay::Element *el : candidate_elements )
-    reactionDb->reactions( el, suggest_reactions );
+  {
+    const auto pos = index.elementReactions.find( el->atomicNumber );
+    if( pos != index.elementReactions.end() )
+      suggest_reactions.insert( suggest_reactions.end(), pos->second.begin(), pos->second.end() );
+  }
+  
   for( const SandiaDecay::Nuclide *nuc : suggestions )
-    reactionDb->reactions( nuc, suggest_reactions );
+  {
+    const auto pos = index.nuclideReactions.find( nuc );
+    if( pos != index.nuclideReactions.end() )
+      suggest_reactions.insert( suggest_reactions.end(), pos->second.begin(), pos->second.end() );
+  }
     
-  //make all rections uniqe and sorted (in not the most effiecient manor...)
+  //make all rections uniqe and sorted
   vector<const ReactionGamma::Reaction *>::iterator new_end;
   std::sort( suggest_reactions.begin(), suggest_reactions.end(),
             &less_than_by_name );
@@ -52,6 +52,7 @@
 
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/PeakModel.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/InterSpecApp.h"
@@ -1064,7 +1065,8 @@ void IsotopeSearchByEnergy::startSearch( const bool refreshBr )
                                 &IsotopeSearchByEnergyModel::setSearchEnergies,
                                 workingspace, m_minBr, m_minHl, srcs,
                                 app->sessionId(), updatefcnt );
-  WServer::instance()->ioService().post( worker );
+  ComputeScheduler::instance().post( app->sessionId(), worker,
+                                     ComputeScheduler::Priority::Interactive );
   
   m_searching->show();
 }//void startSearch()
@@ -65,6 +65,7 @@
 #include "InterSpec/MakeDrfChart.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/DataBaseUtils.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "SandiaDecay/SandiaDecay.h"
 #include "InterSpec/MakeDrfSrcDef.h"
 #include "InterSpec/PhysicalUnits.h"
@@ -1215,7 +1216,11 @@ MakeDrf::MakeDrf( InterSpec *viewer, MaterialDB *materialDB,
   m_fwhmFitId( 0 ),
   m_effEqnFitId( 0 ),
   m_fwhmEqnChi2( -999.9 ),
-  m_effEqnChi2( -999.9 )
+  m_effEqnChi2( -999.9 ),
+  m_prevFwhmForm( -1 ),
+  m_prevEffEqnInMeV( false ),
+  m_userSelectedEffOrder( false ),
+  m_userSelectedFwhmForm( false )
 {
   assert( m_interspec );
   assert( m_materialDB );
@@ -1247,7 +1252,7 @@ MakeDrf::MakeDrf( InterSpec *viewer, MaterialDB *materialDB,
   m_effOptionGroup = new WGroupBox( "Intrinsic Eff.", fitOptionsDiv );
   m_effEqnOrder = new WComboBox( m_effOptionGroup );
   m_effEqnOrder->setInline( false );
-  m_effEqnOrder->changed().connect( this, &MakeDrf::handleSourcesUpdates );
+  m_effEqnOrder->changed().connect( this, &MakeDrf::handleEffEqnOrderChanged );
   
   m_effEqnUnits = new WComboBox( m_effOptionGroup );
   m_effEqnUnits->setInline( false );
@@ -2184,8 +2189,17 @@ void MakeDrf::handleSourcesUpdates()
 }//void handleSourcesUpdates()
 
 
+void MakeDrf::handleEffEqnOrderChanged()
+{
+  m_userSelectedEffOrder = true;
+  handleSourcesUpdates();
+}//void handleEffEqnOrderChanged()
+
+
 void MakeDrf::handleFwhmTypeChanged()
 {
+  m_userSelectedFwhmForm = true;
+  
   switch( m_fwhmEqnType->currentIndex() )
   {
     case 0:
@@ -2210,6 +2224,8 @@ void MakeDrf::handleFwhmTypeChanged()
 
 void MakeDrf::handleSqrtEqnOrderChange()
 {
+  m_userSelectedFwhmForm = true;
+  
   //We could update *just* the FWHM equation like:
   //size_t numchan = 0;
   //vector< std::shared_ptr<const PeakDef> > peaks;
@@ -2291,19 +2307,41 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
   
   //ToDo: I'm not entirely sure the next line protects against updateFwhmEqn()
   //  not being called if this widget is deleted before fit is done.
-  auto updater = boost::bind( &MakeDrf::updateFwhmEqn, this, _1, _2, _3, static_cast<int>(fnctnlForm), fitid );
+  auto updater = boost::bind( &MakeDrf::updateFwhmEqn, this, _1, _2, _3, _4, fitid );
   
   const string thisid = id();
   
-  auto worker = [sessionId,fnctnlForm,peaks,num_gamma_channels,sqrtEqnOrder,updater,thisid]() {
+  //Start from the previous solution, if it was for the same equation form
+  const vector<float> prevGadrasCoefs = (m_prevFwhmForm == static_cast<int>(DetectorPeakResponse::kGadrasResolutionFcn))
+                                          ? m_prevFwhmCoefs : vector<float>();
+  const bool scanForms = !m_userSelectedFwhmForm;
+  const int maxSqrtEqnOrder = std::min( m_sqrtEqnOrder->count(), 6 );
+  
+  auto worker = [sessionId,fnctnlForm,peaks,num_gamma_channels,sqrtEqnOrder,updater,thisid,prevGadrasCoefs,scanForms,maxSqrtEqnOrder]() {
     try
     {
       auto peakdequ = std::make_shared<std::deque< std::shared_ptr<const PeakDef> > >( peaks.begin(), peaks.end() );
     
       //Takes between 5 and 500ms for a HPGe detector
       const double start_time = UtilityFunctions::get_wall_time();
+      double chi2;
+      int form = static_cast<int>( fnctnlForm );
       vector<float> fwhm_coefs, fwhm_coefs_uncert;
-      const double chi2 = MakeDrfFit::performResolutionFit( peakdequ, num_gamma_channels, fnctnlForm, sqrtEqnOrder, fwhm_coefs, fwhm_coefs_uncert );
+      if( scanForms )
+      {
+        vector<MakeDrfFit::FitCandidate> candidates;
+        const size_t best = MakeDrfFit::performResolutionFitScan( peakdequ, num_gamma_channels, maxSqrtEqnOrder,
+                                                                  prevGadrasCoefs, candidates );
+        chi2 = candidates[best].chi2;
+        form = static_cast<int>( candidates[best].fwhmForm );
+        fwhm_coefs = candidates[best].coefficients;
+        fwhm_coefs_uncert = candidates[best].uncertainties;
+      }else
+      {
+        if( fnctnlForm == DetectorPeakResponse::kGadrasResolutionFcn )
+          fwhm_coefs = prevGadrasCoefs;
+        chi2 = MakeDrfFit::performResolutionFit( peakdequ, num_gamma_channels, fnctnlForm, sqrtEqnOrder, fwhm_coefs, fwhm_coefs_uncert );
+      }//if( scanForms ) / else
     
       const double end_time = UtilityFunctions::get_wall_time();
     
@@ -2313,9 +2351,9 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
         cout << fwhm_coefs[i] << "+-" << fwhm_coefs_uncert[i] << ", ";
       cout << "}; took " << (end_time-start_time) << " seconds" << endl;
       
-      WServer::instance()->post( sessionId, std::bind( [updater,fwhm_coefs,fwhm_coefs_uncert,thisid,chi2](){
+      WServer::instance()->post( sessionId, std::bind( [updater,fwhm_coefs,fwhm_coefs_uncert,thisid,chi2,form](){
         if( wApp->domRoot() && dynamic_cast<MakeDrf *>(wApp->domRoot()->findById(thisid)) )
-          updater(fwhm_coefs,fwhm_coefs_uncert,chi2);
+          updater(fwhm_coefs,fwhm_coefs_uncert,chi2,form);
         else
           cerr << "MakeDrf widget was deleted while calculating FWHM coefs" << endl;
       } ) );
@@ -2325,7 +2363,7 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
     }//try / catch fit FWHM
   };
   
-  WServer::instance()->ioService().post( worker );
+  ComputeScheduler::instance().post( sessionId, worker, ComputeScheduler::Priority::Normal );
 }//void fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks )
 
 
@@ -2345,11 +2383,15 @@ void MakeDrf::updateFwhmEqn( std::vector<float> coefs,
     case DetectorPeakResponse::ResolutionFnctForm::kGadrasResolutionFcn:
       eqnType = MakeDrfChart::FwhmCoefType::Gadras;
       m_fwhmEqnType->setCurrentIndex( 0 );
+      m_sqrtEqnOrder->hide();
       break;
     
     case DetectorPeakResponse::ResolutionFnctForm::kSqrtPolynomial:
       eqnType = MakeDrfChart::FwhmCoefType::SqrtEqn;
       m_fwhmEqnType->setCurrentIndex( 1 );
+      m_sqrtEqnOrder->show();
+      if( !coefs.empty() && static_cast<int>(coefs.size()) <= m_sqrtEqnOrder->count() )
+        m_sqrtEqnOrder->setCurrentIndex( static_cast<int>(coefs.size()) - 1 );
       break;
       
     case DetectorPeakResponse::ResolutionFnctForm::kNumResolutionFnctForm:
@@ -2361,6 +2403,8 @@ void MakeDrf::updateFwhmEqn( std::vector<float> coefs,
   m_fwhmEqnChi2 = chi2;
   m_fwhmCoefs = coefs;
   m_fwhmCoefUncerts = uncerts;
+  m_prevFwhmCoefs = coefs;
+  m_prevFwhmForm = functionalForm;
   m_chart->setFwhmCoefficients( coefs, uncerts, eqnType, MakeDrfChart::EqnEnergyUnits::keV );
   
   wApp->triggerUpdate();
@@ -2403,14 +2447,32 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
   auto updater = boost::bind( &MakeDrf::updateEffEqn, this, _1, _2, _3, fitid, _4 );
   const string thisid = id();
   
+  //Start from the previous solution, if it was for the same units
+  const vector<float> previous = (m_prevEffEqnInMeV == inMeV) ? m_prevEffEqnCoefs : vector<float>();
+  const bool scanOrders = !m_userSelectedEffOrder;
+  const int maxOrder = std::min( m_effEqnOrder->count(), 8 );
   
-  auto worker = [sessionId,thisid,data,nfitpars,updater]() {
+  auto worker = [sessionId,thisid,data,nfitpars,updater,previous,scanOrders,maxOrder]() {
     try
     {
       //Takes between 5 and 500ms for a HPGe detector
       const double start_time = UtilityFunctions::get_wall_time();
+      double chi2;
       vector<float> result, uncerts;
-      const double chi2 = MakeDrfFit::performEfficiencyFit( data, nfitpars, result, uncerts );
+      if( scanOrders )
+      {
+        vector<MakeDrfFit::FitCandidate> candidates;
+        const size_t best = MakeDrfFit::performEfficiencyFitScan( data, 1, maxOrder, previous, candidates );
+        result = candidates[best].coefficients;
+        uncerts = candidates[best].uncertainties;
+        const size_t npar = result.size();
+        chi2 = (npar == data.size()) ? candidates[best].chi2 : candidates[best].chi2 / (data.size() - npar);
+      }else
+      {
+        if( previous.size() == static_cast<size_t>(nfitpars) )
+          result = previous;
+        chi2 = MakeDrfFit::performEfficiencyFit( data, nfitpars, result, uncerts );
+      }//if( scanOrders ) / else
       
       const double end_time = UtilityFunctions::get_wall_time();
       
@@ -2440,19 +2502,31 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
     }//try / catch fit FWHM
   };
   
-  WServer::instance()->ioService().post( worker );
+  ComputeScheduler::instance().post( sessionId, worker, ComputeScheduler::Priority::Normal );
 }//void fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
 
 
 void MakeDrf::updateEffEqn( std::vector<float> coefs, std::vector<float> uncerts,
                             const double chi2, const int fitid, const string errmsg )
 {
+  if( fitid != m_effEqnFitId )
+    return;
+  
   const bool isMeV = isEffEqnInMeV();
   const auto units = (isMeV ? MakeDrfChart::EqnEnergyUnits::MeV : MakeDrfChart::EqnEnergyUnits::keV);
 
   m_effEqnChi2 = chi2;
   m_effEqnCoefs = coefs;
   m_effEqnCoefUncerts = uncerts;
+  
+  if( !coefs.empty() )
+  {
+    m_prevEffEqnCoefs = coefs;
+    m_prevEffEqnInMeV = isMeV;
+    
+    if( !m_userSelectedEffOrder && static_cast<int>(coefs.size()) <= m_effEqnOrder->count() )
+      m_effEqnOrder->setCurrentIndex( static_cast<int>(coefs.size()) - 1 );
+  }//if( !coefs.empty() )
   m_intrinsicEfficiencyIsValid.emit( !m_effEqnCoefs.empty() );
   m_chart->setEfficiencyCoefficients( coefs, uncerts, units );
   
@@ -23,7 +23,10 @@
 
 #include "InterSpec_config.h"
 
+#include <cmath>
+#include <limits>
 #include <vector>
+#include <algorithm>
 
 #define BOOST_UBLAS_TYPE_CHECK 0
 #include <boost/numeric/ublas/lu.hpp>
@@ -32,6 +35,7 @@
 
 //Roots Minuit2 includes
 #include "Minuit2/FCNBase.h"
+#include "Minuit2/FCNGradientBase.h"
 #include "Minuit2/FunctionMinimum.h"
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMinos.h"
@@ -46,6 +50,7 @@
 
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/ComputeScheduler.h"
 
 
 using namespace std;
@@ -116,8 +121,62 @@ namespace
   };//class DetectorResolutionFitness
   
   
+  /** Chi2 of eff(x) = exp(A + B*log(x) + C*log(x)^2 + ...) to the data; the
+   same equation as DetectorPeakResponse::expOfLogPowerSeriesEfficiency(...),
+   but evaluated in double precision so it is consistent with the analytic
+   gradient.  If 'gradient' is non-null, it will be filled with the partial
+   derivatives of chi2 with respect to each coefficient.
+   */
+  double efficiency_chi2( const std::vector<MakeDrfFit::DetEffDataPoint> &data,
+                          const std::vector<double> &x,
+                          std::vector<double> *gradient )
+  {
+    if( gradient )
+      gradient->assign( x.size(), 0.0 );
+    
+    for( const double val : x )
+      if( isinf(val) || isnan(val) )
+        return 999999.9;
+    
+    vector<double> logpowers( x.size() );
+    vector<double> grad( x.size(), 0.0 );
+    
+    double chi2 = 0.0;
+    for( const MakeDrfFit::DetEffDataPoint &point : data )
+    {
+      const double logx = std::log( static_cast<double>(point.energy) );
+      
+      double exparg = 0.0, logpower = 1.0;
+      for( size_t i = 0; i < x.size(); ++i )
+      {
+        logpowers[i] = logpower;
+        exparg += x[i] * logpower;
+        logpower *= logx;
+      }
+      
+      const double eqneff = std::exp( exparg );
+      if( eqneff <= 0.0 || isnan(eqneff) || isinf(eqneff) )
+        return 999999.9;
+      
+      const double uncert = point.efficiency_uncert <= 0.0 ? 0.05*point.efficiency : point.efficiency_uncert;
+      const double diff = eqneff - point.efficiency;
+      chi2 += (diff*diff) / (uncert*uncert);
+      
+      //d(chi2)/d(x_i) = 2*(eff - data)/uncert^2 * eff * log(energy)^i
+      const double dchi2_deff = 2.0 * diff / (uncert*uncert);
+      for( size_t i = 0; i < x.size(); ++i )
+        grad[i] += dchi2_deff * eqneff * logpowers[i];
+    }//for( const MakeDrfFit::DetEffDataPoint &point : data )
+    
+    if( gradient )
+      gradient->swap( grad );
+    
+    return chi2;
+  }//efficiency_chi2(...)
+  
+  
   class DetectorEffFitness
-  : public ROOT::Minuit2::FCNBase
+  : public ROOT::Minuit2::FCNGradientBase
   {
   protected:
     std::vector<MakeDrfFit::DetEffDataPoint> m_data;
@@ -134,31 +193,19 @@ namespace
     
     virtual double DoEval( const std::vector<double> &x ) const
     {
-      for( const double val : x )
-        if( isinf(val) || isnan(val) )
-          return 999999.9;
-      
-      vector<float> fx( x.size() );
-      for( size_t i = 0; i < x.size(); ++i )
-        fx[i] = static_cast<float>( x[i] );
-      
-      double chi2 = 0.0;
-      for( const MakeDrfFit::DetEffDataPoint &data : m_data )
-      {
-        const float eqneff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( data.energy, fx );
-        if( eqneff <= 0.0 || isnan(eqneff) || isinf(eqneff) )
-          return 999999.9;
-        
-        const double uncert = data.efficiency_uncert <= 0.0 ? 0.05*data.efficiency : data.efficiency_uncert;
-        //cout << "data.energy=" << data.energy << ", eqneff=" << eqneff
-        //     << ", data.efficiency=" << data.efficiency << ", uncert=" << uncert
-        //     << ", data.efficiency_uncert=" << data.efficiency_uncert << endl;
-        chi2 += std::pow( (eqneff - data.efficiency)/uncert, 2 );
-      }
-      
-      return chi2;
+      return efficiency_chi2( m_data, x, nullptr );
     }//DoEval();
     
+    virtual std::vector<double> Gradient( const std::vector<double> &x ) const
+    {
+      std::vector<double> gradient;
+      efficiency_chi2( m_data, x, &gradient );
+      return gradient;
+    }//Gradient(...)
+    
+    //The gradient is exact, so Minuit doesnt need to numerically verify it
+    virtual bool CheckGradient() const { return false; }
+    
     virtual double operator()( const std::vector<double> &x ) const
     {
       return DoEval( x );
@@ -693,6 +740,9 @@ double performEfficiencyFit( const std::vector<DetEffDataPoint> data,
     throw runtime_error( "MakeDrfFit::performEfficiencyFit(...): requested fit order " + std::to_string(fcnOrder)
                          + ", with only " + std::to_string(data.size()) + " data points." );
   
+  //If the caller passed in a previous solution, consider it as a starting point
+  const vector<float> previous = (result.size() == static_cast<size_t>(fcnOrder)) ? result : vector<float>();
+  
   result.clear();
   uncerts.clear();
   
@@ -769,6 +819,29 @@ double performEfficiencyFit( const std::vector<DetEffDataPoint> data,
     }//if( inMeV ) / else
   }
 
+  //When re-fitting after the user changes the data a little (e.g., toggles a
+  //  peak) the previous solution is usually closer to the answer than the LLS
+  //  or default starting values, so start from it if it is better.
+  if( !previous.empty() && previous.size() <= inputPrams.Params().size() )
+  {
+    vector<double> startpars = inputPrams.Params();
+    bool within_limits = true;
+    for( size_t i = 0; i < previous.size(); ++i )
+    {
+      const ROOT::Minuit2::MinuitParameter &par = inputPrams.Parameter( static_cast<unsigned int>(i) );
+      within_limits = within_limits
+                      && (!par.HasLowerLimit() || previous[i] > par.LowerLimit())
+                      && (!par.HasUpperLimit() || previous[i] < par.UpperLimit());
+      startpars[i] = previous[i];
+    }
+    
+    if( within_limits && (fitness.DoEval(startpars) < fitness.DoEval(inputPrams.Params())) )
+    {
+      for( size_t i = 0; i < previous.size(); ++i )
+        inputPrams.SetValue( static_cast<unsigned int>(i), previous[i] );
+    }
+  }//if( !previous.empty() )
+  
   
   ROOT::Minuit2::MnUserParameterState inputParamState( inputPrams );
   ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
@@ -836,4 +909,125 @@ double performEfficiencyFit( const std::vector<DetEffDataPoint> data,
   return (fcnOrder == data.size()) ? chi2 : (chi2 / (data.size() - fcnOrder));
 }//performEfficiencyFit(...)
   
+
+void FitCandidate::setInformationCriteria( const size_t numDataPoints )
+{
+  const double n = static_cast<double>( std::max( numDataPoints, size_t(1) ) );
+  aic = chi2 + 2.0*numParameters;
+  bic = chi2 + numParameters*std::log( n );
+}//void setInformationCriteria( const size_t numDataPoints )
+  
+  
+size_t best_candidate_by_bic( const std::vector<FitCandidate> &candidates )
+{
+  size_t best = candidates.size();
+  for( size_t i = 0; i < candidates.size(); ++i )
+  {
+    if( !candidates[i].error.empty() )
+      continue;
+    if( best == candidates.size() || candidates[i].bic < candidates[best].bic )
+      best = i;
+  }//for( size_t i = 0; i < candidates.size(); ++i )
+  
+  if( best == candidates.size() )
+    throw runtime_error( candidates.empty() ? string("no fit candidates")
+                                            : candidates.front().error );
+  return best;
+}//size_t best_candidate_by_bic(...)
+  
+  
+size_t performEfficiencyFitScan( const std::vector<DetEffDataPoint> &data,
+                                 int minOrder, int maxOrder,
+                                 const std::vector<float> &previous,
+                                 std::vector<FitCandidate> &candidates )
+{
+  candidates.clear();
+  
+  minOrder = std::max( minOrder, 1 );
+  maxOrder = std::min( maxOrder, std::min( 8, static_cast<int>(data.size()) ) );
+  if( data.empty() || maxOrder < minOrder )
+    throw runtime_error( "MakeDrfFit::performEfficiencyFitScan(...): not enough data points" );
+  
+  candidates.resize( maxOrder - minOrder + 1 );
+  
+  ComputeScheduler::TaskGroup pool;
+  for( int order = minOrder; order <= maxOrder; ++order )
+  {
+    FitCandidate &candidate = candidates[order - minOrder];
+    pool.post( [&data,&previous,&candidate,order](){
+      candidate.fwhmForm = DetectorPeakResponse::kNumResolutionFnctForm;
+      candidate.order = order;
+      candidate.numParameters = order;
+      try
+      {
+        if( previous.size() == static_cast<size_t>(order) )
+          candidate.coefficients = previous;
+        performEfficiencyFit( data, order, candidate.coefficients, candidate.uncertainties );
+        
+        const vector<double> pars( begin(candidate.coefficients), end(candidate.coefficients) );
+        candidate.chi2 = efficiency_chi2( data, pars, nullptr );
+        candidate.setInformationCriteria( data.size() );
+      }catch( std::exception &e )
+      {
+        candidate.error = e.what();
+      }
+    } );
+  }//for( int order = minOrder; order <= maxOrder; ++order )
+  pool.join();
+  
+  return best_candidate_by_bic( candidates );
+}//size_t performEfficiencyFitScan(...)
+  
+  
+size_t performResolutionFitScan( std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > peaks,
+                                 const size_t num_gamma_channels,
+                                 const int maxSqrtEqnOrder,
+                                 const std::vector<float> &previousGadras,
+                                 std::vector<FitCandidate> &candidates )
+{
+  candidates.clear();
+  
+  if( !peaks || peaks->empty() )
+    throw runtime_error( "MakeDrfFit::performResolutionFitScan(...): no input peaks" );
+  
+  const int npeaks = static_cast<int>( peaks->size() );
+  const int maxSqrtOrder = std::min( maxSqrtEqnOrder, npeaks );
+  
+  candidates.resize( 1 + std::max( maxSqrtOrder, 0 ) );
+  candidates[0].fwhmForm = DetectorPeakResponse::kGadrasResolutionFcn;
+  candidates[0].order = -1;
+  candidates[0].numParameters = std::min( 3, npeaks );
+  candidates[0].coefficients = previousGadras;
+  for( int order = 1; order <= maxSqrtOrder; ++order )
+  {
+    candidates[order].fwhmForm = DetectorPeakResponse::kSqrtPolynomial;
+    candidates[order].order = order;
+    candidates[order].numParameters = order;
+  }
+  
+  ComputeScheduler::TaskGroup pool;
+  for( FitCandidate &candidate : candidates )
+  {
+    pool.post( [&peaks,num_gamma_channels,&candidate](){
+      try
+      {
+        if( candidate.fwhmForm == DetectorPeakResponse::kGadrasResolutionFcn
+            && candidate.coefficients.size() != 3 )
+          candidate.coefficients.clear();
+        
+        candidate.chi2 = performResolutionFit( peaks, num_gamma_channels, candidate.fwhmForm,
+                                               candidate.order, candidate.coefficients,
+                                               candidate.uncertainties );
+        candidate.setInformationCriteria( peaks->size() );
+      }catch( std::exception &e )
+      {
+        candidate.error = e.what();
+      }
+    } );
+  }//for( FitCandidate &candidate : candidates )
+  pool.join();
+  
+  return best_candidate_by_bic( candidates );
+}//size_t performResolutionFitScan(...)
+  
 }//namespace MakeDrfFit
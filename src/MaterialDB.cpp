@@ -32,6 +32,7 @@
 #include <fstream>
 #include <utility>
 #include <sstream>
+#include <algorithm>
 #include <stdexcept>
 #include <condition_variable>
 
@@ -316,12 +317,47 @@ MaterialDB::MaterialDB()
 MaterialDB::~MaterialDB()
 {
   for( const Material *m : m_materials )
-    if( m != &sm_voidMaterial )
+  {
+    if( m != &sm_voidMaterial && !m_sharedMaterials.count( m ) )
       delete m;
+  }//for( const Material *m : m_materials )
+  
   m_materials.clear();
 }
 
 
+void MaterialDB::addSharedMaterials( std::shared_ptr<const MaterialDB> shared )
+{
+  if( !shared )
+    throw runtime_error( "MaterialDB::addSharedMaterials(): invalid input" );
+  
+  if( !shared->wait_material_ready() )
+    throw runtime_error( "MaterialDB::addSharedMaterials(): shared database is"
+                         " not initialized" );
+  
+  {
+    std::unique_lock<std::mutex> lock( m_mutex );
+    
+    //Since 'shared' is const, its materials can no longer change.
+    for( const Material *m : shared->m_materials )
+    {
+      if( m != &sm_voidMaterial )
+      {
+        m_materials.push_back( m );
+        m_sharedMaterials.insert( m );
+      }
+    }
+    sort( m_materials.begin(), m_materials.end(), &MaterialDB::less_than_by_name );
+    
+    m_sharedDatabases.push_back( shared );
+  }
+  
+  refreshMaterialNames();
+  
+  m_condition.notify_all();
+}//void addSharedMaterials( std::shared_ptr<const MaterialDB> shared )
+
+
 const std::vector<std::string> &MaterialDB::names() const
 {
   if( !wait_material_ready() )
@@ -0,0 +1,358 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+
+#include "InterSpec/MemoryAccountant.h"
+
+using namespace std;
+
+namespace
+{
+  string print_mb( const size_t bytes )
+  {
+    char buffer[32];
+    snprintf( buffer, sizeof(buffer), "%.1f MB", bytes / (1024.0*1024.0) );
+    return buffer;
+  }//print_mb(...)
+}//namespace
+
+
+const char *MemoryAccountant::toString( const Category category )
+{
+  switch( category )
+  {
+    case Category::Spectra:         return "Spectra";
+    case Category::Peaks:           return "Peaks";
+    case Category::SampleSums:      return "SampleSums";
+    case Category::InactiveSpectra: return "InactiveSpectra";
+    case Category::DatabaseBlobs:   return "DatabaseBlobs";
+    case Category::NumCategories:   break;
+  }//switch( category )
+
+  return "";
+}//const char *toString( const Category category )
+
+
+MemoryAccountant::Entry::Entry()
+  : category( Category::Spectra ),
+    bytes( 0 ),
+    lastUse( 0 ),
+    evictPending( false )
+{
+}
+
+
+MemoryAccountant &MemoryAccountant::instance()
+{
+  static MemoryAccountant s_instance;
+  return s_instance;
+}//MemoryAccountant &instance()
+
+
+MemoryAccountant::MemoryAccountant()
+  : m_totalBytes( 0 ),
+#if( defined(MAX_TOTAL_SESSION_MEMORY_SIZE_MB) && MAX_TOTAL_SESSION_MEMORY_SIZE_MB > 0 )
+    m_budget( size_t(1024) * 1024 * MAX_TOTAL_SESSION_MEMORY_SIZE_MB ),
+#else
+    m_budget( 0 ),
+#endif
+    m_useCounter( 0 ),
+    m_lastOverBudgetLog(),
+    m_numEvictsSinceLog( 0 )
+{
+}//MemoryAccountant constructor
+
+
+void MemoryAccountant::setUsage( const std::string &sessionId, const void *owner,
+                                 const Category category, const size_t bytes,
+                                 std::function<void()> evict )
+{
+  if( !owner )
+    return;
+
+  vector<function<void()>> evicts;
+
+  {//begin lock on m_mutex
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    const auto pos = m_entries.find( owner );
+    if( pos != m_entries.end() )
+    {
+      m_totalBytes -= pos->second.bytes;
+      subtractFromSession( pos->second.sessionId, pos->second.bytes );
+    }
+
+    Entry &entry = (pos != m_entries.end()) ? pos->second : m_entries[owner];
+    entry.sessionId = sessionId;
+    entry.category = category;
+    entry.bytes = bytes;
+    entry.lastUse = ++m_useCounter;
+    entry.evict = std::move( evict );
+    entry.evictPending = false;
+
+    m_totalBytes += bytes;
+    addToSession( sessionId, bytes );
+
+    evicts = enforceBudget( owner );
+  }//end lock on m_mutex
+
+  for( const function<void()> &fcn : evicts )
+  {
+    try
+    {
+      fcn();
+    }catch( std::exception &e )
+    {
+      cerr << "MemoryAccountant: caught exception evicting: " << e.what() << endl;
+    }
+  }//for( const function<void()> &fcn : evicts )
+}//void setUsage(...)
+
+
+void MemoryAccountant::touch( const void *owner )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  const auto pos = m_entries.find( owner );
+  if( pos != m_entries.end() )
+    pos->second.lastUse = ++m_useCounter;
+}//void touch( const void *owner )
+
+
+void MemoryAccountant::remove( const void *owner )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  const auto pos = m_entries.find( owner );
+  if( pos == m_entries.end() )
+    return;
+
+  m_totalBytes -= pos->second.bytes;
+  subtractFromSession( pos->second.sessionId, pos->second.bytes );
+  m_entries.erase( pos );
+}//void remove( const void *owner )
+
+
+void MemoryAccountant::removeSession( const std::string &sessionId )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  size_t sessionTotal = 0;
+  for( auto iter = m_entries.begin(); iter != m_entries.end(); )
+  {
+    if( iter->second.sessionId == sessionId )
+    {
+      sessionTotal += iter->second.bytes;
+      m_totalBytes -= iter->second.bytes;
+      iter = m_entries.erase( iter );
+    }else
+    {
+      ++iter;
+    }
+  }//for( loop over entries )
+
+  m_sessionBytes.erase( sessionId );
+  
+  const auto peakpos = m_sessionPeakBytes.find( sessionId );
+  const size_t peak = (peakpos == m_sessionPeakBytes.end()) ? size_t(0) : peakpos->second;
+  if( peakpos != m_sessionPeakBytes.end() )
+    m_sessionPeakBytes.erase( peakpos );
+
+  cerr << "MemoryAccountant: session " << sessionId << " ended using "
+       << print_mb(sessionTotal) << ", with a peak of " << print_mb(peak)
+       << "; all sessions now using " << print_mb(m_totalBytes) << endl;
+}//void removeSession( const std::string &sessionId )
+
+
+size_t MemoryAccountant::totalBytes() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return m_totalBytes;
+}
+
+
+size_t MemoryAccountant::sessionBytes( const std::string &sessionId ) const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  const auto pos = m_sessionBytes.find( sessionId );
+  return (pos == m_sessionBytes.end()) ? size_t(0) : pos->second;
+}//size_t sessionBytes( const std::string &sessionId ) const
+
+
+void MemoryAccountant::addToSession( const std::string &sessionId, const size_t bytes )
+{
+  size_t &total = m_sessionBytes[sessionId];
+  total += bytes;
+
+  size_t &peak = m_sessionPeakBytes[sessionId];
+  peak = std::max( peak, total );
+}//void addToSession(...)
+
+
+void MemoryAccountant::subtractFromSession( const std::string &sessionId, const size_t bytes )
+{
+  const auto pos = m_sessionBytes.find( sessionId );
+  if( pos == m_sessionBytes.end() )
+    return;
+
+  pos->second -= std::min( pos->second, bytes );
+}//void subtractFromSession(...)
+
+
+size_t MemoryAccountant::budget() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return m_budget;
+}
+
+
+void MemoryAccountant::setBudget( const size_t bytes )
+{
+  vector<function<void()>> evicts;
+
+  {//begin lock on m_mutex
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_budget = bytes;
+    evicts = enforceBudget( nullptr );
+  }//end lock on m_mutex
+
+  for( const function<void()> &fcn : evicts )
+    fcn();
+}//void setBudget( const size_t bytes )
+
+
+std::vector<std::function<void()>> MemoryAccountant::enforceBudget( const void *justSet )
+{
+  vector<function<void()>> evicts;
+
+  if( !m_budget || (m_totalBytes <= m_budget) )
+    return evicts;
+
+  size_t projected = m_totalBytes;
+  for( const auto &e : m_entries )
+    if( e.second.evictPending )
+      projected -= e.second.bytes;
+
+  if( projected <= m_budget )
+    return evicts;
+
+  vector<pair<std::uint64_t,Entry *>> candidates;
+  for( auto &e : m_entries )
+  {
+    //Evicting what was just inserted would just cause it to be recomputed on
+    //  the next use, so leave it, even if that means staying over budget.
+    if( e.first == justSet )
+      continue;
+    
+    if( e.second.evict && !e.second.evictPending && e.second.bytes )
+      candidates.push_back( make_pair( e.second.lastUse, &e.second ) );
+  }
+
+  std::sort( candidates.begin(), candidates.end(),
+             []( const pair<std::uint64_t,Entry *> &lhs, const pair<std::uint64_t,Entry *> &rhs ) -> bool {
+               return lhs.first < rhs.first;
+             } );
+
+  for( size_t i = 0; i < candidates.size() && projected > m_budget; ++i )
+  {
+    Entry &entry = *candidates[i].second;
+    entry.evictPending = true;
+    projected -= entry.bytes;
+    evicts.push_back( entry.evict );
+  }//for( loop over least recently used candidates )
+  
+  //Log at most once a minute, whether or not anything could be evicted, so
+  //  a server that is persistently near its budget doesnt flood the log.
+  m_numEvictsSinceLog += evicts.size();
+  const auto now = std::chrono::steady_clock::now();
+  if( (now - m_lastOverBudgetLog) < std::chrono::minutes(1) )
+    return evicts;
+  m_lastOverBudgetLog = now;
+
+  cerr << "MemoryAccountant: using " << print_mb(m_totalBytes) << " of a "
+       << print_mb(m_budget) << " budget; evicted " << m_numEvictsSinceLog
+       << " caches/spectra since last report.  Usage by session:\n"
+       << summaryInternal() << endl;
+  m_numEvictsSinceLog = 0;
+
+  return evicts;
+}//std::vector<std::function<void()>> enforceBudget()
+
+
+std::string MemoryAccountant::summary() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return summaryInternal();
+}//std::string summary() const
+
+
+std::string MemoryAccountant::summaryInternal() const
+{
+  const size_t ncat = static_cast<size_t>( Category::NumCategories );
+  map<string,vector<size_t>> sessions;
+
+  for( const auto &e : m_entries )
+  {
+    vector<size_t> &bytes = sessions[e.second.sessionId];
+    bytes.resize( ncat, 0 );
+    bytes[static_cast<size_t>(e.second.category)] += e.second.bytes;
+  }
+
+  stringstream strm;
+  for( const auto &s : sessions )
+  {
+    size_t total = 0;
+    for( const size_t b : s.second )
+      total += b;
+
+    const auto peakpos = m_sessionPeakBytes.find( s.first );
+    const size_t peak = (peakpos == m_sessionPeakBytes.end()) ? total : peakpos->second;
+
+    strm << "  session " << (s.first.empty() ? string("(none)") : s.first)
+         << ": " << print_mb(total) << " (peak " << print_mb(peak) << ")";
+    for( size_t i = 0; i < ncat; ++i )
+    {
+      if( s.second[i] )
+        strm << ", " << toString( Category(i) ) << "=" << print_mb(s.second[i]);
+    }
+    strm << "\n";
+  }//for( const auto &s : sessions )
+
+  strm << "  total: " << print_mb(m_totalBytes);
+  if( m_budget )
+    strm << " of " << print_mb(m_budget) << " budget";
+
+  return strm.str();
+}//std::string summaryInternal() const
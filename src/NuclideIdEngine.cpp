@@ -0,0 +1,945 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <set>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/PeakFit.h"
+#include "InterSpec/MaterialDB.h"
+#include "InterSpec/IsotopeId.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/ComputeScheduler.h"
+#include "InterSpec/NuclideIdEngine.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+#include "InterSpec/DetectorPeakResponse.h"
+#include "InterSpec/GammaInteractionCalc.h"
+
+using namespace std;
+
+namespace
+{
+  /** An observation being fit; either a fitted peak, a region where a
+   candidate predicts a peak but there isnt one (observed=0), or a channel of
+   the continuum subtracted spectrum.
+   */
+  struct Observation
+  {
+    double energy;
+    double lower;
+    double upper;
+    double observed;
+    double uncertainty;
+  };//struct Observation
+
+
+  bool observation_less_than( const Observation &lhs, const Observation &rhs )
+  {
+    return lhs.energy < rhs.energy;
+  }
+
+
+  /** A candidate nuclide, and its expected counts per becquerel for each
+   observation, for each age and shielding.
+   */
+  struct Candidate
+  {
+    const SandiaDecay::Nuclide *nuclide;
+    std::vector<double> ages;
+
+    //templates[age_index][shielding_index][observation_index]
+    std::vector< std::vector< std::vector<double> > > templates;
+  };//struct Candidate
+
+
+  /** A source line: energy, and expected counts per becquerel of the source
+   (before shielding and detector efficiency).
+   */
+  typedef std::pair<double,double> LineCounts;
+
+
+  std::vector<LineCounts> source_lines( const SandiaDecay::Nuclide *nuc,
+                                        const double age,
+                                        const double live_time )
+  {
+    SandiaDecay::NuclideMixture mix;
+    mix.addNuclideByActivity( nuc, 1.0*SandiaDecay::becquerel );
+    const vector<SandiaDecay::EnergyRatePair> gammas
+             = mix.gammas( age, SandiaDecay::NuclideMixture::OrderByEnergy, true );
+
+    std::vector<LineCounts> answer;
+    answer.reserve( gammas.size() );
+    for( const SandiaDecay::EnergyRatePair &erp : gammas )
+    {
+      if( erp.numPerSecond > 0.0 )
+        answer.push_back( LineCounts( erp.energy, erp.numPerSecond*live_time ) );
+    }
+
+    return answer;
+  }//source_lines(...)
+
+
+  /** Resolution (sigma) as a function of energy; uses the detector response if
+   it has resolution information, otherwise the fitted peaks, and otherwise a
+   generic HPGe or NaI resolution depending on number of channels.
+   */
+  class Resolution
+  {
+  public:
+    Resolution( const std::deque< std::shared_ptr<const PeakDef> > &peaks,
+                const std::shared_ptr<const Measurement> &data,
+                const std::shared_ptr<const DetectorPeakResponse> &response )
+      : m_response( (response && response->isValid() && response->hasResolutionInfo()) ? response : nullptr ),
+        m_highres( data ? (data->num_gamma_channels() > 2050) : false )
+    {
+      for( const std::shared_ptr<const PeakDef> &p : peaks )
+      {
+        if( p && p->gausPeak() && p->mean() > 0.0 && p->sigma() > 0.0 )
+          m_peakSigmas.push_back( make_pair( p->mean(), p->sigma() ) );
+      }
+      std::sort( m_peakSigmas.begin(), m_peakSigmas.end() );
+
+      if( !data && !m_peakSigmas.empty() )
+        m_highres = ((m_peakSigmas[0].second / sqrt(m_peakSigmas[0].first)) < 0.5);
+    }
+
+    double sigma( const double energy ) const
+    {
+      if( m_response )
+        return m_response->peakResolutionSigma( static_cast<float>(energy) );
+
+      if( !m_peakSigmas.empty() )
+      {
+        //Scale the nearest peaks sigma as sqrt(energy)
+        const auto pos = std::lower_bound( m_peakSigmas.begin(), m_peakSigmas.end(),
+                                           make_pair(energy, 0.0) );
+        const pair<double,double> &nearest = (pos == m_peakSigmas.end())
+                     ? m_peakSigmas.back()
+                     : ((pos == m_peakSigmas.begin() || (pos->first - energy) < (energy - (pos-1)->first)) ? *pos : *(pos-1));
+        return nearest.second * sqrt( std::max(energy,1.0) / nearest.first );
+      }//if( !m_peakSigmas.empty() )
+
+      const double fwhm = m_highres ? (1.0 + 0.0007*energy)
+                                    : (0.07*sqrt(661.7*std::max(energy,1.0)));
+      return fwhm / 2.35482;
+    }//double sigma( const double energy ) const
+
+  protected:
+    std::shared_ptr<const DetectorPeakResponse> m_response;
+    bool m_highres;
+    std::vector< std::pair<double,double> > m_peakSigmas;
+  };//class Resolution
+
+
+  /** Adds the expected counts, 'counts', of a line at 'energy' to
+   'expected'.  If fitting peaks, all the counts go to the observation whose
+   range contains the energy (the nearest one, if multiple do); if fitting the
+   spectrum, counts are distributed according to the Gaussian resolution.
+   */
+  void add_line( std::vector<double> &expected,
+                 const std::vector<Observation> &observations,
+                 const double energy, const double counts, const double sigma,
+                 const bool fitFullSpectrum )
+  {
+    if( counts <= 0.0 || observations.empty() )
+      return;
+
+    Observation test;
+    if( fitFullSpectrum )
+    {
+      test.energy = energy - 5.0*sigma;
+      auto pos = std::lower_bound( observations.begin(), observations.end(), test, &observation_less_than );
+      for( ; pos != observations.end() && pos->lower < (energy + 5.0*sigma); ++pos )
+      {
+        const double frac = 0.5*( erf( (pos->upper - energy)/(sqrt(2.0)*sigma) )
+                                  - erf( (pos->lower - energy)/(sqrt(2.0)*sigma) ) );
+        expected[pos - observations.begin()] += frac * counts;
+      }
+      return;
+    }//if( fitFullSpectrum )
+
+    test.energy = energy;
+    const auto pos = std::lower_bound( observations.begin(), observations.end(), test, &observation_less_than );
+
+    size_t nearest = observations.size();
+    double nearest_dist = std::numeric_limits<double>::max();
+    const size_t upper_index = std::min( observations.size(), size_t(pos - observations.begin()) + 2 );
+    const size_t lower_index = (pos - observations.begin()) >= 2 ? size_t(pos - observations.begin()) - 2 : size_t(0);
+    for( size_t i = lower_index; i < upper_index; ++i )
+    {
+      const Observation &obs = observations[i];
+      if( energy < obs.lower || energy > obs.upper )
+        continue;
+      const double dist = fabs( obs.energy - energy );
+      if( dist < nearest_dist )
+      {
+        nearest_dist = dist;
+        nearest = i;
+      }
+    }//for( loop over nearby observations )
+
+    if( nearest < observations.size() )
+      expected[nearest] += counts;
+  }//void add_line(...)
+
+
+  /** Solves G*x = h, for the small, symmetric positive (semi-)definite G, using
+   Gaussian elimination with partial pivoting.  Returns false if singular.
+   If 'inverse_diag' is non-null, the diagonal of the inverse of G is also
+   computed.
+   */
+  bool solve_linear( std::vector< std::vector<double> > G, std::vector<double> h,
+                     std::vector<double> &x, std::vector<double> *inverse_diag )
+  {
+    const size_t n = h.size();
+
+    //Augment G with h and, if requested, the identity matrix.
+    const size_t ncols = n + 1 + (inverse_diag ? n : 0);
+    for( size_t i = 0; i < n; ++i )
+    {
+      G[i].resize( ncols, 0.0 );
+      G[i][n] = h[i];
+      if( inverse_diag )
+        G[i][n+1+i] = 1.0;
+    }
+
+    for( size_t col = 0; col < n; ++col )
+    {
+      size_t pivot = col;
+      for( size_t row = col + 1; row < n; ++row )
+        if( fabs(G[row][col]) > fabs(G[pivot][col]) )
+          pivot = row;
+
+      if( fabs(G[pivot][col]) < 1.0E-300 )
+        return false;
+
+      std::swap( G[col], G[pivot] );
+
+      for( size_t row = 0; row < n; ++row )
+      {
+        if( row == col )
+          continue;
+        const double factor = G[row][col] / G[col][col];
+        if( factor == 0.0 )
+          continue;
+        for( size_t k = col; k < ncols; ++k )
+          G[row][k] -= factor * G[col][k];
+      }//for( size_t row = 0; row < n; ++row )
+    }//for( size_t col = 0; col < n; ++col )
+
+    x.resize( n );
+    for( size_t i = 0; i < n; ++i )
+      x[i] = G[i][n] / G[i][i];
+
+    if( inverse_diag )
+    {
+      inverse_diag->resize( n );
+      for( size_t i = 0; i < n; ++i )
+        (*inverse_diag)[i] = G[i][n+1+i] / G[i][i];
+    }
+
+    return true;
+  }//bool solve_linear(...)
+
+
+  /** Non-negative least squares (Lawson-Hanson active set method), solving
+   min |A*x - b|^2 subject to x >= 0, where 'columns' are the columns of A,
+   and all columns and 'b' are already divided by the observation
+   uncertainties.  Returns the chi2, and fills out 'x', and the uncertainties
+   of the non-zero components of 'x'.
+   */
+  double nnls( const std::vector< const std::vector<double> * > &columns,
+               const std::vector<double> &b,
+               std::vector<double> &x,
+               std::vector<double> &x_uncert )
+  {
+    const size_t ncol = columns.size();
+    const size_t nrow = b.size();
+
+    //We only ever have a handful of columns, so work with the normal equations.
+    vector< vector<double> > G( ncol, vector<double>(ncol, 0.0) );
+    vector<double> h( ncol, 0.0 );
+    for( size_t i = 0; i < ncol; ++i )
+    {
+      const vector<double> &ci = *columns[i];
+      for( size_t r = 0; r < nrow; ++r )
+        h[i] += ci[r] * b[r];
+
+      for( size_t j = i; j < ncol; ++j )
+      {
+        const vector<double> &cj = *columns[j];
+        double sum = 0.0;
+        for( size_t r = 0; r < nrow; ++r )
+          sum += ci[r] * cj[r];
+        G[i][j] = G[j][i] = sum;
+      }
+    }//for( size_t i = 0; i < ncol; ++i )
+
+    x.assign( ncol, 0.0 );
+    x_uncert.assign( ncol, 0.0 );
+    vector<bool> passive( ncol, false );
+
+    auto gradient = [&]( const size_t i ) -> double {
+      double w = h[i];
+      for( size_t j = 0; j < ncol; ++j )
+        w -= G[i][j] * x[j];
+      return w;
+    };
+
+    auto solve_passive = [&]( vector<double> &z, vector<double> *inv_diag ) -> bool {
+      vector<size_t> indices;
+      for( size_t i = 0; i < ncol; ++i )
+        if( passive[i] )
+          indices.push_back( i );
+
+      vector< vector<double> > Gp( indices.size(), vector<double>(indices.size()) );
+      vector<double> hp( indices.size() ), zp, invp;
+      for( size_t i = 0; i < indices.size(); ++i )
+      {
+        hp[i] = h[indices[i]];
+        for( size_t j = 0; j < indices.size(); ++j )
+          Gp[i][j] = G[indices[i]][indices[j]];
+      }
+
+      if( !solve_linear( Gp, hp, zp, inv_diag ? &invp : nullptr ) )
+        return false;
+
+      z.assign( ncol, 0.0 );
+      if( inv_diag )
+        inv_diag->assign( ncol, 0.0 );
+      for( size_t i = 0; i < indices.size(); ++i )
+      {
+        z[indices[i]] = zp[i];
+        if( inv_diag )
+          (*inv_diag)[indices[i]] = invp[i];
+      }
+      return true;
+    };//solve_passive lambda
+
+    const double tolerance = 1.0E-12 * (1.0 + *std::max_element(h.begin(), h.end()));
+
+    for( size_t outer_iter = 0; outer_iter < 3*ncol + 3; ++outer_iter )
+    {
+      size_t best = ncol;
+      double best_w = tolerance;
+      for( size_t i = 0; i < ncol; ++i )
+      {
+        const double w = passive[i] ? 0.0 : gradient( i );
+        if( !passive[i] && w > best_w )
+        {
+          best_w = w;
+          best = i;
+        }
+      }
+
+      if( best == ncol )
+        break;
+
+      passive[best] = true;
+
+      for( size_t inner_iter = 0; inner_iter < 3*ncol + 3; ++inner_iter )
+      {
+        vector<double> z;
+        if( !solve_passive( z, nullptr ) )
+        {
+          //Column is linearly dependent on the others; leave it at zero.
+          passive[best] = false;
+          break;
+        }
+
+        bool all_positive = true;
+        double alpha = 1.0;
+        for( size_t i = 0; i < ncol; ++i )
+        {
+          if( passive[i] && z[i] <= 0.0 )
+          {
+            all_positive = false;
+            const double denom = x[i] - z[i];
+            if( denom > 0.0 )
+              alpha = std::min( alpha, x[i] / denom );
+          }
+        }//for( size_t i = 0; i < ncol; ++i )
+
+        if( all_positive )
+        {
+          x = z;
+          break;
+        }
+
+        for( size_t i = 0; i < ncol; ++i )
+        {
+          x[i] += alpha * (z[i] - x[i]);
+          if( passive[i] && x[i] <= tolerance*1.0E-6 )
+          {
+            x[i] = 0.0;
+            passive[i] = false;
+          }
+        }
+      }//for( inner loop )
+    }//for( outer loop )
+
+    vector<double> zfinal, inv_diag;
+    if( std::count( passive.begin(), passive.end(), true ) && solve_passive( zfinal, &inv_diag ) )
+    {
+      for( size_t i = 0; i < ncol; ++i )
+        x_uncert[i] = (passive[i] && inv_diag[i] > 0.0) ? sqrt( inv_diag[i] ) : 0.0;
+    }
+
+    double chi2 = 0.0;
+    for( size_t r = 0; r < nrow; ++r )
+    {
+      double pred = 0.0;
+      for( size_t i = 0; i < ncol; ++i )
+        pred += x[i] * (*columns[i])[r];
+      chi2 += (b[r] - pred) * (b[r] - pred);
+    }
+
+    return chi2;
+  }//double nnls(...)
+
+
+  /** Template, already divided by the observation uncertainties. */
+  const std::vector<double> &weighted_template( const Candidate &cand,
+                                                 const size_t age_index,
+                                                 const size_t shielding_index )
+  {
+    return cand.templates[age_index][shielding_index];
+  }
+
+
+  /** A (partial) mixture: candidate index and age index, for each nuclide. */
+  struct MixtureFit
+  {
+    std::vector< std::pair<size_t,size_t> > members;
+    std::vector<double> activities;
+    std::vector<double> uncertainties;
+    double chi2;
+
+    MixtureFit() : chi2( std::numeric_limits<double>::infinity() ) {}
+  };//struct MixtureFit
+
+
+  MixtureFit fit_mixture( const std::vector<Candidate> &candidates,
+                          const std::vector< std::pair<size_t,size_t> > &members,
+                          const size_t shielding_index,
+                          const std::vector<double> &weighted_obs )
+  {
+    MixtureFit answer;
+    answer.members = members;
+
+    vector<const vector<double> *> columns;
+    for( const pair<size_t,size_t> &m : members )
+      columns.push_back( &weighted_template( candidates[m.first], m.second, shielding_index ) );
+
+    answer.chi2 = nnls( columns, weighted_obs, answer.activities, answer.uncertainties );
+
+    return answer;
+  }//MixtureFit fit_mixture(...)
+}//namespace
+
+
+namespace NuclideIdEngine
+{
+Shielding::Shielding()
+  : atomicNumber( 0.0 ),
+    arealDensity( 0.0 ),
+    material( nullptr ),
+    thickness( 0.0 )
+{
+}
+
+
+Shielding::Shielding( const double atomic_number, const double areal_density )
+  : atomicNumber( atomic_number ),
+    arealDensity( areal_density ),
+    material( nullptr ),
+    thickness( 0.0 )
+{
+}
+
+
+Shielding::Shielding( const Material *mat, const double thick )
+  : atomicNumber( 0.0 ),
+    arealDensity( 0.0 ),
+    material( mat ),
+    thickness( thick )
+{
+}
+
+
+double Shielding::transmission( const double energy ) const
+{
+  const float e = static_cast<float>( energy );
+
+  if( material && thickness > 0.0 )
+    return exp( -GammaInteractionCalc::transmition_coefficient_material( material, e, static_cast<float>(thickness) ) );
+
+  if( atomicNumber >= 1.0 && arealDensity > 0.0 )
+    return exp( -GammaInteractionCalc::transmition_coefficient_generic( static_cast<float>(atomicNumber),
+                                                                         static_cast<float>(arealDensity), e ) );
+
+  return 1.0;
+}//double Shielding::transmission( const double energy ) const
+
+
+std::string Shielding::description() const
+{
+  char buffer[128];
+
+  if( material && thickness > 0.0 )
+  {
+    snprintf( buffer, sizeof(buffer), "%s %s", material->name.c_str(),
+              PhysicalUnits::printToBestLengthUnits( thickness ).c_str() );
+    return buffer;
+  }
+
+  if( atomicNumber >= 1.0 && arealDensity > 0.0 )
+  {
+    const double gcm2 = PhysicalUnits::g / PhysicalUnits::cm2;
+    snprintf( buffer, sizeof(buffer), "AN=%.1f, AD=%.2f g/cm2", atomicNumber, arealDensity/gcm2 );
+    return buffer;
+  }
+
+  return "none";
+}//std::string Shielding::description() const
+
+
+Options::Options()
+  : ageMultiples{ 0.1, 1.0, 5.0 },
+    maxCandidates( 30 ),
+    maxNuclidesInMixture( 4 ),
+    numSigmaWindow( 1.5 ),
+    minRelativeLineIntensity( 0.05 ),
+    fitFullSpectrum( false ),
+    distance( 1.0*PhysicalUnits::m )
+{
+  const double gcm2 = PhysicalUnits::g / PhysicalUnits::cm2;
+  shieldings.push_back( Shielding() );
+  shieldings.push_back( Shielding( 26.0, 10.0*gcm2 ) );
+  shieldings.push_back( Shielding( 74.0, 25.0*gcm2 ) );
+}//Options constructor
+
+
+Hypothesis::Hypothesis()
+  : shieldingIndex( 0 ),
+    chi2( 0.0 ),
+    numObservations( 0 ),
+    logLikelihoodRatio( 0.0 ),
+    score( 0.0 ),
+    logLikelihoodRatioToBest( 0.0 )
+{
+}
+
+
+std::string Hypothesis::description() const
+{
+  stringstream strm;
+
+  for( size_t i = 0; i < nuclides.size(); ++i )
+  {
+    const NuclideContribution &n = nuclides[i];
+    strm << (i ? " + " : "") << (n.nuclide ? n.nuclide->symbol : string("null"))
+         << " (age " << PhysicalUnits::printToBestTimeUnits( n.age )
+         << ", " << PhysicalUnits::printToBestActivityUnits( n.activity ) << ")";
+  }
+
+  strm << "; shielding: " << shieldingDescription
+       << "; lnLR=" << logLikelihoodRatio
+       << ", chi2/n=" << chi2 << "/" << numObservations;
+
+  return strm.str();
+}//std::string Hypothesis::description() const
+
+
+std::vector<Hypothesis> identify(
+                  const std::deque< std::shared_ptr<const PeakDef> > &peaks,
+                  std::shared_ptr<const Measurement> data,
+                  std::shared_ptr<const DetectorPeakResponse> response,
+                  const Options &options )
+{
+  if( options.shieldings.empty() || options.ageMultiples.empty() )
+    throw runtime_error( "NuclideIdEngine::identify(...): must specify at least one shielding and age" );
+
+  if( options.fitFullSpectrum && (!data || data->num_gamma_channels() < 16) )
+    throw runtime_error( "NuclideIdEngine::identify(...): spectrum required to fit full spectrum" );
+
+  if( response && !response->isValid() )
+    response.reset();
+
+  const double live_time = (data && data->live_time() > 0.0f) ? data->live_time() : 1.0;
+  const float distance = static_cast<float>( options.distance );
+  const Resolution resolution( peaks, data, response );
+  const size_t nshield = options.shieldings.size();
+
+  //1) Find candidate nuclides from the peaks; rank by number of peaks they
+  //   have a line near.
+  vector<Observation> observations;
+  map<const SandiaDecay::Nuclide *, set<size_t> > nucToPeaks;
+
+  for( size_t i = 0; i < peaks.size(); ++i )
+  {
+    const std::shared_ptr<const PeakDef> &peak = peaks[i];
+    if( !peak || peak->peakArea() <= 0.0 )
+      continue;
+
+    Observation obs;
+    obs.energy = peak->mean();
+    if( peak->gausPeak() )
+    {
+      obs.lower = peak->mean() - options.numSigmaWindow*peak->sigma();
+      obs.upper = peak->mean() + options.numSigmaWindow*peak->sigma();
+    }else
+    {
+      obs.lower = peak->lowerX();
+      obs.upper = peak->upperX();
+    }
+    obs.observed = peak->peakArea();
+    obs.uncertainty = peak->peakAreaUncert();
+    if( !(obs.uncertainty > 0.0) )
+      obs.uncertainty = sqrt( std::max( obs.observed, 1.0 ) );
+    observations.push_back( obs );
+
+    const double window = 0.5*(obs.upper - obs.lower);
+    const vector<IsotopeId::NuclideStatWeightPair> near
+                  = IsotopeId::gammasNearInEnergy( static_cast<float>(obs.energy), window );
+    for( const IsotopeId::NuclideStatWeightPair &nw : near )
+      nucToPeaks[nw.nuclide].insert( i );
+  }//for( size_t i = 0; i < peaks.size(); ++i )
+
+  if( observations.empty() )
+    throw runtime_error( "NuclideIdEngine::identify(...): no peaks with positive area" );
+
+  std::sort( observations.begin(), observations.end(), &observation_less_than );
+
+  vector< pair<size_t,const SandiaDecay::Nuclide *> > ranked;
+  for( const auto &np : nucToPeaks )
+    ranked.push_back( make_pair( np.second.size(), np.first ) );
+  std::sort( ranked.begin(), ranked.end(),
+             []( const pair<size_t,const SandiaDecay::Nuclide *> &lhs,
+                 const pair<size_t,const SandiaDecay::Nuclide *> &rhs ) -> bool {
+               if( lhs.first != rhs.first )
+                 return lhs.first > rhs.first;
+               return lhs.second->symbol < rhs.second->symbol;
+             } );
+  if( ranked.size() > options.maxCandidates )
+    ranked.resize( options.maxCandidates );
+
+  vector<Candidate> candidates( ranked.size() );
+  for( size_t i = 0; i < ranked.size(); ++i )
+  {
+    Candidate &cand = candidates[i];
+    cand.nuclide = ranked[i].second;
+    const double default_age = PeakDef::defaultDecayTime( cand.nuclide );
+    if( PeakDef::ageFitNotAllowed( cand.nuclide ) )
+      cand.ages.push_back( default_age );
+    else
+      for( const double mult : options.ageMultiples )
+        cand.ages.push_back( mult * default_age );
+  }//for( size_t i = 0; i < ranked.size(); ++i )
+
+  if( candidates.empty() )
+    return vector<Hypothesis>();
+
+  auto efficiency = [&response,distance]( const double energy ) -> double {
+    return response ? response->efficiency( static_cast<float>(energy), distance ) : 1.0;
+  };
+
+  double min_energy = observations.front().lower, max_energy = observations.back().upper;
+  if( data )
+  {
+    min_energy = data->gamma_energy_min();
+    max_energy = data->gamma_energy_max();
+  }
+
+  //2) Determine the observations to fit.  When fitting peaks, add in
+  //   observations of zero counts where candidates (unshielded, default age)
+  //   predict a significant line, but there is no peak.  When fitting the
+  //   spectrum, use the channels of the continuum subtracted spectrum near
+  //   the candidates lines.
+  {
+    vector< pair<double,double> > significant_lines;  //energy, sigma
+    for( const Candidate &cand : candidates )
+    {
+      const double age = PeakDef::defaultDecayTime( cand.nuclide );
+      const vector<LineCounts> lines = source_lines( cand.nuclide, age, live_time );
+
+      double max_counts = 0.0;
+      for( const LineCounts &line : lines )
+        max_counts = std::max( max_counts, line.second * efficiency(line.first) );
+
+      for( const LineCounts &line : lines )
+      {
+        if( line.first < min_energy || line.first > max_energy )
+          continue;
+        if( line.second * efficiency(line.first) < options.minRelativeLineIntensity*max_counts )
+          continue;
+        significant_lines.push_back( make_pair( line.first, resolution.sigma(line.first) ) );
+      }
+    }//for( const Candidate &cand : candidates )
+
+    std::sort( significant_lines.begin(), significant_lines.end() );
+
+    if( options.fitFullSpectrum )
+    {
+      std::shared_ptr<const Measurement> continuum = estimateContinuum( data );
+      const size_t nchannel = data->num_gamma_channels();
+      vector<bool> use_channel( nchannel, false );
+      for( const pair<double,double> &line : significant_lines )
+      {
+        const size_t first = data->find_gamma_channel( static_cast<float>(line.first - 4.0*line.second) );
+        const size_t last = data->find_gamma_channel( static_cast<float>(line.first + 4.0*line.second) );
+        for( size_t channel = first; channel <= last && channel < nchannel; ++channel )
+          use_channel[channel] = true;
+      }
+
+      observations.clear();
+      for( size_t channel = 0; channel < nchannel; ++channel )
+      {
+        if( !use_channel[channel] )
+          continue;
+
+        const double counts = data->gamma_channel_content( channel );
+        Observation obs;
+        obs.lower = data->gamma_channel_lower( channel );
+        obs.upper = data->gamma_channel_upper( channel );
+        obs.energy = 0.5*(obs.lower + obs.upper);
+        obs.observed = counts - (continuum ? continuum->gamma_channel_content( channel ) : 0.0);
+        obs.uncertainty = sqrt( std::max( counts, 1.0 ) );
+        observations.push_back( obs );
+      }//for( size_t channel = 0; channel < nchannel; ++channel )
+    }else
+    {
+      vector<Observation> missing;
+      for( const pair<double,double> &line : significant_lines )
+      {
+        const double energy = line.first, sigma = line.second;
+
+        bool covered = false;
+        for( const Observation &obs : observations )
+          covered |= (energy >= obs.lower && energy <= obs.upper);
+        for( const Observation &obs : missing )
+          covered |= (energy >= obs.lower && energy <= obs.upper);
+        if( covered )
+          continue;
+
+        Observation obs;
+        obs.energy = energy;
+        obs.lower = energy - options.numSigmaWindow*sigma;
+        obs.upper = energy + options.numSigmaWindow*sigma;
+        obs.observed = 0.0;
+        const double background = data ? gamma_integral( data, static_cast<float>(obs.lower), static_cast<float>(obs.upper) ) : 0.0;
+        obs.uncertainty = sqrt( std::max( background, 1.0 ) );
+        missing.push_back( obs );
+      }//for( const pair<double,double> &line : significant_lines )
+
+      observations.insert( observations.end(), missing.begin(), missing.end() );
+      std::sort( observations.begin(), observations.end(), &observation_less_than );
+    }//if( options.fitFullSpectrum ) / else
+  }
+
+  const size_t nobs = observations.size();
+  if( !nobs )
+    return vector<Hypothesis>();
+
+  vector<double> weighted_obs( nobs );
+  double chi2_null = 0.0;
+  for( size_t i = 0; i < nobs; ++i )
+  {
+    weighted_obs[i] = observations[i].observed / observations[i].uncertainty;
+    chi2_null += weighted_obs[i] * weighted_obs[i];
+  }
+
+  //3) Compute the expected counts of each candidate, at each age and
+  //   shielding, for each observation; in parallel over candidates.
+  {
+    ComputeScheduler::TaskGroup pool;
+    for( Candidate &cand : candidates )
+    {
+      Candidate *candptr = &cand;
+      pool.post( [candptr,&observations,&options,&resolution,&efficiency,live_time,nshield](){
+        Candidate &c = *candptr;
+        c.templates.resize( c.ages.size() );
+        for( size_t age_index = 0; age_index < c.ages.size(); ++age_index )
+        {
+          const vector<LineCounts> lines = source_lines( c.nuclide, c.ages[age_index], live_time );
+          c.templates[age_index].assign( nshield, vector<double>( observations.size(), 0.0 ) );
+
+          for( const LineCounts &line : lines )
+          {
+            const double sigma = resolution.sigma( line.first );
+            const double eff = efficiency( line.first );
+            for( size_t s = 0; s < nshield; ++s )
+            {
+              const double counts = line.second * eff * options.shieldings[s].transmission( line.first );
+              add_line( c.templates[age_index][s], observations, line.first, counts,
+                        sigma, options.fitFullSpectrum );
+            }
+          }//for( const LineCounts &line : lines )
+
+          for( size_t s = 0; s < nshield; ++s )
+          {
+            vector<double> &t = c.templates[age_index][s];
+            for( size_t i = 0; i < t.size(); ++i )
+              t[i] /= observations[i].uncertainty;
+          }
+        }//for( loop over ages )
+      } );
+    }//for( Candidate &cand : candidates )
+    pool.join();
+  }
+
+  //4) For each shielding, build up mixtures by forward selection: at each
+  //   step, add the candidate (at its best age) that most reduces the chi2,
+  //   as long as the improvement is worth the extra parameter.
+  const double penalty = 0.5*log( static_cast<double>(nobs) );
+  vector< pair<MixtureFit,size_t> > fits;  //the fit, and shielding index
+
+  for( size_t s = 0; s < nshield; ++s )
+  {
+    vector< pair<size_t,size_t> > members;
+    double current_chi2 = chi2_null;
+
+    for( size_t nnuc = 0; nnuc < options.maxNuclidesInMixture; ++nnuc )
+    {
+      vector<MixtureFit> trials( candidates.size() );
+
+      ComputeScheduler::TaskGroup pool;
+      for( size_t c = 0; c < candidates.size(); ++c )
+      {
+        bool already_used = false;
+        for( const pair<size_t,size_t> &m : members )
+          already_used |= (m.first == c);
+        if( already_used )
+          continue;
+
+        pool.post( [c,s,&trials,&members,&candidates,&weighted_obs](){
+          for( size_t age_index = 0; age_index < candidates[c].ages.size(); ++age_index )
+          {
+            vector< pair<size_t,size_t> > trial_members = members;
+            trial_members.push_back( make_pair( c, age_index ) );
+            MixtureFit fit = fit_mixture( candidates, trial_members, s, weighted_obs );
+            if( fit.chi2 < trials[c].chi2 )
+              trials[c] = fit;
+          }
+        } );
+      }//for( size_t c = 0; c < candidates.size(); ++c )
+      pool.join();
+
+      //Single nuclide fits are all kept as hypotheses
+      if( nnuc == 0 )
+      {
+        for( const MixtureFit &fit : trials )
+          if( !fit.members.empty() && fit.activities[0] > 0.0 )
+            fits.push_back( make_pair( fit, s ) );
+      }
+
+      size_t best = candidates.size();
+      for( size_t c = 0; c < trials.size(); ++c )
+      {
+        if( !trials[c].members.empty()
+            && (best == candidates.size() || trials[c].chi2 < trials[best].chi2) )
+          best = c;
+      }
+
+      if( best == candidates.size() )
+        break;
+
+      //Require the new nuclide to improve the likelihood by more than the BIC
+      //  penalty, and to have a non-zero activity.
+      const MixtureFit &bestfit = trials[best];
+      if( (0.5*(current_chi2 - bestfit.chi2) < penalty) || !(bestfit.activities.back() > 0.0) )
+        break;
+
+      members = bestfit.members;
+      current_chi2 = bestfit.chi2;
+
+      if( nnuc > 0 )
+        fits.push_back( make_pair( bestfit, s ) );
+    }//for( size_t nnuc = 0; nnuc < options.maxNuclidesInMixture; ++nnuc )
+  }//for( size_t s = 0; s < nshield; ++s )
+
+  //5) Convert to hypotheses, and rank
+  vector<Hypothesis> answer;
+  set< pair<set<const SandiaDecay::Nuclide *>,size_t> > seen;
+
+  for( const pair<MixtureFit,size_t> &fitshield : fits )
+  {
+    const MixtureFit &fit = fitshield.first;
+
+    Hypothesis hyp;
+    set<const SandiaDecay::Nuclide *> nucs;
+    for( size_t i = 0; i < fit.members.size(); ++i )
+    {
+      if( !(fit.activities[i] > 0.0) )
+        continue;
+
+      const Candidate &cand = candidates[fit.members[i].first];
+      NuclideContribution contrib;
+      contrib.nuclide = cand.nuclide;
+      contrib.age = cand.ages[fit.members[i].second];
+      contrib.activity = fit.activities[i] * SandiaDecay::becquerel;
+      contrib.activityUncertainty = fit.uncertainties[i] * SandiaDecay::becquerel;
+      hyp.nuclides.push_back( contrib );
+      nucs.insert( cand.nuclide );
+    }//for( size_t i = 0; i < fit.members.size(); ++i )
+
+    if( hyp.nuclides.empty() || !seen.insert( make_pair(nucs, fitshield.second) ).second )
+      continue;
+
+    hyp.shieldingIndex = fitshield.second;
+    hyp.shieldingDescription = options.shieldings[fitshield.second].description();
+    hyp.chi2 = fit.chi2;
+    hyp.numObservations = nobs;
+    hyp.logLikelihoodRatio = 0.5*(chi2_null - fit.chi2);
+    hyp.score = hyp.logLikelihoodRatio - penalty*hyp.nuclides.size();
+    answer.push_back( hyp );
+  }//for( const pair<MixtureFit,size_t> &fitshield : fits )
+
+  std::sort( answer.begin(), answer.end(), []( const Hypothesis &lhs, const Hypothesis &rhs ) -> bool {
+    return lhs.score > rhs.score;
+  } );
+
+  if( !answer.empty() )
+  {
+    const double best_lnlr = answer.front().logLikelihoodRatio;
+    for( Hypothesis &hyp : answer )
+      hyp.logLikelihoodRatioToBest = hyp.logLikelihoodRatio - best_lnlr;
+  }
+
+  return answer;
+}//std::vector<Hypothesis> identify(...)
+}//namespace NuclideIdEngine
@@ -2902,6 +2902,54 @@ bool PeakDef::operator==( const PeakDef &rhs ) const
 }//PeakDef::operator==
 
 
+bool PeakDef::identicalTo( const PeakDef &rhs ) const
+{
+  for( CoefficientType t = CoefficientType(0);
+       t < NumCoefficientTypes; t = CoefficientType(t+1) )
+  {
+    if( m_coefficients[t] != rhs.m_coefficients[t]
+        || m_uncertainties[t] != rhs.m_uncertainties[t]
+        || m_fitFor[t] != rhs.m_fitFor[t] )
+      return false;
+  }
+  
+  if( m_continuum != rhs.m_continuum )
+  {
+    if( !m_continuum || !rhs.m_continuum || !(*m_continuum == *rhs.m_continuum) )
+      return false;
+  }
+  
+  if( m_candidateNuclides.size() != rhs.m_candidateNuclides.size() )
+    return false;
+  
+  for( size_t i = 0; i < m_candidateNuclides.size(); ++i )
+  {
+    const CandidateNuclide &l = m_candidateNuclides[i];
+    const CandidateNuclide &r = rhs.m_candidateNuclides[i];
+    if( l.nuclide != r.nuclide || l.transition != r.transition
+        || l.radparticleIndex != r.radparticleIndex || l.weight != r.weight
+        || l.sourceGammaType != r.sourceGammaType )
+      return false;
+  }//for( size_t i = 0; i < m_candidateNuclides.size(); ++i )
+  
+  return m_type==rhs.m_type
+      && m_skewType==rhs.m_skewType
+      && m_userLabel==rhs.m_userLabel
+      && m_parentNuclide==rhs.m_parentNuclide
+      && m_transition==rhs.m_transition
+      && m_radparticleIndex==rhs.m_radparticleIndex
+      && m_sourceGammaType==rhs.m_sourceGammaType
+      && m_xrayElement==rhs.m_xrayElement
+      && m_xrayEnergy==rhs.m_xrayEnergy
+      && m_reaction==rhs.m_reaction
+      && m_reactionEnergy==rhs.m_reactionEnergy
+      && m_useForCalibration==rhs.m_useForCalibration
+      && m_useForShieldingSourceFit==rhs.m_useForShieldingSourceFit
+      && m_useForDetectorResponseFit==rhs.m_useForDetectorResponseFit
+      && m_lineColor==rhs.m_lineColor;
+}//bool PeakDef::identicalTo( const PeakDef &rhs ) const
+
+
 void PeakDef::clearSources()
 {
   m_radparticleIndex = -1;
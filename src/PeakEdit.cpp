@@ -46,6 +46,7 @@
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/ColorSelect.h"
 #include "InterSpec/WarningWidget.h"
+#include "InterSpec/UndoRedoManager.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "InterSpec/SpectrumDisplayDiv.h"
 #include "SpecUtils/SpectrumDataStructs.h"
@@ -1825,6 +1826,8 @@ void PeakEdit::apply()
   if( !isDirty() )
     return;
   
+  UndoRedoManager::StepGroup undo_group( "edit peak" );
+  
   PeakDef revertPeak = *m_peakModel->peak( m_peakIndex ); //used to restore peak if catches an exception.
     
   try
@@ -2260,6 +2263,8 @@ void PeakEdit::accept()
 
 void PeakEdit::cancel()
 {
+  UndoRedoManager::StepGroup undo_group( "revert peak edit" );
+  
   if( m_peakIndex.isValid() )
   {
     m_peakModel->removePeak( m_peakIndex );
@@ -59,8 +59,9 @@
 
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PeakFit.h"
+#include "InterSpec/Tracing.h"
 #include "InterSpec/PeakFitChi2Fcn.h"
-#include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "SpecUtils/SpectrumDataStructs.h"
 #include "InterSpec/DetectorPeakResponse.h"
@@ -437,7 +438,7 @@ std::vector<std::shared_ptr<const PeakDef> > search_for_peaks_multithread(
     }//for( size_t i = 0; i < candidates.size(); ++i )
     
     
-    SpecUtilsAsync::ThreadPool pool;
+    ComputeScheduler::TaskGroup pool;
     
     vector< pair< PeakShrdVec, PeakShrdVec > > results( candidatesBeingFitFor.size() );
     
@@ -592,6 +593,8 @@ vector<std::shared_ptr<const PeakDef> > search_for_peaks(
                               std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > origpeaks,
                               const bool singleThreaded  )
 {
+  INTERSPEC_TRACE_SPAN( "search_for_peaks" );
+  
   vector<std::shared_ptr<const PeakDef> > answer;
   
   if( singleThreaded )
@@ -1202,6 +1205,7 @@ std::vector<PeakDef> fitPeaksInRange( const double x0,
   //Multithreaded (phys cores only): 0.022624s wall, 0.080000s user + 0.000000s system = 0.080000s CPU (353.6%)
   //Multithreaded (logical cores)  : 0.019906s wall, 0.100000s user + 0.000000s system = 0.100000s CPU (502.3%)
   
+  INTERSPEC_TRACE_SPAN( "fitPeaksInRange" );
   
   typedef vector<PeakDef> PeakVec;
   typedef PeakVec::iterator PeakVecIter;
@@ -1269,7 +1273,7 @@ std::vector<PeakDef> fitPeaksInRange( const double x0,
   
   //Fit each of the ranges
   vector< PeakVec > fit_peak_ranges( seperated_peaks.size() );
-  SpecUtilsAsync::ThreadPool threadpool;
+  ComputeScheduler::TaskGroup threadpool;
   //  vector< boost::function<void()> > fit_jobs( seperated_peaks.size() );
   for( size_t peakn = 0; peakn < seperated_peaks.size(); ++peakn )
   {
@@ -6343,7 +6347,7 @@ bool chi2_significance_test( PeakDef peak,
             
             size_t peakn = 0;
             
-            SpecUtilsAsync::ThreadPool pool;
+            ComputeScheduler::TaskGroup pool;
             
             for( size_t group = 0; group < m_grouped_candidates.size(); ++group )
             {
@@ -23,6 +23,7 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <deque>
 #include <string>
 #include <vector>
@@ -52,6 +53,7 @@
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/WarningWidget.h"
+#include "InterSpec/UndoRedoManager.h"
 #include "InterSpec/PeakFitChi2Fcn.h"
 #include "InterSpec/PeakInfoDisplay.h"  //Only for ALLOW_PEAK_COLOR_DELEGATE
 #include "SpecUtils/UtilityFunctions.h"
@@ -605,6 +607,8 @@ WModelIndex PeakModel::addNewPeak( const PeakDef &peak )
   if( !isWithinRange( peak ) )
     return WModelIndex();
 
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+  
   notifySpecMeasOfPeakChange();
   
   PeakDef *new_peak_ptr = new PeakDef( peak );
@@ -629,6 +633,8 @@ WModelIndex PeakModel::addNewPeak( const PeakDef &peak )
   m_sortedPeaks.insert( sort_pos, peak_ptr );
   endInsertRows();
   
+  peak_undo_creator.peakAdded( peak_ptr );
+  
   return index( indexpos, 0 );
 }//void addPeak( const PeakDef &peak )
 
@@ -636,6 +642,8 @@ WModelIndex PeakModel::addNewPeak( const PeakDef &peak )
 
 void PeakModel::addPeaks( const vector<PeakDef> &peaks )
 {
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+  
   for( size_t i = 0; i < peaks.size(); ++i )
     addNewPeak( peaks[i] );
 }//void addPeaks( const vector<PeakDef> &peaks )
@@ -685,48 +693,254 @@ void PeakModel::setPeaks( vector<PeakDef> peaks )
   if( !m_peaks )
     throw runtime_error( "Set a primary spectrum before adding peak" );
 
-  if( !m_peaks->empty() )
-  {
-    beginRemoveRows( WModelIndex(), 0, static_cast<int>(m_peaks->size()-1) );
-    m_peaks->clear();
-    m_sortedPeaks.clear();
-    endRemoveRows();
-  }//if( !m_peaks->empty() )
+  UndoRedoManager::PeakModelChange peak_undo_creator;
 
   // Remove any peaks that aren't within the range.
-  const vector<PeakDef>::const_iterator peaks_end
-              = remove_if( peaks.begin(), peaks.end(),
-                           boost::bind( &PeakModel::isOutOfRange, this, _1 ) );
+  peaks.erase( remove_if( peaks.begin(), peaks.end(),
+                          boost::bind( &PeakModel::isOutOfRange, this, _1 ) ),
+               peaks.end() );
+  
+  for( size_t i = 0; i < peaks.size(); ++i )
+    definePeakXRange( peaks[i] );
+//    need to go through and estimate the chi2DOF here
+  
+  boost::function<bool(const PeakShrdPtr &, const PeakShrdPtr &)> sortfcn, meansort;
+  sortfcn = boost::bind( &PeakModel::compare, _1, _2, m_sortColumn, m_sortOrder );
+  meansort = boost::bind( &PeakModel::compare, _1, _2, kMean, Wt::AscendingOrder );
+  
+  //Most calls to this function (refitting a ROI, undo/redo, etc) change only
+  //  a small fraction of the peaks, so instead of removing and re-inserting
+  //  every row (which causes every view, and the chart, to update everything),
+  //  we diff the old and new peaks by ROI (peaks that share a continuum), and
+  //  only remove/insert/update the rows that actually changed.
+  //  Unchanged ROIs keep their original PeakDef objects.
+  typedef vector<PeakShrdPtr> RoiPeaks;
+  
+  vector<RoiPeaks> newrois, oldrois;
+  
+  {//begin group new peaks by continuum
+    map<const PeakContinuum *,size_t> contToRoi;
+    for( size_t i = 0; i < peaks.size(); ++i )
+    {
+      const PeakContinuum *cont = peaks[i].continuum().get();
+      const auto pos = contToRoi.find( cont );
+      const size_t roinum = (pos == contToRoi.end()) ? newrois.size() : pos->second;
+      if( roinum == newrois.size() )
+      {
+        contToRoi[cont] = roinum;
+        newrois.push_back( RoiPeaks() );
+      }
+      newrois[roinum].push_back( std::make_shared<PeakDef>( peaks[i] ) );
+    }//for( size_t i = 0; i < peaks.size(); ++i )
+    
+    for( RoiPeaks &roi : newrois )
+      std::sort( roi.begin(), roi.end(), meansort );
+  }//end group new peaks by continuum
+  
+  {//begin group old peaks by continuum (m_peaks is already sorted by mean)
+    map<const PeakContinuum *,size_t> contToRoi;
+    for( const PeakShrdPtr &p : *m_peaks )
+    {
+      const PeakContinuum *cont = p->continuum().get();
+      const auto pos = contToRoi.find( cont );
+      const size_t roinum = (pos == contToRoi.end()) ? oldrois.size() : pos->second;
+      if( roinum == oldrois.size() )
+      {
+        contToRoi[cont] = roinum;
+        oldrois.push_back( RoiPeaks() );
+      }
+      oldrois[roinum].push_back( p );
+    }//for( const PeakShrdPtr &p : *m_peaks )
+  }//end group old peaks by continuum
   
+  //Match ROIs, first by identity (all peaks identical), then by the ROIs
+  //  overlapping in energy and having the same number of peaks (e.g., a refit).
+  vector<bool> oldRoiUsed( oldrois.size(), false );
+  vector<int> newToOldRoi( newrois.size(), -1 );
+  vector<bool> roiIsIdentical( newrois.size(), false );
   
-  const size_t npeaksadd = peaks_end - peaks.begin();
+  multimap<double,size_t> oldRoiByMean;
+  for( size_t i = 0; i < oldrois.size(); ++i )
+    oldRoiByMean.insert( make_pair( oldrois[i].front()->mean(), i ) );
   
-  if( npeaksadd )
+  for( size_t i = 0; i < newrois.size(); ++i )
   {
-    for( size_t i = 0; i < npeaksadd; ++i )
-      definePeakXRange( peaks[i] );
-//    need to go through and estimate the chi2DOF here
+    const RoiPeaks &newroi = newrois[i];
+    const auto range = oldRoiByMean.equal_range( newroi.front()->mean() );
+    for( auto iter = range.first; iter != range.second; ++iter )
+    {
+      const RoiPeaks &oldroi = oldrois[iter->second];
+      if( oldRoiUsed[iter->second] || oldroi.size() != newroi.size() )
+        continue;
+      
+      bool same = true;
+      for( size_t j = 0; same && j < newroi.size(); ++j )
+        same = newroi[j]->identicalTo( *oldroi[j] );
+      
+      if( same )
+      {
+        oldRoiUsed[iter->second] = true;
+        newToOldRoi[i] = static_cast<int>( iter->second );
+        roiIsIdentical[i] = true;
+        break;
+      }
+    }//for( loop over old ROIs with same first mean )
+  }//for( size_t i = 0; i < newrois.size(); ++i )
+  
+  for( size_t i = 0; i < newrois.size(); ++i )
+  {
+    if( newToOldRoi[i] >= 0 )
+      continue;
     
-    boost::function<bool(const PeakShrdPtr &, const PeakShrdPtr &)> sortfcn, meansort;
-    sortfcn = boost::bind( &PeakModel::compare, _1, _2, m_sortColumn, m_sortOrder );
-    meansort = boost::bind( &PeakModel::compare, _1, _2, kMean, Wt::AscendingOrder );
-
-    beginInsertRows( WModelIndex(), 0, int(npeaksadd - 1) );
-
-    for( size_t i = 0; i < npeaksadd; ++i )
+    const RoiPeaks &newroi = newrois[i];
+    const double newlower = newroi.front()->lowerX();
+    const double newupper = newroi.front()->upperX();
+    
+    for( size_t j = 0; j < oldrois.size(); ++j )
     {
-      const PeakDef &inpeak = peaks[i];
-      std::shared_ptr<PeakDef> peak = std::make_shared<PeakDef>( inpeak );
-      m_peaks->push_back( peak );
-      m_sortedPeaks.push_back( peak );
-    }// for( loop over peaks )
-
-    std::sort( m_peaks->begin(), m_peaks->end(), meansort );
-    std::stable_sort( m_sortedPeaks.begin(), m_sortedPeaks.end(), sortfcn );
+      const RoiPeaks &oldroi = oldrois[j];
+      if( oldRoiUsed[j] || oldroi.size() != newroi.size() )
+        continue;
+      
+      if( oldroi.front()->lowerX() < newupper && newlower < oldroi.front()->upperX() )
+      {
+        oldRoiUsed[j] = true;
+        newToOldRoi[i] = static_cast<int>( j );
+        break;
+      }
+    }//for( size_t j = 0; j < oldrois.size(); ++j )
+  }//for( size_t i = 0; i < newrois.size(); ++i )
+  
+  vector<PeakShrdPtr> toRemove, toAdd;
+  vector<pair<PeakShrdPtr,PeakShrdPtr>> toReplace;
+  
+  for( size_t i = 0; i < oldrois.size(); ++i )
+  {
+    if( !oldRoiUsed[i] )
+      toRemove.insert( toRemove.end(), oldrois[i].begin(), oldrois[i].end() );
+  }
+  
+  for( size_t i = 0; i < newrois.size(); ++i )
+  {
+    if( roiIsIdentical[i] )
+      continue;
+    
+    if( newToOldRoi[i] < 0 )
+    {
+      toAdd.insert( toAdd.end(), newrois[i].begin(), newrois[i].end() );
+    }else
+    {
+      const RoiPeaks &oldroi = oldrois[newToOldRoi[i]];
+      for( size_t j = 0; j < oldroi.size(); ++j )
+        toReplace.push_back( make_pair( oldroi[j], newrois[i][j] ) );
+    }
+  }//for( size_t i = 0; i < newrois.size(); ++i )
+  
+  if( toRemove.empty() && toAdd.empty() && toReplace.empty() )
+    return;
+  
+  const size_t nchanged = toRemove.size() + toAdd.size() + toReplace.size();
+  
+  if( nchanged > std::max( size_t(16), m_peaks->size()/2 ) )
+  {
+    //Most of the peaks changed (e.g., a new search for peaks), so just reset
+    //  the whole model, which is cheaper than many individual row updates.
+    deque<PeakShrdPtr> newpeaks;
+    for( size_t i = 0; i < newrois.size(); ++i )
+    {
+      const RoiPeaks &roi = roiIsIdentical[i] ? oldrois[newToOldRoi[i]] : newrois[i];
+      newpeaks.insert( newpeaks.end(), roi.begin(), roi.end() );
+    }
+    
+    for( const PeakShrdPtr &peak : *m_peaks )
+      peak_undo_creator.peakRemoved( peak );
+    for( const PeakShrdPtr &peak : newpeaks )
+      peak_undo_creator.peakAdded( peak );
+    
+    if( !m_peaks->empty() )
+    {
+      beginRemoveRows( WModelIndex(), 0, static_cast<int>(m_peaks->size()-1) );
+      m_peaks->clear();
+      m_sortedPeaks.clear();
+      endRemoveRows();
+    }//if( !m_peaks->empty() )
+    
+    if( !newpeaks.empty() )
+    {
+      std::sort( newpeaks.begin(), newpeaks.end(), meansort );
+      
+      beginInsertRows( WModelIndex(), 0, static_cast<int>(newpeaks.size() - 1) );
+      *m_peaks = newpeaks;
+      m_sortedPeaks = newpeaks;
+      std::stable_sort( m_sortedPeaks.begin(), m_sortedPeaks.end(), sortfcn );
+      endInsertRows();
+    }//if( !newpeaks.empty() )
+    
+    notifySpecMeasOfPeakChange();
+    return;
+  }//if( most of the peaks changed )
+  
+  auto removeRow = [this,&peak_undo_creator]( const PeakShrdPtr &peak ){
+    const auto sort_pos = std::find( m_sortedPeaks.begin(), m_sortedPeaks.end(), peak );
+    const auto mean_pos = std::find( m_peaks->begin(), m_peaks->end(), peak );
+    assert( sort_pos != m_sortedPeaks.end() && mean_pos != m_peaks->end() );
+    
+    const int row = static_cast<int>( sort_pos - m_sortedPeaks.begin() );
+    beginRemoveRows( WModelIndex(), row, row );
+    m_sortedPeaks.erase( sort_pos );
+    m_peaks->erase( mean_pos );
+    endRemoveRows();
     
+    peak_undo_creator.peakRemoved( peak );
+  };//removeRow lambda
+  
+  for( const PeakShrdPtr &peak : toRemove )
+    removeRow( peak );
+  
+  for( const auto &oldnew : toReplace )
+  {
+    const PeakShrdPtr &oldpeak = oldnew.first;
+    const PeakShrdPtr &newpeak = oldnew.second;
+    
+    const auto sort_pos = std::find( m_sortedPeaks.begin(), m_sortedPeaks.end(), oldpeak );
+    const auto mean_pos = std::find( m_peaks->begin(), m_peaks->end(), oldpeak );
+    assert( sort_pos != m_sortedPeaks.end() && mean_pos != m_peaks->end() );
+    
+    //We can only update the row in place if the new peak would stay in the
+    //  same position in both orderings; otherwise remove it and re-insert.
+    const bool mean_ok = (mean_pos == m_peaks->begin() || !meansort( newpeak, *(mean_pos-1) ))
+                       && ((mean_pos+1) == m_peaks->end() || !meansort( *(mean_pos+1), newpeak ));
+    const bool sort_ok = (sort_pos == m_sortedPeaks.begin() || !sortfcn( newpeak, *(sort_pos-1) ))
+                       && ((sort_pos+1) == m_sortedPeaks.end() || !sortfcn( *(sort_pos+1), newpeak ));
+    
+    if( mean_ok && sort_ok )
+    {
+      const int row = static_cast<int>( sort_pos - m_sortedPeaks.begin() );
+      *sort_pos = newpeak;
+      *mean_pos = newpeak;
+      peak_undo_creator.peakRemoved( oldpeak );
+      peak_undo_creator.peakAdded( newpeak );
+      dataChanged().emit( index(row,0), index(row,kNumColumns-1) );
+    }else
+    {
+      removeRow( oldpeak );
+      toAdd.push_back( newpeak );
+    }
+  }//for( const auto &oldnew : toReplace )
+  
+  for( const PeakShrdPtr &peak : toAdd )
+  {
+    const auto mean_pos = lower_bound( m_peaks->begin(), m_peaks->end(), peak, meansort );
+    const auto sort_pos = lower_bound( m_sortedPeaks.begin(), m_sortedPeaks.end(), peak, sortfcn );
+    const int row = static_cast<int>( sort_pos - m_sortedPeaks.begin() );
+    
+    beginInsertRows( WModelIndex(), row, row );
+    m_peaks->insert( mean_pos, peak );
+    m_sortedPeaks.insert( sort_pos, peak );
     endInsertRows();
-    layoutChanged().emit();
-  }//if( peaks.size() )
+    
+    peak_undo_creator.peakAdded( peak );
+  }//for( const PeakShrdPtr &peak : toAdd )
   
   notifySpecMeasOfPeakChange();
 }//void setPeaks( const vector<PeakDef> &peaks )
@@ -737,6 +951,8 @@ void PeakModel::removePeak( const size_t peakn )  //throws if invalid peak numbe
   if( peakn >= m_peaks->size() )
     throw std::runtime_error( "PeakModel::removePeak(): invalid index" );
 
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+  
   PeakShrdPtr peak = (*m_peaks)[peakn];
 
   std::deque< PeakShrdPtr >::iterator sort_pos = find( m_sortedPeaks.begin(), m_sortedPeaks.end(), peak );
@@ -748,6 +964,8 @@ void PeakModel::removePeak( const size_t peakn )  //throws if invalid peak numbe
   m_sortedPeaks.erase( sort_pos );
   endRemoveRows();
   
+  peak_undo_creator.peakRemoved( peak );
+  
   notifySpecMeasOfPeakChange();
 }//void removePeak( const size_t peakn )
 
@@ -757,6 +975,7 @@ void PeakModel::removePeak( Wt::WModelIndex index )
   if( !index.isValid() )
     throw std::runtime_error( "PeakModel::removePeak(): non-valid index" );
 
+  UndoRedoManager::PeakModelChange peak_undo_creator;
   
   PeakShrdPtr peak = m_sortedPeaks.at( index.row() );
   
@@ -768,6 +987,8 @@ void PeakModel::removePeak( Wt::WModelIndex index )
   m_sortedPeaks.erase( m_sortedPeaks.begin() + index.row() );
   endRemoveRows();
   
+  peak_undo_creator.peakRemoved( peak );
+  
   notifySpecMeasOfPeakChange();
 }//void removePeak( Wt::WModelIndex index )
 
@@ -813,12 +1034,17 @@ void PeakModel::setPeakFitFor( const Wt::WModelIndex index,
     throw runtime_error( "Serious logic error in setPeakFitFor(...)" );
   const size_t energy_index = energy_pos - m_peaks->begin();
   
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+  
   PeakDef newPeak = *old_peak;
   newPeak.setFitFor( coef, fitfor );
   
   m_sortedPeaks[row] = std::make_shared<PeakDef>( newPeak );
   (*m_peaks)[energy_index] = m_sortedPeaks[row];
   
+  peak_undo_creator.peakRemoved( old_peak );
+  peak_undo_creator.peakAdded( m_sortedPeaks[row] );
+  
   notifySpecMeasOfPeakChange();
 }//setPeakFitFor(...)
 
@@ -845,6 +1071,8 @@ void PeakModel::setContinuumPolynomialFitFor( const Wt::WModelIndex index,
                          " setContinuumPolynomialFitFor(...)" );
   const size_t energy_index = energy_pos - m_peaks->begin();
   
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+  
   PeakDef newPeak = *old_peak;
 //  newPeak.setContinuum( old_peak->continuum() );
   newPeak.continuum()->setPolynomialCoefFitFor( polyCoefNum, fitfor );
@@ -852,6 +1080,9 @@ void PeakModel::setContinuumPolynomialFitFor( const Wt::WModelIndex index,
   m_sortedPeaks[row] = std::make_shared<PeakDef>( newPeak );
   (*m_peaks)[energy_index] = m_sortedPeaks[row];
   
+  peak_undo_creator.peakRemoved( old_peak );
+  peak_undo_creator.peakAdded( m_sortedPeaks[row] );
+  
   notifySpecMeasOfPeakChange();
 }//void setContinuumPolynomialFitFor(...)
 
@@ -1419,6 +1650,8 @@ bool PeakModel::setData( const WModelIndex &index,
   if( !m_peaks )
     throw runtime_error( "Set a primary spectrum before setting peak data" );
 
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+  
   notifySpecMeasOfPeakChange();
   
   try
@@ -1751,6 +1984,9 @@ bool PeakModel::setData( const WModelIndex &index,
     m_sortedPeaks[row] = std::make_shared<const PeakDef>( new_peak );
     (*energy_pos) = m_sortedPeaks[row];
 
+    peak_undo_creator.peakRemoved( old_peak );
+    peak_undo_creator.peakAdded( m_sortedPeaks[row] );
+
     if( column != kIsotope
         && column != kPhotoPeakEnergy
         && column != kMean )
@@ -1895,6 +2131,8 @@ bool PeakModel::removeRows( int row, int count, const WModelIndex & )
   if( !m_peaks )
     throw runtime_error( "Can not remove rows without a primary spectrum" );
 
+  UndoRedoManager::PeakModelChange peak_undo_creator;
+
   const int nrow = static_cast<int>( m_peaks->size() );
 
   if( !count )
@@ -1915,6 +2153,7 @@ bool PeakModel::removeRows( int row, int count, const WModelIndex & )
     mean_index = find( m_peaks->begin(), m_peaks->end(), peak );
     assert( mean_index != m_peaks->end() );
     m_peaks->erase( mean_index );
+    peak_undo_creator.peakRemoved( peak );
   }//for( index = start; index != end; ++index )
 
   m_sortedPeaks.erase( start, end );
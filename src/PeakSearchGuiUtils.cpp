@@ -48,6 +48,8 @@
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/SpecMeas.h"
+#include "InterSpec/Tracing.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/ColorTheme.h"
@@ -1903,11 +1905,10 @@ void automated_search_for_peaks( InterSpec *viewer,
   std::weak_ptr<const Measurement> weakdata = dataPtr;
   const string seshid = wApp->sessionId();
   
-  server->ioService().post( std::bind( [=](){
+  ComputeScheduler::instance().post( seshid, [=](){
     search_for_peaks_worker( weakdata, startingPeaks, displayed, setColor,
                             searchresults, callback, seshid, false );
-    
-  } ) );
+  }, ComputeScheduler::Priority::Normal );
 }//void automated_search_for_peaks( InterSpec *interspec, const bool keep_old_peaks )
 
   
@@ -2065,6 +2066,8 @@ void search_for_peaks_worker( std::weak_ptr<const Measurement> weak_data,
                                const std::string sessionID,
                                const bool singleThread )
 {
+  INTERSPEC_TRACE_SESSION( sessionID );
+  
   Wt::WServer *server = Wt::WServer::instance();
   if( !server )  //shouldnt ever happen,
     return;
@@ -25,11 +25,23 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "rapidxml/rapidxml.hpp"
 
 #include "InterSpec/ReactionGamma.h"
@@ -41,9 +53,196 @@
 using namespace std;
 
 string ReactionGammaServer::sm_xmlFileLocation = "data/sandia.reactiongamma.xml";
+string ReactionGammaServer::sm_binaryCacheLocation;
+bool ReactionGammaServer::sm_binaryCacheLocationSet = false;
 std::mutex ReactionGammaServer::sm_dataBaseMutex;
 std::unique_ptr<ReactionGamma> ReactionGammaServer::sm_dataBase;
 
+
+namespace
+{
+  //The binary image of the reaction data starts with ns_cacheMagic, then the
+  //  format version, a byte order mark, the hash and size of the XML data it
+  //  was made from, and the number of reactions.  Each reaction is then the
+  //  reaction type (uint8), the target nuclide, target element, and product
+  //  nuclide symbols (uint8 length, then characters; empty if null), the
+  //  number of gammas (uint32), and then the (energy,abundance) float pairs.
+  //  The annihilation reaction is not stored since it isnt from the XML.
+  //  Increment ns_cacheVersion whenever this layout, or how the XML is
+  //  interpreted, changes.
+  const char ns_cacheMagic[8] = { 'I', 'S', 'R', 'C', 'T', 'N', 'G', 'M' };
+  const uint32_t ns_cacheVersion = 1;
+  const uint32_t ns_byteOrderMark = 0x01020304;
+  
+  
+  //64 bit FNV-1a hash; only used to detect the XML file changing.
+  uint64_t fnv1a_hash( const char *data, const size_t len )
+  {
+    uint64_t hash = 14695981039346656037ULL;
+    for( size_t i = 0; i < len; ++i )
+    {
+      hash ^= static_cast<unsigned char>( data[i] );
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }//uint64_t fnv1a_hash(...)
+  
+  
+  /** Read-only memory mapping of a whole file; data() will be null if the
+      file couldnt be mapped.
+   */
+  class MappedFile
+  {
+  public:
+    explicit MappedFile( const std::string &filename )
+      : m_data( nullptr ),
+        m_size( 0 )
+#ifdef _WIN32
+        , m_file( nullptr ),
+        m_mapping( nullptr )
+#endif
+    {
+#ifdef _WIN32
+      const std::wstring wfilename = UtilityFunctions::convert_from_utf8_to_utf16( filename );
+      HANDLE file = CreateFileW( wfilename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                 NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+      if( file == INVALID_HANDLE_VALUE )
+        return;
+      m_file = file;
+      
+      LARGE_INTEGER filesize;
+      if( !GetFileSizeEx( file, &filesize ) || filesize.QuadPart <= 0 )
+      {
+        unmap();
+        return;
+      }
+      
+      m_mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+      if( m_mapping )
+        m_data = static_cast<const char *>( MapViewOfFile( m_mapping, FILE_MAP_READ, 0, 0, 0 ) );
+      
+      if( !m_data )
+      {
+        unmap();
+        return;
+      }
+      m_size = static_cast<size_t>( filesize.QuadPart );
+#else
+      const int fd = open( filename.c_str(), O_RDONLY );
+      if( fd < 0 )
+        return;
+      
+      struct stat filestat;
+      if( fstat( fd, &filestat ) != 0 || filestat.st_size <= 0 )
+      {
+        close( fd );
+        return;
+      }
+      
+      const size_t size = static_cast<size_t>( filestat.st_size );
+      void *data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      close( fd );
+      
+      if( data == MAP_FAILED )
+        return;
+      
+      m_data = static_cast<const char *>( data );
+      m_size = size;
+#endif
+    }//MappedFile constructor
+    
+    ~MappedFile()
+    {
+      unmap();
+    }
+    
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    
+  private:
+    MappedFile( const MappedFile & );
+    MappedFile &operator=( const MappedFile & );
+    
+    void unmap()
+    {
+#ifdef _WIN32
+      if( m_data )
+        UnmapViewOfFile( m_data );
+      if( m_mapping )
+        CloseHandle( m_mapping );
+      if( m_file )
+        CloseHandle( m_file );
+      m_mapping = m_file = nullptr;
+#else
+      if( m_data )
+        munmap( const_cast<char *>(m_data), m_size );
+#endif
+      m_data = nullptr;
+      m_size = 0;
+    }//void unmap()
+    
+    const char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+  };//class MappedFile
+  
+  
+  /** Bounds checked sequential reads from a block of memory. */
+  class CacheReader
+  {
+  public:
+    CacheReader( const char *data, const size_t size )
+      : m_pos( data ), m_end( data + size )
+    {
+    }
+    
+    template<class T>
+    bool read( T &val )
+    {
+      if( static_cast<size_t>(m_end - m_pos) < sizeof(T) )
+        return false;
+      memcpy( &val, m_pos, sizeof(T) );
+      m_pos += sizeof(T);
+      return true;
+    }
+    
+    bool read_string( std::string &val )
+    {
+      uint8_t len;
+      if( !read( len ) || static_cast<size_t>(m_end - m_pos) < len )
+        return false;
+      val.assign( m_pos, m_pos + len );
+      m_pos += len;
+      return true;
+    }
+    
+    size_t remaining() const { return static_cast<size_t>( m_end - m_pos ); }
+    
+  private:
+    const char *m_pos;
+    const char *m_end;
+  };//class CacheReader
+  
+  
+  template<class T>
+  void append_bytes( std::vector<char> &buffer, const T &val )
+  {
+    const char *start = reinterpret_cast<const char *>( &val );
+    buffer.insert( buffer.end(), start, start + sizeof(T) );
+  }
+  
+  void append_string( std::vector<char> &buffer, const std::string &val )
+  {
+    if( val.size() > 255 )
+      throw runtime_error( "ReactionGamma: symbol to long for binary image" );
+    append_bytes( buffer, static_cast<uint8_t>(val.size()) );
+    buffer.insert( buffer.end(), val.begin(), val.end() );
+  }
+}//namespace
+
 /*
 void print_reaction( std::string name )
 {
@@ -71,6 +270,18 @@ void ReactionGammaServer::set_xml_file_location( const std::string &filename )
   sm_xmlFileLocation = filename;
 }//void set_xml_file_location()
 
+
+void ReactionGammaServer::set_binary_cache_location( const std::string &filename )
+{
+  std::unique_lock<std::mutex> lock( sm_dataBaseMutex );
+  if( sm_dataBase )
+    throw std::runtime_error( "ReactionGammaServer::set_binary_cache_location(...)"
+                              " can not be called after ReactionGammaServer::database()"
+                              " has been called" );
+  sm_binaryCacheLocation = filename;
+  sm_binaryCacheLocationSet = true;
+}//void set_binary_cache_location()
+
 const ReactionGamma *ReactionGammaServer::database()
 {
   //is it thread safe to test if a scoped_ptr is valid?
@@ -83,7 +294,13 @@ const ReactionGamma *ReactionGammaServer::database()
 
   const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
 
-  sm_dataBase.reset( new ReactionGamma( sm_xmlFileLocation, db ) );
+  //There is no default location for the image: a fixed name in a shared
+  //  directory (like the temp directory) could be replaced by another user,
+  //  so we only use one when set_binary_cache_location(...) has been called,
+  //  which InterSpec does with the per-user writable data directory.
+  const string cachefile = sm_binaryCacheLocationSet ? sm_binaryCacheLocation : string();
+  
+  sm_dataBase.reset( new ReactionGamma( sm_xmlFileLocation, db, cachefile ) );
 
   return sm_dataBase.get();
 }//database()
@@ -168,10 +385,12 @@ bool ReactionGamma::Reaction::less_than( const Reaction &lhs,
 
 
 ReactionGamma::ReactionGamma( const string &sandia_reaction_xml,
-                              const SandiaDecay::SandiaDecayDataBase *database )
-  : m_decayDatabase( database )
+                              const SandiaDecay::SandiaDecayDataBase *database,
+                              const string &binary_cache )
+  : m_decayDatabase( database ),
+    m_loadedFromBinaryCache( false )
 {
-  init( sandia_reaction_xml );
+  init( sandia_reaction_xml, binary_cache );
 }//ReactionGamma constructor
 
 
@@ -432,6 +651,12 @@ const vector<const ReactionGamma::Reaction *> &ReactionGamma::reactions(
 }//reactions( ReactionType type )
 
 
+bool ReactionGamma::loadedFromBinaryCache() const
+{
+  return m_loadedFromBinaryCache;
+}
+
+
 //reactions(...): looks through all reactions and returns results in 'answer'
 //  for every reaction with a gamma in the energy range specified.
 //  Note that 'answer' is appended to (not replaced).
@@ -629,31 +854,216 @@ void ReactionGamma::populate_reaction( const rapidxml::xml_node<char> *parent,
 
 
 
-void ReactionGamma::init( const string &input )
+bool ReactionGamma::read_binary_cache( const string &filename,
+                                       const uint64_t xml_hash )
 {
-  using namespace rapidxml;
+  if( !m_decayDatabase || !UtilityFunctions::is_file(filename) )
+    return false;
+  
+#ifndef _WIN32
+  //Only trust an image that no other (non-root) user could have written.
+  struct stat filestat;
+  if( stat( filename.c_str(), &filestat ) != 0
+      || filestat.st_uid != geteuid()
+      || (filestat.st_mode & (S_IWGRP | S_IWOTH)) )
+  {
+    cerr << "ReactionGamma: ignoring binary image " << filename
+         << " as it is not owned by, and only writable by, the current user" << endl;
+    return false;
+  }
+#endif
+  
+  const MappedFile file( filename );
+  if( !file.data() )
+    return false;
+  
+  CacheReader reader( file.data(), file.size() );
+  
+  char magic[sizeof(ns_cacheMagic)];
+  uint32_t version, byteorder, nreactions;
+  uint64_t hash;
+  
+  if( !reader.read( magic ) || memcmp( magic, ns_cacheMagic, sizeof(magic) )
+      || !reader.read( version ) || version != ns_cacheVersion
+      || !reader.read( byteorder ) || byteorder != ns_byteOrderMark
+      || !reader.read( hash ) || hash != xml_hash
+      || !reader.read( nreactions ) )
+    return false;
+  
+  const SandiaDecay::SandiaDecayDataBase *db = m_decayDatabase;
+  vector< unique_ptr<Reaction> > results[NumReactionType];
+  
+  for( uint32_t i = 0; i < nreactions; ++i )
+  {
+    uint8_t type;
+    uint32_t ngammas;
+    string target_nuc, target_el, product;
+    
+    if( !reader.read( type ) || type >= AnnihilationReaction
+        || !reader.read_string( target_nuc )
+        || !reader.read_string( target_el )
+        || !reader.read_string( product )
+        || !reader.read( ngammas )
+        || (reader.remaining() / (2*sizeof(float))) < ngammas )
+      return false;
+    
+    unique_ptr<Reaction> rctn( new Reaction() );
+    rctn->type = ReactionType( type );
+    
+    if( !target_nuc.empty() && !(rctn->targetNuclide = db->nuclide( target_nuc )) )
+      return false;
+    if( !target_el.empty() && !(rctn->targetElement = db->element( target_el )) )
+      return false;
+    if( !product.empty() && !(rctn->productNuclide = db->nuclide( product )) )
+      return false;
+    
+    if( !rctn->targetNuclide && !rctn->targetElement )
+      return false;
+    
+    rctn->gammas.resize( ngammas );
+    for( EnergyAbundance &ea : rctn->gammas )
+    {
+      reader.read( ea.energy );
+      reader.read( ea.abundance );
+    }
+    
+    results[type].push_back( std::move(rctn) );
+  }//for( uint32_t i = 0; i < nreactions; ++i )
+  
+  if( reader.remaining() )
+    return false;
+  
+  for( ReactionType rt = ReactionType(0);
+       rt < AnnihilationReaction;
+       rt = ReactionType(rt+1) )
+  {
+    for( unique_ptr<Reaction> &rctn : results[rt] )
+      m_reactions[rt].push_back( rctn.release() );
+  }
+  
+  return true;
+}//bool read_binary_cache(...)
 
-  vector<char> inputdata;
-  UtilityFunctions::load_file_data( input.c_str(), inputdata );
 
-  xml_document<char> document;
-  document.parse<parse_normalize_whitespace | parse_trim_whitespace>( &inputdata.front() );
-  const rapidxml::xml_node<char> *doc_node = document.first_node();
+void ReactionGamma::write_binary_cache( const string &filename,
+                                        const uint64_t xml_hash ) const
+{
+  uint32_t nreactions = 0;
+  for( ReactionType rt = ReactionType(0);
+       rt < AnnihilationReaction;
+       rt = ReactionType(rt+1) )
+    nreactions += static_cast<uint32_t>( m_reactions[rt].size() );
+  
+  vector<char> buffer;
+  buffer.insert( buffer.end(), ns_cacheMagic, ns_cacheMagic + sizeof(ns_cacheMagic) );
+  append_bytes( buffer, ns_cacheVersion );
+  append_bytes( buffer, ns_byteOrderMark );
+  append_bytes( buffer, xml_hash );
+  append_bytes( buffer, nreactions );
+  
+  for( ReactionType rt = ReactionType(0);
+       rt < AnnihilationReaction;
+       rt = ReactionType(rt+1) )
+  {
+    for( const Reaction *rctn : m_reactions[rt] )
+    {
+      append_bytes( buffer, static_cast<uint8_t>(rt) );
+      append_string( buffer, rctn->targetNuclide ? rctn->targetNuclide->symbol : string() );
+      append_string( buffer, rctn->targetElement ? rctn->targetElement->symbol : string() );
+      append_string( buffer, rctn->productNuclide ? rctn->productNuclide->symbol : string() );
+      append_bytes( buffer, static_cast<uint32_t>(rctn->gammas.size()) );
+      for( const EnergyAbundance &ea : rctn->gammas )
+      {
+        append_bytes( buffer, ea.energy );
+        append_bytes( buffer, ea.abundance );
+      }
+    }//for( const Reaction *rctn : m_reactions[rt] )
+  }//for( loop over reaction types )
+  
+  //Write to a temporary file and then move it into place, so another process
+  //  starting up at the same time never sees a partially written file.
+  const string tmpname = UtilityFunctions::temp_file_name(
+                                    UtilityFunctions::filename( filename ),
+                                    UtilityFunctions::parent_path( filename ) );
+  {//begin codeblock to write file
+#ifdef _WIN32
+    const std::wstring wtmpname = UtilityFunctions::convert_from_utf8_to_utf16( tmpname );
+    ofstream output( wtmpname.c_str(), ios::out | ios::binary );
+#else
+    ofstream output( tmpname.c_str(), ios::out | ios::binary );
+#endif
+    if( !output.is_open() )
+      throw runtime_error( "could not open " + tmpname + " for writing" );
+    
+    if( !output.write( &buffer[0], buffer.size() ) )
+    {
+      output.close();
+      UtilityFunctions::remove_file( tmpname );
+      throw runtime_error( "failed writing " + tmpname );
+    }
+  }//end codeblock to write file
+  
+  if( UtilityFunctions::is_file( filename ) )
+    UtilityFunctions::remove_file( filename );
+  
+  if( !UtilityFunctions::rename_file( tmpname, filename ) )
+  {
+    UtilityFunctions::remove_file( tmpname );
+    throw runtime_error( "could not move " + tmpname + " to " + filename );
+  }
+}//void write_binary_cache(...)
+
 
-  if( !doc_node )
-    throw runtime_error( "No document node in " + input );
+void ReactionGamma::init( const string &input, const string &binary_cache )
+{
+  using namespace rapidxml;
 
-  const rapidxml::xml_node<char> *alphaneutron_node = doc_node->first_node( "alphaneutron", 12 );
-  const rapidxml::xml_node<char> *neutronalpha_node = doc_node->first_node( "neutronalpha", 12 );
-  const rapidxml::xml_node<char> *alphaproton_node = doc_node->first_node( "alphaproton", 11 );
-  const rapidxml::xml_node<char> *capture_node = doc_node->first_node( "neutroncapture", 14 );
-  const rapidxml::xml_node<char> *scatter_node = doc_node->first_node( "neutroninelasticscatter", 23 );
+  vector<char> inputdata;
+  UtilityFunctions::load_file_data( input.c_str(), inputdata );
 
-  populate_reaction( alphaneutron_node, AlphaNeutron, m_reactions[AlphaNeutron] );
-  populate_reaction( neutronalpha_node, NeutronAlpha, m_reactions[NeutronAlpha] );
-  populate_reaction( alphaproton_node, AlphaProton, m_reactions[AlphaProton] );
-  populate_reaction( capture_node, NeutronCapture, m_reactions[NeutronCapture] );
-  populate_reaction( scatter_node, NeutronInelasticScatter, m_reactions[NeutronInelasticScatter] );
+  //The binary image is keyed off of the XML contents, so if the XML is
+  //  updated, the image will be ignored, and re-written below.
+  const uint64_t xml_hash = fnv1a_hash( inputdata.data(), inputdata.size() );
+  
+  const bool from_cache = !binary_cache.empty()
+                          && read_binary_cache( binary_cache, xml_hash );
+  m_loadedFromBinaryCache = from_cache;
+  
+  if( !from_cache )
+  {
+    xml_document<char> document;
+    document.parse<parse_normalize_whitespace | parse_trim_whitespace>( &inputdata.front() );
+    const rapidxml::xml_node<char> *doc_node = document.first_node();
+
+    if( !doc_node )
+      throw runtime_error( "No document node in " + input );
+
+    const rapidxml::xml_node<char> *alphaneutron_node = doc_node->first_node( "alphaneutron", 12 );
+    const rapidxml::xml_node<char> *neutronalpha_node = doc_node->first_node( "neutronalpha", 12 );
+    const rapidxml::xml_node<char> *alphaproton_node = doc_node->first_node( "alphaproton", 11 );
+    const rapidxml::xml_node<char> *capture_node = doc_node->first_node( "neutroncapture", 14 );
+    const rapidxml::xml_node<char> *scatter_node = doc_node->first_node( "neutroninelasticscatter", 23 );
+
+    populate_reaction( alphaneutron_node, AlphaNeutron, m_reactions[AlphaNeutron] );
+    populate_reaction( neutronalpha_node, NeutronAlpha, m_reactions[NeutronAlpha] );
+    populate_reaction( alphaproton_node, AlphaProton, m_reactions[AlphaProton] );
+    populate_reaction( capture_node, NeutronCapture, m_reactions[NeutronCapture] );
+    populate_reaction( scatter_node, NeutronInelasticScatter, m_reactions[NeutronInelasticScatter] );
+  
+    if( !binary_cache.empty() )
+    {
+      try
+      {
+        write_binary_cache( binary_cache, xml_hash );
+      }catch( std::exception &e )
+      {
+        //Not being able to write the image (e.g., read-only data directory)
+        //  only costs us parsing the XML again next time.
+        cerr << "ReactionGamma: unable to write binary image of reaction data: "
+             << e.what() << endl;
+      }
+    }//if( !binary_cache.empty() )
+  }//if( !from_cache )
   
   Reaction *annrctn = new Reaction();
   annrctn->type = AnnihilationReaction;
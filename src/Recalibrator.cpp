@@ -23,10 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <set>
 #include <deque>
 #include <limits>
 #include <iostream>
+#include <algorithm>
 #include <sstream>
 #include <vector>
 
@@ -69,6 +71,8 @@
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/Recalibrator.h"
 #include "InterSpec/WarningWidget.h"
+#include "InterSpec/UndoRedoManager.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "InterSpec/SpectraFileModel.h"
 #include "InterSpec/InterSpecApp.h"
@@ -86,6 +90,37 @@ using namespace Wt;
 using namespace std;
 
 
+namespace
+{
+  //coefficients_for_file(...): converts calibration coefficients 'coefs', of
+  //  type 'fromType' for 'fromNbin' channels, so they can be applied to a file
+  //  with 'toNbin' channels whose calibration is of type 'toType'.  Files that
+  //  dont have a polynomial or full range fraction calibration get a
+  //  polynomial one; 'toType' is set to the type of the returned coefficients.
+  vector<float> coefficients_for_file( vector<float> coefs,
+                                       const Measurement::EquationType fromType,
+                                       const size_t fromNbin,
+                                       Measurement::EquationType &toType,
+                                       const size_t toNbin )
+  {
+    if( fromType == Measurement::FullRangeFraction )
+    {
+      if( toType == Measurement::FullRangeFraction && fromNbin == toNbin )
+        return coefs;
+      coefs = fullrangefraction_coef_to_polynomial( coefs, fromNbin );
+    }//if( fromType == Measurement::FullRangeFraction )
+    
+    if( toType == Measurement::FullRangeFraction )
+      return polynomial_coef_to_fullrangefraction( coefs, toNbin );
+    
+    if( toType != Measurement::UnspecifiedUsingDefaultPolynomial )
+      toType = Measurement::Polynomial;
+    
+    return coefs;
+  }//coefficients_for_file(...)
+}//namespace
+
+
 Recalibrator::Recalibrator(
 #if ( USE_SPECTRUM_CHART_D3 )
                             D3SpectrumDisplayDiv *spectrumDisplayDiv,
@@ -710,6 +745,8 @@ void Recalibrator::finishConvertToPolynomial( const bool followThrough )
   if( !followThrough )
     return;
   
+  UndoRedoManager::EnergyCalibrationChange calib_undo_creator;
+  
   std::shared_ptr<SpecMeas> foreground = m_hostViewer->measurment(kForeground);
   std::shared_ptr<const Measurement> displ_foreground = m_hostViewer->displayedHistogram(kForeground);
   
@@ -767,6 +804,8 @@ void Recalibrator::engageRecalibration( RecalAction action )
   if( !foreground || !foreground->num_gamma_channels()
      || !disp_foreground || !disp_foreground->num_gamma_channels() )
     return;
+  
+  UndoRedoManager::EnergyCalibrationChange calib_undo_creator;
  
 #if( PERFORM_DEVELOPER_CHECKS )
   const double origForSum    = ((!!foreground) ? foreground->deep_gamma_count_sum() : 0.0);
@@ -1033,6 +1072,8 @@ void Recalibrator::engageRecalibration( RecalAction action )
 
 void Recalibrator::recalibrateByPeaks()
 {
+  UndoRedoManager::EnergyCalibrationChange calib_undo_creator;
+  
   try
   {
     const size_t npeaks = m_peakModel->npeaks();
@@ -1110,16 +1151,46 @@ void Recalibrator::recalibrateByPeaks()
         {
           std::shared_ptr<SpecMeas> &second = m_hostViewer->m_secondDataMeasurement;
           std::shared_ptr<SpecMeas> &back = m_hostViewer->m_backgroundMeasurement;
-          const DeviationPairVec &devpairs = displ_foreground->deviation_pairs();
+          
+          //Copy the deviation pairs, since displ_foreground may be one of the
+          //  Measurements being rebinned below.
+          const DeviationPairVec devpairs = displ_foreground->deviation_pairs();
         
+          //Each file is rebinned independently of the others, so we will do
+          //  them concurrently (making sure to only rebin each file once).
+          vector< std::shared_ptr<SpecMeas> > torebin;
           if( m_applyTo[kForeground]->isChecked() )
-            foreground->rebin_by_eqn( poly_eqn, devpairs, Measurement::Polynomial );
-
-          if( !!second && m_applyTo[kSecondForeground]->isChecked() )
-            second->rebin_by_eqn( poly_eqn, devpairs, Measurement::Polynomial );
-
-          if( !!back && m_applyTo[kBackground]->isChecked() )
-            back->rebin_by_eqn( poly_eqn, devpairs, Measurement::Polynomial );
+            torebin.push_back( foreground );
+          
+          if( !!second && m_applyTo[kSecondForeground]->isChecked()
+              && std::find(torebin.begin(), torebin.end(), second) == torebin.end() )
+            torebin.push_back( second );
+          
+          if( !!back && m_applyTo[kBackground]->isChecked()
+              && std::find(torebin.begin(), torebin.end(), back) == torebin.end() )
+            torebin.push_back( back );
+          
+          vector<string> rebinErrors( torebin.size() );
+          ComputeScheduler::TaskGroup pool;
+          for( size_t i = 0; i < torebin.size(); ++i )
+          {
+            std::shared_ptr<SpecMeas> meas = torebin[i];
+            string &error = rebinErrors[i];
+            pool.post( [meas,&error,&poly_eqn,&devpairs](){
+              try
+              {
+                meas->rebinByEqn( poly_eqn, devpairs, Measurement::Polynomial );
+              }catch( std::exception &e )
+              {
+                error = e.what();
+              }
+            } );
+          }//for( size_t i = 0; i < torebin.size(); ++i )
+          pool.join();
+          
+          for( const string &error : rebinErrors )
+            if( !error.empty() )
+              throw runtime_error( error );
 
           m_coeffEquationType = Measurement::FullRangeFraction;
           calib_coefs = polynomial_coef_to_fullrangefraction( poly_eqn, nbin );
@@ -1826,6 +1897,125 @@ double Recalibrator::PolyCalibCoefMinFcn::operator()( const vector<double> &coef
 }//operator()
 
 
+Recalibrator::MultiFileCalibCoefMinFcn::MultiFileCalibCoefMinFcn(
+                     const vector<RecalPeakInfo> &peakInfo,
+                     const vector<size_t> &peakFile,
+                     const size_t nfile,
+                     const size_t nbin,
+                     Measurement::EquationType eqnType,
+                     const std::vector< std::vector< std::pair<float,float> > > &fileDevpairs )
+  : ROOT::Minuit2::FCNBase(),
+    m_nbin( nbin ),
+    m_nfile( nfile ),
+    m_eqnType( eqnType ),
+    m_peakInfo( peakInfo ),
+    m_peakFile( peakFile ),
+    m_fileDevpairs( fileDevpairs )
+{
+  if( m_peakFile.size() != m_peakInfo.size() )
+    throw runtime_error( "MultiFileCalibCoefMinFcn: peak file index and peak "
+                         "info sizes must match" );
+  
+  if( m_fileDevpairs.size() != m_nfile )
+    throw runtime_error( "MultiFileCalibCoefMinFcn: deviation pairs must be"
+                         " given for each file" );
+  
+  for( const size_t filenum : m_peakFile )
+    if( filenum >= m_nfile )
+      throw runtime_error( "MultiFileCalibCoefMinFcn: invalid peak file index" );
+  
+  switch( m_eqnType )
+  {
+    case Measurement::Polynomial:
+    case Measurement::FullRangeFraction:
+    case Measurement::UnspecifiedUsingDefaultPolynomial:
+      break;
+    case Measurement::LowerChannelEdge:
+    case Measurement::InvalidEquationType:
+      throw runtime_error( "MultiFileCalibCoefMinFcn can only work with Full "
+                           "Range Fraction and Polynomial binnings" );
+      break;
+  }
+}//MultiFileCalibCoefMinFcn( constructor )
+
+
+Recalibrator::MultiFileCalibCoefMinFcn::~MultiFileCalibCoefMinFcn()
+{
+  // no-op
+}
+
+
+double Recalibrator::MultiFileCalibCoefMinFcn::Up() const
+{
+  return 1.0;
+}
+
+
+double Recalibrator::MultiFileCalibCoefMinFcn::operator()( const vector<double> &x ) const
+{
+  if( x.size() != (2 + m_nfile) )
+  {
+    cerr << "Recalibrator::MultiFileCalibCoefMinFcn::operator(): "
+         << "invalid number of paramaters" << endl;
+    return 99999999.0;
+  }
+  
+  for( const double d : x )
+  {
+    if( IsInf(d) || IsNan(d) )
+    {
+      cerr << "Recalibrator::MultiFileCalibCoefMinFcn::operator(): "
+           << "invalid input paramater" << endl;
+      return 99999999.0;
+    }
+  }//for( const double d : x )
+  
+  vector<float> float_coef( 3 );
+  for( size_t i = 0; i < 3; ++i )
+    float_coef[i] = static_cast<float>( x[i] );
+  
+  if( m_eqnType == Measurement::Polynomial
+      || m_eqnType == Measurement::UnspecifiedUsingDefaultPolynomial )
+    float_coef = polynomial_coef_to_fullrangefraction( float_coef, m_nbin );
+  
+  for( const float d : float_coef )
+  {
+    if( IsInf(d) || IsNan(d) )
+      return 99999999.0;
+  }
+  
+  for( const std::vector< std::pair<float,float> > &devpair : m_fileDevpairs )
+  {
+    const float nearend = fullrangefraction_energy( m_nbin-2, float_coef, m_nbin, devpair );
+    const float end = fullrangefraction_energy( m_nbin-1, float_coef, m_nbin, devpair );
+    const float begin = fullrangefraction_energy( 0, float_coef, m_nbin, devpair );
+    const float nearbegin = fullrangefraction_energy( 1, float_coef, m_nbin, devpair );
+    
+    if( (nearend >= end) || (begin >= nearbegin) )
+      return 99999999.0;
+  }//for( const auto &devpair : m_fileDevpairs )
+  
+  double chi2 = 0.0;
+  for( size_t i = 0; i < m_peakInfo.size(); ++i )
+  {
+    const RecalPeakInfo &info = m_peakInfo[i];
+    const size_t filenum = m_peakFile[i];
+    const double offset = (filenum > 0) ? x[2+filenum] : 0.0;
+    const double predictedMean = offset + fullrangefraction_energy( info.peakMeanBinNumber, float_coef, m_nbin, m_fileDevpairs[filenum] );
+    const double uncert = ((info.peakMeanUncert<=0.0) ? 1.0 : info.peakMeanUncert );
+    chi2 += pow(predictedMean - info.photopeakEnergy, 2.0 ) / (uncert*uncert);
+  }//for( size_t i = 0; i < m_peakInfo.size(); ++i )
+  
+  if( IsInf(chi2) || IsNan(chi2) )
+  {
+    cerr << "Recalibrator::MultiFileCalibCoefMinFcn::operator(): invalid result chi2" << endl;
+    return 1000.0;
+  }
+  
+  return chi2;
+}//operator()
+
+
 void Recalibrator::CalibrationInformation::reset()
 {
   type = Measurement::InvalidEquationType;
@@ -2011,6 +2201,8 @@ void Recalibrator::GraphicalRecalConfirm::apply()
     return;
   }//if( startE == finalE )
   
+  UndoRedoManager::EnergyCalibrationChange calib_undo_creator;
+  
   
   //Need to implement recalibrating logic, and also logic to check how long
   //  ago user last calibrated this spectra...
@@ -2665,10 +2857,29 @@ boost::any Recalibrator::MultiFileModel::data( const Wt::WModelIndex &index,
   if( row < 0 || row >= static_cast<int>(m_peaks.size()) )
     return boost::any();
   
-  std::shared_ptr<SpectraFileHeader> header = m_fileModel->fileHeader( row );
-  if( header )
-    return boost::any( header->displayName() );
-  return boost::any();
+  std::shared_ptr<SpectraFileHeader> header = m_fileModel->fileHeader( m_fileIndex[row] );
+  if( !header )
+    return boost::any();
+  
+  //If more than one set of samples from this file has peaks, label which
+  //  samples this row is for.
+  const bool multipleSampleSets
+      = ((row > 0) && (m_fileIndex[row-1] == m_fileIndex[row]))
+        || ((row+1) < static_cast<int>(m_fileIndex.size())
+            && (m_fileIndex[row+1] == m_fileIndex[row]));
+  
+  WString name = header->displayName();
+  if( multipleSampleSets && !m_sampleNums[row].empty() )
+  {
+    const int first = *m_sampleNums[row].begin();
+    const int last = *m_sampleNums[row].rbegin();
+    if( first == last )
+      name += " (sample " + std::to_string(first) + ")";
+    else
+      name += " (samples " + std::to_string(first) + "-" + std::to_string(last) + ")";
+  }//if( multipleSampleSets )
+  
+  return boost::any( name );
 }//data(...)
 
 
@@ -2737,30 +2948,27 @@ void Recalibrator::MultiFileModel::refreshData()
   {
     beginRemoveRows( WModelIndex(), 0, static_cast<int>(m_peaks.size())-1 );
     m_peaks.clear();
+    m_fileIndex.clear();
+    m_sampleNums.clear();
     endRemoveRows();
   }//if( m_peaks.size() )
   
   vector<std::vector< std::pair<bool,std::shared_ptr<const PeakDef> > > > newdata;
+  vector<int> newFileIndex;
+  vector< set<int> > newSampleNums;
   
   const int nfile = m_fileModel->rowCount();
   for( int filenum = 0; filenum < nfile; ++filenum )
   {
-    vector< pair<bool,std::shared_ptr<const PeakDef> > > peaks;
     std::shared_ptr<SpectraFileHeader> header
                                            = m_fileModel->fileHeader( filenum );
     if( !header )
-    {
-      newdata.push_back( peaks );
       continue;
-    }//if( !header )
     
     std::shared_ptr<SpecMeas> spec = header->parseFile();
     
     if( !spec )
-    {
-      newdata.push_back( peaks );
       continue;
-    }//if( !header )
     
     typedef set<int> IntSet;
     typedef std::shared_ptr<const PeakDef> PeakPtr;
@@ -2772,6 +2980,7 @@ void Recalibrator::MultiFileModel::refreshData()
       if( !measpeaks )
         continue;
       
+      vector< pair<bool,std::shared_ptr<const PeakDef> > > peaks;
       for( const PeakPtr &peak : *measpeaks )
       {
         const bool use = peak->useForCalibration();
@@ -2780,6 +2989,8 @@ void Recalibrator::MultiFileModel::refreshData()
       }//for( const PeakPtr &peak : peaks )
       
       newdata.push_back( peaks );
+      newFileIndex.push_back( filenum );
+      newSampleNums.push_back( samplnums );
     }//for( const IntSet &samplnums : peaksamplenums )
   }//for( int filenum = 0; filenum < nfile; ++filenum )
 
@@ -2787,6 +2998,8 @@ void Recalibrator::MultiFileModel::refreshData()
   {
     beginInsertRows( WModelIndex(), 0, static_cast<int>(newdata.size()) -1 );
     m_peaks.swap( newdata );
+    m_fileIndex.swap( newFileIndex );
+    m_sampleNums.swap( newSampleNums );
     endInsertRows();
   }//if( newdata.size() )
 }//refreshData()
@@ -2796,10 +3009,13 @@ Recalibrator::MultiFileCalibFit::MultiFileCalibFit( Recalibrator *cal )
 : AuxWindow( "Multi-File Calibration" ),
   m_calibrator( cal ),
   m_model( 0 ),
+  m_perFileOffsets( 0 ),
   m_use( 0 ),
   m_cancel( 0 ),
   m_fit( 0 ),
-  m_fitSumary( 0 )
+  m_fitSumary( 0 ),
+  m_eqnType( Measurement::InvalidEquationType ),
+  m_nbin( 0 )
 {
   InterSpec *viewer = m_calibrator->m_hostViewer;
   SpectraFileModel *fileModel = viewer->fileManager()->model();
@@ -2841,6 +3057,12 @@ Recalibrator::MultiFileCalibFit::MultiFileCalibFit( Recalibrator *cal )
     fitForLayout->addWidget( m_fitFor[i],   i, 2 );
   }//for( int i = 0; i < 3; ++i )
   
+  m_perFileOffsets = new WCheckBox( "Fit an additional offset for each file" );
+  m_perFileOffsets->setToolTip( "When checked, the coefficients above are shared"
+                                " by all files, but each file (after the first)"
+                                " also gets its own energy offset." );
+  fitForLayout->addWidget( m_perFileOffsets, 3, 0, 1, 3 );
+  
   fitForLayout->setColumnStretch( 1, 1 );
   m_fitFor[0]->setChecked( true );
   m_fitFor[1]->setChecked( true );
@@ -2857,6 +3079,8 @@ Recalibrator::MultiFileCalibFit::MultiFileCalibFit( Recalibrator *cal )
   line->setInline( false );
   line = new WText( "Calibration will be applied to all files with at least one selected peak.", instructions );
   line->setInline( false );
+  line = new WText( "Only files with the same number of channels as the first file with selected peaks are used.", instructions );
+  line->setInline( false );
 
   
   WGridLayout *layout = stretcher();
@@ -2907,21 +3131,14 @@ void Recalibrator::MultiFileCalibFit::doFit()
   //      Recalibrator::recalibrateByPeaks() - so a refactoriztion should be
   //      done
   
-  vector< std::shared_ptr<const PeakDef> > peakstouse;
-  for( size_t i = 0; i < m_model->m_peaks.size(); ++i )
-  {
-     const vector< pair<bool,std::shared_ptr<const PeakDef> > > &peaks
-                                                          = m_model->m_peaks[i];
-     for( size_t j = 0; j < peaks.size(); ++j )
-     {
-       if( peaks[j].first && peaks[j].second )
-         peakstouse.push_back( peaks[j].second );
-     }//for( size_t j = 0; j < m_peaks.size(); ++j )
-  }//for( size_t i = 0; i < m_peaks.size(); ++i )
+  m_use->disable();
+  m_fileOffsets.clear();
+  
+  InterSpec *viewer = m_calibrator->m_hostViewer;
+  SpectraFileModel *fileModel = viewer->fileManager()->model();
   
   try
   {
-    const size_t npeaks = peakstouse.size();
     const int num_coeff_fit = m_fitFor[0]->isChecked()
                               + m_fitFor[1]->isChecked()
                               + m_fitFor[2]->isChecked();
@@ -2933,172 +3150,189 @@ void Recalibrator::MultiFileCalibFit::doFit()
       return;
     }//if( num_coeff_fit < 1 )
     
-    if( num_coeff_fit > static_cast<int>(npeaks) )
-    {
-      const char *msg = "You must select at least as many peaks as coeficents to fit for";
-      passMessage( msg, "", WarningWidget::WarningMsgHigh );
-      return;
-    }//if( num_coeff_fit < 1 )
-    
-    
-    std::shared_ptr<const Measurement> data = m_calibrator->m_spectrumDisplayDiv->histUsedForXAxis();
-    std::shared_ptr<const SpecMeas> meas = m_calibrator->m_hostViewer->measurment(kForeground);
+    //The first file with selected peaks defines the starting calibration, its
+    //  type, and the number of channels all other files must have to be
+    //  included in the fit.  Peak bin numbers are found using each files own
+    //  calibration, and each file keeps its own deviation pairs.
+    size_t nbin = 0;
+    vector<float> calib_coefs;
+    Measurement::EquationType calibration_type = Measurement::InvalidEquationType;
+    
+    vector<int> fitFiles;          //SpectraFileModel rows, in fit order
+    vector<DeviationPairVec> fileDevpairs;  //indexed same as fitFiles
+    vector<size_t> peakFile;       //index into fitFiles, for each peakInfos
+    vector<RecalPeakInfo> peakInfos;
+    vector<string> peakFileNames;  //for the fit summary
+    set<string> skippedFiles;
     
-    if( !meas || !data )
+    for( size_t group = 0; group < m_model->m_peaks.size(); ++group )
     {
-      const char *msg = "You need to be displaying a foreground spectrum to do a calibration fit";
-      passMessage( msg, "", WarningWidget::WarningMsgHigh );
-      return;
-    }
-    
-    
-    std::shared_ptr<const Measurement> eqnmeas;
-    const vector< MeasurementConstShrdPtr > meass = meas->measurements();
+      const vector< pair<bool,std::shared_ptr<const PeakDef> > > &peaks
+                                                      = m_model->m_peaks[group];
+      vector< std::shared_ptr<const PeakDef> > peakstouse;
+      for( size_t j = 0; j < peaks.size(); ++j )
+      {
+        if( peaks[j].first && peaks[j].second )
+          peakstouse.push_back( peaks[j].second );
+      }//for( size_t j = 0; j < m_peaks.size(); ++j )
+      
+      if( peakstouse.empty() )
+        continue;
+      
+      const int filerow = m_model->m_fileIndex[group];
+      std::shared_ptr<SpectraFileHeader> header = fileModel->fileHeader( filerow );
+      std::shared_ptr<SpecMeas> spec = header ? header->parseFile() : std::shared_ptr<SpecMeas>();
+      if( !spec )
+        continue;
+      
+      const string filename = header->displayName().toUTF8();
+      
+      std::shared_ptr<const Measurement> eqnmeas;
+      for( const int sample : m_model->m_sampleNums[group] )
+      {
+        for( const auto &m : spec->sample_measurements( sample ) )
+        {
+          if( !eqnmeas && m && m->num_gamma_channels() > 2 )
+            eqnmeas = m;
+        }
+      }//for( const int sample : m_model->m_sampleNums[group] )
+      
+      const vector< MeasurementConstShrdPtr > meass = spec->measurements();
+      for( size_t i = 0; !eqnmeas && i < meass.size(); ++i )
+        if( meass[i]->num_gamma_channels() > 2 )
+          eqnmeas = meass[i];
+      
+      if( !eqnmeas || !eqnmeas->channel_energies()
+          || eqnmeas->channel_energies()->size() < 16 )
+      {
+        skippedFiles.insert( filename );
+        continue;
+      }
+      
+      const Measurement::EquationType eqnType = eqnmeas->energy_calibration_model();
+      if( eqnType == Measurement::LowerChannelEdge
+          || eqnType == Measurement::InvalidEquationType )
+      {
+        skippedFiles.insert( filename );
+        continue;
+      }
+      
+      const size_t filenbin = eqnmeas->channel_energies()->size();
+      
+      if( fitFiles.empty() )
+      {
+        nbin = filenbin;
+        calib_coefs = eqnmeas->calibration_coeffs();
+        calibration_type = eqnType;
+      }else if( filenbin != nbin )
+      {
+        skippedFiles.insert( filename );
+        continue;
+      }
+      
+      vector<float> frfcoef = eqnmeas->calibration_coeffs();
+      if( eqnType != Measurement::FullRangeFraction )
+        frfcoef = polynomial_coef_to_fullrangefraction( frfcoef, filenbin );
+      
+      const size_t filepos = std::find( fitFiles.begin(), fitFiles.end(), filerow ) - fitFiles.begin();
+      if( filepos == fitFiles.size() )
+      {
+        fitFiles.push_back( filerow );
+        fileDevpairs.push_back( eqnmeas->deviation_pairs() );
+      }
+      
+      for( const std::shared_ptr<const PeakDef> &peakptr : peakstouse )
+      {
+        const PeakDef &peak = *peakptr;
+        
+        RecalPeakInfo peakInfo;
+        peakInfo.peakMean = peak.mean();
+        peakInfo.peakMeanUncert = max( peak.meanUncert(), 0.25 );
+        if( IsInf(peakInfo.peakMeanUncert) || IsNan(peakInfo.peakMeanUncert) )
+          peakInfo.peakMeanUncert = 0.5;
+        
+        peakInfo.photopeakEnergy = peak.gammaParticleEnergy();
+        peakInfo.peakMeanBinNumber = find_bin_fullrangefraction( peak.mean(),
+                                                                 frfcoef, filenbin,
+                                                                 eqnmeas->deviation_pairs(),
+                                                                 0.001f );
+        
+        if( IsNan(peakInfo.peakMeanBinNumber)
+            || IsInf(peakInfo.peakMeanBinNumber) )
+          throw runtime_error( "Invalid result fromm "
+                               "find_bin_fullrangefraction(...)" );
+        
+        peakInfos.push_back( peakInfo );
+        peakFile.push_back( filepos );
+        peakFileNames.push_back( filename );
+      }//for( loop over peaks to use )
+    }//for( size_t group = 0; group < m_model->m_peaks.size(); ++group )
     
-    for( size_t i = 0; !eqnmeas && i < meass.size(); ++i )
-      if( meass[i]->num_gamma_channels() )
-        eqnmeas = meass[i];
-    if( !eqnmeas )
+    if( fitFiles.empty() )
     {
-      const char *msg = "You need to be displaying a foreground spectrum to do a calibration fit (unexpected error)";
+      const char *msg = "You must select at least one peak, from a file with a"
+                        " polynomial or full range fraction calibration";
       passMessage( msg, "", WarningWidget::WarningMsgHigh );
       return;
-    }//if( !eqnmeas )
+    }//if( fitFiles.empty() )
     
-    const ShrdConstFVecPtr &binning = eqnmeas->channel_energies();
+    const size_t nfile = fitFiles.size();
+    const bool fitOffsets = m_perFileOffsets->isChecked() && (nfile > 1);
+    const size_t npars = num_coeff_fit + (fitOffsets ? (nfile - 1) : 0);
     
-    if( !binning || binning->size() < 16 )
+    if( npars > peakInfos.size() )
     {
-      const char *msg = "The spectrum isnt high enough resolution to fit for a calibration";
+      const char *msg = "You must select at least as many peaks as coeficents to fit for";
       passMessage( msg, "", WarningWidget::WarningMsgHigh );
       return;
-    }
-    
-    const size_t nbin = binning->size();
-    const Measurement::EquationType calibration_type = eqnmeas->energy_calibration_model();
-    
-    vector<float> calib_coefs = eqnmeas->calibration_coeffs();
-    
-    switch( calibration_type )
-    {
-      case Measurement::Polynomial:
-      case Measurement::FullRangeFraction:
-      case Measurement::UnspecifiedUsingDefaultPolynomial:
-        break;
-        
-      case Measurement::LowerChannelEdge:
-      case Measurement::InvalidEquationType:
-      {
-        passMessage( "Invalid starting calibration type: unknown or lower bin "
-                     "edge energy not allowed", "", WarningWidget::WarningMsgHigh );
-        return;
-        break;
-      }//case LowerChannelEdge or InvalidEquationType
-    }//switch( calibration_type )
-    
-    //TODO: meansFitError will currently contain only values of 1.0, eventually
-    //      will contian the error of the fit mean for that peak
-    vector<RecalPeakInfo> peakInfos;
-    
-    for( size_t peakn = 0; peakn < npeaks; ++peakn )
-    {
-      const PeakDef &peak = *peakstouse[peakn];
-      
-      const double wantedEnergy = peak.gammaParticleEnergy();
-      
-      RecalPeakInfo peakInfo;
-      peakInfo.peakMean = peak.mean();
-      peakInfo.peakMeanUncert = max( peak.meanUncert(), 0.25 );
-      if( IsInf(peakInfo.peakMeanUncert) || IsNan(peakInfo.peakMeanUncert) )
-        peakInfo.peakMeanUncert = 0.5;
-        
-      peakInfo.photopeakEnergy = wantedEnergy;
-      if( m_calibrator->m_coeffEquationType == Measurement::FullRangeFraction )
-      {
-        peakInfo.peakMeanBinNumber = find_bin_fullrangefraction( peak.mean(),
-                                                                  calib_coefs, nbin,
-                                                                  eqnmeas->deviation_pairs(),
-                                                                  0.001f );
-      }else
-      {
-        const vector<float> fwfcoef = polynomial_coef_to_fullrangefraction( calib_coefs, nbin );
-        peakInfo.peakMeanBinNumber = find_bin_fullrangefraction( peak.mean(),
-                                                                  fwfcoef, nbin,
-                                                                  eqnmeas->deviation_pairs(),
-                                                                  0.001f );
-      }//if( FullRangeFraction ) / else
-        
-      if( IsNan(peakInfo.peakMeanBinNumber)
-          || IsInf(peakInfo.peakMeanBinNumber) )
-        throw runtime_error( "Invalid result fromm "
-                             "find_bin_fullrangefraction(...)" );
-      peakInfos.push_back( peakInfo );
-    }//for( int col = 0; col < numModelCol; ++col )
+    }//if( npars > peakInfos.size() )
     
-  
-    PolyCalibCoefMinFcn chi2Fcn( peakInfos,
-                                binning->size(),
-                                m_calibrator->m_coeffEquationType,
-                                eqnmeas->deviation_pairs() );
+    MultiFileCalibCoefMinFcn chi2Fcn( peakInfos, peakFile, nfile, nbin,
+                                      calibration_type, fileDevpairs );
     ROOT::Minuit2::MnUserParameters inputPrams;
     
     if( calib_coefs.size() < 3 )
       calib_coefs.resize( 3, 0.0 );
     
-    //    for( int i = 0; i < calib_coefs.size(); ++i )
-    //      cerr << "initial calib_coefs[" << i << "]=" << calib_coefs[i] << endl;
-    
-    string name = "0";
-    double delta = 1.0/pow( static_cast<double>(nbin), 0.0 );
-    if( m_calibrator->m_coeffEquationType == Measurement::FullRangeFraction )
-      delta = 0.5;
-    
-    if( m_fitFor[0]->isChecked() )
-      inputPrams.Add( name, calib_coefs[0], delta );
-    else
-      inputPrams.Add( name, calib_coefs[0] );
-    
-    name = "1";
-    delta = 1.0/pow( static_cast<double>(data->GetNbinsX()), 1.0 );
-    if( m_calibrator->m_coeffEquationType == Measurement::FullRangeFraction )
-      delta = 1.0;
+    const bool isFRF = (calibration_type == Measurement::FullRangeFraction);
     
-    if( m_fitFor[1]->isChecked() )
-    {
-      inputPrams.Add( name, calib_coefs[1], delta );
-      inputPrams.SetLowerLimit( name, 0.0 );
-    }else
+    for( int i = 0; i < 3; ++i )
     {
-      inputPrams.Add( name, calib_coefs[1] );
-    }
-    
-    name = "2";
-    delta = 1.0/pow( static_cast<double>(data->GetNbinsX()), 2.0 );
-    if( m_calibrator->m_coeffEquationType == Measurement::FullRangeFraction )
-      delta = 0.1;
+      const string name = std::to_string( i );
+      double delta = 1.0/pow( static_cast<double>(nbin), static_cast<double>(i) );
+      if( isFRF )
+        delta = (i == 0) ? 0.5 : ((i == 1) ? 1.0 : 0.1);
+      
+      if( m_fitFor[i]->isChecked() )
+        inputPrams.Add( name, calib_coefs[i], delta );
+      else
+        inputPrams.Add( name, calib_coefs[i] );
+      
+      if( i == 1 && m_fitFor[i]->isChecked() )
+        inputPrams.SetLowerLimit( name, 0.0 );
+    }//for( int i = 0; i < 3; ++i )
     
-    if( m_fitFor[2]->isChecked() )
-      inputPrams.Add( name, calib_coefs[2], delta );
-    else
-      inputPrams.Add( name, calib_coefs[2] );
+    for( size_t i = 1; i < nfile; ++i )
+    {
+      const string name = "Offset" + std::to_string( i );
+      if( fitOffsets )
+        inputPrams.Add( name, 0.0, 0.5 );
+      else
+        inputPrams.Add( name, 0.0 );
+    }//for( size_t i = 1; i < nfile; ++i )
     
     ROOT::Minuit2::MnUserParameterState inputParamState( inputPrams );
     ROOT::Minuit2::MnStrategy strategy( 1 ); //0 low, 1 medium, >=2 high
     
-    
-    const int npars = inputPrams.VariableParameters();
-    const unsigned int maxFcnCall = 200 + 100*npars + 5*npars*npars;
+    const int nvarpars = inputPrams.VariableParameters();
+    const unsigned int maxFcnCall = 200 + 100*nvarpars + 5*nvarpars*nvarpars;
     const double tolerance = 1.0;
     
-//    ROOT::Minuit2::MnMigrad fitter( chi2Fcn, inputParamState, strategy );
-//    ROOT::Minuit2::FunctionMinimum minimum = fitter( maxFcnCall, tolerance );
-    
     ROOT::Minuit2::CombinedMinimizer fitter;
     ROOT::Minuit2::FunctionMinimum minimum
                           = fitter.Minimize( chi2Fcn, inputParamState,
                                             strategy, maxFcnCall, tolerance );
     
-    
     //Not sure why Minuit2 doesnt like converging on the minumum verry well, but
     //  rather than showing the user an error message, we'll give it anither try
     if( minimum.IsAboveMaxEdm() )
@@ -3112,7 +3346,7 @@ void Recalibrator::MultiFileCalibFit::doFit()
       if( !minimum.HasValidCovariance() || !minimum.HasValidParameters() )
       {
         string msg = "Fit for calibration parameters failed.";
-        if( m_fitFor[2] )
+        if( m_fitFor[2]->isChecked() )
           msg += " you might try not fitting for quadratic term.";
         passMessage( msg, "", WarningWidget::WarningMsgHigh );
         return;
@@ -3137,43 +3371,61 @@ void Recalibrator::MultiFileCalibFit::doFit()
     const vector<double> parValues = fitPrams.Params();
     const vector<double> parErrors = fitPrams.Errors();
     
-    //    for( int i = 0; i < parValues.size(); ++i )
-    //      cerr << "parValues[" << i << "]=" << parValues[1] << endl;
-    
     for( size_t i = 0; i < parValues.size(); ++i )
       if( IsInf(parValues[i]) || IsNan(parValues[i]) )
         throw runtime_error( "Invalid calibration parameter from fit :(" );
     
-    assert( parValues.size() == 3 );
+    assert( parValues.size() == (2 + nfile) );
     
     m_eqnType = calibration_type;
+    m_nbin = nbin;
     for( int i = 0; i < 3; ++i )
     {
       m_calVal[i] = parValues[i];
       m_calUncert[i] = parErrors[i];
     }//for( size_t i = 0; i < parValues.size(); ++i )
     
+    for( size_t i = 0; i < nfile; ++i )
+      m_fileOffsets[fitFiles[i]] = (i > 0) ? parValues[2+i] : 0.0;
+    
     //Try to loop over peaks to give chi2 values and such
     vector<float> float_coef;
-    for( const double d : parValues )
-      float_coef.push_back( static_cast<float>(d) );
+    for( int i = 0; i < 3; ++i )
+      float_coef.push_back( static_cast<float>(parValues[i]) );
     
-    if( m_calibrator->m_coeffEquationType == Measurement::Polynomial
-       || m_calibrator->m_coeffEquationType == Measurement::UnspecifiedUsingDefaultPolynomial )
+    if( !isFRF )
       float_coef = polynomial_coef_to_fullrangefraction( float_coef, nbin );
     
     stringstream msg;
-    for( const RecalPeakInfo &info : peakInfos )
+    if( fitOffsets )
     {
-      const double predictedMean = fullrangefraction_energy( info.peakMeanBinNumber, float_coef, nbin, eqnmeas->deviation_pairs() );
+      for( size_t i = 1; i < nfile; ++i )
+      {
+        std::shared_ptr<SpectraFileHeader> header = fileModel->fileHeader( fitFiles[i] );
+        msg << "-" << (header ? header->displayName().toUTF8() : string("File"))
+            << " has an additional offset of " << parValues[2+i] << " +- "
+            << parErrors[2+i] << " keV.\n";
+      }//for( size_t i = 1; i < nfile; ++i )
+    }//if( fitOffsets )
+    
+    for( size_t i = 0; i < peakInfos.size(); ++i )
+    {
+      const RecalPeakInfo &info = peakInfos[i];
+      const double offset = (peakFile[i] > 0) ? parValues[2+peakFile[i]] : 0.0;
+      const double predictedMean = offset + fullrangefraction_energy( info.peakMeanBinNumber, float_coef, nbin, fileDevpairs[peakFile[i]] );
       double uncert = ((info.peakMeanUncert<=0.0) ? 1.0 : info.peakMeanUncert );
       double chi2 = pow(predictedMean - info.photopeakEnergy, 2.0 ) / (uncert*uncert);
       
-      msg << "-Peak originally at " << info.peakMean << " +- "
+      msg << "-Peak in " << peakFileNames[i] << " originally at "
+          << info.peakMean << " +- "
           << info.peakMeanUncert << " keV for photopeak at "
           << info.photopeakEnergy << " keV ended up at " << predictedMean
           << " keV and contributed " << chi2 << " towards the chi2.\n";
-    }//for( const &RecalPeakInfo info : peakInfo )
+    }//for( size_t i = 0; i < peakInfos.size(); ++i )
+    
+    for( const string &name : skippedFiles )
+      msg << "-Peaks from " << name << " were not used, as the file has a"
+          << " different number of channels, or an unsupported calibration.\n";
     
     m_fitSumary->setText( msg.str() );
     m_fitSumary->show();
@@ -3182,6 +3434,7 @@ void Recalibrator::MultiFileCalibFit::doFit()
   }catch( std::exception &e )
   {
     m_use->disable();
+    m_fileOffsets.clear();
     string exceptionmsg = e.what();
     string msg = "Failed calibration by fitting peak means.";
     
@@ -3229,6 +3482,10 @@ void Recalibrator::MultiFileCalibFit::handleFinish( WDialog::DialogCode result )
     case WDialog::Accepted:
     {
       InterSpec *viewer = m_calibrator->m_hostViewer;
+      SpectraFileModel *fileModel = viewer->fileManager()->model();
+      
+      if( m_fileOffsets.empty() )
+        break;
       
       //XXX - the equation could totally be invalid
       vector<float> eqn;
@@ -3237,117 +3494,134 @@ void Recalibrator::MultiFileCalibFit::handleFinish( WDialog::DialogCode result )
       if( m_calVal[2] != 0.0 )
         eqn.push_back( m_calVal[2] );
       
-      
-      cerr << "\n\nm_calVal={" << m_calVal[0] << ", " << m_calVal[1] << ", " << m_calVal[2] << "}" << endl;
-      
-      vector<float> oldcalibpars;
-      DeviationPairVec devpairs;
-      Measurement::EquationType oldEqnType;
-      
       std::shared_ptr<SpecMeas> fore = viewer->measurment(kForeground);
       std::shared_ptr<SpecMeas> back = viewer->measurment(kBackground);
       std::shared_ptr<SpecMeas> second = viewer->measurment(kSecondForeground);
-      std::shared_ptr<const Measurement> displ_foreground
-                                     = viewer->displayedHistogram(kForeground);
-
       
-      std::shared_ptr<const Measurement> eqnmeass[3];
-      for( int i = 0; i < 3; ++i )
-      {
-        const SpectrumType type = SpectrumType(i);
-        std::shared_ptr<SpecMeas> meas = viewer->measurment(type);
-        if( meas )
-        {
-          const vector< MeasurementConstShrdPtr > meass = meas->measurements();
-          for( size_t j = 0; !eqnmeass[i] && j < meass.size(); ++j )
-            if( meass[j]->num_gamma_channels() )
-              eqnmeass[i] = meass[j];
-        }
-      }//for( int i = 0; i < 3; ++i )
+      const vector<string> displayed_detectors = viewer->displayed_detector_names();
       
-      if( fore && eqnmeass[kForeground] )
-      {
-        oldcalibpars = eqnmeass[kForeground]->calibration_coeffs();
-        oldEqnType = eqnmeass[kForeground]->energy_calibration_model();
-        devpairs = eqnmeass[kForeground]->deviation_pairs();
-      }else if( second && eqnmeass[kSecondForeground] )
+      //We will first recalibrate every file concurrently, and then shift the
+      //  peaks of each file on this thread (the foreground peaks go through
+      //  the PeakModel, so must be done here anyway).
+      struct RecalJob
       {
-        oldcalibpars = eqnmeass[kSecondForeground]->calibration_coeffs();
-        oldEqnType = eqnmeass[kSecondForeground]->energy_calibration_model();
-        devpairs = eqnmeass[kSecondForeground]->deviation_pairs();
-      }else if( back && eqnmeass[kBackground] )
-      {
-        oldcalibpars = eqnmeass[kBackground]->calibration_coeffs();
-        oldEqnType = eqnmeass[kBackground]->energy_calibration_model();
-        devpairs = eqnmeass[kBackground]->deviation_pairs();
-      }else
-      {
-        break;
-      }
+        std::shared_ptr<SpecMeas> meas;
+        string name;
+        vector<float> new_pars;
+        DeviationPairVec new_devpairs;
+        Measurement::EquationType new_eqn_type;
+        vector<float> old_pars;
+        DeviationPairVec old_devpairs;
+        Measurement::EquationType old_eqn_type;
+        string error;
+      };//struct RecalJob
       
-      vector<string> displayed_detectors = viewer->displayed_detector_names();
+      vector<RecalJob> jobs;
       
-      
-      if( !m_calibrator->m_applyTo[kForeground]->isChecked() )
-        fore.reset();
-      if( !m_calibrator->m_applyTo[kBackground]->isChecked() )
-        back.reset();
-      if( !m_calibrator->m_applyTo[kSecondForeground]->isChecked() )
-        second.reset();
-      
-      //XXX - applying the calibration parameters does not shift peaks!
-      for( size_t i = 0; i < m_model->m_peaks.size(); ++i )
-      {
-        const vector< pair<bool,std::shared_ptr<const PeakDef> > > &peaks
-                                                          = m_model->m_peaks[i];
-        bool used = false;
-        for( size_t j = 0; j < peaks.size(); ++j )
-          used |= peaks[j].first;
+      //'pars' are of type m_eqnType, for m_nbin channels; each file gets them
+      //  converted to its own calibration type, and keeps its own deviation
+      //  pairs.
+      auto addJob = [&jobs,this]( std::shared_ptr<SpecMeas> meas,
+                             const vector<float> &pars,
+                             const string &name ){
+        if( !meas )
+          return;
+        for( const RecalJob &job : jobs )
+          if( job.meas == meas )
+            return;
         
-        if( !used )
-          continue;
+        std::shared_ptr<const Measurement> eqnmeas;
+        const vector< MeasurementConstShrdPtr > meass = meas->measurements();
+        for( size_t j = 0; !eqnmeas && j < meass.size(); ++j )
+          if( meass[j]->num_gamma_channels() )
+            eqnmeas = meass[j];
+        if( !eqnmeas )
+          return;
         
-        SpectraFileModel *fileModel = viewer->fileManager()->model();
+        RecalJob job;
+        job.meas = meas;
+        job.name = name;
+        job.new_eqn_type = eqnmeas->energy_calibration_model();
+        job.new_pars = coefficients_for_file( pars, m_eqnType, m_nbin, job.new_eqn_type,
+                                              eqnmeas->num_gamma_channels() );
+        job.new_devpairs = eqnmeas->deviation_pairs();
+        job.old_pars = eqnmeas->calibration_coeffs();
+        job.old_devpairs = eqnmeas->deviation_pairs();
+        job.old_eqn_type = eqnmeas->energy_calibration_model();
+        jobs.push_back( job );
+      };//addJob lambda
+      
+      for( const auto &fileoffset : m_fileOffsets )
+      {
         std::shared_ptr<SpectraFileHeader> header
-                                = fileModel->fileHeader( static_cast<int>(i) );
+                                      = fileModel->fileHeader( fileoffset.first );
         if( !header )
           continue;
         
-        std::shared_ptr<SpecMeas> meas = header->parseFile();
-        if( !meas )
-          continue;
+        vector<float> pars = eqn;
+        pars[0] += static_cast<float>( fileoffset.second );
+        addJob( header->parseFile(), pars, header->displayName().toUTF8() );
+      }//for( const auto &fileoffset : m_fileOffsets )
+      
+      //Displayed spectra that didnt contribute peaks to the fit get the shared
+      //  coefficients, if the user has asked for them to be recalibrated.
+      if( m_calibrator->m_applyTo[kForeground]->isChecked() )
+        addJob( fore, eqn, "foreground" );
+      if( m_calibrator->m_applyTo[kBackground]->isChecked() )
+        addJob( back, eqn, "background" );
+      if( m_calibrator->m_applyTo[kSecondForeground]->isChecked() )
+        addJob( second, eqn, "secondary foreground" );
+      
+      ComputeScheduler::TaskGroup pool;
+      for( RecalJob &job : jobs )
+      {
+        const bool displayed = (job.meas == fore || job.meas == back || job.meas == second);
         
-        meas->recalibrate_by_eqn( eqn, devpairs, m_eqnType, displayed_detectors, false );
-        cerr << "\n\nRecalled " << header->displayName().toUTF8()
-             << " to m_calVal={" << m_calVal[0] << ", " << m_calVal[1]
-             << ", " << m_calVal[2] << "}" << endl;
+        pool.post( [&job,&displayed_detectors,displayed](){
+          try
+          {
+            if( displayed )
+              job.meas->recalibrate_by_eqn( job.new_pars, job.new_devpairs, job.new_eqn_type,
+                                            displayed_detectors, false );
+            else
+              job.meas->recalibrate_by_eqn( job.new_pars, job.new_devpairs, job.new_eqn_type );
+          }catch( std::exception &e )
+          {
+            job.error = e.what();
+          }
+        } );
+      }//for( RecalJob &job : jobs )
+      pool.join();
+      
+      string errors;
+      for( const RecalJob &job : jobs )
+      {
+        if( !job.error.empty() )
+        {
+          errors += (errors.empty() ? "" : ", ") + job.name;
+          cerr << "Failed to recalibrate " << job.name << ": " << job.error << endl;
+          continue;
+        }//if( !job.error.empty() )
         
-        if( meas == fore )
+        if( job.meas == fore )
         {
-          fore.reset();
           Recalibrator::shiftPeaksForEnergyCalibration(
                                             m_calibrator->m_peakModel,
-                                            eqn, devpairs, m_eqnType,
-                                            meas, kForeground,
-                                            oldcalibpars, devpairs, oldEqnType );
+                                            job.new_pars, job.new_devpairs, job.new_eqn_type,
+                                            job.meas, kForeground,
+                                            job.old_pars, job.old_devpairs,
+                                            job.old_eqn_type );
         }else
         {
-          meas->shiftPeaksForRecalibration( oldcalibpars, devpairs, oldEqnType,
-                                           eqn, devpairs, m_eqnType );
-        }//if( meas == fore ) / else
-        
-        if( meas == back )
-          back.reset();
-        if( meas == second )
-          second.reset();
-      }//for( size_t i = 0; i < m_peaks.size(); ++i )
+          job.meas->shiftPeaksForRecalibration( job.old_pars, job.old_devpairs,
+                                                job.old_eqn_type, job.new_pars,
+                                                job.new_devpairs, job.new_eqn_type );
+        }//if( job.meas == fore ) / else
+      }//for( const RecalJob &job : jobs )
       
-      if( fore )
-        fore->recalibrate_by_eqn( eqn, devpairs, m_eqnType, displayed_detectors, false );
-      if( back )
-        back->recalibrate_by_eqn( eqn, devpairs, m_eqnType, displayed_detectors, false );
-      if( second )
-        second->recalibrate_by_eqn( eqn, devpairs, m_eqnType, displayed_detectors, false );
+      if( !errors.empty() )
+        passMessage( "Failed to apply calibration to: " + errors, "",
+                     WarningWidget::WarningMsgHigh );
       
       viewer->displayForegroundData( true );
       viewer->displaySecondForegroundData();
@@ -3355,6 +3629,11 @@ void Recalibrator::MultiFileCalibFit::handleFinish( WDialog::DialogCode result )
       
       m_calibrator->refreshRecalibrator();
       
+      //This may recalibrate (and shift the peaks of) files that arent
+      //  displayed, so cant be undone; previous steps would no longer apply.
+      if( viewer->undoRedoManager() )
+        viewer->undoRedoManager()->clearHistory();
+      
       cerr << "\nAccepted Recalibrator::MultiFileCalibFit" << endl;
       break;
     }//case WDialog::Accepted:
@@ -23,6 +23,7 @@
 
 #include "InterSpec_config.h"
 
+#include <set>
 #include <vector>
 #include <algorithm>
 
@@ -935,6 +936,213 @@ std::map<std::string,std::vector<Wt::WColor>> ReferencePhotopeakDisplay::current
 }//currentlyUsedPeakColors()
 
 
+ReferencePhotopeakDisplay::DecayLineTemplate::DecayLineTemplate(
+                               const SandiaDecay::Nuclide *nuc, const bool prompt,
+                               const std::vector<SandiaDecay::ProductType> &ptypes,
+                               const double age )
+  : nuclide( nuc ), promptOnly( prompt ), types( ptypes ),
+    positronTransition( nullptr )
+{
+  if( promptOnly )
+    mixture.addNuclideInPromptEquilibrium( nuc, 1.0E-3 * SandiaDecay::curie );
+  else
+    mixture.addNuclideByActivity( nuc, 1.0E-3 * SandiaDecay::curie );
+  
+  const vector<SandiaDecay::NuclideActivityPair> activities
+                                                   = mixture.activity( age );
+  for( const SandiaDecay::NuclideActivityPair &nap : activities )
+    chain.push_back( nap.nuclide );
+  
+  positronRow.energy      = static_cast<float>( 510.9989 * PhysicalUnits::keV );
+  positronRow.branchRatio = 0.0f;
+  positronRow.particle    = SandiaDecay::GammaParticle; //SandiaDecay::positron
+  positronRow.responsibleNuc = 0;
+  std::set<const SandiaDecay::Nuclide *> positronparents;
+  std::set<const SandiaDecay::Transition *> positrontrans;
+  
+  for( SandiaDecay::ProductType type : types )
+  {
+    for( size_t nucIndex = 0; nucIndex < chain.size(); ++nucIndex )
+    {
+      const SandiaDecay::Nuclide *chainNuc = chain[nucIndex];
+      
+      for( const SandiaDecay::Transition *transition : chainNuc->decaysToChildren )
+      {
+        for( const SandiaDecay::RadParticle &particle : transition->products )
+        {
+          Term term;
+          term.chainIndex  = nucIndex;
+          term.intensity   = particle.intensity;
+          term.branchRatio = transition->branchRatio;
+          
+          if( type == SandiaDecay::PositronParticle && particle.type == SandiaDecay::PositronParticle )
+          {
+            positronTerms.push_back( term );
+            positronRow.decayMode = transition->mode;
+            positronparents.insert( transition->parent );
+            positrontrans.insert( transition );
+          }else if( (particle.type == type) && (particle.type == SandiaDecay::XrayParticle) )
+          {
+            size_t index = 0;
+            for( ; index < lines.size(); ++index )
+            {
+              if( fabs(lines[index].energy - particle.energy) < 1.0E-6 )
+                break;
+            }
+            
+            if( index < lines.size() )
+            {
+              lines[index].terms.push_back( term );
+            }else
+            {
+              Line line;
+              line.transition     = NULL;
+              line.energy         = particle.energy;
+              line.type           = SandiaDecay::XrayParticle;
+              line.row.energy     = particle.energy;
+              line.row.branchRatio = 0.0f;
+              line.row.particle   = SandiaDecay::XrayParticle;
+              line.row.decayMode  = DecayParticleModel::RowData::XRayDecayMode;
+              line.row.responsibleNuc = nuc;
+              line.terms.push_back( term );
+              lines.push_back( line );
+            }
+          }else if( particle.type == type )
+          {
+            Line line;
+            line.transition     = transition;
+            line.energy         = particle.energy;
+            line.type           = type;
+            line.row.energy     = particle.energy;
+            line.row.branchRatio = 0.0f;
+            line.row.particle   = particle.type;
+            line.row.decayMode  = transition->mode;
+            line.row.responsibleNuc = transition->parent;
+            line.terms.push_back( term );
+            lines.push_back( line );
+          }//if( positron ) / else if( xray ) / else if( particle.type == type )
+        }//for( loop over products )
+      }//for( loop over transitions )
+    }//for( size_t nucIndex = 0; nucIndex < chain.size(); ++nucIndex )
+  }//for( SandiaDecay::ProductType type : types )
+  
+  if( positronparents.size() == 1 )
+    positronRow.responsibleNuc = *positronparents.begin();
+  if( positrontrans.size() == 1 )
+    positronTransition = *positrontrans.begin();
+}//DecayLineTemplate constructor
+
+
+bool ReferencePhotopeakDisplay::DecayLineTemplate::evaluate( const double age,
+               vector<const SandiaDecay::Transition *> &transistions,
+               vector<double> &energies, vector<double> &branchratios,
+               vector<SandiaDecay::ProductType> &particle_type,
+               vector<DecayParticleModel::RowData> &inforows ) const
+{
+  const vector<SandiaDecay::NuclideActivityPair> activities
+                                                   = mixture.activity( age );
+  if( activities.size() != chain.size() )
+    return false;
+  for( size_t i = 0; i < chain.size(); ++i )
+    if( activities[i].nuclide != chain[i] )
+      return false;
+  
+  const double parent_activity = mixture.activity( age, nuclide );
+  
+  for( const Line &line : lines )
+  {
+    double br = 0.0;
+    DecayParticleModel::RowData row = line.row;
+    for( const Term &term : line.terms )
+    {
+      const double termbr = activities[term.chainIndex].activity * term.intensity
+                                          * term.branchRatio / parent_activity;
+      br += termbr;
+      row.branchRatio += termbr;
+    }
+    
+    transistions.push_back( line.transition );
+    energies.push_back( line.energy );
+    branchratios.push_back( br );
+    particle_type.push_back( line.type );
+    inforows.push_back( row );
+  }//for( const Line &line : lines )
+  
+  DecayParticleModel::RowData positronrow = positronRow;
+  for( const Term &term : positronTerms )
+  {
+    const double br = activities[term.chainIndex].activity * term.intensity
+                                          * term.branchRatio / parent_activity;
+    positronrow.branchRatio += 2.0*br;
+  }
+  
+  if( positronrow.branchRatio > 0.0 )
+  {
+    transistions.push_back( positronTransition );
+    energies.push_back( positronrow.energy );
+    branchratios.push_back( positronrow.branchRatio );
+    particle_type.push_back( SandiaDecay::GammaParticle );
+    inforows.push_back( positronrow );
+  }//if( positronrow.branchRatio > 0.0 )
+  
+  return true;
+}//bool evaluate(...)
+
+
+std::shared_ptr<const ReferencePhotopeakDisplay::DecayLineTemplate>
+  ReferencePhotopeakDisplay::decayLineTemplate( const SandiaDecay::Nuclide *nuc,
+                                const bool promptOnly,
+                                const std::vector<SandiaDecay::ProductType> &types,
+                                const double age )
+{
+  const size_t max_cached_templates = 16;
+  
+  for( auto iter = begin(m_decayLineTemplates); iter != end(m_decayLineTemplates); ++iter )
+  {
+    const std::shared_ptr<const DecayLineTemplate> &tmplt = *iter;
+    if( tmplt->nuclide == nuc && tmplt->promptOnly == promptOnly
+        && tmplt->types == types )
+    {
+      m_decayLineTemplates.splice( begin(m_decayLineTemplates), m_decayLineTemplates, iter );
+      return m_decayLineTemplates.front();
+    }
+  }//for( loop over cached templates )
+  
+  auto tmplt = std::make_shared<const DecayLineTemplate>( nuc, promptOnly, types, age );
+  m_decayLineTemplates.push_front( tmplt );
+  while( m_decayLineTemplates.size() > max_cached_templates )
+    m_decayLineTemplates.pop_back();
+  
+  return tmplt;
+}//decayLineTemplate(...)
+
+
+double ReferencePhotopeakDisplay::cachedLineFactor( LineFactorCache &cache,
+                                                    const std::string &key,
+                                                    const double energy,
+                                        const std::function<double(double)> &fcn )
+{
+  //Enough for many dozens of nuclides worth of lines; past this we just start
+  //  over rather than tracking usage.
+  const size_t max_cached_energies = 20000;
+  
+  if( cache.key != key || cache.values.size() > max_cached_energies )
+  {
+    cache.key = key;
+    cache.values.clear();
+  }
+  
+  const auto pos = cache.values.find( energy );
+  if( pos != end(cache.values) )
+    return pos->second;
+  
+  const double value = fcn( energy );
+  cache.values[energy] = value;
+  
+  return value;
+}//double cachedLineFactor(...)
+
+
 void ReferencePhotopeakDisplay::updateDisplayChange()
 {
   bool show = true;
@@ -1260,20 +1468,9 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
 //  bool islogy = m_chart->yAxisIsLog();
 //  double chartMaxSf = (islogy ? log(2.5) : 1.0/1.1);
 
-  SandiaDecay::NuclideMixture mixture;
-
-  if( nuc && canHavePromptEquil && m_promptLinesOnly->isChecked() )
-  {
+  const bool promptOnly = (nuc && canHavePromptEquil && m_promptLinesOnly->isChecked());
+  if( promptOnly )
     age = 0.0;
-    mixture.addNuclideInPromptEquilibrium( nuc, 1.0E-3 * SandiaDecay::curie );
-  }else if( nuc )
-  {
-    mixture.addNuclideByActivity( nuc, 1.0E-3 * SandiaDecay::curie );
-  }//if( we want promt only ) / else
-
-  const vector<SandiaDecay::NuclideActivityPair> activities
-                                                     = mixture.activity( age );
-  const double parent_activity = nuc ? mixture.activity( age, nuc ) : 0.0;
 
   vector<double> energies, branchratios;
   vector<SandiaDecay::ProductType> particle_type;
@@ -1295,117 +1492,27 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
   if( (!m_showXrays || m_showXrays->isChecked()) )
     types.push_back( SandiaDecay::XrayParticle );
   
-  DecayParticleModel::RowData positronrow;
-  positronrow.energy      = static_cast<float>( 510.9989 * PhysicalUnits::keV );
-  positronrow.branchRatio = 0.0f;
-  positronrow.particle    = SandiaDecay::GammaParticle; //SandiaDecay::positron
-  positronrow.responsibleNuc = 0;
-  std::set<const SandiaDecay::Nuclide *> positronparents;
-  std::set<const SandiaDecay::Transition *> positrontrans;
-
-  for( SandiaDecay::ProductType type : types )
+  if( nuc )
   {
-    for( size_t nucIndex = 0; nucIndex < activities.size(); ++nucIndex )
+    //The decay lines of the nuclide only depend on the nuclide, the particle
+    //  types, and prompt-only; changing the age only re-evaluates the chain
+    //  activities.
+    std::shared_ptr<const DecayLineTemplate> tmplt
+                           = decayLineTemplate( nuc, promptOnly, types, age );
+    if( !tmplt->evaluate( age, transistions, energies, branchratios,
+                          particle_type, inforows ) )
     {
-      const SandiaDecay::Nuclide *nuclide = activities[nucIndex].nuclide;
-      const double activity = activities[nucIndex].activity;
-
-      const size_t n_decaysToChildren = nuclide->decaysToChildren.size();
-      
-      for( size_t decayIndex = 0; decayIndex < n_decaysToChildren; ++decayIndex )
-      {
-        const SandiaDecay::Transition *transition
-                                       = nuclide->decaysToChildren[decayIndex];
-        const size_t n_products = transition->products.size();
-
-        for( size_t productNum = 0; productNum < n_products; ++productNum )
-        {
-          const SandiaDecay::RadParticle &particle
-                                            = transition->products[productNum];
-          if( type == SandiaDecay::PositronParticle && particle.type == SandiaDecay::PositronParticle )
-          {
-            const double br = activity * particle.intensity
-                              * transition->branchRatio / parent_activity;
-            positronrow.branchRatio += 2.0*br;
-            positronrow.decayMode   = transition->mode;
-            positronparents.insert( transition->parent );
-            positrontrans.insert( transition );
-          }else if( (particle.type == type) && (particle.type == SandiaDecay::XrayParticle) )
-          {
-            size_t index = 0;
-            for( ; index < energies.size(); ++index )
-            {
-              if( fabs(energies[index] - particle.energy) < 1.0E-6 )
-                break;
-            }
-            
-            const double br = activity * particle.intensity
-                                   * transition->branchRatio / parent_activity;
-            
-            if( index < energies.size() )
-            {
-              branchratios[index] += br;
-              inforows[index].branchRatio += br;
-            }else
-            {
-              transistions.push_back( NULL );
-              energies.push_back( particle.energy );
-              branchratios.push_back( br );
-              particle_type.push_back( SandiaDecay::XrayParticle );
-              reactionPeaks.push_back( NULL );
-              backgroundLines.push_back( NULL );
-            
-              DecayParticleModel::RowData row;
-              row.energy      = particle.energy;
-              row.branchRatio = br;
-              row.particle    = SandiaDecay::XrayParticle;
-              row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
-              row.responsibleNuc = nuc;
-            
-              inforows.push_back( row );
-            }
-          }else if( particle.type == type )
-          {
-            transistions.push_back( transition );
-            energies.push_back( particle.energy );
-            const double br = activity * particle.intensity
-                                   * transition->branchRatio / parent_activity;
-            branchratios.push_back( br );
-            particle_type.push_back( type );
-            
-            reactionPeaks.push_back( NULL );
-            backgroundLines.push_back( NULL );
-
-            DecayParticleModel::RowData row;
-            row.energy      = particle.energy;
-            row.branchRatio = br;
-            row.particle    = particle.type;
-            row.decayMode   = transition->mode;
-            row.responsibleNuc = transition->parent;
-            inforows.push_back( row );
-          }//if( particle.type == type )
-        }//for( size_t productNum = 0; productNum < n_products; ++productNum )
-      }//for( size_t decayIndex = 0; decayIndex < n_decaysToChildren; ++decayIndex )
-    }//for( size_t nucIndex = 0; nucIndex < activities.size(); ++nucIndex )
-  }//for( SandiaDecay::ProductType type : types )
-
-  if( positronrow.branchRatio > 0.0 )
-  {
-    if( positronparents.size() == 1 )
-      positronrow.responsibleNuc = *positronparents.begin();
-    
-    if( positrontrans.size() == 1 )
-      transistions.push_back( *positrontrans.begin() );
-    else
-      transistions.push_back( NULL );
-    energies.push_back( positronrow.energy );
-    branchratios.push_back( positronrow.branchRatio );
-    particle_type.push_back( SandiaDecay::GammaParticle );
-    reactionPeaks.push_back( NULL );
-    backgroundLines.push_back( NULL );
+      //The template was built at an age with a different set of descendants,
+      //  so rebuild it at this age.
+      m_decayLineTemplates.remove( tmplt );
+      tmplt = decayLineTemplate( nuc, promptOnly, types, age );
+      tmplt->evaluate( age, transistions, energies, branchratios,
+                       particle_type, inforows );
+    }//if( the decay chain changed with age )
     
-    inforows.push_back( positronrow );
-  }//if( positronrow.branchRatio > 0.0 )
+    reactionPeaks.resize( energies.size(), NULL );
+    backgroundLines.resize( energies.size(), NULL );
+  }//if( nuc )
   
   const bool showXrays = ((el && !nuc) && (!m_showXrays || m_showXrays->isChecked()));
   
@@ -1507,12 +1614,20 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
   //fold in detector response
   std::shared_ptr<DetectorPeakResponse> det = m_detectorDisplay->detector();
 
+  //The efficiency and resolution factors are cached by energy, for the
+  //  current DRF, so they are shared between nuclides and ages.
+  const string drfkey = det ? std::to_string( det->hashValue() ) : string();
+  
   //Wider peaks mean not as large value of 'y' for the peaks
   if( det && det->isValid() )
   {
+    const std::function<double(double)> efffcn = [&det]( double energy ) -> double {
+      return det->efficiency( energy, PhysicalUnits::m );
+    };
+    
     for( size_t i = 0; i < branchratios.size(); ++i )
       if( (particle_type[i] == SandiaDecay::GammaParticle) || (particle_type[i] == SandiaDecay::XrayParticle) )
-        branchratios[i] *= det->efficiency( energies[i], PhysicalUnits::m );
+        branchratios[i] *= cachedLineFactor( m_efficiencyCache, drfkey, energies[i], efffcn );
   }//if( detector )
 
   
@@ -1521,6 +1636,9 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
   {
     std::shared_ptr<const Material> material;
     boost::function<double(float)> att_coef_fcn;
+    
+    //Describes the shielding, so the transmission factors can be cached.
+    char attkey[256] = { '\0' };
 
     if( m_shieldingSelect->isGenericMaterial() )
     {
@@ -1529,6 +1647,8 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
       att_coef_fcn
           = boost::bind( &GammaInteractionCalc::transmition_coefficient_generic,
                          atomic_number, areal_density, _1 );
+      snprintf( attkey, sizeof(attkey), "G:%.9g,%.9g",
+                double(atomic_number), double(areal_density) );
     }else
     {
       material = m_shieldingSelect->material();
@@ -1538,14 +1658,20 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
         att_coef_fcn
           = boost::bind( &GammaInteractionCalc::transmition_coefficient_material,
                           material.get(), _1, thick );
+        snprintf( attkey, sizeof(attkey), "M:%s,%p,%.9g",
+                  material->name.c_str(), (const void *)material.get(), double(thick) );
       }//if( !!material )
     }//if( isGenericMaterial ) / else
 
     if( !att_coef_fcn.empty() )
     {
+      const std::function<double(double)> transfcn = [&att_coef_fcn]( double energy ) -> double {
+        return exp( -1.0 * att_coef_fcn( energy ) );
+      };
+      
       for( size_t i = 0; i < branchratios.size(); ++i )
         if( (particle_type[i] == SandiaDecay::GammaParticle) || (particle_type[i] == SandiaDecay::XrayParticle) )
-          branchratios[i] *= exp( -1.0 * att_coef_fcn( energies[i] ) );
+          branchratios[i] *= cachedLineFactor( m_attenuationCache, attkey, energies[i], transfcn );
     }//if( att_coef_fcn )
   }catch( MassAttenuation::ErrorLoadingDataException & )
   {
@@ -1567,11 +1693,15 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
   {
     const vector<double> origbr = branchratios;
     
+    const std::function<double(double)> sigmafcn = [&det]( double energy ) -> double {
+      return det->peakResolutionSigma( energy );
+    };
+    
     try
     {
       for( size_t i = 0; i < branchratios.size(); ++i )
       {
-        const double sigma = det->peakResolutionSigma( energies[i] );
+        const double sigma = cachedLineFactor( m_resolutionCache, drfkey, energies[i], sigmafcn );
         if( sigma <= 0.0 )
           throw exception();
         branchratios[i] /= sigma;
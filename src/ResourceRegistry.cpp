@@ -0,0 +1,164 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <mutex>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+
+#include <Wt/Json/Value>
+#include <Wt/Json/Parser>
+
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/MaterialDB.h"
+#include "InterSpec/GadrasSpecFunc.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/ResourceRegistry.h"
+#include "InterSpec/DecayDataBaseServer.h"
+
+using namespace std;
+
+namespace
+{
+  template<class T>
+  struct ResourceSlot
+  {
+    std::mutex mutex;
+    std::shared_ptr<const T> resource;
+    size_t numLoads = 0;
+  };//struct ResourceSlot
+  
+  
+  //Returns the resource in 'slot', loading it with 'loader' if it isnt loaded
+  //  yet.  The slots mutex is held while loading, so concurrent requests wait
+  //  for the single load, rather than each doing their own.
+  template<class T>
+  std::shared_ptr<const T> get_resource( ResourceSlot<T> &slot,
+                                  const std::function<std::shared_ptr<const T>()> &loader )
+  {
+    std::lock_guard<std::mutex> lock( slot.mutex );
+    
+    if( !slot.resource )
+    {
+      slot.resource = loader();
+      if( !slot.resource )
+        throw runtime_error( "ResourceRegistry: resource failed to load" );
+      ++slot.numLoads;
+    }//if( !slot.resource )
+    
+    return slot.resource;
+  }//get_resource(...)
+  
+  
+  template<class T>
+  void release_resource( ResourceSlot<T> &slot )
+  {
+    std::lock_guard<std::mutex> lock( slot.mutex );
+    slot.resource.reset();
+  }
+  
+  template<class T>
+  size_t num_loads( ResourceSlot<T> &slot )
+  {
+    std::lock_guard<std::mutex> lock( slot.mutex );
+    return slot.numLoads;
+  }
+  
+  ResourceSlot<MaterialDB> sm_materialDbSlot;
+  ResourceSlot<GadrasScatterTable> sm_scatterSlot;
+  ResourceSlot<Wt::Json::Value> sm_helpJsonSlot;
+}//namespace
+
+
+std::shared_ptr<const MaterialDB> ResourceRegistry::materialDB()
+{
+  return get_resource<MaterialDB>( sm_materialDbSlot, [](){
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    const string materialfile = UtilityFunctions::append_path(
+                         InterSpec::staticDataDirectory(), "MaterialDataBase.txt" );
+    auto materialDB = std::make_shared<MaterialDB>();
+    materialDB->parseGadrasMaterialFile( materialfile, db, false );
+    return std::shared_ptr<const MaterialDB>( materialDB );
+  } );
+}//std::shared_ptr<const MaterialDB> materialDB()
+
+
+std::shared_ptr<const GadrasScatterTable> ResourceRegistry::gadrasScatterTable()
+{
+  return get_resource<GadrasScatterTable>( sm_scatterSlot, [](){
+    const string continuumData = UtilityFunctions::append_path(
+                          InterSpec::staticDataDirectory(), "GadrasContinuum.lib" );
+    return std::make_shared<const GadrasScatterTable>( continuumData );
+  } );
+}//std::shared_ptr<const GadrasScatterTable> gadrasScatterTable()
+
+
+std::shared_ptr<const Wt::Json::Value> ResourceRegistry::helpJson()
+{
+  return get_resource<Wt::Json::Value>( sm_helpJsonSlot, [](){
+    const char *help_json = "InterSpec_resources/static_text/help.json";
+    ifstream helpinfo( help_json );
+    if( !helpinfo.is_open() )
+      throw runtime_error( "Could not open help JSON file at '" + string(help_json) + "'" );
+    
+    const string contents( (std::istreambuf_iterator<char>(helpinfo)),
+                           std::istreambuf_iterator<char>() );
+    
+    auto result = std::make_shared<Wt::Json::Value>();
+    Wt::Json::parse( contents, *result );
+    
+    return std::shared_ptr<const Wt::Json::Value>( result );
+  } );
+}//std::shared_ptr<const Wt::Json::Value> helpJson()
+
+
+size_t ResourceRegistry::numTimesLoaded( const Resource resource )
+{
+  switch( resource )
+  {
+    case MaterialDataBase: return num_loads( sm_materialDbSlot );
+    case GadrasScatter:    return num_loads( sm_scatterSlot );
+    case HelpJson:         return num_loads( sm_helpJsonSlot );
+    case NumResources:     break;
+  }//switch( resource )
+  
+  throw runtime_error( "ResourceRegistry::numTimesLoaded: invalid resource" );
+}//size_t numTimesLoaded( const Resource resource )
+
+
+void ResourceRegistry::release( const Resource resource )
+{
+  switch( resource )
+  {
+    case MaterialDataBase: release_resource( sm_materialDbSlot ); break;
+    case GadrasScatter:    release_resource( sm_scatterSlot );    break;
+    case HelpJson:         release_resource( sm_helpJsonSlot );   break;
+    case NumResources:     break;
+  }//switch( resource )
+}//void release( const Resource resource )
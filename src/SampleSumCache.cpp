@@ -0,0 +1,467 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+#include "InterSpec/Tracing.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/SampleSumCache.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+
+using namespace std;
+
+namespace
+{
+  //After this many add/subtract updates of the running sum, it is recomputed
+  //  from the block sums, just to keep any error from building up.
+  const size_t ns_maxUpdatesBeforeResum = 512;
+}//namespace
+
+
+const size_t SampleSumCache::sm_minNumSamples = 32;
+const size_t SampleSumCache::sm_maxBlockMemory = 32*1024*1024;
+
+
+void SampleSumCache::CompensatedSum::reset( const size_t nentries )
+{
+  sum.assign( nentries, 0.0 );
+  compensation.assign( nentries, 0.0 );
+}//void CompensatedSum::reset( const size_t nentries )
+
+
+void SampleSumCache::CompensatedSum::add( const size_t index, const double value )
+{
+  double &s = sum[index];
+  const double t = s + value;
+  if( fabs(s) >= fabs(value) )
+    compensation[index] += (s - t) + value;
+  else
+    compensation[index] += (value - t) + s;
+  s = t;
+}//void CompensatedSum::add( const size_t index, const double value )
+
+
+double SampleSumCache::CompensatedSum::value( const size_t index ) const
+{
+  return sum[index] + compensation[index];
+}//double CompensatedSum::value( const size_t index ) const
+
+
+SampleSumCache::SampleSumCache()
+  : m_usable( false ),
+    m_nchannel( 0 ),
+    m_blockSize( 64 ),
+    m_currentValid( false ),
+    m_numUpdatesSinceSum( 0 )
+{
+}//SampleSumCache constructor
+
+
+SampleSumCache::~SampleSumCache()
+{
+}//~SampleSumCache()
+
+
+void SampleSumCache::clear()
+{
+  m_meas.reset();
+  m_detectors.clear();
+  m_usable = false;
+  m_nchannel = 0;
+  m_measurements.clear();
+  m_counts.clear();
+  m_binnings.clear();
+  m_sampleNumbers.clear();
+  m_sampleMeasurements.clear();
+  m_blocks.clear();
+  m_currentValid = false;
+  m_currentIndexes.clear();
+  m_current.reset( 0 );
+  m_numUpdatesSinceSum = 0;
+}//void clear()
+
+
+size_t SampleSumCache::memorySize() const
+{
+  size_t nbytes = sizeof(*this);
+  
+  for( const std::vector<double> &block : m_blocks )
+    nbytes += sizeof(block) + block.capacity()*sizeof(double);
+  
+  for( const std::vector<size_t> &indexes : m_sampleMeasurements )
+    nbytes += sizeof(indexes) + indexes.capacity()*sizeof(size_t);
+  
+  nbytes += m_measurements.capacity() * sizeof(m_measurements[0]);
+  nbytes += m_counts.capacity() * sizeof(m_counts[0]);
+  nbytes += m_binnings.capacity() * sizeof(m_binnings[0]);
+  nbytes += m_sampleNumbers.capacity() * sizeof(int);
+  nbytes += m_currentIndexes.capacity() * sizeof(size_t);
+  nbytes += (m_current.sum.capacity() + m_current.compensation.capacity()) * sizeof(double);
+  
+  return nbytes;
+}//size_t memorySize() const
+
+
+bool SampleSumCache::isIndexValid( const std::shared_ptr<SpecMeas> &meas,
+                                   const std::vector<bool> &detectors ) const
+{
+  if( m_meas.lock() != meas || detectors != m_detectors )
+    return false;
+
+  const vector<std::shared_ptr<const Measurement>> &measurements = meas->measurements();
+  if( measurements.size() != m_measurements.size() )
+    return false;
+
+  for( size_t i = 0; i < measurements.size(); ++i )
+  {
+    const std::shared_ptr<const Measurement> &m = measurements[i];
+    if( m != m_measurements[i]
+        || m->gamma_counts() != m_counts[i]
+        || m->channel_energies() != m_binnings[i] )
+      return false;
+  }//for( size_t i = 0; i < measurements.size(); ++i )
+
+  return true;
+}//bool isIndexValid(...)
+
+
+void SampleSumCache::buildIndex( const std::shared_ptr<SpecMeas> &meas,
+                                 const std::vector<bool> &detectors )
+{
+  clear();
+
+  m_meas = meas;
+  m_detectors = detectors;
+
+  const vector<std::shared_ptr<const Measurement>> &measurements = meas->measurements();
+  for( const std::shared_ptr<const Measurement> &m : measurements )
+  {
+    m_measurements.push_back( m );
+    m_counts.push_back( m->gamma_counts() );
+    m_binnings.push_back( m->channel_energies() );
+  }//for( const std::shared_ptr<const Measurement> &m : measurements )
+
+  const set<int> &samples = meas->sample_numbers();
+  m_sampleNumbers.insert( m_sampleNumbers.end(), samples.begin(), samples.end() );
+  m_sampleMeasurements.resize( m_sampleNumbers.size() );
+
+  if( m_sampleNumbers.size() < sm_minNumSamples )
+    return;
+
+  const vector<int> &detnums = meas->detector_numbers();
+  if( detectors.size() != detnums.size() )
+    return;
+
+  std::shared_ptr<const std::vector<float>> binning;
+
+  for( size_t i = 0; i < m_measurements.size(); ++i )
+  {
+    const std::shared_ptr<const Measurement> &m = m_measurements[i];
+
+    const auto detpos = std::find( detnums.begin(), detnums.end(), m->detector_number() );
+    if( detpos == detnums.end() || !detectors[detpos - detnums.begin()] )
+      continue;
+
+    const auto samplepos = std::lower_bound( m_sampleNumbers.begin(),
+                                             m_sampleNumbers.end(), m->sample_number() );
+    if( samplepos == m_sampleNumbers.end() || (*samplepos) != m->sample_number() )
+      return;
+
+    m_sampleMeasurements[samplepos - m_sampleNumbers.begin()].push_back( i );
+
+    //Measurements without gamma counts only contribute their neutrons, so we
+    //  dont care about their binning.
+    if( !m_counts[i] || m_counts[i]->empty() )
+      continue;
+
+    if( !m_binnings[i] || m_binnings[i]->size() < m_counts[i]->size() )
+      return;
+
+    if( !binning )
+    {
+      binning = m_binnings[i];
+      m_nchannel = m_counts[i]->size();
+    }else if( m_counts[i]->size() != m_nchannel )
+    {
+      return;
+    }else if( m_binnings[i] != binning && (*m_binnings[i]) != (*binning) )
+    {
+      //sum_measurements(...) would rebin this measurement
+      return;
+    }
+  }//for( size_t i = 0; i < m_measurements.size(); ++i )
+
+  if( !m_nchannel )
+    return;
+
+  const size_t nsamples = m_sampleNumbers.size();
+  const size_t bytesPerBlock = (m_nchannel + 3) * sizeof(double);
+  const size_t maxBlocks = std::max( size_t(1), sm_maxBlockMemory / bytesPerBlock );
+  m_blockSize = std::max( size_t(64), (nsamples + maxBlocks - 1) / maxBlocks );
+  m_blocks.resize( (nsamples + m_blockSize - 1) / m_blockSize );
+
+  m_usable = true;
+}//void buildIndex(...)
+
+
+void SampleSumCache::addSample( CompensatedSum &sum, const size_t sampleIndex,
+                                const double sign ) const
+{
+  for( const size_t measIndex : m_sampleMeasurements[sampleIndex] )
+  {
+    const Measurement &m = *m_measurements[measIndex];
+    const std::shared_ptr<const std::vector<float>> &counts = m_counts[measIndex];
+
+    if( counts && counts->size() == m_nchannel )
+    {
+      const float *channels = &((*counts)[0]);
+      for( size_t i = 0; i < m_nchannel; ++i )
+        sum.add( i, sign*channels[i] );
+    }//if( counts && counts->size() == m_nchannel )
+
+    sum.add( m_nchannel + 0, sign*m.live_time() );
+    sum.add( m_nchannel + 1, sign*m.real_time() );
+    sum.add( m_nchannel + 2, sign*m.neutron_counts_sum() );
+  }//for( const size_t measIndex : m_sampleMeasurements[sampleIndex] )
+}//void addSample(...)
+
+
+const std::vector<double> &SampleSumCache::block( const size_t blockIndex )
+{
+  assert( blockIndex < m_blocks.size() );
+
+  vector<double> &answer = m_blocks[blockIndex];
+  if( !answer.empty() )
+    return answer;
+
+  CompensatedSum sum;
+  sum.reset( m_nchannel + 3 );
+
+  const size_t start = blockIndex * m_blockSize;
+  const size_t end = std::min( start + m_blockSize, m_sampleNumbers.size() );
+  for( size_t i = start; i < end; ++i )
+    addSample( sum, i, 1.0 );
+
+  answer.resize( m_nchannel + 3 );
+  for( size_t i = 0; i < answer.size(); ++i )
+    answer[i] = sum.value( i );
+
+  return answer;
+}//const std::vector<double> &block( const size_t blockIndex )
+
+
+void SampleSumCache::setSumMetadata( Measurement &answer,
+                                     const std::vector<size_t> &indexes ) const
+{
+  boost::posix_time::ptime start_time, position_time;
+  double latitude = 0.0, longitude = 0.0;
+  size_t nmeas = 0, ngps = 0;
+  string title;
+  bool sameTitle = true;
+  
+  for( const size_t index : indexes )
+  {
+    for( const size_t measIndex : m_sampleMeasurements[index] )
+    {
+      const Measurement &m = *m_measurements[measIndex];
+      
+      const boost::posix_time::ptime &mstart = m.start_time();
+      if( !mstart.is_special() && (start_time.is_special() || mstart < start_time) )
+        start_time = mstart;
+      
+      if( m.has_gps_info() )
+      {
+        latitude += m.latitude();
+        longitude += m.longitude();
+        if( !ngps )
+          position_time = m.position_time();
+        ++ngps;
+      }//if( m.has_gps_info() )
+      
+      if( !nmeas )
+        title = m.title();
+      else if( sameTitle && m.title() != title )
+        sameTitle = false;
+      ++nmeas;
+    }//for( loop over measurements of the sample )
+  }//for( const size_t index : indexes )
+  
+  answer.set_start_time( start_time );
+  answer.set_title( sameTitle ? title : string() );
+  
+  if( ngps )
+    answer.set_position( longitude/ngps, latitude/ngps, position_time );
+  else
+    answer.set_position( -999.9, -999.9, boost::posix_time::ptime() );
+}//void setSumMetadata(...)
+
+
+size_t SampleSumCache::costFromBlocks( const std::vector<size_t> &indexes ) const
+{
+  size_t cost = 0;
+
+  for( size_t i = 0; i < indexes.size(); )
+  {
+    const size_t blockIndex = indexes[i] / m_blockSize;
+    const size_t blockStart = blockIndex * m_blockSize;
+    const size_t blockEnd = std::min( blockStart + m_blockSize, m_sampleNumbers.size() );
+
+    //Count how many of the requested samples are in this block
+    size_t j = i;
+    while( j < indexes.size() && indexes[j] < blockEnd )
+      ++j;
+
+    if( (j - i) == (blockEnd - blockStart) )
+      cost += (m_blocks[blockIndex].empty() ? (blockEnd - blockStart) : 0) + 1;
+    else
+      cost += (j - i);
+
+    i = j;
+  }//for( size_t i = 0; i < indexes.size(); )
+
+  return cost;
+}//size_t costFromBlocks( const std::vector<size_t> &indexes ) const
+
+
+void SampleSumCache::sumFromBlocks( const std::vector<size_t> &indexes )
+{
+  m_current.reset( m_nchannel + 3 );
+
+  for( size_t i = 0; i < indexes.size(); )
+  {
+    const size_t blockIndex = indexes[i] / m_blockSize;
+    const size_t blockStart = blockIndex * m_blockSize;
+    const size_t blockEnd = std::min( blockStart + m_blockSize, m_sampleNumbers.size() );
+
+    size_t j = i;
+    while( j < indexes.size() && indexes[j] < blockEnd )
+      ++j;
+
+    if( (j - i) == (blockEnd - blockStart) )
+    {
+      const vector<double> &blocksum = block( blockIndex );
+      for( size_t k = 0; k < blocksum.size(); ++k )
+        m_current.add( k, blocksum[k] );
+    }else
+    {
+      for( size_t k = i; k < j; ++k )
+        addSample( m_current, indexes[k], 1.0 );
+    }
+
+    i = j;
+  }//for( size_t i = 0; i < indexes.size(); )
+
+  m_currentIndexes = indexes;
+  m_currentValid = true;
+  m_numUpdatesSinceSum = 0;
+}//void sumFromBlocks( const std::vector<size_t> &indexes )
+
+
+std::shared_ptr<Measurement> SampleSumCache::sum( const std::shared_ptr<SpecMeas> &meas,
+                                                  const std::set<int> &samples,
+                                                  const std::vector<bool> &detectors )
+{
+  INTERSPEC_TRACE_SPAN( "SampleSumCache::sum" );
+  
+  if( !meas || samples.empty() )
+    return meas ? meas->sum_measurements( samples, detectors ) : nullptr;
+
+  if( !isIndexValid( meas, detectors ) )
+    buildIndex( meas, detectors );
+
+  if( !m_usable )
+    return meas->sum_measurements( samples, detectors );
+
+  vector<size_t> indexes;
+  indexes.reserve( samples.size() );
+  for( const int sample : samples )
+  {
+    const auto pos = std::lower_bound( m_sampleNumbers.begin(), m_sampleNumbers.end(), sample );
+    if( pos == m_sampleNumbers.end() || (*pos) != sample )
+      return meas->sum_measurements( samples, detectors );
+    indexes.push_back( pos - m_sampleNumbers.begin() );
+  }//for( const int sample : samples )
+
+  //Both 'indexes' and 'm_currentIndexes' are sorted, so we can find what was
+  //  added and removed with a single pass.
+  const bool canUpdate = m_currentValid && (m_numUpdatesSinceSum < ns_maxUpdatesBeforeResum);
+
+  vector<size_t> added, removed;
+  if( canUpdate )
+  {
+    std::set_difference( indexes.begin(), indexes.end(),
+                         m_currentIndexes.begin(), m_currentIndexes.end(),
+                         std::back_inserter(added) );
+    std::set_difference( m_currentIndexes.begin(), m_currentIndexes.end(),
+                         indexes.begin(), indexes.end(),
+                         std::back_inserter(removed) );
+  }//if( we could update the current sum )
+
+  const size_t updateCost = added.size() + removed.size();
+
+  if( canUpdate && (updateCost <= costFromBlocks( indexes )) )
+  {
+    for( const size_t index : added )
+      addSample( m_current, index, 1.0 );
+    for( const size_t index : removed )
+      addSample( m_current, index, -1.0 );
+
+    m_currentIndexes = indexes;
+    m_numUpdatesSinceSum += (updateCost ? 1 : 0);
+  }else
+  {
+    sumFromBlocks( indexes );
+  }
+
+  //We'll let sum_measurements(...) fill out the meta-information that is the
+  //  same for all the samples (energy calibration, detector, etc) by summing a
+  //  single sample, then replace its counts and times with the cached sum, and
+  //  its start time, title, and position with those of all the samples.
+  const set<int> firstSample{ *samples.begin() };
+  std::shared_ptr<Measurement> answer = meas->sum_measurements( firstSample, detectors );
+  if( !answer )
+    return meas->sum_measurements( samples, detectors );
+
+  auto counts = std::make_shared<vector<float>>( m_nchannel );
+  for( size_t i = 0; i < m_nchannel; ++i )
+    (*counts)[i] = static_cast<float>( m_current.value(i) );
+
+  const float live_time = static_cast<float>( m_current.value(m_nchannel + 0) );
+  const float real_time = static_cast<float>( m_current.value(m_nchannel + 1) );
+  const float neutrons = static_cast<float>( m_current.value(m_nchannel + 2) );
+
+  answer->set_gamma_counts( counts, live_time, real_time );
+  if( answer->contained_neutron() || neutrons > 0.0f )
+    answer->set_neutron_counts( vector<float>( 1, neutrons ) );
+
+  setSumMetadata( *answer, indexes );
+  
+  return answer;
+}//std::shared_ptr<Measurement> sum(...)
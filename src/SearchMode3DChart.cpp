@@ -183,8 +183,8 @@ void SearchMode3DChart::initChart()
   assert( !m_chart );
   
   m_model = new SearchMode3DDataModel( this );
-  m_model->setMaxNumTimeSamples( 60 );
   m_model->setMaxNumEnergyChannels( 128 );
+  m_model->dataUpdated().connect( this, &SearchMode3DChart::modelDataUpdated );
   
   m_chart = new Chart::WCartesian3DChart();
   m_layout->addWidget( m_chart, 0, 0, 1, 5 );
@@ -340,6 +340,21 @@ void SearchMode3DChart::newSpectralDataSet()
 }//void newSpectralDataSet()
 
 
+void SearchMode3DChart::modelDataUpdated()
+{
+  if( !m_chart )
+    return;
+  
+  Chart::WStandardColorMap *colormap =
+    new Chart::WStandardColorMap( m_data->minimum(Wt::Chart::ZAxis_3D),
+                                      m_data->maximum(Wt::Chart::ZAxis_3D),
+                                      true );
+  m_data->setColorMap( colormap );
+  
+  updateRange();
+}//void modelDataUpdated()
+
+
 void SearchMode3DChart::updateRange()
 {
   if( !m_chart )
@@ -352,6 +367,17 @@ void SearchMode3DChart::updateRange()
   const double maxenergy = m_inputMaxEnergy->value();
   const double mintime = m_inputMinTime->value();
   const double maxtime = m_inputMaxTime->value();
+  
+  //Only the samples within the time range are sent to the client, so when the
+  //  user zooms in on part of a long file, its individual samples are shown.
+  if( m_model->setTimeWindow( mintime, maxtime ) )
+  {
+    Chart::WStandardColorMap *colormap =
+      new Chart::WStandardColorMap( m_data->minimum(Wt::Chart::ZAxis_3D),
+                                    m_data->maximum(Wt::Chart::ZAxis_3D),
+                                    true );
+    m_data->setColorMap( colormap );
+  }//if( the displayed samples changed )
 
   //Wt::Chart::WStandardColorMap *colormapUpdated =
   //                    new Wt::Chart::WStandardColorMap(minenergy,maxenergy, false);
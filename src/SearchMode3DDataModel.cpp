@@ -24,28 +24,378 @@
 #include "InterSpec_config.h"
 
 #include <set>
+#include <cfloat>
 #include <string>
 #include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 #include <Wt/WColor>
 #include <Wt/WString>
+#include <Wt/WServer>
+#include <Wt/WApplication>
 #include <Wt/WModelIndex>
 #include <Wt/WAbstractTableModel>
 
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/InterSpec.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/SearchMode3DDataModel.h"
 
 using namespace Wt;
 using namespace std;
 
+namespace
+{
+  //The maximum number of sample-channel cells the summed area table for a file
+  //  may have; if a file has more than this, adjacent channels are combined by
+  //  factors of two until it fits (4M cells is 32 MB of memory).
+  const size_t sm_maxPyramidCells = 4*1024*1024;
+  
+  //Files with more sample-channel cells than this will be summed in the
+  //  background.
+  const size_t sm_maxSynchronousCells = 256*1024;
+  
+  //The maximum number of entries we will use for the min/max range table of
+  //  the displayed counts; above this we will just scan the counts.
+  const size_t sm_maxRangeTableEntries = 4*1024*1024;
+  
+  size_t floor_log2( size_t n )
+  {
+    size_t answer = 0;
+    while( n > 1 )
+    {
+      n /= 2;
+      ++answer;
+    }
+    return answer;
+  }//size_t floor_log2( size_t n )
+}//namespace
+
+
+/** The summed counts, for each time sample and (possibly combined) channel, of
+ a file, stored as a summed area table (i.e., 2D prefix sums), so the counts for
+ any range of samples and channels (and hence any number of combined samples or
+ channels) can be looked up in constant time, without having to re-sum the
+ spectra in the file.
+ */
+struct TimeEnergyPyramid
+{
+  TimeEnergyPyramid( std::shared_ptr<const SpecMeas> meas,
+                     const vector<int> &samples,
+                     const vector<bool> &det_to_use,
+                     const set<int> &displayed_detectors,
+                     std::shared_ptr<const Measurement> binning )
+  : m_meas( meas ),
+    m_sampleNumbers( samples ),
+    m_detToUse( det_to_use ),
+    m_displayedDetectors( displayed_detectors ),
+    m_binning( binning ),
+    m_binningEnergies( binning->gamma_channel_energies() ),
+    m_numOrigChannels( binning->gamma_channel_contents()->size() ),
+    m_baseCombine( 1 ),
+    m_numChannels( 0 ),
+    m_valid( false )
+  {
+    const size_t nsamples = std::max( samples.size(), size_t(1) );
+    while( (nsamples * (m_numOrigChannels / m_baseCombine)) > sm_maxPyramidCells
+           && (m_numOrigChannels / m_baseCombine) > 4 )
+      m_baseCombine *= 2;
+    m_numChannels = m_numOrigChannels / m_baseCombine;
+  }//TimeEnergyPyramid constructor
+  
+  
+  /** Returns true if this pyramid was (or will be) built from the same data as
+   would be specified by the arguments.
+   */
+  bool sameSource( std::shared_ptr<const SpecMeas> meas,
+                   const vector<int> &samples,
+                   const vector<bool> &det_to_use,
+                   const set<int> &displayed_detectors,
+                   std::shared_ptr<const Measurement> binning ) const
+  {
+    const std::shared_ptr<const SpecMeas> ourmeas = m_meas.lock();
+    return ourmeas && (ourmeas == meas)
+           && (m_sampleNumbers == samples)
+           && (m_detToUse == det_to_use)
+           && (m_displayedDetectors == displayed_detectors)
+           && binning
+           && (m_binningEnergies == binning->gamma_channel_energies())
+           && (m_numOrigChannels == binning->gamma_channel_contents()->size());
+  }//bool sameSource(...)
+  
+  
+  /** Number of sample-channel cells that will be summed. */
+  size_t numCells() const
+  {
+    return m_sampleNumbers.size() * m_numChannels;
+  }
+  
+  
+  /** Sums all the spectra of the file, and fills out the summed area table.
+   May be called from any thread.  Throws exception on error.
+   */
+  void build()
+  {
+    const std::shared_ptr<const SpecMeas> meas = m_meas.lock();
+    if( !meas )
+      throw runtime_error( "Spectrum file no longer available" );
+    
+    const size_t nsamples = m_sampleNumbers.size();
+    const size_t nchan = m_numChannels;
+    const size_t bc = m_baseCombine;
+    
+    if( !nsamples || nchan < 2 || !m_binningEnergies || m_binningEnergies->size() < 2 )
+      throw runtime_error( "No data to display" );
+    
+    //Lower energy of each of our channels, plus upper energy of the last one.
+    const vector<float> &origenergies = *m_binningEnergies;
+    m_energies.resize( nchan + 1 );
+    for( size_t i = 0; i <= nchan; ++i )
+    {
+      const size_t index = i * bc;
+      if( index < origenergies.size() )
+      {
+        m_energies[i] = origenergies[index];
+      }else
+      {
+        const size_t last = origenergies.size() - 1;
+        const float width = origenergies[last] - origenergies[last-1];
+        m_energies[i] = origenergies[last] + width*(index - last);
+      }
+    }//for( size_t i = 0; i <= nchan; ++i )
+    
+    m_realTimes.resize( nsamples, 0.0f );
+    m_sums.assign( (nsamples + 1) * (nchan + 1), 0.0 );
+    
+    vector<double> rowsum( nchan, 0.0 );
+    
+    for( size_t sample = 0; sample < nsamples; ++sample )
+    {
+      const int samplenum = m_sampleNumbers[sample];
+      
+      float realtime = FLT_MAX;
+      for( const int detnum : m_displayedDetectors )
+      {
+        MeasurementConstShrdPtr m = meas->measurement( samplenum, detnum );
+        if( m )
+          realtime = std::min( realtime, m->real_time() );
+      }//for( const int detnum : m_displayedDetectors )
+      
+      if( realtime > 1.0E+6f )
+        realtime = 0.0f;
+      m_realTimes[sample] = realtime;
+      
+      set<int> thissamplenum;
+      thissamplenum.insert( samplenum );
+      
+      std::shared_ptr<const Measurement> summed
+                   = meas->sum_measurements( thissamplenum, m_detToUse, m_binning );
+      
+      if( !summed || !summed->gamma_channel_contents()
+          || summed->gamma_channel_contents()->size() != m_numOrigChannels )
+        throw runtime_error( "Summing results have unexpected issues" );
+      
+      const vector<float> &counts = *summed->gamma_channel_contents();
+      
+      //Combine channels, if necassary, truncating any channels that dont make a
+      //  full combined channel at the end
+      for( size_t i = 0; i < nchan; ++i )
+      {
+        double sum = 0.0;
+        for( size_t j = i*bc; j < (i+1)*bc; ++j )
+          sum += counts[j];
+        rowsum[i] = sum;
+      }//for( size_t i = 0; i < nchan; ++i )
+      
+      const double *prevrow = &(m_sums[sample*(nchan+1)]);
+      double *thisrow = &(m_sums[(sample+1)*(nchan+1)]);
+      double runningsum = 0.0;
+      for( size_t i = 0; i < nchan; ++i )
+      {
+        runningsum += rowsum[i];
+        thisrow[i+1] = prevrow[i+1] + runningsum;
+      }
+    }//for( size_t sample = 0; sample < nsamples; ++sample )
+    
+    m_valid = true;
+  }//void build()
+  
+  
+  /** Returns the sum of counts for samples in range [sample_begin,sample_end),
+   and channels in range [chan_begin,chan_end).
+   */
+  double sum( const size_t sample_begin, const size_t sample_end,
+              const size_t chan_begin, const size_t chan_end ) const
+  {
+    const size_t w = m_numChannels + 1;
+    return m_sums[sample_end*w + chan_end] - m_sums[sample_begin*w + chan_end]
+           - m_sums[sample_end*w + chan_begin] + m_sums[sample_begin*w + chan_begin];
+  }//double sum(...)
+  
+  
+  std::weak_ptr<const SpecMeas> m_meas;
+  const vector<int> m_sampleNumbers;
+  const vector<bool> m_detToUse;
+  const set<int> m_displayedDetectors;
+  const std::shared_ptr<const Measurement> m_binning;
+  const std::shared_ptr<const vector<float>> m_binningEnergies;
+  
+  //The number of channels in the spectrum used for binning
+  const size_t m_numOrigChannels;
+  
+  //The number of original channels combined together for each channel of the
+  //  pyramid; will be a power of two.
+  size_t m_baseCombine;
+  
+  //The number of (possibly combined) channels in the pyramid.
+  size_t m_numChannels;
+  
+  //Set to true once build() has successfully completed.
+  bool m_valid;
+  
+  //m_energies: lower energy of each channel, plus the upper energy of the last
+  //  channel.
+  vector<float> m_energies;
+  
+  //m_realTimes: the minimum real time, of the displayed detectors, of each
+  //  sample.
+  vector<float> m_realTimes;
+  
+  //m_sums: summed area table; m_sums[i*(m_numChannels+1) + j] is the sum of
+  //  counts for samples [0,i) and channels [0,j).
+  vector<double> m_sums;
+};//struct TimeEnergyPyramid
+
+
+/** A 2D sparse table (i.e., the min and max of every power-of-two sized block)
+ of the displayed counts, so the min and max counts for any rectangular range
+ can be found with four lookups.
+ */
+class CountsRangeTable
+{
+public:
+  CountsRangeTable( const boost::multi_array<float, 2> &counts )
+  : m_nrow( counts.shape()[0] ),
+    m_ncol( counts.shape()[1] ),
+    m_nrowlevels( floor_log2( std::max( m_nrow, size_t(1) ) ) + 1 ),
+    m_ncollevels( floor_log2( std::max( m_ncol, size_t(1) ) ) + 1 )
+  {
+    const size_t nentries = numEntries( m_nrow, m_ncol );
+    m_min.resize( nentries );
+    m_max.resize( nentries );
+    
+    for( size_t row = 0; row < m_nrow; ++row )
+    {
+      for( size_t col = 0; col < m_ncol; ++col )
+      {
+        const size_t index = entry( 0, 0, row, col );
+        m_min[index] = m_max[index] = counts[row][col];
+      }
+    }//for( size_t row = 0; row < m_nrow; ++row )
+    
+    //First fill out the column levels for single rows, then build the row
+    //  levels up from them.
+    for( size_t cl = 1; cl < m_ncollevels; ++cl )
+    {
+      const size_t half = size_t(1) << (cl - 1);
+      for( size_t row = 0; row < m_nrow; ++row )
+      {
+        for( size_t col = 0; (col + 2*half) <= m_ncol; ++col )
+        {
+          const size_t a = entry( 0, cl-1, row, col );
+          const size_t b = entry( 0, cl-1, row, col + half );
+          const size_t index = entry( 0, cl, row, col );
+          m_min[index] = std::min( m_min[a], m_min[b] );
+          m_max[index] = std::max( m_max[a], m_max[b] );
+        }
+      }
+    }//for( size_t cl = 1; cl < m_ncollevels; ++cl )
+    
+    for( size_t rl = 1; rl < m_nrowlevels; ++rl )
+    {
+      const size_t half = size_t(1) << (rl - 1);
+      for( size_t cl = 0; cl < m_ncollevels; ++cl )
+      {
+        const size_t colwidth = size_t(1) << cl;
+        for( size_t row = 0; (row + 2*half) <= m_nrow; ++row )
+        {
+          for( size_t col = 0; (col + colwidth) <= m_ncol; ++col )
+          {
+            const size_t a = entry( rl-1, cl, row, col );
+            const size_t b = entry( rl-1, cl, row + half, col );
+            const size_t index = entry( rl, cl, row, col );
+            m_min[index] = std::min( m_min[a], m_min[b] );
+            m_max[index] = std::max( m_max[a], m_max[b] );
+          }
+        }
+      }
+    }//for( size_t rl = 1; rl < m_nrowlevels; ++rl )
+  }//CountsRangeTable constructor
+  
+  
+  /** The number of entries (for each of min and max) a table for a nrow by ncol
+   array would have.
+   */
+  static size_t numEntries( const size_t nrow, const size_t ncol )
+  {
+    const size_t nrowlevels = floor_log2( std::max( nrow, size_t(1) ) ) + 1;
+    const size_t ncollevels = floor_log2( std::max( ncol, size_t(1) ) ) + 1;
+    return nrowlevels * ncollevels * nrow * ncol;
+  }
+  
+  
+  /** Returns min and max for rows [row_begin,row_end) and columns
+   [col_begin,col_end).  Ranges must be non-empty and within the table.
+   */
+  std::pair<float,float> minMax( const size_t row_begin, const size_t row_end,
+                                 const size_t col_begin, const size_t col_end ) const
+  {
+    const size_t rl = floor_log2( row_end - row_begin );
+    const size_t cl = floor_log2( col_end - col_begin );
+    const size_t row2 = row_end - (size_t(1) << rl);
+    const size_t col2 = col_end - (size_t(1) << cl);
+    
+    const size_t a = entry( rl, cl, row_begin, col_begin );
+    const size_t b = entry( rl, cl, row_begin, col2 );
+    const size_t c = entry( rl, cl, row2, col_begin );
+    const size_t d = entry( rl, cl, row2, col2 );
+    
+    return std::pair<float,float>(
+                std::min( std::min(m_min[a], m_min[b]), std::min(m_min[c], m_min[d]) ),
+                std::max( std::max(m_max[a], m_max[b]), std::max(m_max[c], m_max[d]) ) );
+  }//minMax(...)
+  
+protected:
+  size_t entry( const size_t rowlevel, const size_t collevel,
+                const size_t row, const size_t col ) const
+  {
+    return ((rowlevel*m_ncollevels + collevel)*m_nrow + row)*m_ncol + col;
+  }
+  
+  const size_t m_nrow;
+  const size_t m_ncol;
+  const size_t m_nrowlevels;
+  const size_t m_ncollevels;
+  vector<float> m_min;
+  vector<float> m_max;
+};//class CountsRangeTable
+
 
 SearchMode3DDataModel::SearchMode3DDataModel( WObject *parent )
   : WAbstractTableModel( parent ),
   m_minCounts( 0.0f ),
   m_maxCounts( 0.0f ),
   m_maxNumChannels( 128 ),
-  m_maxNumSamples( 60 )
+  m_maxNumSamples( 256 ),
+  m_windowStart( 0.0f ),
+  m_windowEnd( 0.0f ),
+  m_totalTime( 0.0f ),
+  m_pyramidBuildNumber( 0 ),
+  m_dataUpdated( this )
 {
 }
 
@@ -125,8 +475,8 @@ float SearchMode3DDataModel::minCounts() const { return m_minCounts; }
 float SearchMode3DDataModel::maxCounts() const { return m_maxCounts; }
 float SearchMode3DDataModel::minEnergy() const { return (m_energies.empty() ? 0.0f : m_energies[0]); }
 float SearchMode3DDataModel::maxEnergy() const { return (m_energies.empty() ? 1.0f : m_energies.back()); }
-float SearchMode3DDataModel::minTime() const { return (m_times.empty() ? 0.0f : m_times[0]); }
-float SearchMode3DDataModel::maxTime() const { return (m_times.empty() ? 1.0f : m_times.back()); }
+float SearchMode3DDataModel::minTime() const { return 0.0f; }
+float SearchMode3DDataModel::maxTime() const { return ((m_times.empty() || m_totalTime <= 0.0f) ? 1.0f : m_totalTime); }
 int SearchMode3DDataModel::maxNumTimeSamples() const { return m_maxNumSamples; }
 int SearchMode3DDataModel::maxNumEnergyChannels() const { return m_maxNumChannels; }
 
@@ -165,9 +515,20 @@ std::pair<float,float> SearchMode3DDataModel::minMaxCounts( const float time_min
   
   answer.first = FLT_MAX;
   answer.second = -FLT_MAX;
-  for( size_t sample = start_time_index; sample < end_time_index && sample < num_samples; ++sample )
+  
+  const size_t end_sample = std::min( end_time_index, num_samples );
+  const size_t end_channel = std::min( end_energy_index, num_energies );
+  
+  if( start_time_index >= end_sample || start_energy_index >= end_channel )
+    return answer;
+  
+  if( m_countsRange )
+    return m_countsRange->minMax( start_time_index, end_sample,
+                                  start_energy_index, end_channel );
+  
+  for( size_t sample = start_time_index; sample < end_sample; ++sample )
   {
-    for( size_t channel = start_energy_index; channel < end_energy_index && channel < num_energies; ++channel )
+    for( size_t channel = start_energy_index; channel < end_channel; ++channel )
     {
       const float value = m_counts[sample][channel];
       answer.first = std::min( answer.first, value );
@@ -197,13 +558,40 @@ void SearchMode3DDataModel::setMaxNumEnergyChannels( const int num )
 }
 
 
-void SearchMode3DDataModel::update( InterSpec *viewer )
+bool SearchMode3DDataModel::setTimeWindow( const float minTime, const float maxTime )
 {
-  //If the model currently contains any data, we will remove it, and notify any
-  //  views that may be using the model.  Then if there is data to display
-  //  we will add it to the model and notify the views of the newly available
-  //  data.
+  if( minTime == m_windowStart && maxTime == m_windowEnd )
+    return false;
+  
+  m_windowStart = minTime;
+  m_windowEnd = maxTime;
+  
+  if( !m_pyramid || !m_pyramid->m_valid )
+    return false;
+  
+  clearData();
+  
+  try
+  {
+    fillFromPyramid();
+  }catch( std::exception &e )
+  {
+    cerr << "SearchMode3DDataModel::setTimeWindow() caught: " << e.what() << endl;
+    return false;
+  }
   
+  return true;
+}//bool setTimeWindow(...)
+
+
+Wt::Signal<> &SearchMode3DDataModel::dataUpdated()
+{
+  return m_dataUpdated;
+}
+
+
+void SearchMode3DDataModel::clearData()
+{
   const int nrow = rowCount();
   const int ncol = columnCount();
   
@@ -226,146 +614,242 @@ void SearchMode3DDataModel::update( InterSpec *viewer )
     boost::multi_array<float, 2>::extent_gen extents;
     m_counts.resize( extents[0][0] );
   }
-    
+  
+  m_countsRange.reset();
   m_minCounts = 0.0f;
   m_maxCounts = 1.0f;
-    
-    
+}//void clearData()
+
+
+void SearchMode3DDataModel::update( InterSpec *viewer )
+{
+  //If the model currently contains any data, we will remove it, and notify any
+  //  views that may be using the model.  Then if there is data to display
+  //  we will add it to the model and notify the views of the newly available
+  //  data.
+  clearData();
+  
   std::shared_ptr<const SpecMeas> meas = viewer->measurment( kForeground );
   const set<int> displayed_detectors = viewer->displayedDetectorNumbers();
   const vector<bool> det_to_use = viewer->detectors_to_display();
-  const set<int> sample_numbers = meas->sample_numbers();
-  const vector<int> sample_numbers_vec( sample_numbers.begin(), sample_numbers.end() );
-    
-  //foreground_samples: samples the user has summed to display the spectrum of
-  //    const set<int> foreground_samples = viewer->displayedSamples( kForeground );
+  
   try
   {
-    if( !meas || sample_numbers.empty() || displayed_detectors.empty() )
+    if( !meas )
+      throw runtime_error( "No data to display" );
+    
+    const set<int> sample_numbers = meas->sample_numbers();
+    const vector<int> sample_numbers_vec( sample_numbers.begin(), sample_numbers.end() );
+    
+    if( sample_numbers.empty() || displayed_detectors.empty() )
       throw runtime_error( "No data to display" );
     
     const size_t binningIndex = meas->suggested_gamma_binning_index( sample_numbers, det_to_use );
-    std::shared_ptr<Measurement> binning = std::make_shared<Measurement>( *meas->measurements().at(binningIndex) );
+    std::shared_ptr<const Measurement> binning = meas->measurements().at(binningIndex);
     
-    if( binning->num_gamma_channels() < 4 )
+    if( !binning || binning->num_gamma_channels() < 4 )
       throw runtime_error( "Not enough gamma channels to plot" );
     
-    const size_t nsamples = sample_numbers.size();
-    size_t nenergies = binning->gamma_channel_contents()->size();
-    
-    while( nenergies > m_maxNumChannels )
-      nenergies /= 2;
-      
-    const size_t ncombine = binning->gamma_channel_contents()->size() / nenergies;
-      
-    if( ncombine > 1 )
+    if( m_pyramid && m_pyramid->sameSource( meas, sample_numbers_vec, det_to_use,
+                                            displayed_detectors, binning ) )
     {
-      cout << "Reducing channels to " << nenergies << " from "
-        << binning->gamma_channel_contents()->size() << endl;
-        
-        //The combine_gamma_channels() and truncate_gamma_channels() functions
-        //  are protected for the Measurment class, so we have to do a little
-        //  hack to get around this, by adding binning to a MeasurementInfo
-        //  object, and then calling these functions on that object.
-      MeasurementInfo temp;
-      temp.add_measurment( binning, true );
-        
-      const size_t nchannel = binning->gamma_channel_contents()->size();
-      if( (nchannel % ncombine) != 0 )
-        temp.truncate_gamma_channels( 0, ncombine*nenergies, nchannel, true );
-      temp.combine_gamma_channels( ncombine, nchannel );
+      fillFromPyramid();
+      return;
     }
-      
-    assert( binning->gamma_channel_contents()->size() == nenergies );
-      
-    m_minCounts = FLT_MAX;
-    m_maxCounts = 0.0f;
-    vector<float> newtimes;
-    vector<float> newenergies = (*binning->gamma_channel_energies());
-    if( binning->gamma_channel_energies()->size() == nenergies )
-      newenergies.push_back( 2.0f*newenergies[nenergies-1] - newenergies[nenergies-2] );
-      
-    assert( newenergies.size() >= (nenergies+1) );
-      
-    boost::multi_array<float, 2>::extent_gen extentgen;
-    m_counts.resize( extentgen[nsamples][nenergies] );
-      
-    int samplen = 0;
-    double cumulativeRealTime = 0.0;
     
-    size_t sampleNumDelta = 1;
-    //while loop inefficient, but whatever
-    while( (sample_numbers_vec.size()/sampleNumDelta) >= m_maxNumSamples )
-      ++sampleNumDelta;
+    //If we are already summing this data in the background, we'll just wait
+    //  for it to finish.
+    if( m_pendingPyramid && m_pendingPyramid->sameSource( meas, sample_numbers_vec,
+                                            det_to_use, displayed_detectors, binning ) )
+      return;
+    
+    m_pyramid.reset();
+    m_pendingPyramid.reset();
+    ++m_pyramidBuildNumber;
+    
+    auto pyramid = std::make_shared<TimeEnergyPyramid>( meas, sample_numbers_vec,
+                                        det_to_use, displayed_detectors, binning );
     
-    //Think of case where m_maxNumSamples==20, and sample_numbers_vec.size()==100,
-    // then sampleNumDelta will be 6, but we want 5.
-    if( sampleNumDelta > 1 && ((sample_numbers_vec.size()%sampleNumDelta)==0) )
-      --sampleNumDelta;
+    WApplication *app = WApplication::instance();
     
-    const size_t numSampleNums = sample_numbers_vec.size();
-    for( size_t sampleNumIndex = 0; sampleNumIndex < numSampleNums; sampleNumIndex += sampleNumDelta )
+    if( !app || pyramid->numCells() <= sm_maxSynchronousCells )
     {
-      set<int> thissamplenum;
-        
-      //Kevin: note that the last displayed time period may not have as many
-      //  samples as the other time periods if (sample_numbers.size() % m_maxNumSamples) != 0
-      for( int i = 0; (i < sampleNumDelta) && ((sampleNumIndex+i) < numSampleNums); ++i )
-        thissamplenum.insert( sample_numbers_vec[sampleNumIndex + i] );
-      
-      float realtime = FLT_MAX;
-      for( const int detnum : displayed_detectors )
+      pyramid->build();
+      m_pyramid = pyramid;
+      fillFromPyramid();
+      return;
+    }//if( small enough to do right now )
+    
+    //Sum the file in the background, and then fill out the model once done.
+    m_pendingPyramid = pyramid;
+    const string sessionid = app->sessionId();
+    boost::function<void(void)> donefcn = app->bind( boost::bind(
+                                      &SearchMode3DDataModel::pyramidBuilt,
+                                      this, pyramid, m_pyramidBuildNumber ) );
+    
+    ComputeScheduler::instance().post( sessionid, [pyramid, donefcn, sessionid](){
+      try
       {
-        for( const int samplenum : thissamplenum )
-        {
-          MeasurementConstShrdPtr m = meas->measurement( samplenum, detnum );
-          if( m )
-            realtime = std::min( realtime, m->real_time() );
-        }//for( const int samplenum : thissamplenum )
-      }//for( const int detnum : displayed_detectors )
-        
-      if( realtime > 1.0E+6f )
-        realtime = 0.0f;
-        
-      std::shared_ptr<const Measurement> summed
-                = meas->sum_measurements( thissamplenum, det_to_use, binning );
-        
-      if( !summed || !summed->gamma_channel_contents()
-          || summed->gamma_channel_contents()->size() != nenergies )
-        throw runtime_error( "Summing results have unexpected issues" );
-        
-      const vector<float> &counts = *summed->gamma_channel_contents();
-      for( size_t i = 0; i < nenergies; ++i )
+        pyramid->build();
+      }catch( std::exception &e )
       {
-        m_minCounts = std::min( m_minCounts, counts[i] );
-        m_maxCounts = std::max( m_maxCounts, counts[i] );
-        
-        //Kevin: note that we are displaying detected counts, since the real-time of each sample may not be the same, you might want to display counts per second.
-        m_counts[samplen][i] = counts[i];
+        cerr << "SearchMode3DDataModel: error building pyramid: " << e.what() << endl;
       }
-      newtimes.push_back( cumulativeRealTime );
-        
-      ++samplen;
-      cumulativeRealTime += realtime;
-    }//for( const int samplenum : sample_numbers )
-      
-    newtimes.push_back( cumulativeRealTime );
-    
-    if( (newenergies.size() > 1) && (newtimes.size() > 1) )  //probably always true
-    {
-      beginInsertColumns( WModelIndex(), 0, int(2*newenergies.size()+1) );
-      beginInsertRows( WModelIndex(), 0, int(2*newtimes.size()+1) );
       
-      m_times = newtimes;
-      m_energies = newenergies;
-  
-      endInsertRows();
-      endInsertColumns();
-    }//if( newenergies.size() && newtimes.size() )
+      WServer::instance()->post( sessionid, donefcn );
+    }, ComputeScheduler::Priority::Normal );
   }catch( std::exception &e )
   {
-      cerr << "SearchMode3DDataModel::update() caught: " << e.what() << endl;
+    cerr << "SearchMode3DDataModel::update() caught: " << e.what() << endl;
   }
 }//void update( InterSpec *viewer )
 
 
+void SearchMode3DDataModel::pyramidBuilt( std::shared_ptr<TimeEnergyPyramid> pyramid,
+                                          const int buildNumber )
+{
+  if( buildNumber != m_pyramidBuildNumber )
+    return;
+  
+  m_pendingPyramid.reset();
+  
+  if( !pyramid || !pyramid->m_valid )
+    return;
+  
+  m_pyramid = pyramid;
+  
+  if( rowCount() || columnCount() )  //shouldnt happen
+    return;
+  
+  try
+  {
+    fillFromPyramid();
+  }catch( std::exception &e )
+  {
+    cerr << "SearchMode3DDataModel::pyramidBuilt() caught: " << e.what() << endl;
+    return;
+  }
+  
+  m_dataUpdated.emit();
+  
+  if( wApp )
+    wApp->triggerUpdate();
+}//void pyramidBuilt(...)
+
+
+void SearchMode3DDataModel::fillFromPyramid()
+{
+  if( !m_pyramid || !m_pyramid->m_valid )
+    throw runtime_error( "No data to display" );
+  
+  const TimeEnergyPyramid &pyramid = *m_pyramid;
+  
+  const size_t numSampleNums = pyramid.m_sampleNumbers.size();
+  const size_t norigchannels = pyramid.m_numOrigChannels;
+  const size_t nbase = pyramid.m_numChannels;
+  const size_t bc = pyramid.m_baseCombine;
+  
+  size_t nenergies = norigchannels;
+  while( nenergies > m_maxNumChannels )
+    nenergies /= 2;
+  
+  //The number of the pyramids channels to combine for each displayed channel;
+  //  the pyramid may have already combined some channels together for very
+  //  large files.
+  const size_t ncombine = norigchannels / nenergies;
+  const size_t step = std::max( (ncombine + bc - 1) / bc, size_t(1) );
+  nenergies = std::min( nenergies, nbase / step );
+  
+  if( nenergies < 2 )
+    throw runtime_error( "Not enough gamma channels to plot" );
+  
+  vector<float> newenergies( nenergies + 1 );
+  for( size_t i = 0; i <= nenergies; ++i )
+    newenergies[i] = pyramid.m_energies[i*step];
+  
+  //Start time of each sample (and the end time of the last one), so we can find
+  //  the samples within the time window.
+  vector<double> startTimes( numSampleNums + 1, 0.0 );
+  for( size_t sample = 0; sample < numSampleNums; ++sample )
+    startTimes[sample+1] = startTimes[sample] + pyramid.m_realTimes[sample];
+  m_totalTime = static_cast<float>( startTimes.back() );
+  
+  size_t firstSample = 0, endSample = numSampleNums;
+  if( m_windowEnd > m_windowStart && m_totalTime > 0.0f )
+  {
+    //First sample ending after the window starts, through the last sample
+    //  starting before the window ends.
+    const auto firstpos = std::upper_bound( begin(startTimes) + 1, end(startTimes),
+                                            static_cast<double>(m_windowStart) );
+    const auto endpos = std::lower_bound( begin(startTimes), end(startTimes) - 1,
+                                          static_cast<double>(m_windowEnd) );
+    firstSample = std::min( static_cast<size_t>(firstpos - begin(startTimes)) - 1,
+                            numSampleNums - 1 );
+    endSample = std::max( static_cast<size_t>(endpos - begin(startTimes)), firstSample + 1 );
+  }//if( only display part of the file )
+  
+  const size_t numWindowSamples = endSample - firstSample;
+  
+  size_t sampleNumDelta = 1;
+  //while loop inefficient, but whatever
+  while( (numWindowSamples/sampleNumDelta) >= m_maxNumSamples )
+    ++sampleNumDelta;
+  
+  //Think of case where m_maxNumSamples==20, and sample_numbers_vec.size()==100,
+  // then sampleNumDelta will be 6, but we want 5.
+  if( sampleNumDelta > 1 && ((numWindowSamples%sampleNumDelta)==0) )
+    --sampleNumDelta;
+  
+  const size_t nsamples = (numWindowSamples + sampleNumDelta - 1) / sampleNumDelta;
+  
+  boost::multi_array<float, 2>::extent_gen extentgen;
+  m_counts.resize( extentgen[nsamples][nenergies] );
+  
+  m_minCounts = FLT_MAX;
+  m_maxCounts = 0.0f;
+  
+  vector<float> newtimes;
+  double cumulativeRealTime = startTimes[firstSample];
+  
+  for( size_t samplen = 0; samplen < nsamples; ++samplen )
+  {
+    //Kevin: note that the last displayed time period may not have as many
+    //  samples as the other time periods if (sample_numbers.size() % m_maxNumSamples) != 0
+    const size_t sample_begin = firstSample + samplen * sampleNumDelta;
+    const size_t sample_end = std::min( sample_begin + sampleNumDelta, endSample );
+    
+    for( size_t i = 0; i < nenergies; ++i )
+    {
+      const float counts = static_cast<float>( pyramid.sum( sample_begin, sample_end,
+                                                           i*step, (i+1)*step ) );
+      m_minCounts = std::min( m_minCounts, counts );
+      m_maxCounts = std::max( m_maxCounts, counts );
+      
+      //Kevin: note that we are displaying detected counts, since the real-time of each sample may not be the same, you might want to display counts per second.
+      m_counts[samplen][i] = counts;
+    }
+    
+    newtimes.push_back( cumulativeRealTime );
+    for( size_t sample = sample_begin; sample < sample_end; ++sample )
+      cumulativeRealTime += pyramid.m_realTimes[sample];
+  }//for( size_t samplen = 0; samplen < nsamples; ++samplen )
+  
+  newtimes.push_back( cumulativeRealTime );
+  
+  if( CountsRangeTable::numEntries( nsamples, nenergies ) <= sm_maxRangeTableEntries )
+    m_countsRange = std::make_shared<CountsRangeTable>( m_counts );
+  else
+    m_countsRange.reset();
+  
+  if( (newenergies.size() > 1) && (newtimes.size() > 1) )  //probably always true
+  {
+    beginInsertColumns( WModelIndex(), 0, int(2*newenergies.size()+1) );
+    beginInsertRows( WModelIndex(), 0, int(2*newtimes.size()+1) );
+    
+    m_times = newtimes;
+    m_energies = newenergies;
+    
+    endInsertRows();
+    endInsertColumns();
+  }//if( newenergies.size() && newtimes.size() )
+}//void fillFromPyramid()
@@ -80,6 +80,8 @@
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/PopupDiv.h"
+#include "InterSpec/Tracing.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/ColorTheme.h"
@@ -7313,6 +7315,9 @@ void ShieldingSourceDisplay::doModelFittingWork( const std::string wtsession,
                                           std::shared_ptr<ModelFitResults> results,
                                           boost::function<void()> update_fcn )
 {
+  INTERSPEC_TRACE_SESSION( wtsession );
+  INTERSPEC_TRACE_SPAN( "ShieldingSourceDisplay::doModelFittingWork" );
+  
   //The self attenuating probing questions are not tested.
   
   assert( results );
@@ -7618,9 +7623,10 @@ void ShieldingSourceDisplay::startModelFit()
   
   
   const string sessionid = wApp->sessionId();
-  Wt::WServer *server = Wt::WServer::instance();
-  server->ioService().post( boost::bind( &ShieldingSourceDisplay::doModelFittingWork,
-                            this, sessionid, inputPrams, progress, progress_updater, results, gui_updater ) );
+  ComputeScheduler::instance().post( sessionid,
+                          boost::bind( &ShieldingSourceDisplay::doModelFittingWork,
+                            this, sessionid, inputPrams, progress, progress_updater, results, gui_updater ),
+                          ComputeScheduler::Priority::Normal );
 }//void startModelFit()
 
 
@@ -73,6 +73,7 @@
 #include "InterSpec/SpecFileQuery.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "InterSpec/RowStretchTreeView.h"
@@ -2502,7 +2503,8 @@ void SpecFileQueryWidget::doSearch( const std::string basedir,
     const int nfile_at_a_time = SpecUtilsAsync::num_physical_cpu_cores();
 #endif
     
-    SpecUtilsAsync::ThreadPool pool;
+    //Ran from the WIOService, so specify the session the work is for.
+    ComputeScheduler::TaskGroup pool( sessionid, ComputeScheduler::Priority::Normal );
     
 #if( USE_DIRECTORY_ITERATOR_METHOD )
     size_t ncheckssubmitted = 0;
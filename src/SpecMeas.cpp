@@ -23,13 +23,18 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <cmath>
 #include <deque>
 #include <memory>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <iterator>
 #include <algorithm>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include "external_libs/SpecUtils/3rdparty/rapidxml/rapidxml.hpp"
 #include "external_libs/SpecUtils/3rdparty/rapidxml/rapidxml_utils.hpp"
 #include "external_libs/SpecUtils/3rdparty/rapidxml/rapidxml_print.hpp"
@@ -108,6 +113,220 @@ namespace
       clone_node_deep( child, cloned_child );
     }
   }//clone_node_deep(...)
+  
+  
+  //Helpers for SpecMeas::write_2012_N42_streaming(...)
+  
+  /** Appends 'str' to 'out', escaping the XML special characters. */
+  void append_xml_escaped( std::string &out, const std::string &str )
+  {
+    for( const char c : str )
+    {
+      switch( c )
+      {
+        case '&':  out += "&amp;";  break;
+        case '<':  out += "&lt;";   break;
+        case '>':  out += "&gt;";   break;
+        case '"':  out += "&quot;"; break;
+        case '\'': out += "&apos;"; break;
+        default:   out += c;        break;
+      }//switch( c )
+    }//for( const char c : str )
+  }//append_xml_escaped(...)
+  
+  
+  /** Appends 'value' to 'out'; integral values (by far the most common for
+      channel counts) are formatted by hand, and others with just enough
+      digits to be read back to the same float.
+   */
+  void append_float( std::string &out, const float value )
+  {
+    if( value == std::floor(value) && std::fabs(value) < 1.0E9f )
+    {
+      char buffer[16];
+      char *end = buffer + sizeof(buffer);
+      char *pos = end;
+      long long ival = static_cast<long long>( value );
+      const bool negative = (ival < 0);
+      if( negative )
+        ival = -ival;
+      do
+      {
+        *(--pos) = static_cast<char>( '0' + (ival % 10) );
+        ival /= 10;
+      }while( ival );
+      if( negative )
+        *(--pos) = '-';
+      out.append( pos, end );
+      return;
+    }//if( an integer value )
+    
+    char buffer[32];
+    const int nchar = snprintf( buffer, sizeof(buffer), "%.9g", value );
+    out.append( buffer, static_cast<size_t>(std::max(nchar,0)) );
+  }//append_float(...)
+  
+  
+  /** Appends an N42 2012 duration (e.g., "PT299.98S"). */
+  void append_duration( std::string &out, const float seconds )
+  {
+    out += "PT";
+    append_float( out, seconds );
+    out += "S";
+  }//append_duration(...)
+  
+  
+  /** Appends channel counts using the N42 "CountedZeroes" compression, where
+      each run of zeros is written as a zero followed by the run length.
+   */
+  void append_counted_zeros( std::string &out, const std::vector<float> &counts )
+  {
+    const size_t nchannel = counts.size();
+    for( size_t i = 0; i < nchannel; )
+    {
+      if( i )
+        out += ' ';
+      
+      if( counts[i] == 0.0f )
+      {
+        size_t nzero = 0;
+        while( (i+nzero) < nchannel && counts[i+nzero] == 0.0f )
+          ++nzero;
+        out += "0 ";
+        append_float( out, static_cast<float>(nzero) );
+        i += nzero;
+      }else
+      {
+        append_float( out, counts[i] );
+        ++i;
+      }
+    }//for( size_t i = 0; i < nchannel; )
+  }//append_counted_zeros(...)
+  
+  
+  /** Appends a space separated list of values. */
+  void append_float_list( std::string &out, const std::vector<float> &values )
+  {
+    for( size_t i = 0; i < values.size(); ++i )
+    {
+      if( i )
+        out += ' ';
+      append_float( out, values[i] );
+    }
+  }//append_float_list(...)
+  
+  
+  /** Returns if 'name' can be used as an XML ID (and hence reference) without
+      modification, so it is read back unchanged.
+   */
+  bool is_valid_xml_id( const std::string &name )
+  {
+    if( name.empty() || !(isalpha(name[0]) || name[0]=='_') )
+      return false;
+    for( const char c : name )
+    {
+      if( !(isalnum(c) || c=='_' || c=='-' || c=='.') )
+        return false;
+    }
+    return true;
+  }//is_valid_xml_id(...)
+  
+  
+  const char *n42_2012_class_code( const Measurement::SourceType type )
+  {
+    switch( type )
+    {
+      case Measurement::IntrinsicActivity: return "IntrinsicActivity";
+      case Measurement::Calibration:       return "Calibration";
+      case Measurement::Background:        return "Background";
+      case Measurement::Foreground:        return "Foreground";
+      case Measurement::UnknownSourceType: break;
+    }//switch( type )
+    
+    return "NotSpecified";
+  }//n42_2012_class_code(...)
+  
+  
+  //ChannelOverlapWeights: for rebinning from one energy binning to another,
+  //  the fraction of each original channel that falls within each new
+  //  channel, stored as a sparse matrix (compressed by new channel); counts
+  //  are taken to be uniformly distributed within each original channel, and
+  //  the upper edge of the last channel of a binning is extrapolated from the
+  //  width of the channel before it, as rebin_by_lower_edge(...) does.
+  //  Only channels that overlap have an entry, so the matrix has about
+  //  (number of original channels + number of new channels) entries.
+  struct ChannelOverlapWeights
+  {
+    //Entries for new channel i are [rowStart[i], rowStart[i+1]).
+    vector<size_t> rowStart;
+    vector<size_t> oldChannel;
+    vector<float> fraction;
+    
+    ChannelOverlapWeights( const vector<float> &oldEdges, const vector<float> &newEdges )
+    {
+      const size_t nold = oldEdges.size();
+      const size_t nnew = newEdges.size();
+      
+      rowStart.reserve( nnew + 1 );
+      rowStart.push_back( 0 );
+      oldChannel.reserve( nold + nnew );
+      fraction.reserve( nold + nnew );
+      
+      if( nold < 2 || nnew < 2 )
+      {
+        rowStart.resize( nnew + 1, 0 );
+        return;
+      }
+      
+      auto upperEdge = []( const vector<float> &edges, const size_t i ) -> double {
+        return (i+1 < edges.size()) ? edges[i+1] : (2.0*edges[i] - edges[i-1]);
+      };
+      
+      size_t first = 0;  //first original channel that may overlap the new one
+      for( size_t i = 0; i < nnew; ++i )
+      {
+        const double lower = newEdges[i];
+        const double upper = upperEdge( newEdges, i );
+        
+        while( first < nold && upperEdge( oldEdges, first ) <= lower )
+          ++first;
+        
+        for( size_t j = first; j < nold && oldEdges[j] < upper; ++j )
+        {
+          const double oldlower = oldEdges[j];
+          const double oldupper = upperEdge( oldEdges, j );
+          const double width = oldupper - oldlower;
+          const double overlap = std::min( upper, oldupper ) - std::max( lower, oldlower );
+          if( width > 0.0 && overlap > 0.0 )
+          {
+            oldChannel.push_back( j );
+            fraction.push_back( static_cast<float>( overlap / width ) );
+          }
+        }//for( loop over overlapping original channels )
+        
+        rowStart.push_back( oldChannel.size() );
+      }//for( size_t i = 0; i < nnew; ++i )
+    }//ChannelOverlapWeights constructor
+    
+    
+    std::shared_ptr<vector<float>> apply( const vector<float> &counts ) const
+    {
+      const size_t nnew = rowStart.size() - 1;
+      auto answer = std::make_shared<vector<float>>( nnew, 0.0f );
+      for( size_t i = 0; i < nnew; ++i )
+      {
+        double sum = 0.0;
+        for( size_t entry = rowStart[i]; entry < rowStart[i+1]; ++entry )
+        {
+          if( oldChannel[entry] < counts.size() )
+            sum += fraction[entry] * counts[oldChannel[entry]];
+        }
+        (*answer)[i] = static_cast<float>( sum );
+      }//for( size_t i = 0; i < nnew; ++i )
+      
+      return answer;
+    }//apply(...)
+  };//struct ChannelOverlapWeights
 
 }//namespace
 
@@ -507,7 +726,30 @@ bool SpecMeas::save2012N42File( const std::string &filename )
   ofstream ofs( filename.c_str(), ios::binary|ios::out );
 #endif
 
-  return ofs.is_open() && write_2012_N42( ofs );
+  if( !ofs.is_open() || !write_2012_N42_streaming( ofs ) )
+    return false;
+  
+#if( PERFORM_DEVELOPER_CHECKS )
+  ofs.close();
+  
+  SpecMeas reloaded;
+  if( !reloaded.load_N42_file( filename ) )
+  {
+    log_developer_error( BOOST_CURRENT_FUNCTION, ("Failed to read back N42 file '" + filename + "'").c_str() );
+  }else
+  {
+    try
+    {
+      equalEnough( *this, reloaded );
+    }catch( std::exception &e )
+    {
+      const string msg = "Written N42 file '" + filename + "' differs from original: " + e.what();
+      log_developer_error( BOOST_CURRENT_FUNCTION, msg.c_str() );
+    }
+  }//if( could reload ) / else
+#endif
+  
+  return true;
 }//bool save2012N42File( const std::string &filename );
 
 
@@ -1155,6 +1397,409 @@ std::shared_ptr< ::rapidxml::xml_document<char> > SpecMeas::create_2012_N42_xml(
 }//create_2012_N42_xml() const
 
 
+bool SpecMeas::canWrite2012N42Streaming() const
+{
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  //Any information compared by MeasurementInfo::equalEnough(...) that
+  //  write_2012_N42_streaming(...) doesnt write must cause us to use the XML
+  //  document based writer.
+  if( detectors_analysis() )
+    return false;
+  
+  const std::vector< std::shared_ptr<const Measurement> > &meass = measurements();
+  
+  std::map<int, std::vector<std::shared_ptr<const Measurement>> > samples;
+  std::map<std::string,std::string> detector_descriptions;
+  
+  for( const std::shared_ptr<const Measurement> &m : meass )
+  {
+    if( !m )
+      continue;
+    
+    if( !is_valid_xml_id( m->detector_name() )
+        || m->energy_calibration_model() == Measurement::FullRangeFraction )
+      return false;
+    
+    //The detector description is written once per detector.
+    const auto descpos = detector_descriptions.insert( std::make_pair(m->detector_name(), m->detector_type()) ).first;
+    if( descpos->second != m->detector_type() )
+      return false;
+    
+    //Start time, real time, source type, occupancy, speed, and GPS are
+    //  written once per sample.
+    std::vector<std::shared_ptr<const Measurement>> &sample = samples[m->sample_number()];
+    for( const std::shared_ptr<const Measurement> &other : sample )
+    {
+      if( (other->detector_name() == m->detector_name())
+          || (other->real_time() != m->real_time())
+          || (other->start_time() != m->start_time())
+          || (other->source_type() != m->source_type())
+          || (other->occupied() != m->occupied())
+          || (other->speed() != m->speed())
+          || (other->has_gps_info() != m->has_gps_info())
+          || (m->has_gps_info() && ((other->latitude() != m->latitude())
+                                    || (other->longitude() != m->longitude())
+                                    || (other->position_time() != m->position_time()))) )
+        return false;
+    }//for( loop over other measurements of this sample )
+    
+    sample.push_back( m );
+  }//for( loop over measurements )
+  
+  return true;
+}//bool canWrite2012N42Streaming() const
+
+
+bool SpecMeas::write_2012_N42_streaming( std::ostream &ostr ) const
+{
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  if( !canWrite2012N42Streaming() )
+    return write_2012_N42( ostr );
+  
+  const std::vector< std::shared_ptr<const Measurement> > &meass = measurements();
+  
+  std::map<int, std::vector<std::shared_ptr<const Measurement>> > samples;
+  for( const std::shared_ptr<const Measurement> &m : meass )
+  {
+    if( m )
+      samples[m->sample_number()].push_back( m );
+  }
+  
+  //Figure out unique energy calibrations and detectors
+  std::map<std::string,std::string> calibration_ids;  //key to ID
+  std::map<std::shared_ptr<const Measurement>,std::string> meas_calibration_ids;
+  std::vector<std::string> calibration_xml;
+  std::vector<std::string> gamma_detectors, neutron_detectors;
+  std::set<std::string> detector_names_set;
+  std::map<std::string,std::string> detector_descriptions;
+  
+  for( const std::shared_ptr<const Measurement> &m : meass )
+  {
+    if( !m )
+      continue;
+    
+    const std::shared_ptr<const std::vector<float>> &counts = m->gamma_counts();
+    const bool has_gamma = (counts && !counts->empty());
+    const std::string neutname = has_gamma ? (m->detector_name() + "N") : m->detector_name();
+    
+    if( !m->detector_type().empty() )
+    {
+      detector_descriptions[m->detector_name()] = m->detector_type();
+      detector_descriptions[neutname] = m->detector_type();
+    }
+    
+    if( has_gamma && !detector_names_set.count(m->detector_name()) )
+    {
+      gamma_detectors.push_back( m->detector_name() );
+      detector_names_set.insert( m->detector_name() );
+    }
+    
+    if( m->contained_neutron()
+        && std::find(neutron_detectors.begin(), neutron_detectors.end(), neutname) == neutron_detectors.end() )
+      neutron_detectors.push_back( neutname );
+    
+    if( !has_gamma )
+      continue;
+    
+    std::string xml;
+    const std::shared_ptr<const std::vector<float>> &energies = m->channel_energies();
+    switch( m->energy_calibration_model() )
+    {
+      case Measurement::Polynomial:
+      case Measurement::UnspecifiedUsingDefaultPolynomial:
+        xml += "<CoefficientValues>";
+        append_float_list( xml, m->calibration_coeffs() );
+        xml += "</CoefficientValues>";
+        break;
+        
+      case Measurement::LowerChannelEdge:
+        if( energies && !energies->empty() )
+        {
+          xml += "<EnergyBoundaryValues>";
+          append_float_list( xml, *energies );
+          xml += "</EnergyBoundaryValues>";
+        }
+        break;
+        
+      case Measurement::FullRangeFraction:
+      case Measurement::InvalidEquationType:
+        break;
+    }//switch( m->energy_calibration_model() )
+    
+    if( xml.empty() )
+      continue;
+    
+    const std::vector<std::pair<float,float>> &devpairs = m->deviation_pairs();
+    if( !devpairs.empty() )
+    {
+      std::vector<float> dev_energies, dev_offsets;
+      for( const std::pair<float,float> &p : devpairs )
+      {
+        dev_energies.push_back( p.first );
+        dev_offsets.push_back( p.second );
+      }
+      xml += "<EnergyValues>";
+      append_float_list( xml, dev_energies );
+      xml += "</EnergyValues><EnergyDeviationValues>";
+      append_float_list( xml, dev_offsets );
+      xml += "</EnergyDeviationValues>";
+    }//if( !devpairs.empty() )
+    
+    const std::string key = std::to_string( counts->size() ) + xml;
+    std::map<std::string,std::string>::const_iterator pos = calibration_ids.find( key );
+    if( pos == calibration_ids.end() )
+    {
+      const std::string id = "EnergyCal" + std::to_string( calibration_ids.size() + 1 );
+      pos = calibration_ids.insert( std::make_pair(key, id) ).first;
+      calibration_xml.push_back( "  <EnergyCalibration id=\"" + id + "\">" + xml + "</EnergyCalibration>\n" );
+    }
+    meas_calibration_ids[m] = pos->second;
+  }//for( const std::shared_ptr<const Measurement> &m : meass )
+  
+  //Now write things out
+  std::string buffer;
+  buffer.reserve( 64*1024 );
+  
+  buffer += "<?xml version=\"1.0\"?>\n"
+            "<RadInstrumentData xmlns=\"http://physics.nist.gov/N42/2011/N42\""
+            " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+            " xsi:schemaLocation=\"http://physics.nist.gov/N42/2011/N42 http://physics.nist.gov/N42/2011/n42.xsd\""
+            " xmlns:DHS=\"http://www.dhs.gov\""
+            " xmlns:InterSpec=\"https://github.com/sandialabs/InterSpec\"";
+  if( !uuid().empty() )
+  {
+    buffer += " n42DocUUID=\"";
+    append_xml_escaped( buffer, uuid() );
+    buffer += "\"";
+  }
+  buffer += ">\n  <RadInstrumentDataCreatorName>InterSpec</RadInstrumentDataCreatorName>\n";
+  
+  for( const std::string &remark : remarks() )
+  {
+    buffer += "  <Remark>";
+    append_xml_escaped( buffer, remark );
+    buffer += "</Remark>\n";
+  }
+  
+  buffer += "  <RadInstrumentInformation id=\"InstInfo1\">\n";
+  const std::pair<const char *,std::string> instinfo[] = {
+    { "RadInstrumentManufacturerName", manufacturer() },
+    { "RadInstrumentIdentifier", instrument_id() },
+    { "RadInstrumentModelName", instrument_model() },
+    { "RadInstrumentClassCode", (instrument_type().empty() ? string("Other") : instrument_type()) }
+  };
+  for( const std::pair<const char *,std::string> &info : instinfo )
+  {
+    if( info.second.empty() )
+      continue;
+    buffer += string("    <") + info.first + ">";
+    append_xml_escaped( buffer, info.second );
+    buffer += string("</") + info.first + ">\n";
+  }
+  buffer += "    <RadInstrumentVersion>\n"
+            "      <RadInstrumentComponentName>Software</RadInstrumentComponentName>\n"
+            "      <RadInstrumentComponentVersion>InterSpec</RadInstrumentComponentVersion>\n"
+            "    </RadInstrumentVersion>\n";
+  
+  //Information without a place in the N42 2012 schema goes in the
+  //  instrument information extension element.
+  const std::string lane = (lane_number() >= 0) ? std::to_string( lane_number() ) : string();
+  const std::pair<const char *,std::string> extinfo[] = {
+    { "InterSpec:DetectorType", (detector_type() == DetectorType::kUnknownDetector)
+                                 ? string() : detectorTypeToString( detector_type() ) },
+    { "InterSpec:MeasurementOperator", measurment_operator() },
+    { "InterSpec:Inspection", inspection() },
+    { "InterSpec:LaneNumber", lane },
+    { "InterSpec:MeasurementLocationName", measurement_location_name() }
+  };
+  bool wrote_ext = false;
+  for( const std::pair<const char *,std::string> &info : extinfo )
+  {
+    if( info.second.empty() )
+      continue;
+    if( !wrote_ext )
+      buffer += "    <RadInstrumentInformationExtension>\n";
+    wrote_ext = true;
+    buffer += string("      <") + info.first + ">";
+    append_xml_escaped( buffer, info.second );
+    buffer += string("</") + info.first + ">\n";
+  }
+  if( wrote_ext )
+    buffer += "    </RadInstrumentInformationExtension>\n";
+  
+  buffer += "  </RadInstrumentInformation>\n";
+  
+  for( size_t i = 0; i < (gamma_detectors.size() + neutron_detectors.size()); ++i )
+  {
+    const bool is_gamma = (i < gamma_detectors.size());
+    const std::string &name = is_gamma ? gamma_detectors[i]
+                                       : neutron_detectors[i - gamma_detectors.size()];
+    buffer += "  <RadDetectorInformation id=\"" + name + "\">\n"
+              "    <RadDetectorCategoryCode>";
+    buffer += (is_gamma ? "Gamma" : "Neutron");
+    buffer += "</RadDetectorCategoryCode>\n"
+              "    <RadDetectorKindCode>Other</RadDetectorKindCode>\n";
+    
+    const auto descpos = detector_descriptions.find( name );
+    if( descpos != detector_descriptions.end() )
+    {
+      buffer += "    <RadDetectorDescription>";
+      append_xml_escaped( buffer, descpos->second );
+      buffer += "</RadDetectorDescription>\n";
+    }
+    
+    buffer += "  </RadDetectorInformation>\n";
+  }//for( loop over gamma, then neutron, detectors )
+  
+  for( const std::string &xml : calibration_xml )
+    buffer += xml;
+  
+  ostr.write( buffer.c_str(), buffer.size() );
+  
+  for( const auto &sample : samples )
+  {
+    const int samplenum = sample.first;
+    const std::vector<std::shared_ptr<const Measurement>> &sample_meas = sample.second;
+    const std::shared_ptr<const Measurement> &first = sample_meas.front();
+    const std::string sample_id = "Sample" + std::to_string( samplenum );
+    
+    buffer.clear();
+    buffer += "  <RadMeasurement id=\"" + sample_id + "\">\n    <MeasurementClassCode>";
+    buffer += n42_2012_class_code( first->source_type() );
+    buffer += "</MeasurementClassCode>\n";
+    
+    if( !first->start_time().is_special() )
+      buffer += "    <StartDateTime>"
+                + boost::posix_time::to_iso_extended_string( first->start_time() )
+                + "</StartDateTime>\n";
+    
+    buffer += "    <RealTimeDuration>";
+    append_duration( buffer, first->real_time() );
+    buffer += "</RealTimeDuration>\n";
+    
+    for( const std::shared_ptr<const Measurement> &m : sample_meas )
+    {
+      const std::shared_ptr<const std::vector<float>> &counts = m->gamma_counts();
+      if( !counts || counts->empty() )
+        continue;
+      
+      buffer += "    <Spectrum id=\"" + sample_id + m->detector_name() + "\""
+                " radDetectorInformationReference=\"" + m->detector_name() + "\"";
+      const auto calpos = meas_calibration_ids.find( m );
+      if( calpos != meas_calibration_ids.end() )
+        buffer += " energyCalibrationReference=\"" + calpos->second + "\"";
+      buffer += ">\n";
+      
+      if( !m->title().empty() )
+      {
+        buffer += "      <Remark>Title: ";
+        append_xml_escaped( buffer, m->title() );
+        buffer += "</Remark>\n";
+      }
+      
+      for( const std::string &remark : m->remarks() )
+      {
+        buffer += "      <Remark>";
+        append_xml_escaped( buffer, remark );
+        buffer += "</Remark>\n";
+      }
+      
+      buffer += "      <LiveTimeDuration>";
+      append_duration( buffer, m->live_time() );
+      buffer += "</LiveTimeDuration>\n      <ChannelData compressionCode=\"CountedZeroes\">";
+      append_counted_zeros( buffer, *counts );
+      buffer += "</ChannelData>\n    </Spectrum>\n";
+    }//for( const std::shared_ptr<const Measurement> &m : sample_meas )
+    
+    for( const std::shared_ptr<const Measurement> &m : sample_meas )
+    {
+      if( !m->contained_neutron() )
+        continue;
+      
+      const std::shared_ptr<const std::vector<float>> &counts = m->gamma_counts();
+      const bool has_gamma = (counts && !counts->empty());
+      const std::string neutname = has_gamma ? (m->detector_name() + "N") : m->detector_name();
+      
+      buffer += "    <GrossCounts id=\"" + sample_id + neutname + "Neutrons\""
+                " radDetectorInformationReference=\"" + neutname + "\">\n"
+                "      <LiveTimeDuration>";
+      append_duration( buffer, m->real_time() );
+      buffer += "</LiveTimeDuration>\n      <CountData>";
+      append_float_list( buffer, m->neutron_counts() );
+      buffer += "</CountData>\n    </GrossCounts>\n";
+    }//for( const std::shared_ptr<const Measurement> &m : sample_meas )
+    
+    //Position and speed are the same for every measurement of the sample.
+    if( first->has_gps_info() || (first->speed() != 0.0f) )
+    {
+      char value[64];
+      buffer += "    <RadInstrumentState radInstrumentInformationReference=\"InstInfo1\">\n"
+                "      <StateVector>\n";
+      if( first->has_gps_info() )
+      {
+        snprintf( value, sizeof(value), "%.10g", first->latitude() );
+        buffer += string("        <GeographicPoint>\n          <LatitudeValue>") + value;
+        snprintf( value, sizeof(value), "%.10g", first->longitude() );
+        buffer += string("</LatitudeValue>\n          <LongitudeValue>") + value
+                  + "</LongitudeValue>\n        </GeographicPoint>\n";
+      }//if( first->has_gps_info() )
+      
+      if( first->speed() != 0.0f )
+      {
+        buffer += "        <SpeedValue>";
+        append_float( buffer, first->speed() );
+        buffer += "</SpeedValue>\n";
+      }//if( first->speed() != 0.0f )
+      
+      buffer += "      </StateVector>\n";
+      
+      if( first->has_gps_info() && !first->position_time().is_special() )
+        buffer += "      <RadInstrumentStateExtension>\n"
+                  "        <InterSpec:PositionTime>"
+                  + boost::posix_time::to_iso_extended_string( first->position_time() )
+                  + "</InterSpec:PositionTime>\n"
+                  "      </RadInstrumentStateExtension>\n";
+      
+      buffer += "    </RadInstrumentState>\n";
+    }//if( position or speed to write )
+    
+    if( first->occupied() == Measurement::OccupancyStatus::Occupied )
+      buffer += "    <OccupancyIndicator>true</OccupancyIndicator>\n";
+    else if( first->occupied() == Measurement::OccupancyStatus::NotOccupied )
+      buffer += "    <OccupancyIndicator>false</OccupancyIndicator>\n";
+    
+    buffer += "  </RadMeasurement>\n";
+    
+    ostr.write( buffer.c_str(), buffer.size() );
+    if( !ostr )
+      return false;
+  }//for( const auto &sample : samples )
+  
+  //Write the InterSpec specific information (peaks, DRF, shielding/source
+  //  model, etc.) the same way create_2012_N42_xml() does, but in its own
+  //  (small) document.
+  {
+    using namespace rapidxml;
+    
+    xml_document<char> doc;
+    xml_node<char> *RadInstrumentData = doc.allocate_node( node_element, "RadInstrumentData" );
+    doc.append_node( RadInstrumentData );
+    
+    appendSpecMeasStuffToXml( RadInstrumentData );
+    
+    for( const xml_node<char> *node = RadInstrumentData->first_node(); node; node = node->next_sibling() )
+      rapidxml::print( std::ostream_iterator<char>(ostr), *node, 0 );
+  }
+  
+  ostr << "\n</RadInstrumentData>\n";
+  
+  return !!ostr;
+}//bool write_2012_N42_streaming( std::ostream &ostr ) const
+
+
+
 bool SpecMeas::load_from_N42( std::istream &input )
 {
   std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
@@ -1401,6 +2046,39 @@ std::set<std::set<int> > SpecMeas::sampleNumsWithPeaks() const
 }//sampleNumsWithPeaks() const
 
 
+size_t SpecMeas::peaksMemorySize() const
+{
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  //Peaks may be shared between sample numbers (and between the user and
+  //  automated search peaks), so only count each once.
+  std::set<const PeakDef *> counted;
+  size_t nbytes = 0;
+  
+  for( const SampleNumsToPeakMap *peakmap : { m_peaks.get(), &m_autoSearchPeaks } )
+  {
+    if( !peakmap )
+      continue;
+    
+    for( const SampleNumsToPeakMap::value_type &t : *peakmap )
+    {
+      nbytes += sizeof(t) + t.first.size()*(sizeof(int) + 4*sizeof(void *));
+      if( !t.second )
+        continue;
+      
+      nbytes += sizeof(PeakDeque) + t.second->size()*sizeof(std::shared_ptr<const PeakDef>);
+      for( const std::shared_ptr<const PeakDef> &peak : *t.second )
+      {
+        if( peak && counted.insert( peak.get() ).second )
+          nbytes += sizeof(PeakDef) + sizeof(PeakContinuum);
+      }
+    }//for( const SampleNumsToPeakMap::value_type &t : *peakmap )
+  }//for( loop over user and automated search peaks )
+  
+  return nbytes;
+}//size_t peaksMemorySize() const
+
+
 void SpecMeas::removeAllPeaks()
 {
   if( !!m_peaks )
@@ -1636,6 +2314,56 @@ void shiftPeaksHelper( std::map<std::set<int>, std::shared_ptr< std::deque< std:
 }//shiftPeaksHelper
 
 
+void SpecMeas::rebinByEqn( const std::vector<float> &eqn,
+                           const std::vector< std::pair<float,float> > &devpairs,
+                           const Measurement::EquationType type )
+{
+  struct RebinInfo
+  {
+    ShrdConstFVecPtr oldBinning;  //Kept alive so its address isnt reused
+    ShrdConstFVecPtr newBinning;
+    std::unique_ptr<ChannelOverlapWeights> weights;
+  };//struct RebinInfo
+  
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  std::map<const std::vector<float> *,RebinInfo> rebinInfos;
+  
+  for( auto &m : measurements_ )
+  {
+    if( !m || m->num_gamma_channels() < 2 )
+      continue;
+    
+    const ShrdConstFVecPtr oldBinning = m->channel_energies();
+    const ShrdConstFVecPtr oldCounts = m->gamma_counts();
+    if( !oldBinning || !oldCounts )
+      continue;
+    
+    RebinInfo &info = rebinInfos[oldBinning.get()];
+    
+    if( !info.weights )
+    {
+      m->recalibrate_by_eqn( eqn, devpairs, type );
+      const ShrdConstFVecPtr newBinning = m->channel_energies();
+      if( !newBinning )
+        throw runtime_error( "SpecMeas::rebinByEqn: failed to compute new binning" );
+      
+      info.oldBinning = oldBinning;
+      info.newBinning = newBinning;
+      info.weights.reset( new ChannelOverlapWeights( *oldBinning, *newBinning ) );
+    }else
+    {
+      m->set_channel_energies( info.newBinning );
+    }//if( first time seeing this binning ) / else
+    
+    const std::shared_ptr<std::vector<float>> newCounts = info.weights->apply( *oldCounts );
+    m->set_gamma_counts( newCounts, m->live_time(), m->real_time() );
+  }//for( auto &m : measurements_ )
+  
+  modified_ = modifiedSinceDecode_ = true;
+}//void rebinByEqn(...)
+
+
 void SpecMeas::shiftPeaksForRecalibration( std::vector<float> old_pars,
                                 const std::vector< std::pair<float,float> > &old_devpairs,
                                 Measurement::EquationType old_eqn_type,
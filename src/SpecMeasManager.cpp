@@ -105,6 +105,7 @@
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/SpecMeasManager.h"
+#include "InterSpec/MemoryAccountant.h"
 #include "SpecUtils/UtilityFunctions.h"
 #include "InterSpec/SpectraFileModel.h"
 #include "InterSpec/InterSpecApp.h"
@@ -396,6 +397,16 @@ namespace
     }//~FileUploadDialog()
     
   };//class FileUploadDialog
+  
+  
+  //spectrum_db_write_key(...): key used with DataBaseUtils::queueDbWrite(...)
+  //  for writing a spectrum file to the database, so later writes of the same
+  //  file replace, or are ordered after, earlier ones.  The queued work holds a
+  //  reference to header, so its address is a unique key while pending.
+  std::string spectrum_db_write_key( const SpectraFileHeader *header )
+  {
+    return "spectrum:" + std::to_string( reinterpret_cast<size_t>(header) );
+  }
 }//namespace
 
 
@@ -863,6 +874,8 @@ SpecMeasManager::~SpecMeasManager()
   std::lock_guard<std::mutex> lock( *m_destructMutex );
   
   (*m_destructed) = true;
+  
+  MemoryAccountant::instance().remove( this );
 } // SpecMeasManager::~SpecMeasManager()
 
 
@@ -902,6 +915,125 @@ FileDragUploadResource *SpecMeasManager::backgroundDragNDrop()
 
 #if( SUPPORT_ZIPPED_SPECTRUM_FILES )
 
+namespace
+{
+  //Returns true if 'data' looks like it is an XML file (e.g., N42), in which
+  //  case we can parse it right from memory.
+  bool looks_like_xml( const vector<char> &data )
+  {
+    size_t pos = 0;
+    if( data.size() >= 3 && data[0]==char(0xEF) && data[1]==char(0xBB) && data[2]==char(0xBF) )
+      pos = 3;  //UTF-8 BOM
+    
+    while( pos < data.size() && isspace( static_cast<unsigned char>(data[pos]) ) )
+      ++pos;
+    
+    return (pos < data.size()) && (data[pos] == '<');
+  }//bool looks_like_xml( const vector<char> &data )
+  
+  
+  //Parses a N42 file extracted from a zip file, right from memory.  'data'
+  //  must be null terminated, and will be modified if it looks like XML (even
+  //  if parsing fails).  Returns null if not a N42 file, or on failure.  Safe
+  //  to call from any thread.
+  std::shared_ptr<SpecMeas> parse_n42_from_zip( const string &fileInZip,
+                                                vector<char> &data )
+  {
+    if( data.size() < 2 || !looks_like_xml( data ) )
+      return nullptr;
+    
+    try
+    {
+      auto meas = std::make_shared<SpecMeas>();
+      if( meas->load_N42_from_data( &data[0] ) )
+      {
+        meas->set_filename( fileInZip );
+        meas->reset_modified();
+        meas->reset_modified_since_decode();
+        return meas;
+      }
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to parse '" << fileInZip << "' as N42: " << e.what() << endl;
+    }
+    
+    return nullptr;
+  }//parse_n42_from_zip(...)
+  
+  
+  //Parses a spectrum file extracted from a zip file.  N42 files are parsed
+  //  directly from memory, other formats are written to a temporary file, and
+  //  parsed from there.  'data' must be the null terminated contents of
+  //  'header', and may be modified.  Returns null on failure.  Safe to call
+  //  from any thread.
+  std::shared_ptr<SpecMeas> parse_file_from_zip( const ZipArchive::MappedZipFile &zipfile,
+                                  std::shared_ptr<const ZipArchive::ZipFileHeader> header,
+                                  vector<char> &data )
+  {
+    const string &fileInZip = header->filename;
+    
+    if( data.size() < 2 )
+      return nullptr;
+    
+    if( looks_like_xml( data ) )
+    {
+      std::shared_ptr<SpecMeas> n42meas = parse_n42_from_zip( fileInZip, data );
+      if( n42meas )
+        return n42meas;
+      
+      //The XML parser modifies the data in place, so re-extract it.
+      try
+      {
+        zipfile.read_file( header, data, true );
+      }catch( std::exception & )
+      {
+        return nullptr;
+      }
+    }//if( looks_like_xml( data ) )
+    
+    string file_ending;
+    const size_t pos = fileInZip.find_last_of( '.' );
+    if( pos != string::npos )
+      file_ending = fileInZip.substr( pos+1 );
+    UtilityFunctions::to_lower( file_ending );
+    
+    const string tmppath = UtilityFunctions::temp_dir();
+    const string tmpfile = UtilityFunctions::temp_file_name( "", tmppath );
+    
+    std::shared_ptr<SpecMeas> meas;
+    
+    try
+    {
+      {
+#ifdef _WIN32
+        const std::wstring wtmpfile = UtilityFunctions::convert_from_utf8_to_utf16(tmpfile);
+        ofstream tmpfilestrm( wtmpfile.c_str(), ios::out | ios::binary );
+#else
+        ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
+#endif
+        tmpfilestrm.write( &data[0], data.size() - 1 );
+      }
+      
+      auto tmpmeas = std::make_shared<SpecMeas>();
+      if( tmpmeas->load_file( tmpfile, kAutoParser, file_ending ) )
+      {
+        tmpmeas->set_filename( fileInZip );
+        tmpmeas->reset_modified();
+        tmpmeas->reset_modified_since_decode();
+        meas = tmpmeas;
+      }
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to parse '" << fileInZip << "': " << e.what() << endl;
+    }
+    
+    UtilityFunctions::remove_file( tmpfile );
+    
+    return meas;
+  }//parse_file_from_zip(...)
+}//namespace
+
+
 void SpecMeasManager::extractAndOpenFromZip( const std::string &spoolName,
                                              WButtonGroup *group,
                                              WTreeView *table,
@@ -925,32 +1057,51 @@ void SpecMeasManager::extractAndOpenFromZip( const std::string &spoolName,
     
     const string fileInZip = Wt::asString(index.data()).toUTF8();
     
-    const string tmppath = UtilityFunctions::temp_dir();
-    string tmpfile = UtilityFunctions::temp_file_name( "", tmppath );
-    
-    ifstream zipfilestrm( spoolName.c_str(), ios::in | ios::binary );
+    const ZipArchive::MappedZipFile zipfile( spoolName );
+    const ZipArchive::FilenameToZipHeaderMap &headers = zipfile.headers();
     
-    ZipArchive::FilenameToZipHeaderMap headers
-                                    = ZipArchive::open_zip_file( zipfilestrm );
-    
-    if( !headers.count(fileInZip) )
+    const ZipArchive::FilenameToZipHeaderMap::const_iterator pos
+                                                  = headers.find( fileInZip );
+    if( pos == headers.end() )
       throw runtime_error( "Couldnt find file in zip" );
 
-    size_t nbytewritten = 0;
+    vector<char> data;
+    zipfile.read_file( pos->second, data, true );
+    
+    //N42 files we can parse right from memory; for everything else (including
+    //  nested zip files and non-spectrum files) we will go through the normal
+    //  file drop handling.
+    const bool isxml = looks_like_xml( data );
+    std::shared_ptr<SpecMeas> meas = parse_n42_from_zip( fileInZip, data );
     
+    //The XML parser modifies the data in place, so re-extract it if needed.
+    if( !meas && isxml )
+      zipfile.read_file( pos->second, data, true );
+    
+    if( meas )
+    {
+      std::shared_ptr<SpectraFileHeader> header = addFile( fileInZip, meas );
+      const WModelIndex fileindex = m_fileModel->index( header );
+      displayFile( fileindex.row(), meas, type, true, true, true );
+    }else
     {
+      const string tmppath = UtilityFunctions::temp_dir();
+      string tmpfile = UtilityFunctions::temp_file_name( "", tmppath );
+      
+      {
 #ifdef _WIN32
-      const std::wstring wtmpfile = UtilityFunctions::convert_from_utf8_to_utf16(tmpfile);
-      ofstream tmpfilestrm( wtmpfile.c_str(), ios::out | ios::binary );
+        const std::wstring wtmpfile = UtilityFunctions::convert_from_utf8_to_utf16(tmpfile);
+        ofstream tmpfilestrm( wtmpfile.c_str(), ios::out | ios::binary );
 #else
-      ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
+        ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
 #endif
-      nbytewritten = read_file_from_zip( zipfilestrm, headers[fileInZip], tmpfilestrm );
-    }
-    
-    handleFileDrop( fileInZip, tmpfile, type );
-    
-    UtilityFunctions::remove_file( tmpfile );
+        tmpfilestrm.write( &data[0], data.size() - 1 );
+      }
+      
+      handleFileDrop( fileInZip, tmpfile, type );
+      
+      UtilityFunctions::remove_file( tmpfile );
+    }//if( meas ) / else
   }catch( std::exception & )
   {
     passMessage( "Error extracting file from zip", "", 2 );
@@ -960,6 +1111,71 @@ void SpecMeasManager::extractAndOpenFromZip( const std::string &spoolName,
 }//SpecMeasManager::extractAndOpenFromZip(...)
 
 
+void SpecMeasManager::openAllFromZip( const std::string &spoolName,
+                                      Wt::WButtonGroup *group,
+                                      AuxWindow *window )
+{
+  try
+  {
+    const SpectrumType type = SpectrumType( group->checkedId() );
+    
+    const ZipArchive::MappedZipFile zipfile( spoolName );
+    
+    vector<std::shared_ptr<const ZipArchive::ZipFileHeader> > files;
+    for( const ZipArchive::FilenameToZipHeaderMap::value_type &t : zipfile.headers() )
+    {
+      const string &n = t.first;
+      if( n.empty() || n[n.size()-1] == '/' || !t.second->uncompressed_size )
+        continue;
+      if( n.size() >= 4 && UtilityFunctions::iequals(n.substr(n.size()-4), ".zip" ) )
+        continue;
+      files.push_back( t.second );
+    }//for( loop over files in zip )
+    
+    if( files.empty() )
+      throw runtime_error( "No files in zip" );
+    
+    //Inflate and parse all the files in parallel; each worker only writes to
+    //  its own entry of 'parsed'.
+    vector<std::shared_ptr<SpecMeas> > parsed( files.size() );
+    zipfile.read_files( files, [&zipfile,&files,&parsed]( size_t index, vector<char> &data ){
+      parsed[index] = parse_file_from_zip( zipfile, files[index], data );
+    }, true );
+    
+    size_t nopened = 0;
+    for( size_t i = 0; i < files.size(); ++i )
+    {
+      if( !parsed[i] )
+        continue;
+      
+      std::shared_ptr<SpectraFileHeader> header
+                                    = addFile( files[i]->filename, parsed[i] );
+      
+      //Display the first file, and leave the rest in the file manager.
+      if( !nopened )
+      {
+        const WModelIndex fileindex = m_fileModel->index( header );
+        displayFile( fileindex.row(), parsed[i], type, true, true, true );
+      }
+      
+      ++nopened;
+    }//for( size_t i = 0; i < files.size(); ++i )
+    
+    if( !nopened )
+      throw runtime_error( "No spectrum files could be opened" );
+    
+    passMessage( "Opened " + std::to_string(nopened) + " of "
+                 + std::to_string(files.size()) + " files in the ZIP file; they"
+                 " are available in the Spectrum Manager.", "", 0 );
+  }catch( std::exception &e )
+  {
+    passMessage( "Error opening files from zip: " + string(e.what()), "", 2 );
+  }//try / catch
+  
+  delete window;
+}//void SpecMeasManager::openAllFromZip(...)
+
+
 bool SpecMeasManager::handleZippedFile( const std::string &name,
                                         const std::string &spoolName,
                                         const int spectrum_type )
@@ -974,10 +1190,8 @@ bool SpecMeasManager::handleZippedFile( const std::string &name,
     if( app )
       lock.reset( new WApplication::UpdateLock( app ) );
     
-    ifstream zipfilestrm( spoolName.c_str(), ios::in | ios::binary );
-    
-    ZipArchive::FilenameToZipHeaderMap headers = ZipArchive::open_zip_file( zipfilestrm );
-    
+    const ZipArchive::MappedZipFile zipfile( spoolName );
+    const ZipArchive::FilenameToZipHeaderMap &headers = zipfile.headers();
     
     vector<string> filenames;
     vector<uint32_t> uncompresssize;
@@ -1164,6 +1378,16 @@ bool SpecMeasManager::handleZippedFile( const std::string &name,
     //openButton->clicked().connect( boost::bind( &SpecMeasManager::extractAndOpenFromZip, this, spoolName, type, selection, window ) );
     openButton->clicked().connect( boost::bind( &SpecMeasManager::extractAndOpenFromZip, this, spoolName, group, table, window, WModelIndex() ) );
     
+    if( model->rowCount() > 1 )
+    {
+      WPushButton *openAllButton = new WPushButton( "Open All" );
+      openAllButton->setToolTip( "Opens all the spectrum files in the ZIP file;"
+                                 " the first is displayed, and the rest are"
+                                 " available in the Spectrum Manager." );
+      window->footer()->addWidget( openAllButton );
+      openAllButton->clicked().connect( boost::bind( &SpecMeasManager::openAllFromZip, this, spoolName, group, window ) );
+    }//if( model->rowCount() > 1 )
+    
     window->setResizable( true );
     window->centerWindow();
     window->disableCollapse();
@@ -3180,9 +3404,12 @@ void SpecMeasManager::saveToDatabase(
 //                      = app->bind( boost::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header ) );
 //    WServer::instance()->post( app->sessionId(), worker );
     
+    //If this file is saved again before the background writer gets to it,
+    //  only the latest will be written.
     std::shared_ptr<SpecMeas> meas = header->parseFile();
-    boost::function<void(void)> worker = boost::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header );
-    WServer::instance()->ioService().post( worker );
+    const string key = spectrum_db_write_key( header.get() );
+    DataBaseUtils::queueDbWrite( m_sql, key, std::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header ),
+                                 false, std::function<void(const std::string &)>() );
   }//if( headermeas && (headermeas==meas) )
 }//void saveToDatabase( std::shared_ptr<const SpecMeas> meas ) const
 
@@ -3218,17 +3445,18 @@ void SpecMeasManager::userCanceledResumeFromPreviousOpened( AuxWindow *window,
 
   std::shared_ptr<SpecMeas> meas = header->measurementIfInMemory();
   
-  boost::function<void(void)> f;
+  std::function<void(void)> f;
   
   if( meas )
-    f = boost::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header );
+    f = std::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header );
   else
-    f = boost::bind( &SpectraFileHeader::saveToDatabaseFromTempFileWorker,
+    f = std::bind( &SpectraFileHeader::saveToDatabaseFromTempFileWorker,
                      header );
   
-//  boost::function<void(void)> worker = wApp->bind( f );
-//  WServer::instance()->post( wApp->sessionId(), worker );
-  WServer::instance()->ioService().post( f );
+  //Use the same key as saveToDatabase(...), so this cant race with writes of
+  //  this file already queued.
+  DataBaseUtils::queueDbWrite( m_sql, spectrum_db_write_key( header.get() ), f,
+                               false, std::function<void(const std::string &)>() );
 }//userCanceledResumeFromPreviousOpened(..)
 
 
@@ -3610,6 +3838,8 @@ void SpecMeasManager::clearTempSpectrumInfoCache()
   }//for( loop over m_tempSpectrumInfoCache to save them to disk )
     
   m_tempSpectrumInfoCache.clear();
+  
+  updateMemoryAccounting();
 } // void SpecMeasManager::clearTempSpectrumInfoCache()
 
 
@@ -3673,9 +3903,43 @@ void SpecMeasManager::removeFromSpectrumInfoCache( std::shared_ptr<const SpecMea
 #endif
   
   m_tempSpectrumInfoCache.erase( pos );
+  
+  updateMemoryAccounting();
 }//void SpecMeasManager::removeFromSpectrumInfoCache(...) const
 
 
+void SpecMeasManager::updateMemoryAccounting() const
+{
+  WApplication *app = wApp;
+  if( !app || !m_viewer )
+    return;
+  
+  size_t nbytes = 0;
+  for( const std::shared_ptr<const SpecMeas> &meas : m_tempSpectrumInfoCache )
+  {
+    if( meas && meas != m_viewer->measurment(kForeground)
+        && meas != m_viewer->measurment(kSecondForeground)
+        && meas != m_viewer->measurment(kBackground) )
+      nbytes += meas->memmorysize();
+  }//for( loop over m_tempSpectrumInfoCache )
+  
+  //Evicting writes the spectra to disk, and drops them from the cache; they
+  //  will be read back in when the user selects them again.
+  const string sessionid = app->sessionId();
+  SpecMeasManager *self = const_cast<SpecMeasManager *>( this );
+  const boost::function<void()> evict
+        = app->bind( boost::bind( &SpecMeasManager::clearTempSpectrumInfoCache, self ) );
+  
+  MemoryAccountant::instance().setUsage( sessionid, this,
+                            MemoryAccountant::Category::InactiveSpectra, nbytes,
+                            [sessionid,evict](){
+                              WServer *server = WServer::instance();
+                              if( server )
+                                server->post( sessionid, evict );
+                            } );
+}//void updateMemoryAccounting() const
+
+
 void SpecMeasManager::addToTempSpectrumInfoCache( std::shared_ptr<const SpecMeas> meas ) const
 {
   if( sm_maxTempCacheSize == 0 )
@@ -3731,6 +3995,8 @@ void SpecMeasManager::addToTempSpectrumInfoCache( std::shared_ptr<const SpecMeas
       break;
     } // if( curr_size > sm_maxTempCacheSize )
   } // for( loop over m_tempSpectrumInfoCache )
+  
+  updateMemoryAccounting();
 } // void SpecMeasManager::addToTempSpectrumInfoCache()
 
 
@@ -3972,7 +4238,8 @@ void SpecMeasManager::finishSaveSnapshotInDb(
       try
       {
         data->setFileData( specs[i],
-                           UserFileInDbData::sm_defaultSerializationFormat );
+                           UserFileInDbData::sm_defaultSerializationFormat,
+                           wApp ? wApp->sessionId() : string("") );
       }catch( std::exception & )
       {
         delete data;
@@ -30,6 +30,7 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 // #include <fcntl.h>
 
@@ -73,11 +74,12 @@
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PopupDiv.h"
 #include "InterSpec/SpecMeas.h"
+#include "InterSpec/Tracing.h"
 #include "InterSpec/AuxWindow.h"
 #include "InterSpec/InterSpecUser.h"
 #include "InterSpec/DataBaseUtils.h"
 #include "InterSpec/WarningWidget.h"
-#include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "InterSpec/SpectraFileModel.h"
 #include "SpecUtils/SpectrumDataStructs.h"
@@ -605,7 +607,8 @@ void SpectraFileHeader::saveToDatabaseFromTempFile() const
                             .bind( data.id() );
     if( data )
       data.modify()->setFileData( m_fileSystemLocation,
-                               UserFileInDbData::sm_defaultSerializationFormat );
+                               UserFileInDbData::sm_defaultSerializationFormat,
+                               m_appId );
     transaction.commit();
   }catch( FileToLargeForDbException &e )
   {
@@ -772,7 +775,8 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
     try
     {
       data->setFileData( meas,
-                        UserFileInDbData::sm_defaultSerializationFormat );
+                        UserFileInDbData::sm_defaultSerializationFormat,
+                        m_appId );
     }catch( FileToLargeForDbException &e )
     {
       delete data;
@@ -841,7 +845,8 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
       
       UserFileInDbData newdata = *data;
       newdata.setFileData( meas,
-                           UserFileInDbData::sm_defaultSerializationFormat );
+                           UserFileInDbData::sm_defaultSerializationFormat,
+                           m_appId );
       
       try
       {
@@ -875,7 +880,8 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
       try
       {
         dataptr->setFileData( meas,
-                             UserFileInDbData::sm_defaultSerializationFormat );
+                             UserFileInDbData::sm_defaultSerializationFormat,
+                             m_appId );
       }catch( std::exception &e )
       {
         delete dataptr;
@@ -1025,6 +1031,8 @@ std::shared_ptr<SpecMeas> SpectraFileHeader::initFile(
 {
   try
   {
+    INTERSPEC_TRACE_SPAN( "SpectraFileHeader::initFile" );
+    
     std::shared_ptr<SpecMeas> info = std::make_shared<SpecMeas>();
 
     const bool success = info->load_file( filename, parseType, orig_file_ending );
@@ -1303,11 +1311,12 @@ void SpectraFileHeader::setMeasurmentInfo( std::shared_ptr<SpecMeas> info )
     std::copy( sample_numbers.begin(), sample_numbers.end(),
                sample_num_vec.begin() );
 
-    const int nthread = SpecUtilsAsync::num_logical_cpu_cores();
-    const size_t meas_per_thread = nsamplenums / nthread;
+    //maxThreads() is configurable, so may be more than the number of samples.
+    const size_t nthread = std::max<size_t>( 1, ComputeScheduler::instance().maxThreads() );
+    const size_t meas_per_thread = std::max<size_t>( 1, nsamplenums / nthread );
 
 //    vector<SpectraHeaderMaker> workers;
-    SpecUtilsAsync::ThreadPool pool;
+    ComputeScheduler::TaskGroup pool;
     m_samples.resize( nsamplenums );
 
     for( size_t pos = 0; pos < nsamplenums; pos += meas_per_thread )
@@ -1426,7 +1435,10 @@ std::shared_ptr<SpecMeas> SpectraFileHeader::parseFile() const
   bool success = false;
   auto info = std::make_shared<SpecMeas>();
 
-  success = info->load_N42_file( filesystemlocation );
+  {
+    INTERSPEC_TRACE_SPAN( "SpectraFileHeader::parseFile" );
+    success = info->load_N42_file( filesystemlocation );
+  }
 
   if( !success )
   {
@@ -25,6 +25,8 @@
 
 #include <set>
 #include <map>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <algorithm>
 
@@ -1260,6 +1262,110 @@ void SpectrumChart::renderGridLines( Wt::WPainter &painter,
 }//void renderXGrid( Wt::WPainter &painter, const Wt::WAxis &axis ) const
 
 
+const SpectrumChart::DecimatedSeries &SpectrumChart::decimatedSeries(
+                                          const SpectrumDataModel *model,
+                                          const int xColumn, const int yColumn,
+                                          const int minRow, const int maxRow,
+                                          const double minX, const double maxX,
+                                          const int numPixels ) const
+{
+  DecimatedSeries *entry = nullptr;
+  for( DecimatedSeries &d : m_decimatedSeries )
+  {
+    if( d.yColumn == yColumn )
+      entry = &d;
+  }
+  
+  if( !entry )
+  {
+    m_decimatedSeries.push_back( DecimatedSeries() );
+    entry = &m_decimatedSeries.back();
+    entry->yColumn = yColumn;
+    entry->numPixels = -1;
+  }//if( !entry )
+  
+  if( entry->numPixels == numPixels
+      && entry->modelRevision == model->revision()
+      && entry->xColumn == xColumn
+      && entry->minRow == minRow && entry->maxRow == maxRow
+      && entry->minX == minX && entry->maxX == maxX )
+    return *entry;
+  
+  entry->modelRevision = model->revision();
+  entry->xColumn = xColumn;
+  entry->minRow = minRow;
+  entry->maxRow = maxRow;
+  entry->minX = minX;
+  entry->maxX = maxX;
+  entry->numPixels = numPixels;
+  
+  vector< pair<double,double> > &points = entry->points;
+  points.clear();
+  points.reserve( 4*numPixels + 8 );
+  
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double pxPerX = numPixels / (maxX - minX);
+  
+  //For the current pixel column we keep the first, min, max, and last points,
+  //  which are then added in the order they occur.
+  int currentPixel = -1, npoints = 0;
+  pair<double,double> first, minpoint, maxpoint, last;
+  
+  auto flushPixel = [&](){
+    if( npoints == 0 )
+      return;
+    
+    pair<double,double> pixelpoints[4] = { first, minpoint, maxpoint, last };
+    std::sort( begin(pixelpoints), end(pixelpoints) );
+    for( size_t i = 0; i < 4; ++i )
+    {
+      if( i == 0 || pixelpoints[i] != pixelpoints[i-1] )
+        points.push_back( pixelpoints[i] );
+    }
+    npoints = 0;
+  };//flushPixel
+  
+  const vector<double> &xvalues = model->columnValues( SpectrumDataModel::ColumnType(xColumn) );
+  const vector<double> &yvalues = model->columnValues( SpectrumDataModel::ColumnType(yColumn) );
+  const int lastRow = std::min( maxRow, static_cast<int>( std::min(xvalues.size(), yvalues.size()) ) - 1 );
+  
+  for( int row = minRow; row <= lastRow; ++row )
+  {
+    const double x = xvalues[row];
+    const double y = yvalues[row];
+    
+    if( IsNan(x) || IsNan(y) )
+    {
+      //Keep breaks in the line, like when drawing every point
+      flushPixel();
+      points.push_back( make_pair( x, nan ) );
+      currentPixel = -1;
+      continue;
+    }//if( IsNan(x) || IsNan(y) )
+    
+    const int pixel = static_cast<int>( std::floor( (x - minX) * pxPerX ) );
+    
+    if( pixel != currentPixel )
+    {
+      flushPixel();
+      currentPixel = pixel;
+      first = minpoint = maxpoint = make_pair( x, y );
+    }//if( pixel != currentPixel )
+    
+    if( y < minpoint.second )
+      minpoint = make_pair( x, y );
+    if( y > maxpoint.second )
+      maxpoint = make_pair( x, y );
+    last = make_pair( x, y );
+    ++npoints;
+  }//for( int row = minRow; row <= maxRow; ++row )
+  
+  flushPixel();
+  
+  return *entry;
+}//const DecimatedSeries &decimatedSeries(...) const
+
+
 
 void SpectrumChart::renderSeries( Wt::WPainter &painter ) const
 {
@@ -1795,31 +1901,56 @@ void SpectrumChart::iterateSpectrum( SpectrumRenderIterator *iterator,
             painter.setClipPath(clipPath);
             painter.setClipping(true);
             
-            for( int row = minRow; row <= maxRow; ++row )
+            int c = series.XSeriesColumn();
+            if( c == -1 )
+              c = XSeriesColumn();
+            const int column = series.modelColumn();
+            
+            if( c < SpectrumDataModel::X_AXIS_COLUMN || c > SpectrumDataModel::BACKGROUND_COLUMN
+                || column < SpectrumDataModel::X_AXIS_COLUMN || column > SpectrumDataModel::BACKGROUND_COLUMN )
             {
-              int c = series.XSeriesColumn();
-              if( c == -1 )
-                c = XSeriesColumn();
-              const int column = series.modelColumn();
-              const WModelIndex xIndex = m->index( row, c );
-              const WModelIndex yIndex = m->index( row, column );
-              
-              if( !yIndex.isValid() || !xIndex.isValid() )
-                continue;
+              iterator->endSegment();
+              painter.restore();
+              continue;
+            }
+            
+            const vector<double> &xvalues = m->columnValues( SpectrumDataModel::ColumnType(c) );
+            const vector<double> &yvalues = m->columnValues( SpectrumDataModel::ColumnType(column) );
+            const vector<double> &lowEdges = m->rowLowEdges();
+            const vector<double> &widths = m->rowWidths();
+            const int lastRow = std::min( maxRow, static_cast<int>( std::min(xvalues.size(), yvalues.size()) ) - 1 );
+            
+            //When there are many more channels than pixels (ex. zoomed out on
+            //  a HPGe spectrum), draw the min/max per pixel instead.
+            const int numPixels = static_cast<int>( std::ceil(maxXPx - minXPx) );
+            const bool decimate = (!drawHist && numPixels > 0
+                                   && (maxRow - minRow + 1) > 4*numPixels);
+            
+            if( decimate )
+            {
+              const DecimatedSeries &decimated
+                           = decimatedSeries( m, c, column, minRow, maxRow,
+                                              minx, maxx, numPixels );
               
-              const double y = asNumber( m->data(yIndex) );
+              for( const pair<double,double> &p : decimated.points )
+                iterator->newValue( series, p.first, p.second, 0,
+                                    WModelIndex(), WModelIndex() );
+            }//if( decimate )
+            
+            for( int row = minRow; !decimate && row <= lastRow; ++row )
+            {
+              const double y = yvalues[row];
               
               if( !drawHist )
               {
-                const double x = asNumber( m->data(xIndex) );
-                iterator->newValue( series, x, y, 0, xIndex, yIndex );
+                iterator->newValue( series, xvalues[row], y, 0, WModelIndex(), WModelIndex() );
               }else
               {
                 //should consider if (pxPerBin > 3*penWidth)
-                const double x_start = m->rowLowEdge( xIndex.row() );
-                const double x_end = x_start + m->rowWidth( xIndex.row() );
-                iterator->newValue( series, x_start, y, 0, xIndex, yIndex );
-                iterator->newValue( series, x_end, y, 0, xIndex, yIndex );
+                const double x_start = lowEdges[row];
+                const double x_end = x_start + widths[row];
+                iterator->newValue( series, x_start, y, 0, WModelIndex(), WModelIndex() );
+                iterator->newValue( series, x_end, y, 0, WModelIndex(), WModelIndex() );
               }//if( pxPerBin < 3.0 )
             }//for( unsigned row = 0; row < rows; ++row )
             
@@ -23,9 +23,12 @@
 
 #include "InterSpec_config.h"
 
-#include <vector>
+#include <limits>
+#include <vector>
 #include <memory>
+#include <iterator>
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 
 // Disable streamsize <=> size_t warnings in boost
@@ -73,8 +76,17 @@ SpectrumDataModel::SpectrumDataModel( Wt::WObject *parent )
     m_backgroundSubtract( false ),
     m_addHistIntegralToLegend( true ),
     m_dataSet( this ),
-    m_seriesColors{ ns_default_foreground_color, ns_default_background_color, ns_default_secondary_color }
+    m_seriesColors{ ns_default_foreground_color, ns_default_background_color, ns_default_secondary_color },
+    m_revision( 0 )
 {
+  dataChanged().connect( this, &SpectrumDataModel::incrementRevision );
+  headerDataChanged().connect( this, &SpectrumDataModel::incrementRevision );
+  layoutChanged().connect( this, &SpectrumDataModel::incrementRevision );
+  modelReset().connect( this, &SpectrumDataModel::incrementRevision );
+  rowsInserted().connect( this, &SpectrumDataModel::incrementRevision );
+  rowsRemoved().connect( this, &SpectrumDataModel::incrementRevision );
+  columnsInserted().connect( this, &SpectrumDataModel::incrementRevision );
+  columnsRemoved().connect( this, &SpectrumDataModel::incrementRevision );
 } // SpectrumDataModel constructor
 
 SpectrumDataModel::~SpectrumDataModel()
@@ -88,6 +100,18 @@ Wt::Signal<SpectrumDataModel::ColumnType> &SpectrumDataModel::dataSet()
   return m_dataSet;
 }//Wt::Signal<ColumnType> &dataSet()
 
+
+size_t SpectrumDataModel::revision() const
+{
+  return m_revision;
+}//size_t revision() const
+
+
+void SpectrumDataModel::incrementRevision()
+{
+  ++m_revision;
+}//void incrementRevision()
+
 void SpectrumDataModel::setDataHistogram( std::shared_ptr<Measurement> hist,
                                           float liveTime,
                                           float realTime,
@@ -421,6 +445,10 @@ int SpectrumDataModel::columnCount( const WModelIndex & ) const
 
 double SpectrumDataModel::rowWidth( int row ) const
 {
+  const vector<double> &widths = rowWidths();
+  if( row >= 0 && row < static_cast<int>(widths.size()) )
+    return widths[row];
+  
   std::shared_ptr<const Measurement> xHist = histUsedForXAxis();
   if( !xHist || row < 0 )
     return 0.0;
@@ -446,6 +474,10 @@ double SpectrumDataModel::rowCenter( int row ) const
 
 double SpectrumDataModel::rowLowEdge( int row ) const
 {
+  const vector<double> &edges = rowLowEdges();
+  if( row >= 0 && row < static_cast<int>(edges.size()) )
+    return edges[row];
+  
   std::shared_ptr<const Measurement> xHist = histUsedForXAxis();
   if( !xHist || row < 0 )
     return 0.0;
@@ -475,30 +507,27 @@ int SpectrumDataModel::findRow( const double x ) const
 } // int findRow( const double x ) const
 
 
-// { TODO this function can probably be made more efficient }
 void SpectrumDataModel::yRangeInXRange( const double xMin, const double xMax,
                             double &yMin, double &yMax ) const
 {
-  const int lowRow  = findRow( xMin );
+  const int lowRow  = std::max( findRow( xMin ), 0 );
   const int highRow = findRow( xMax );
-  const int columns = columnCount();
 
   yMax = -numeric_limits<double>::max();
   yMin =  numeric_limits<double>::max();
 
-  for( int column = 1; column < columns; ++column )
+  for( int column = DATA_COLUMN; column <= BACKGROUND_COLUMN; ++column )
   {
-    // Make sure that column is active.
-    if( !columnHasData( column ) ) continue;
-
-    for( int row = lowRow; row <= highRow; ++row )
+    const vector<double> &values = columnValues( ColumnType(column) );
+    const int endRow = std::min( highRow, static_cast<int>(values.size()) - 1 );
+    
+    for( int row = lowRow; row <= endRow; ++row )
     {
-      try
-      {
-        const double val = boost::any_cast<double>( data( index( row, column ), DisplayRole ) );
-        yMax = max( yMax, val );
-        yMin = min( yMin, val );
-      } catch(...) { }
+      const double val = values[row];
+      if( IsNan(val) )
+        continue;
+      yMax = max( yMax, val );
+      yMin = min( yMin, val );
     } // for( looping over the rows )
   } // for( looping over the columns )
 
@@ -554,33 +583,148 @@ WModelIndex SpectrumDataModel::parent( const WModelIndex & ) const
 
 double SpectrumDataModel::data( int row, int column ) const
 {
-  try
+  if( column < X_AXIS_COLUMN || column > BACKGROUND_COLUMN )
+    return 0.0;
+  
+  const vector<double> &values = columnValues( ColumnType(column) );
+  if( row < 0 || row >= static_cast<int>(values.size()) || IsNan(values[row]) )
+    return 0.0;
+  
+  return values[row];
+} // double SpectrumDataModel::data( int row, int column ) const
+
+
+const std::vector<double> &SpectrumDataModel::columnValues( const ColumnType column ) const
+{
+  updateColumnCache();
+  return m_columnCache.values[column];
+}//const std::vector<double> &columnValues( const ColumnType column ) const
+
+
+const std::vector<double> &SpectrumDataModel::rowLowEdges() const
+{
+  updateColumnCache();
+  return m_columnCache.lowEdges;
+}//const std::vector<double> &rowLowEdges() const
+
+
+const std::vector<double> &SpectrumDataModel::rowWidths() const
+{
+  updateColumnCache();
+  return m_columnCache.widths;
+}//const std::vector<double> &rowWidths() const
+
+
+void SpectrumDataModel::updateColumnCache() const
+{
+  std::shared_ptr<const Measurement> xHist = histUsedForXAxis();
+  
+  const std::shared_ptr<const Measurement> hists[3] = { m_data, m_secondData, m_background };
+  
+  vector<const void *> pointers;
+  pointers.reserve( 10 );
+  pointers.push_back( xHist.get() );
+  for( const std::shared_ptr<const Measurement> &h : hists )
   {
-    return boost::any_cast<double>( data( index( row, column ), DisplayRole ) );
+    pointers.push_back( h.get() );
+    pointers.push_back( h ? h->channel_energies().get() : nullptr );
+    pointers.push_back( h ? h->gamma_channel_contents().get() : nullptr );
   }
-  catch(...)
+  
+  const double params[] = {
+    static_cast<double>( m_rebinFactor ),
+    static_cast<double>( secondDataScaledBy() ),
+    static_cast<double>( backgroundScaledBy() ),
+    static_cast<double>( m_backgroundSubtract ),
+    static_cast<double>( m_secondDataOwnAxis ),
+    static_cast<double>( xHist ? xHist->num_gamma_channels() : 0 ),
+    static_cast<double>( m_revision )
+  };
+  const vector<double> parameters( std::begin(params), std::end(params) );
+  
+  ColumnCache &cache = m_columnCache;
+  if( pointers == cache.sourcePointers && parameters == cache.sourceParameters )
+    return;
+  
+  cache.sourcePointers = pointers;
+  cache.sourceParameters = parameters;
+  
+  const int nrows = rowCount();
+  const int rebin = ( m_rebinFactor > 1 ) ? m_rebinFactor : 1;
+  
+  cache.lowEdges.resize( nrows );
+  cache.widths.resize( nrows );
+  for( int row = 0; row < nrows; ++row )
   {
-    // no-op
-  }
-
-  return 0.0;
-} // double SpectrumDataModel::data( int row, int column ) const
+    const size_t firstBin = static_cast<size_t>(row * rebin);
+    const size_t lastBin  = firstBin + rebin - 1;
+    const double xMin = xHist->gamma_channel_lower( firstBin );
+    const double xMax = xHist->gamma_channel_upper( lastBin );
+    cache.lowEdges[row] = xMin;
+    cache.widths[row] = xMax - xMin;
+  }//for( int row = 0; row < nrows; ++row )
+  
+  const double nan = numeric_limits<double>::quiet_NaN();
+  
+  for( ColumnType column : { X_AXIS_COLUMN, DATA_COLUMN, SECOND_DATA_COLUMN, BACKGROUND_COLUMN } )
+  {
+    vector<double> &values = cache.values[column];
+    values.clear();
+    
+    if( !columnHasData( column ) )
+      continue;
+    
+    values.resize( nrows );
+    for( int row = 0; row < nrows; ++row )
+    {
+      if( !displayBinValue( row, column, values[row] ) )
+        values[row] = nan;
+    }
+  }//for( loop over columns )
+  
+  //Apply background subtraction the same way data(...) has always done.
+  const vector<double> &back = cache.values[BACKGROUND_COLUMN];
+  if( m_backgroundSubtract && !back.empty() )
+  {
+    vector<double> &foreground = cache.values[DATA_COLUMN];
+    for( size_t row = 0; row < foreground.size(); ++row )
+      foreground[row] -= back[row];
+    
+    if( !m_secondDataOwnAxis )
+    {
+      vector<double> &second = cache.values[SECOND_DATA_COLUMN];
+      for( size_t row = 0; row < second.size(); ++row )
+        second[row] -= back[row];
+    }
+  }//if( m_backgroundSubtract && !back.empty() )
+}//void updateColumnCache() const
 
 
 boost::any SpectrumDataModel::displayBinValue( int row,
                                                SpectrumDataModel::ColumnType column ) const
+{
+  double value;
+  if( !displayBinValue( row, column, value ) )
+    return boost::any();
+  return boost::any( value );
+}//displayBinValue(...)
+
+
+bool SpectrumDataModel::displayBinValue( int row,
+                                         SpectrumDataModel::ColumnType column,
+                                         double &value ) const
 {
   //Could optimize this function to be a bit more efficient since we no longer
   //  support using TH1Fs with the SpectrumDataModel class
   std::shared_ptr<const Measurement> xHist = histUsedForXAxis();
 
   if( !xHist )
-    return boost::any();
+    return false;
 
   const size_t nchannel = xHist->num_gamma_channels();
   const int numRows = static_cast<int>(nchannel) / m_rebinFactor;
   if( (row < 0) || (row >= numRows) )
-    return boost::any();
+    return false;
 
   const size_t newxAxisFirstBin = std::min( static_cast<size_t>(row * m_rebinFactor), nchannel-1);
   const size_t newxAxisLastBin = std::min( static_cast<size_t>(newxAxisFirstBin + m_rebinFactor - 1), nchannel-1 );
@@ -593,7 +737,8 @@ boost::any SpectrumDataModel::displayBinValue( int row,
     {
       const float xMin = xHist->gamma_channel_lower( newxAxisFirstBin );
       const float xMax = xHist->gamma_channel_upper( newxAxisLastBin );
-      return boost::any(0.5*(xMax+xMin));
+      value = 0.5*(xMax+xMin);
+      return true;
     }
       
     case DATA_COLUMN:        hist = m_data;       break;
@@ -602,7 +747,7 @@ boost::any SpectrumDataModel::displayBinValue( int row,
   }//switch( column )
 
   if( !hist )
-    return boost::any();
+    return false;
   
   double integral = 0.0;
   const vector<float> &channel_contents = *(hist->gamma_channel_contents());
@@ -664,8 +809,9 @@ boost::any SpectrumDataModel::displayBinValue( int row,
     case BACKGROUND_COLUMN:  integral *= backgroundScaledBy(); break;
   }//switch( column )
 
-  return boost::any( integral );
-}//displayBinValue(...)
+  value = integral;
+  return true;
+}//bool displayBinValue(...)
 
 
 boost::any SpectrumDataModel::data( const WModelIndex &index, int role ) const
@@ -676,44 +822,15 @@ boost::any SpectrumDataModel::data( const WModelIndex &index, int role ) const
   const int row    = index.row();
   const int column = index.column();
 
-  const int rebin = ( m_rebinFactor > 1 ) ? m_rebinFactor : 1;
-  // Note: m_rebinFactor >= 1 always, this is for testing.
-
-  std::shared_ptr<const Measurement> xHist = histUsedForXAxis();
-  const int numRows    = xHist ? static_cast<int>(xHist->num_gamma_channels()) / rebin : 0;
-  const int numColumns = columnCount();
-
-  // Make sure it's within standard bounds.
-  if( ( row    < 0 ) || ( row    >= numRows    ) )
+  if( ( column < X_AXIS_COLUMN ) || ( column > BACKGROUND_COLUMN ) )
     return boost::any();
-  if( ( column < 0 ) || ( column >= numColumns ) )
+  
+  const vector<double> &values = columnValues( ColumnType(column) );
+  
+  if( ( row < 0 ) || ( row >= static_cast<int>(values.size()) ) || IsNan(values[row]) )
     return boost::any();
-
-  if( column == X_AXIS_COLUMN )
-    return displayBinValue( row, X_AXIS_COLUMN );
-
-  if( (column == DATA_COLUMN) && !!m_data )
-  {
-    if( !m_backgroundSubtract || !m_background )
-      return displayBinValue( row, DATA_COLUMN );
-    
-    const double value = asNumber( displayBinValue( row, DATA_COLUMN ) )
-                         - asNumber( displayBinValue( row, BACKGROUND_COLUMN ) );
-    return boost::any( value );
-  }else if( (column == SECOND_DATA_COLUMN) && !!m_secondData )
-  {
-    if( !m_backgroundSubtract || m_secondDataOwnAxis || !m_background )
-      return displayBinValue( row, SECOND_DATA_COLUMN );
-    
-    const double value = asNumber( displayBinValue( row, SECOND_DATA_COLUMN ) )
-                         - asNumber( displayBinValue( row, BACKGROUND_COLUMN ) );
-    return boost::any( value );
-  }else if( (column == BACKGROUND_COLUMN) && m_background )
-  {
-    return displayBinValue( row, BACKGROUND_COLUMN );
-  }
   
-  return boost::any();
+  return boost::any( values[row] );
 } //boost::any SpectrumDataModel::data( const WModelIndex &index, int role ) const
 
 
@@ -0,0 +1,289 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include "InterSpec/Tracing.h"
+
+#if( INTERSPEC_ENABLE_TRACING )
+
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+  //sm_maxExitedThreadBuffers: buffers of threads that have exited are kept
+  //  (so spans of short-lived worker threads can still be exported), but only
+  //  this many of them.
+  const size_t sm_maxExitedThreadBuffers = 32;
+
+  struct ThreadBuffer
+  {
+    ThreadBuffer( const size_t index )
+      : threadIndex( index ), next( 0 ), exited( false )
+    {
+    }
+
+    //mutex: only contended while exporting or clearing.
+    std::mutex mutex;
+    const size_t threadIndex;
+
+    //events: grows to Tracing::sm_eventsPerThread, then 'next' wraps around
+    //  overwriting the oldest.
+    std::vector<Tracing::Event> events;
+    size_t next;
+    bool exited;
+  };//struct ThreadBuffer
+
+
+  std::mutex sm_registryMutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> sm_buffers;
+  size_t sm_nextThreadIndex = 0;
+
+  const std::chrono::steady_clock::time_point sm_epoch
+                                           = std::chrono::steady_clock::now();
+
+
+  //ThreadBufferHolder: marks the buffer as exited when the thread ends.
+  struct ThreadBufferHolder
+  {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    ~ThreadBufferHolder()
+    {
+      if( !buffer )
+        return;
+
+      std::lock_guard<std::mutex> lock( buffer->mutex );
+      buffer->exited = true;
+    }
+  };//struct ThreadBufferHolder
+
+  thread_local ThreadBufferHolder t_buffer;
+  thread_local std::string t_session;
+
+
+  ThreadBuffer &thread_buffer()
+  {
+    if( t_buffer.buffer )
+      return *t_buffer.buffer;
+
+    std::lock_guard<std::mutex> lock( sm_registryMutex );
+
+    //Drop the oldest buffers of exited threads, if there are too many.
+    size_t nexited = 0;
+    for( const auto &b : sm_buffers )
+    {
+      std::lock_guard<std::mutex> bufferlock( b->mutex );
+      nexited += b->exited;
+    }
+
+    for( auto iter = begin(sm_buffers);
+         nexited >= sm_maxExitedThreadBuffers && iter != end(sm_buffers); )
+    {
+      bool exited;
+      {
+        std::lock_guard<std::mutex> bufferlock( (*iter)->mutex );
+        exited = (*iter)->exited;
+      }
+
+      if( exited )
+      {
+        iter = sm_buffers.erase( iter );
+        --nexited;
+      }else
+      {
+        ++iter;
+      }
+    }//for( loop over buffers to remove exited ones )
+
+    t_buffer.buffer = std::make_shared<ThreadBuffer>( sm_nextThreadIndex++ );
+    sm_buffers.push_back( t_buffer.buffer );
+
+    return *t_buffer.buffer;
+  }//ThreadBuffer &thread_buffer()
+
+
+  void write_json_escaped( std::ostream &output, const char *str )
+  {
+    for( ; str && *str; ++str )
+    {
+      const char c = *str;
+      switch( c )
+      {
+        case '\"': output << "\\\""; break;
+        case '\\': output << "\\\\"; break;
+        default:
+          if( static_cast<unsigned char>(c) < 0x20 )
+          {
+            char buffer[8];
+            snprintf( buffer, sizeof(buffer), "\\u%04x", static_cast<int>(c) );
+            output << buffer;
+          }else
+          {
+            output << c;
+          }
+      }//switch( c )
+    }//for( loop over characters )
+  }//void write_json_escaped(...)
+  
+  
+  //Returns if 'event' was recorded for 'sessionId'; if the ID was too long
+  //  to fit in Event::session, the truncated prefix is compared.
+  bool event_is_for_session( const Tracing::Event &event, const std::string &sessionId )
+  {
+    const size_t maxlen = sizeof(event.session) - 1;
+    if( sessionId.size() <= maxlen )
+      return (sessionId == event.session);
+    
+    return (strlen(event.session) == maxlen)
+           && (sessionId.compare( 0, maxlen, event.session ) == 0);
+  }//bool event_is_for_session(...)
+}//namespace
+
+
+namespace Tracing
+{
+const size_t sm_eventsPerThread = 16384;
+
+
+ScopedSpan::ScopedSpan( const char *name )
+  : m_name( name ),
+    m_start( std::chrono::steady_clock::now() )
+{
+}
+
+
+ScopedSpan::~ScopedSpan()
+{
+  using namespace std::chrono;
+
+  const steady_clock::time_point now = steady_clock::now();
+
+  Event event;
+  event.name = m_name;
+  event.start = duration_cast<nanoseconds>( m_start - sm_epoch ).count();
+  event.duration = duration_cast<nanoseconds>( now - m_start ).count();
+
+  const size_t len = std::min( t_session.size(), sizeof(event.session) - 1 );
+  memcpy( event.session, t_session.c_str(), len );
+  event.session[len] = '\0';
+
+  ThreadBuffer &buffer = thread_buffer();
+
+  std::lock_guard<std::mutex> lock( buffer.mutex );
+  if( buffer.events.size() < sm_eventsPerThread )
+  {
+    buffer.events.push_back( event );
+  }else
+  {
+    buffer.events[buffer.next] = event;
+    buffer.next = (buffer.next + 1) % sm_eventsPerThread;
+  }
+}//ScopedSpan::~ScopedSpan()
+
+
+SessionScope::SessionScope( const std::string &sessionId )
+  : m_previous( t_session )
+{
+  t_session = sessionId;
+}
+
+
+SessionScope::~SessionScope()
+{
+  t_session.swap( m_previous );
+}
+
+
+void writeChromeTrace( std::ostream &output, const std::string &sessionId )
+{
+  //Copy the events out, so we dont hold up the threads recording them while
+  //  writing the output.
+  vector<std::pair<size_t,Event>> events;
+
+  {
+    std::lock_guard<std::mutex> lock( sm_registryMutex );
+    for( const auto &buffer : sm_buffers )
+    {
+      std::lock_guard<std::mutex> bufferlock( buffer->mutex );
+      for( const Event &event : buffer->events )
+      {
+        if( sessionId.empty() || event_is_for_session( event, sessionId ) )
+          events.emplace_back( buffer->threadIndex, event );
+      }
+    }//for( const auto &buffer : sm_buffers )
+  }
+
+  std::sort( begin(events), end(events),
+            []( const std::pair<size_t,Event> &lhs, const std::pair<size_t,Event> &rhs ) -> bool {
+    return std::tie(lhs.second.start,lhs.first) < std::tie(rhs.second.start,rhs.first);
+  } );
+
+  output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+         << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+            "\"args\":{\"name\":\"InterSpec\"}}";
+
+  char buffer[128];
+  for( const std::pair<size_t,Event> &tidevent : events )
+  {
+    const Event &event = tidevent.second;
+
+    output << ",\n{\"name\":\"";
+    write_json_escaped( output, event.name );
+
+    //Trace-event timestamps and durations are in (fractional) microseconds.
+    snprintf( buffer, sizeof(buffer),
+              "\",\"cat\":\"InterSpec\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+              "\"pid\":1,\"tid\":%u,\"args\":{\"session\":\"",
+              1.0E-3*event.start, 1.0E-3*event.duration,
+              static_cast<unsigned int>(tidevent.first) );
+    output << buffer;
+    write_json_escaped( output, event.session );
+    output << "\"}}";
+  }//for( loop over events )
+
+  output << "\n]}\n";
+}//void writeChromeTrace(...)
+
+
+void clear()
+{
+  std::lock_guard<std::mutex> lock( sm_registryMutex );
+  for( const auto &buffer : sm_buffers )
+  {
+    std::lock_guard<std::mutex> bufferlock( buffer->mutex );
+    buffer->events.clear();
+    buffer->next = 0;
+  }
+}//void clear()
+}//namespace Tracing
+
+#endif //INTERSPEC_ENABLE_TRACING
@@ -0,0 +1,756 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Wt/WApplication>
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/PeakModel.h"
+#include "InterSpec/InterSpecApp.h"
+#include "InterSpec/Recalibrator.h"
+#include "InterSpec/WarningWidget.h"
+#include "InterSpec/UndoRedoManager.h"
+
+using namespace std;
+
+namespace
+{
+  //Rough memory held by a step: the pointers to the peaks, and the peaks
+  //  themselves (which may also be held by the SpecMeas, but will be solely
+  //  owned by the step once the peaks are changed again).
+  size_t approxPeakBytes( const size_t npeaks )
+  {
+    return npeaks * (sizeof(PeakDef) + 2*sizeof(std::shared_ptr<const PeakDef>));
+  }
+
+
+  bool peakMeanLessThan( const std::shared_ptr<const PeakDef> &lhs,
+                         const std::shared_ptr<const PeakDef> &rhs )
+  {
+    return PeakModel::compare( lhs, rhs, PeakModel::kMean, Wt::AscendingOrder );
+  }
+
+
+  vector<std::shared_ptr<const PeakDef>> peakVector( std::shared_ptr<const SpecMeas::PeakDeque> peaks )
+  {
+    vector<std::shared_ptr<const PeakDef>> answer;
+    if( peaks )
+      answer.insert( end(answer), begin(*peaks), end(*peaks) );
+    return answer;
+  }
+}//namespace
+
+
+UndoRedoManager::UndoRedoManager( InterSpec *viewer )
+  : m_viewer( viewer ),
+    m_memoryBudget( 16*1024*1024 ),
+    m_maxSteps( 250 ),
+    m_memoryUsed( 0 ),
+    m_inUndoRedo( false ),
+    m_blockDepth( 0 ),
+    m_groupDepth( 0 ),
+    m_peakChange( nullptr ),
+    m_calibrationChangeDepth( 0 )
+{
+}//UndoRedoManager constructor
+
+
+UndoRedoManager::~UndoRedoManager()
+{
+}//~UndoRedoManager()
+
+
+UndoRedoManager *UndoRedoManager::instance()
+{
+  InterSpecApp *app = dynamic_cast<InterSpecApp *>( wApp );
+  if( !app )
+    return nullptr;
+
+  InterSpec *viewer = app->viewer();
+  return viewer ? viewer->undoRedoManager() : nullptr;
+}//UndoRedoManager *instance()
+
+
+void UndoRedoManager::addUndoRedoStep( std::function<void()> undo,
+                                       std::function<void()> redo,
+                                       const std::string &description,
+                                       const size_t approx_bytes )
+{
+  if( m_inUndoRedo )
+    return;
+
+  //The caller has changed the state without it being recorded, so redoing
+  //  the steps from before this change would no longer make sense.
+  if( m_blockDepth > 0 )
+  {
+    clearRedoSteps();
+    return;
+  }
+
+  if( !undo || !redo )
+    throw runtime_error( "UndoRedoManager::addUndoRedoStep: invalid functions" );
+
+  Step step;
+  step.undo = std::move(undo);
+  step.redo = std::move(redo);
+  step.description = description;
+  step.approx_bytes = approx_bytes + sizeof(Step) + description.size();
+
+  if( m_groupDepth > 0 )
+  {
+    m_groupSteps.push_back( std::move(step) );
+    return;
+  }
+
+  clearRedoSteps();
+
+  m_memoryUsed += step.approx_bytes;
+  m_undoSteps.push_back( std::move(step) );
+
+  enforceBudget();
+}//void addUndoRedoStep(...)
+
+
+void UndoRedoManager::enforceBudget()
+{
+  //We always keep the most recent undo step, even if it alone is over budget.
+  while( m_undoSteps.size() > 1
+         && (m_memoryUsed > m_memoryBudget || m_undoSteps.size() > m_maxSteps) )
+  {
+    m_memoryUsed -= m_undoSteps.front().approx_bytes;
+    m_undoSteps.pop_front();
+  }
+
+  //Redo steps are only around after an undo, so drop the one furthest from
+  //  the current state (the back of m_redoSteps).
+  while( !m_redoSteps.empty() && m_memoryUsed > m_memoryBudget )
+  {
+    m_memoryUsed -= m_redoSteps.back().approx_bytes;
+    m_redoSteps.pop_back();
+  }
+}//void enforceBudget()
+
+
+bool UndoRedoManager::canUndo() const
+{
+  return !m_undoSteps.empty();
+}
+
+
+bool UndoRedoManager::canRedo() const
+{
+  return !m_redoSteps.empty();
+}
+
+
+void UndoRedoManager::executeStep( const bool isUndo )
+{
+  std::deque<Step> &from = isUndo ? m_undoSteps : m_redoSteps;
+  std::deque<Step> &to = isUndo ? m_redoSteps : m_undoSteps;
+
+  if( from.empty() || m_inUndoRedo || m_groupDepth > 0 )
+    return;
+
+  //Redo steps are pushed to the front of m_redoSteps, so the most recent undo
+  //  is always at the front, and the oldest undo at the back.
+  Step step = isUndo ? std::move(from.back()) : std::move(from.front());
+  if( isUndo )
+    from.pop_back();
+  else
+    from.pop_front();
+
+  m_inUndoRedo = true;
+
+  try
+  {
+    if( isUndo )
+      step.undo();
+    else
+      step.redo();
+    m_inUndoRedo = false;
+  }catch( std::exception &e )
+  {
+    m_inUndoRedo = false;
+    cerr << "UndoRedoManager: error " << (isUndo ? "undoing" : "redoing")
+         << " '" << step.description << "': " << e.what() << endl;
+
+    clearHistory();
+    passMessage( string("Error ") + (isUndo ? "undoing " : "redoing ")
+                 + step.description + "; history has been cleared.",
+                 "", WarningWidget::WarningMsgHigh );
+    return;
+  }//try / catch
+
+  if( isUndo )
+    to.push_front( std::move(step) );
+  else
+    to.push_back( std::move(step) );
+}//void executeStep( const bool isUndo )
+
+
+void UndoRedoManager::undo()
+{
+  executeStep( true );
+}//void undo()
+
+
+void UndoRedoManager::redo()
+{
+  executeStep( false );
+}//void redo()
+
+
+void UndoRedoManager::clearHistory()
+{
+  m_undoSteps.clear();
+  m_redoSteps.clear();
+  m_memoryUsed = 0;
+}//void clearHistory()
+
+
+void UndoRedoManager::clearRedoSteps()
+{
+  if( m_inUndoRedo )
+    return;
+
+  for( const Step &s : m_redoSteps )
+    m_memoryUsed -= s.approx_bytes;
+  m_redoSteps.clear();
+}//void clearRedoSteps()
+
+
+bool UndoRedoManager::isInUndoOrRedo() const
+{
+  return m_inUndoRedo;
+}
+
+
+size_t UndoRedoManager::numUndoSteps() const
+{
+  return m_undoSteps.size();
+}
+
+
+size_t UndoRedoManager::numRedoSteps() const
+{
+  return m_redoSteps.size();
+}
+
+
+size_t UndoRedoManager::memoryBudget() const
+{
+  return m_memoryBudget;
+}
+
+
+void UndoRedoManager::setMemoryBudget( const size_t bytes )
+{
+  m_memoryBudget = bytes;
+  enforceBudget();
+}
+
+
+size_t UndoRedoManager::memoryUsed() const
+{
+  return m_memoryUsed;
+}
+
+
+size_t UndoRedoManager::maxSteps() const
+{
+  return m_maxSteps;
+}
+
+
+void UndoRedoManager::setMaxSteps( const size_t nsteps )
+{
+  m_maxSteps = std::max( nsteps, size_t(1) );
+  enforceBudget();
+}
+
+
+UndoRedoManager::BlockUndoRedoInserts::BlockUndoRedoInserts()
+  : m_manager( UndoRedoManager::instance() )
+{
+  if( m_manager )
+    m_manager->m_blockDepth += 1;
+}//BlockUndoRedoInserts constructor
+
+
+UndoRedoManager::BlockUndoRedoInserts::~BlockUndoRedoInserts()
+{
+  if( m_manager )
+    m_manager->m_blockDepth -= 1;
+}//~BlockUndoRedoInserts()
+
+
+UndoRedoManager::StepGroup::StepGroup( const std::string &description )
+  : m_manager( UndoRedoManager::instance() )
+{
+  if( !m_manager )
+    return;
+
+  if( m_manager->m_groupDepth == 0 )
+  {
+    m_manager->m_groupDescription = description;
+    m_manager->m_groupSteps.clear();
+  }
+
+  m_manager->m_groupDepth += 1;
+}//StepGroup constructor
+
+
+UndoRedoManager::StepGroup::~StepGroup()
+{
+  if( !m_manager )
+    return;
+
+  m_manager->m_groupDepth -= 1;
+  if( m_manager->m_groupDepth > 0 )
+    return;
+
+  vector<Step> steps;
+  steps.swap( m_manager->m_groupSteps );
+
+  if( steps.empty() )
+    return;
+
+  if( steps.size() == 1 )
+  {
+    Step &step = steps.front();
+    m_manager->addUndoRedoStep( std::move(step.undo), std::move(step.redo),
+                                m_manager->m_groupDescription, step.approx_bytes );
+    return;
+  }//if( steps.size() == 1 )
+
+  size_t nbytes = 0;
+  for( const Step &step : steps )
+    nbytes += step.approx_bytes;
+
+  auto shared_steps = std::make_shared<vector<Step>>( std::move(steps) );
+
+  auto undo = [shared_steps](){
+    for( auto iter = shared_steps->rbegin(); iter != shared_steps->rend(); ++iter )
+      iter->undo();
+  };
+
+  auto redo = [shared_steps](){
+    for( auto iter = shared_steps->begin(); iter != shared_steps->end(); ++iter )
+      iter->redo();
+  };
+
+  m_manager->addUndoRedoStep( undo, redo, m_manager->m_groupDescription, nbytes );
+}//~StepGroup()
+
+
+UndoRedoManager::PeakModelChange::PeakModelChange()
+  : m_manager( UndoRedoManager::instance() ),
+    m_outermost( false ),
+    m_recording( false ),
+    m_changed( false )
+{
+  if( !m_manager || m_manager->m_peakChange )
+    return;
+
+  m_outermost = true;
+  m_manager->m_peakChange = this;
+
+  if( m_manager->m_inUndoRedo
+      || m_manager->m_blockDepth > 0
+      || m_manager->m_calibrationChangeDepth > 0 )
+    return;
+
+  InterSpec *viewer = m_manager->m_viewer;
+  std::shared_ptr<SpecMeas> meas = viewer->measurment( kForeground );
+  if( !meas || !viewer->peakModel() )
+    return;
+
+  m_recording = true;
+  m_meas = meas;
+  m_samples = viewer->displayedSamples( kForeground );
+}//PeakModelChange constructor
+
+
+void UndoRedoManager::PeakModelChange::peakRemoved( const std::shared_ptr<const PeakDef> &peak )
+{
+  PeakModelChange *outer = m_manager ? m_manager->m_peakChange : nullptr;
+  if( !outer || !peak )
+    return;
+
+  outer->m_changed = true;
+  if( !outer->m_recording )
+    return;
+
+  //A peak added and then removed within the same step isnt part of the step.
+  const auto pos = std::find( begin(outer->m_added), end(outer->m_added), peak );
+  if( pos != end(outer->m_added) )
+    outer->m_added.erase( pos );
+  else
+    outer->m_removed.push_back( peak );
+}//void peakRemoved(...)
+
+
+void UndoRedoManager::PeakModelChange::peakAdded( const std::shared_ptr<const PeakDef> &peak )
+{
+  PeakModelChange *outer = m_manager ? m_manager->m_peakChange : nullptr;
+  if( !outer || !peak )
+    return;
+
+  outer->m_changed = true;
+  if( !outer->m_recording )
+    return;
+
+  const auto pos = std::find( begin(outer->m_removed), end(outer->m_removed), peak );
+  if( pos != end(outer->m_removed) )
+    outer->m_removed.erase( pos );
+  else
+    outer->m_added.push_back( peak );
+}//void peakAdded(...)
+
+
+UndoRedoManager::PeakModelChange::~PeakModelChange()
+{
+  if( !m_manager || !m_outermost )
+    return;
+
+  m_manager->m_peakChange = nullptr;
+
+  if( !m_changed )
+    return;
+
+  if( !m_recording )
+  {
+    //Changes made while undoing or redoing are the step itself, and changes
+    //  made while recalibrating are recorded by EnergyCalibrationChange; any
+    //  other changes we couldnt record leave the redo steps stale.
+    if( m_manager->m_calibrationChangeDepth == 0 )
+      m_manager->clearRedoSteps();
+    return;
+  }//if( !m_recording )
+
+  try
+  {
+    InterSpec *viewer = m_manager->m_viewer;
+    std::shared_ptr<SpecMeas> meas = m_meas.lock();
+
+    if( !meas || !viewer->peakModel() || (meas != viewer->measurment(kForeground))
+        || (m_samples != viewer->displayedSamples(kForeground)) )
+    {
+      m_manager->clearRedoSteps();
+      return;
+    }
+
+    const vector<std::shared_ptr<const PeakDef>> &removed = m_removed;
+    const vector<std::shared_ptr<const PeakDef>> &added = m_added;
+
+    if( removed.empty() && added.empty() )
+      return;
+
+    string description;
+    if( removed.empty() )
+      description = (added.size() == 1) ? "add peak" : "add peaks";
+    else if( added.empty() )
+      description = (removed.size() == 1) ? "remove peak" : "remove peaks";
+    else
+      description = (added.size() == 1 && removed.size() == 1) ? "peak edit" : "peaks change";
+
+    UndoRedoManager *manager = m_manager;
+    const std::weak_ptr<SpecMeas> weakmeas = m_meas;
+    const set<int> samples = m_samples;
+
+    auto undo = [manager,weakmeas,samples,removed,added](){
+      manager->restorePeaks( weakmeas.lock(), samples, added, removed );
+    };
+
+    auto redo = [manager,weakmeas,samples,removed,added](){
+      manager->restorePeaks( weakmeas.lock(), samples, removed, added );
+    };
+
+    m_manager->addUndoRedoStep( undo, redo, description,
+                                approxPeakBytes(removed.size() + added.size()) );
+  }catch( std::exception &e )
+  {
+    m_manager->clearRedoSteps();
+    cerr << "UndoRedoManager::PeakModelChange: error recording change: "
+         << e.what() << endl;
+  }//try / catch
+}//~PeakModelChange()
+
+
+void UndoRedoManager::restorePeaks( std::shared_ptr<SpecMeas> meas,
+                        const std::set<int> &samples,
+                        const std::vector<std::shared_ptr<const PeakDef>> &remove,
+                        const std::vector<std::shared_ptr<const PeakDef>> &add )
+{
+  if( !meas )
+    return;
+
+  const set<std::shared_ptr<const PeakDef>> toremove( begin(remove), end(remove) );
+
+  SpecMeas::PeakDeque peaks;
+  std::shared_ptr<const SpecMeas> constmeas = meas;
+  std::shared_ptr<const SpecMeas::PeakDeque> current = constmeas->peaks( samples );
+  if( current )
+  {
+    for( const auto &p : *current )
+      if( !toremove.count(p) )
+        peaks.push_back( p );
+  }
+
+  peaks.insert( end(peaks), begin(add), end(add) );
+  std::sort( begin(peaks), end(peaks), &peakMeanLessThan );
+
+  meas->setPeaks( peaks, samples );
+  meas->setModified();
+
+  PeakModel *pmodel = m_viewer->peakModel();
+  if( pmodel && (meas == m_viewer->measurment(kForeground))
+      && (samples == m_viewer->displayedSamples(kForeground)) )
+    pmodel->setPeakFromSpecMeas( meas, samples );
+}//void restorePeaks(...)
+
+
+UndoRedoManager::EnergyCalibrationChange::EnergyCalibrationChange()
+  : m_manager( UndoRedoManager::instance() ),
+    m_recording( false )
+{
+  if( !m_manager )
+    return;
+
+  m_manager->m_calibrationChangeDepth += 1;
+
+  if( m_manager->m_calibrationChangeDepth != 1
+      || m_manager->m_inUndoRedo
+      || m_manager->m_blockDepth > 0 )
+    return;
+
+  InterSpec *viewer = m_manager->m_viewer;
+
+  const SpectrumType types[] = { kForeground, kBackground, kSecondForeground };
+  for( const SpectrumType type : types )
+  {
+    std::shared_ptr<SpecMeas> meas = viewer->measurment( type );
+    std::shared_ptr<const Measurement> hist = viewer->displayedHistogram( type );
+    if( !meas || !hist || !hist->num_gamma_channels() )
+      continue;
+
+    bool alreadyHave = false;
+    for( const auto &spec : m_specs )
+      alreadyHave = (alreadyHave || (spec.second.lock() == meas));
+    if( alreadyHave )
+      continue;
+
+    SpecState state;
+    state.coefficients = hist->calibration_coeffs();
+    state.deviationpairs = hist->deviation_pairs();
+    state.type = hist->energy_calibration_model();
+
+    std::shared_ptr<const SpecMeas> constmeas = meas;
+    for( const set<int> &samples : constmeas->sampleNumsWithPeaks() )
+      state.peaks[samples] = peakVector( constmeas->peaks(samples) );
+
+    m_specs.push_back( make_pair(type, std::weak_ptr<SpecMeas>(meas)) );
+    m_startingStates.push_back( state );
+  }//for( const SpectrumType type : types )
+
+  m_recording = !m_specs.empty();
+}//EnergyCalibrationChange constructor
+
+
+UndoRedoManager::EnergyCalibrationChange::~EnergyCalibrationChange()
+{
+  if( !m_manager )
+    return;
+
+  m_manager->m_calibrationChangeDepth -= 1;
+
+  if( !m_recording )
+  {
+    //We dont know if a blocked recalibration changed anything, so assume it
+    //  did, and that the redo steps no longer apply.
+    if( m_manager->m_calibrationChangeDepth == 0 && m_manager->m_blockDepth > 0 )
+      m_manager->clearRedoSteps();
+    return;
+  }//if( !m_recording )
+
+  try
+  {
+    InterSpec *viewer = m_manager->m_viewer;
+
+    bool changed = false;
+    size_t npeaks = 0;
+    vector<SpecState> finalStates;
+
+    for( size_t i = 0; i < m_specs.size(); ++i )
+    {
+      const SpectrumType type = m_specs[i].first;
+      std::shared_ptr<SpecMeas> meas = m_specs[i].second.lock();
+
+      //If the user has changed spectrum files, we wont try to record anything
+      std::shared_ptr<const Measurement> hist = viewer->displayedHistogram( type );
+      if( !meas || !hist || (meas != viewer->measurment(type)) )
+      {
+        m_manager->clearRedoSteps();
+        return;
+      }
+
+      SpecState state;
+      state.coefficients = hist->calibration_coeffs();
+      state.deviationpairs = hist->deviation_pairs();
+      state.type = hist->energy_calibration_model();
+
+      std::shared_ptr<const SpecMeas> constmeas = meas;
+      for( const set<int> &samples : constmeas->sampleNumsWithPeaks() )
+      {
+        state.peaks[samples] = peakVector( constmeas->peaks(samples) );
+        npeaks += state.peaks[samples].size();
+      }
+
+      const SpecState &orig = m_startingStates[i];
+      changed = (changed || orig.type != state.type
+                 || orig.coefficients != state.coefficients
+                 || orig.deviationpairs != state.deviationpairs);
+
+      for( const auto &p : orig.peaks )
+        npeaks += p.second.size();
+
+      finalStates.push_back( state );
+    }//for( size_t i = 0; i < m_specs.size(); ++i )
+
+    if( !changed )
+      return;
+
+    UndoRedoManager *manager = m_manager;
+    const auto specs = m_specs;
+    const auto startingStates = std::make_shared<const vector<SpecState>>( m_startingStates );
+    const auto endingStates = std::make_shared<const vector<SpecState>>( finalStates );
+
+    auto undo = [manager,specs,startingStates](){
+      manager->restoreCalibration( specs, *startingStates );
+    };
+
+    auto redo = [manager,specs,endingStates](){
+      manager->restoreCalibration( specs, *endingStates );
+    };
+
+    //The peaks themselves are mostly shared with the SpecMeas, so we will
+    //  just count the pointers
+    const size_t nbytes = npeaks * 2 * sizeof(std::shared_ptr<const PeakDef>)
+                          + specs.size() * 2 * sizeof(SpecState);
+
+    m_manager->addUndoRedoStep( undo, redo, "energy calibration", nbytes );
+  }catch( std::exception &e )
+  {
+    m_manager->clearRedoSteps();
+    cerr << "UndoRedoManager::EnergyCalibrationChange: error recording change: "
+         << e.what() << endl;
+  }//try / catch
+}//~EnergyCalibrationChange()
+
+
+void UndoRedoManager::restoreCalibration(
+          const std::vector< std::pair<SpectrumType,std::weak_ptr<SpecMeas>> > &specs,
+          const std::vector<EnergyCalibrationChange::SpecState> &states )
+{
+  assert( specs.size() == states.size() );
+
+  std::shared_ptr<SpecMeas> foreground = m_viewer->measurment( kForeground );
+
+  for( size_t i = 0; i < specs.size(); ++i )
+  {
+    std::shared_ptr<SpecMeas> meas = specs[i].second.lock();
+    if( !meas )
+      continue;
+
+    const EnergyCalibrationChange::SpecState &state = states[i];
+
+    //Like Recalibrator::engageRecalibration( RevertRecal ), the calibration is
+    //  applied to all detectors.
+    meas->recalibrate_by_eqn( state.coefficients, state.deviationpairs, state.type );
+
+    //Put back the exact peaks (rather than shifting the current ones), so the
+    //  peaks match what previous steps in the journal expect.
+    const set<set<int>> current = meas->sampleNumsWithPeaks();
+    for( const set<int> &samples : current )
+    {
+      if( !state.peaks.count(samples) )
+        meas->setPeaks( SpecMeas::PeakDeque(), samples );
+    }
+
+    for( const auto &p : state.peaks )
+      meas->setPeaks( SpecMeas::PeakDeque( begin(p.second), end(p.second) ), p.first );
+
+    if( meas == foreground )
+    {
+      PeakModel *pmodel = m_viewer->peakModel();
+      if( pmodel )
+        pmodel->setPeakFromSpecMeas( meas, m_viewer->displayedSamples(kForeground) );
+    }
+  }//for( size_t i = 0; i < specs.size(); ++i )
+
+  m_viewer->displayForegroundData( true );
+  m_viewer->displaySecondForegroundData();
+  m_viewer->displayBackgroundData();
+
+  if( m_viewer->m_recalibrator )
+    m_viewer->m_recalibrator->refreshRecalibrator();
+}//void restoreCalibration(...)
+
+
+void UndoRedoManager::sampleNumbersChanged( const SpectrumType type,
+                                            std::shared_ptr<SpecMeas> meas,
+                                            const std::set<int> &oldSamples,
+                                            const std::set<int> &newSamples )
+{
+  if( !meas || m_inUndoRedo || m_blockDepth > 0 || oldSamples == newSamples )
+    return;
+
+  InterSpec *viewer = m_viewer;
+  const std::weak_ptr<SpecMeas> weakmeas = meas;
+
+  auto setSamples = [viewer,weakmeas,type]( const set<int> &samples ){
+    std::shared_ptr<SpecMeas> meas = weakmeas.lock();
+    if( meas && (meas == viewer->measurment(type)) )
+      viewer->changeDisplayedSampleNums( samples, type );
+  };
+
+  auto undo = [setSamples,oldSamples](){ setSamples( oldSamples ); };
+  auto redo = [setSamples,newSamples](){ setSamples( newSamples ); };
+
+  const size_t nbytes = 2*sizeof(int)*(oldSamples.size() + newSamples.size());
+
+  addUndoRedoStep( undo, redo, "sample number change", nbytes );
+}//void sampleNumbersChanged(...)
@@ -27,11 +27,26 @@ extern "C"{
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <streambuf>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "SpecUtils/UtilityFunctions.h"
 
 #include "InterSpec/ZipArchive.h"
+#include "InterSpec/ComputeScheduler.h"
 
 using namespace std;
 
@@ -43,6 +58,57 @@ using namespace std;
 //  zlib example code.
 
 
+namespace
+{
+  /** Read-only std::streambuf over a block of memory, supporting seeking, so
+   the existing stream based header reading can be used with a mapped file.
+   */
+  class MemoryStreamBuf : public std::streambuf
+  {
+  public:
+    MemoryStreamBuf( const char *data, const size_t size )
+    {
+      char *p = const_cast<char *>( data );
+      setg( p, p, p + size );
+    }
+    
+  protected:
+    virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+                              std::ios_base::openmode which )
+    {
+      char *pos = nullptr;
+      if( dir == std::ios_base::beg )
+        pos = eback() + off;
+      else if( dir == std::ios_base::cur )
+        pos = gptr() + off;
+      else
+        pos = egptr() + off;
+      
+      if( pos < eback() || pos > egptr() )
+        return pos_type( off_type(-1) );
+      
+      setg( eback(), pos, egptr() );
+      return pos_type( off_type(pos - eback()) );
+    }//seekoff(...)
+    
+    virtual pos_type seekpos( pos_type pos, std::ios_base::openmode which )
+    {
+      return seekoff( off_type(pos), std::ios_base::beg, which );
+    }
+  };//class MemoryStreamBuf
+  
+  
+  template<class T>
+  T read_little_endian( const unsigned char *data )
+  {
+    T answer = 0;
+    for( size_t i = 0; i < sizeof(T); ++i )
+      answer |= (static_cast<T>(data[i]) << (8*i));
+    return answer;
+  }
+}//namespace
+
+
 namespace ZipArchive
 {
 
@@ -303,5 +369,216 @@ std::map<std::string, std::shared_ptr<const ZipFileHeader> >
   
   return answer;
 }
-}//namespace ZipArchive
 
+
+MappedZipFile::MappedZipFile( const std::string &filename )
+  : m_data( nullptr ),
+    m_size( 0 )
+#ifdef _WIN32
+    , m_file( nullptr ),
+    m_mapping( nullptr )
+#endif
+{
+#ifdef _WIN32
+  const std::wstring wfilename = UtilityFunctions::convert_from_utf8_to_utf16( filename );
+  HANDLE file = CreateFileW( wfilename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+  if( file == INVALID_HANDLE_VALUE )
+    throw runtime_error( "ZipArchive: could not open file" );
+  m_file = file;
+  
+  LARGE_INTEGER filesize;
+  if( !GetFileSizeEx( file, &filesize ) || filesize.QuadPart < 22 )
+  {
+    unmap();
+    throw runtime_error( "ZipArchive: invalid file size" );
+  }
+  m_size = static_cast<size_t>( filesize.QuadPart );
+  
+  HANDLE mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+  if( !mapping )
+  {
+    unmap();
+    throw runtime_error( "ZipArchive: could not map file" );
+  }
+  m_mapping = mapping;
+  
+  m_data = static_cast<const char *>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+  if( !m_data )
+  {
+    unmap();
+    throw runtime_error( "ZipArchive: could not map file" );
+  }
+#else
+  const int fd = open( filename.c_str(), O_RDONLY );
+  if( fd < 0 )
+    throw runtime_error( "ZipArchive: could not open file" );
+  
+  struct stat filestat;
+  if( fstat( fd, &filestat ) != 0 || filestat.st_size < 22 )
+  {
+    close( fd );
+    throw runtime_error( "ZipArchive: invalid file size" );
+  }
+  
+  m_size = static_cast<size_t>( filestat.st_size );
+  void *data = mmap( nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  
+  if( data == MAP_FAILED )
+  {
+    m_size = 0;
+    throw runtime_error( "ZipArchive: could not map file" );
+  }
+  
+  m_data = static_cast<const char *>( data );
+#endif
+  
+  try
+  {
+    MemoryStreamBuf buffer( m_data, m_size );
+    std::istream strm( &buffer );
+    m_headers = open_zip_file( strm );
+  }catch( ... )
+  {
+    unmap();
+    throw;
+  }
+}//MappedZipFile constructor
+
+
+MappedZipFile::~MappedZipFile()
+{
+  unmap();
+}
+
+
+void MappedZipFile::unmap()
+{
+#ifdef _WIN32
+  if( m_data )
+    UnmapViewOfFile( m_data );
+  if( m_mapping )
+    CloseHandle( m_mapping );
+  if( m_file )
+    CloseHandle( m_file );
+  m_mapping = m_file = nullptr;
+#else
+  if( m_data )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}//void unmap()
+
+
+const FilenameToZipHeaderMap &MappedZipFile::headers() const
+{
+  return m_headers;
+}
+
+
+size_t MappedZipFile::read_file( std::shared_ptr<const ZipFileHeader> header,
+                                 std::vector<char> &output,
+                                 const bool null_terminate ) const
+{
+  if( !header )
+    throw runtime_error( "ZipArchive: no zip file header passed in to read" );
+  
+  const uint16_t DEFLATE = 8;
+  const uint16_t UNCOMPRESSED = 0;
+  const size_t local_header_size = 30;
+  
+  //The central directory (which 'header' came from) always has the correct
+  //  sizes, but the local header determines where the data actually starts.
+  const size_t offset = header->header_offset;
+  if( offset > m_size || (m_size - offset) < local_header_size )
+    throw runtime_error( "ZipArchive: invalid local header offset" );
+  
+  const unsigned char *local = reinterpret_cast<const unsigned char *>( m_data + offset );
+  if( read_little_endian<uint32_t>( local ) != 0x04034b50 )
+    throw runtime_error( "ZipArchive: did not find local header signature" );
+  
+  const size_t filename_length = read_little_endian<uint16_t>( local + 26 );
+  const size_t extra_length = read_little_endian<uint16_t>( local + 28 );
+  const size_t data_start = offset + local_header_size + filename_length + extra_length;
+  const size_t compressed_size = header->compressed_size;
+  const size_t uncompressed_size = header->uncompressed_size;
+  
+  if( data_start > m_size || (m_size - data_start) < compressed_size )
+    throw runtime_error( "ZipArchive: file data extends past end of archive" );
+  
+  output.resize( uncompressed_size + (null_terminate ? 1 : 0) );
+  if( null_terminate )
+    output[uncompressed_size] = '\0';
+  
+  if( !uncompressed_size )
+    return 0;
+  
+  if( header->compression_type == UNCOMPRESSED )
+  {
+    if( compressed_size != uncompressed_size )
+      throw runtime_error( "ZipArchive: inconsistent sizes for stored file" );
+    std::copy( m_data + data_start, m_data + data_start + uncompressed_size,
+               output.begin() );
+    return uncompressed_size;
+  }//if( header->compression_type == UNCOMPRESSED )
+  
+  if( header->compression_type != DEFLATE )
+    throw runtime_error( "ZipArchive: unrecognized compression" );
+  
+  z_stream strm;
+  strm.zalloc   = Z_NULL;
+  strm.zfree    = Z_NULL;
+  strm.opaque   = Z_NULL;
+  strm.next_in  = (Bytef *)( m_data + data_start );
+  strm.avail_in = static_cast<uInt>( compressed_size );
+  strm.next_out = (Bytef *)( &output[0] );
+  strm.avail_out = static_cast<uInt>( uncompressed_size );
+  
+  if( inflateInit2( &strm, -MAX_WBITS ) != Z_OK )
+    throw runtime_error( "ZipArchive: gzip inflateInit2 didnt return Z_OK" );
+  
+  //We know the full output size, so can inflate in a single call.
+  const int ret = inflate( &strm, Z_FINISH );
+  const string msg = strm.msg ? strm.msg : "(no msg)";
+  const size_t nwritten = uncompressed_size - strm.avail_out;
+  inflateEnd( &strm );
+  
+  if( ret != Z_STREAM_END )
+    throw runtime_error( "ZipArchive: gzip error " + msg );
+  
+  if( nwritten != uncompressed_size )
+    throw runtime_error( "ZipArchive: inflated size didnt match expected size" );
+  
+  return nwritten;
+}//size_t MappedZipFile::read_file(...)
+
+
+void MappedZipFile::read_files( const std::vector<std::shared_ptr<const ZipFileHeader> > &files,
+                                const std::function<void(size_t,std::vector<char> &)> &callback,
+                                const bool null_terminate ) const
+{
+  ComputeScheduler::TaskGroup pool;
+  
+  for( size_t i = 0; i < files.size(); ++i )
+  {
+    pool.post( [this,i,&files,&callback,null_terminate](){
+      try
+      {
+        std::vector<char> data;
+        read_file( files[i], data, null_terminate );
+        callback( i, data );
+      }catch( std::exception &e )
+      {
+        cerr << "ZipArchive: failed to read '"
+             << (files[i] ? files[i]->filename : string("null"))
+             << "' from zip: " << e.what() << endl;
+      }
+    } );
+  }//for( size_t i = 0; i < files.size(); ++i )
+  
+  pool.join();
+}//void MappedZipFile::read_files(...)
+
+}//namespace ZipArchive
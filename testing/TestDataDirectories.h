@@ -0,0 +1,80 @@
+#ifndef TestDataDirectories_h
+#define TestDataDirectories_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include "SpecUtils/UtilityFunctions.h"
+
+//Locations of the data the unit tests use; included by the test sources
+//  after defining BOOST_TEST_MODULE.
+
+namespace
+{
+  //command_line_directory(...): the directory given by the '--flag=...'
+  //  command line argument (e.g., "--datadir="), or 'defaultdir' if not given;
+  //  if the directory doesnt exist, "../" + defaultdir is returned, for when
+  //  the test is run from the build directory.
+  inline std::string command_line_directory( const std::string &flag,
+                                             const std::string &defaultdir )
+  {
+    std::string dir = defaultdir;
+    
+    const int argc = boost::unit_test::framework::master_test_suite().argc;
+    char **argv = boost::unit_test::framework::master_test_suite().argv;
+    for( int i = 1; i < argc; ++i )
+    {
+      const std::string arg = argv[i];
+      if( UtilityFunctions::starts_with( arg, flag ) )
+        dir = arg.substr( flag.size() );
+    }//for( int i = 1; i < argc; ++i )
+    
+    if( !UtilityFunctions::is_directory( dir ) )
+      dir = "../" + defaultdir;
+    
+    return dir;
+  }//std::string command_line_directory(...)
+  
+  
+  //data_directory(): directory with sandia.decay.xml, MaterialDataBase.txt,
+  //  etc; may be specified with the --datadir=... command line argument.
+  inline std::string data_directory()
+  {
+    return command_line_directory( "--datadir=", "data" );
+  }
+  
+  
+  //example_spectra_dir(): directory with the example spectrum files; may be
+  //  specified with the --indir=... command line argument.
+  inline std::string example_spectra_dir()
+  {
+    return command_line_directory( "--indir=", "example_spectra" );
+  }
+}//namespace
+
+#endif //TestDataDirectories_h
@@ -0,0 +1,355 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include "InterSpec_config.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testComputeScheduler
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/ComputeScheduler.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks how ComputeScheduler shares its worker threads between sessions that
+//  are contending for them: each session gets its share, weights are
+//  respected, Background work cant take the last thread, cancelled sessions
+//  dont run, and nested TaskGroups dont deadlock.
+
+namespace
+{
+  typedef ComputeScheduler::Priority Priority;
+
+  //Records the order jobs started in.
+  class StartLog
+  {
+  public:
+    void started( const string &what )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_starts.push_back( what );
+    }
+
+    vector<string> starts() const
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      return m_starts;
+    }
+
+    //Number of the first 'n' jobs started that were for 'what'.
+    size_t countInFirst( const string &what, const size_t n ) const
+    {
+      const vector<string> s = starts();
+      return std::count( begin(s), begin(s) + std::min(n, s.size()), what );
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    vector<string> m_starts;
+  };//class StartLog
+
+
+  void sleep_ms( const int ms )
+  {
+    std::this_thread::sleep_for( std::chrono::milliseconds(ms) );
+  }
+
+
+  //Waits for all jobs, of all sessions, to finish.
+  void wait_for_idle()
+  {
+    ComputeScheduler &scheduler = ComputeScheduler::instance();
+    const auto start = std::chrono::steady_clock::now();
+    while( scheduler.numQueued() || scheduler.numRunning() )
+    {
+      BOOST_REQUIRE( (std::chrono::steady_clock::now() - start) < std::chrono::seconds(60) );
+      sleep_ms( 1 );
+    }
+  }//void wait_for_idle()
+
+
+  //Occupies every worker thread, so work can be queued up by multiple sessions
+  //  before any of it starts; the threads are released when the object is
+  //  destroyed, or release() is called.
+  class BlockWorkers
+  {
+  public:
+    BlockWorkers()
+      : m_release(),
+        m_released( m_release.get_future().share() ),
+        m_numBlocked( 0 ),
+        m_didRelease( false )
+    {
+      ComputeScheduler &scheduler = ComputeScheduler::instance();
+      const size_t nthreads = scheduler.maxThreads();
+      for( size_t i = 0; i < nthreads; ++i )
+      {
+        std::shared_future<void> released = m_released;
+        std::atomic<size_t> *nblocked = &m_numBlocked;
+        scheduler.post( "blocker", [released,nblocked](){
+          ++(*nblocked);
+          released.wait();
+        }, Priority::Interactive );
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      while( m_numBlocked < nthreads )
+      {
+        BOOST_REQUIRE( (std::chrono::steady_clock::now() - start) < std::chrono::seconds(10) );
+        sleep_ms( 1 );
+      }
+    }//BlockWorkers()
+
+    void release()
+    {
+      if( !m_didRelease )
+        m_release.set_value();
+      m_didRelease = true;
+    }
+
+    ~BlockWorkers()
+    {
+      release();
+    }
+
+  private:
+    std::promise<void> m_release;
+    std::shared_future<void> m_released;
+    std::atomic<size_t> m_numBlocked;
+    bool m_didRelease;
+  };//class BlockWorkers
+
+
+  //Queues 'njobs' jobs for 'session' that log their start, then sleep.
+  void post_jobs( const string &session, const size_t njobs, StartLog &log,
+                  const Priority priority = Priority::Normal, const int sleep = 2 )
+  {
+    for( size_t i = 0; i < njobs; ++i )
+    {
+      ComputeScheduler::instance().post( session, [session,&log,sleep](){
+        log.started( session );
+        sleep_ms( sleep );
+      }, priority );
+    }
+  }//void post_jobs(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testContendingSessionsShareThreads )
+{
+  ComputeScheduler &scheduler = ComputeScheduler::instance();
+  scheduler.setMaxThreads( 4 );
+  wait_for_idle();
+
+  StartLog log;
+
+  {
+    //Session A queues all its work before B queues any; B must not have to
+    //  wait for all of A's work to finish.
+    BlockWorkers block;
+    post_jobs( "A", 60, log );
+    post_jobs( "B", 60, log );
+    BOOST_CHECK_EQUAL( scheduler.numQueued(), 120 );
+  }
+
+  wait_for_idle();
+
+  BOOST_REQUIRE_EQUAL( log.starts().size(), 120 );
+  const size_t nB = log.countInFirst( "B", 40 );
+  BOOST_TEST_MESSAGE( "Session B started " << nB << " of the first 40 jobs" );
+  BOOST_CHECK( nB >= 14 && nB <= 26 );
+}//BOOST_AUTO_TEST_CASE( testContendingSessionsShareThreads )
+
+
+BOOST_AUTO_TEST_CASE( testSessionWeights )
+{
+  ComputeScheduler &scheduler = ComputeScheduler::instance();
+  scheduler.setMaxThreads( 4 );
+  wait_for_idle();
+
+  scheduler.setSessionWeight( "Heavy", 3.0 );
+  scheduler.setSessionWeight( "Light", 1.0 );
+
+  StartLog log;
+
+  {
+    BlockWorkers block;
+    post_jobs( "Light", 60, log );
+    post_jobs( "Heavy", 60, log );
+  }
+
+  wait_for_idle();
+
+  const size_t nheavy = log.countInFirst( "Heavy", 40 );
+  const size_t nlight = log.countInFirst( "Light", 40 );
+  BOOST_TEST_MESSAGE( "Of the first 40 jobs, " << nheavy << " were the heavy session's, "
+                      << nlight << " the light session's" );
+  BOOST_CHECK( nheavy >= 2*nlight );
+  BOOST_CHECK( nlight > 0 );
+
+  scheduler.cancelSession( "Heavy" );
+  scheduler.cancelSession( "Light" );
+}//BOOST_AUTO_TEST_CASE( testSessionWeights )
+
+
+BOOST_AUTO_TEST_CASE( testInteractiveNotStarvedByBackground )
+{
+  ComputeScheduler &scheduler = ComputeScheduler::instance();
+  scheduler.setMaxThreads( 2 );
+  wait_for_idle();
+
+  StartLog log;
+  std::atomic<size_t> nbackground( 0 ), maxbackground( 0 );
+
+  for( size_t i = 0; i < 20; ++i )
+  {
+    scheduler.post( "A", [&log,&nbackground,&maxbackground](){
+      log.started( "A" );
+      const size_t n = ++nbackground;
+      size_t prev = maxbackground;
+      while( n > prev && !maxbackground.compare_exchange_weak( prev, n ) )
+      {
+      }
+      sleep_ms( 5 );
+      --nbackground;
+    }, Priority::Background );
+  }//for( size_t i = 0; i < 20; ++i )
+
+  sleep_ms( 10 );
+  post_jobs( "B", 1, log, Priority::Interactive );
+
+  wait_for_idle();
+
+  //Background work of session A may only ever use one of the two threads, so
+  //  B's interactive job starts right away, not after A's 20 jobs.
+  const vector<string> starts = log.starts();
+  BOOST_REQUIRE_EQUAL( starts.size(), 21 );
+  const size_t bpos = std::find( begin(starts), end(starts), "B" ) - begin(starts);
+  BOOST_TEST_MESSAGE( "Interactive job started " << bpos << " jobs in" );
+  BOOST_CHECK( bpos < 10 );
+  BOOST_CHECK_EQUAL( maxbackground.load(), 1 );
+}//BOOST_AUTO_TEST_CASE( testInteractiveNotStarvedByBackground )
+
+
+BOOST_AUTO_TEST_CASE( testCancelContendingSession )
+{
+  ComputeScheduler &scheduler = ComputeScheduler::instance();
+  scheduler.setMaxThreads( 2 );
+  wait_for_idle();
+
+  StartLog log;
+  std::shared_ptr<ComputeScheduler::CancellationToken> token;
+
+  {
+    BlockWorkers block;
+    post_jobs( "A", 20, log );
+    token = scheduler.post( "A", [&log](){ log.started( "A" ); } );
+    post_jobs( "B", 20, log );
+
+    scheduler.cancelSession( "A" );
+    BOOST_CHECK_EQUAL( scheduler.numQueued(), 20 );
+  }
+
+  wait_for_idle();
+
+  BOOST_CHECK( token->isCancelled() );
+  BOOST_CHECK_EQUAL( log.countInFirst( "A", 1000 ), 0 );
+  BOOST_CHECK_EQUAL( log.countInFirst( "B", 1000 ), 20 );
+}//BOOST_AUTO_TEST_CASE( testCancelContendingSession )
+
+
+BOOST_AUTO_TEST_CASE( testNestedTaskGroups )
+{
+  ComputeScheduler &scheduler = ComputeScheduler::instance();
+  scheduler.setMaxThreads( 2 );
+  wait_for_idle();
+
+  //More jobs than threads, each of which waits on a group of tasks that wait
+  //  on a group of tasks; this must finish, with each task attributed to the
+  //  session and priority of the job that created it.
+  const size_t njobs = 8, ntasks = 6;
+  std::atomic<size_t> ncompleted( 0 ), nmismatched( 0 );
+
+  for( size_t job = 0; job < njobs; ++job )
+  {
+    const string session = (job % 2) ? "A" : "B";
+    scheduler.post( session, [session,&ncompleted,&nmismatched,ntasks](){
+      ComputeScheduler::TaskGroup outer;
+      for( size_t i = 0; i < ntasks; ++i )
+      {
+        outer.post( [session,&ncompleted,&nmismatched,ntasks](){
+          ComputeScheduler::TaskGroup inner;
+          for( size_t j = 0; j < ntasks; ++j )
+          {
+            inner.post( [session,&ncompleted,&nmismatched](){
+              if( ComputeScheduler::currentSessionId() != session
+                  || ComputeScheduler::currentPriority() != Priority::Normal )
+                ++nmismatched;
+              sleep_ms( 1 );
+              ++ncompleted;
+            } );
+          }
+          inner.join();
+        } );
+      }
+      outer.join();
+    }, Priority::Normal );
+  }//for( size_t job = 0; job < njobs; ++job )
+
+  wait_for_idle();
+
+  BOOST_CHECK_EQUAL( ncompleted.load(), njobs * ntasks * ntasks );
+  BOOST_CHECK_EQUAL( nmismatched.load(), 0 );
+}//BOOST_AUTO_TEST_CASE( testNestedTaskGroups )
+
+
+BOOST_AUTO_TEST_CASE( testTaskGroupOutsideOfJob )
+{
+  //Not called from a job, or a WApplication event loop, so there is no
+  //  session, and someone is waiting on the result.
+  BOOST_CHECK( ComputeScheduler::currentSessionId().empty() );
+  BOOST_CHECK( ComputeScheduler::currentPriority() == Priority::Interactive );
+
+  std::atomic<int> sum( 0 );
+  ComputeScheduler::TaskGroup group;
+  for( int i = 1; i <= 100; ++i )
+    group.post( [i,&sum](){ sum += i; } );
+  group.join();
+  BOOST_CHECK_EQUAL( sum.load(), 5050 );
+
+  ComputeScheduler::TaskGroup throwing;
+  throwing.post( [](){ throw std::runtime_error( "expected" ); } );
+  BOOST_CHECK_THROW( throwing.join(), std::runtime_error );
+}//BOOST_AUTO_TEST_CASE( testTaskGroupOutsideOfJob )
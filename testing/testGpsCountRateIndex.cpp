@@ -0,0 +1,328 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testGpsCountRateIndex
+#include <boost/test/unit_test.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "InterSpec/GpsCountRateIndex.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks GpsCountRateIndex geohashes agree with standard base-32 geohashes,
+//  the cell counts and levels it reports agree with the cells it builds,
+//  query(...) gives the same cells as checking every cell, and coarsens to
+//  at most maxCells, and the CSV and GeoJSON exports have every sample/cell.
+
+namespace
+{
+  //TestIndex: exposes numCells(...), which is protected.
+  struct TestIndex : public GpsCountRateIndex
+  {
+    explicit TestIndex( const std::shared_ptr<const MeasurementInfo> &meas )
+      : GpsCountRateIndex( meas )
+    {
+    }
+
+    using GpsCountRateIndex::numCells;
+  };//struct TestIndex
+
+
+  const int sm_hotSample = 57;
+
+
+  //A synthetic walk survey: a meandering path of one second samples near
+  //  Albuquerque, with a hot spot, plus a few samples on either side of the
+  //  antimeridian, and a sample without GPS (which shouldnt be indexed).
+  std::shared_ptr<MeasurementInfo> make_survey( size_t &numGpsSamples )
+  {
+    auto info = std::make_shared<MeasurementInfo>();
+
+    struct Point{ double latitude, longitude; };
+    vector<Point> points;
+    for( size_t i = 0; i < 300; ++i )
+    {
+      const double t = static_cast<double>( i );
+      points.push_back( { 35.0844 + 1.0E-5*t, -106.6504 + 5.0E-4*std::sin(0.05*t) } );
+    }
+    points.push_back( { -17.0, 179.999 } );
+    points.push_back( { -17.0, 179.998 } );
+    points.push_back( { -17.0, -179.999 } );
+
+    const boost::posix_time::ptime start
+                  = boost::posix_time::time_from_string( "2019-06-01 10:00:00" );
+
+    vector<std::shared_ptr<Measurement>> measurements;
+    for( size_t i = 0; i <= points.size(); ++i )
+    {
+      const int sample = static_cast<int>( i ) + 1;
+      const float counts = (sample == sm_hotSample) ? 5000.0f : (100.0f + (i % 17));
+
+      auto meas = std::make_shared<Measurement>();
+      meas->set_sample_number( sample );
+      meas->set_gamma_counts( std::make_shared<vector<float>>( 64, counts / 64.0f ), 1.0f, 1.0f );
+      meas->set_neutron_counts( vector<float>( 1, 2.0f ) );
+      info->add_measurment( meas, false );
+      measurements.push_back( meas );
+    }//for( loop over points, plus the sample without GPS )
+
+    info->cleanup_after_load( MeasurementInfo::DontChangeOrReorderSamples );
+
+    for( size_t i = 0; i < points.size(); ++i )
+    {
+      const boost::posix_time::ptime time = start + boost::posix_time::seconds( static_cast<long>(i) );
+      info->set_start_time( time, measurements[i] );
+      info->set_position( points[i].longitude, points[i].latitude, time, measurements[i] );
+    }
+
+    numGpsSamples = points.size();
+
+    return info;
+  }//make_survey(...)
+
+
+  size_t count_occurrences( const string &str, const string &what )
+  {
+    size_t n = 0;
+    for( size_t pos = str.find( what ); pos != string::npos; pos = str.find( what, pos + 1 ) )
+      ++n;
+    return n;
+  }//count_occurrences(...)
+
+
+  //Cells of 'index' at 'level' whose centroid is in 'viewport', by checking
+  //  every cell.
+  vector<std::uint64_t> brute_force_query( const GpsCountRateIndex &index,
+                                           const GpsCountRateIndex::Extent &viewport,
+                                           const int level )
+  {
+    vector<std::uint64_t> answer;
+    for( const GpsCountRateIndex::Cell &cell : index.cells( level ) )
+    {
+      if( viewport.contains( cell.latitude, cell.longitude ) )
+        answer.push_back( cell.geohash );
+    }
+    return answer;
+  }//brute_force_query(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( geohashMatchesStandard )
+{
+  //Well known geohashes (e.g., from the Wikipedia Geohash article).
+  BOOST_CHECK_EQUAL( GpsCountRateIndex::geohashString( GpsCountRateIndex::geohash( 57.64911, 10.40744 ), 11 ), "u4pruydqqvj" );
+  BOOST_CHECK_EQUAL( GpsCountRateIndex::geohashString( GpsCountRateIndex::geohash( 42.6, -5.6 ), 5 ), "ezs42" );
+  BOOST_CHECK_EQUAL( GpsCountRateIndex::geohashString( GpsCountRateIndex::geohash( -25.382708, -49.265506 ), 12 ), "6gkzwgjzn820" );
+
+  //At most 12 characters (60 bits) are available.
+  BOOST_CHECK_EQUAL( GpsCountRateIndex::geohashString( GpsCountRateIndex::geohash( -25.382708, -49.265506 ), 20 ).size(), 12 );
+
+  //Every 5 bits of a cell geohash is a character, so cells at levels that
+  //  are a multiple of 5 bits are the standard geohash prefixes.
+  const std::uint64_t hash = GpsCountRateIndex::geohash( 57.64911, 10.40744 );
+  const string full = GpsCountRateIndex::geohashString( hash, 12 );
+  for( int level = 5; level <= 30; level += 5 )
+  {
+    const std::uint64_t prefix = hash >> (64 - 2*level);
+    const size_t nchars = static_cast<size_t>( 2*level / 5 );
+    BOOST_CHECK_EQUAL( GpsCountRateIndex::geohashString( prefix << (64 - 2*level), nchars ),
+                       full.substr( 0, nchars ) );
+  }
+
+  //Corners of the world dont overflow.
+  BOOST_CHECK_EQUAL( GpsCountRateIndex::geohash( -90.0, -180.0 ), std::uint64_t(0) );
+  BOOST_CHECK_EQUAL( GpsCountRateIndex::geohash( 90.0, 180.0 ), ~std::uint64_t(0) );
+}//BOOST_AUTO_TEST_CASE( geohashMatchesStandard )
+
+
+BOOST_AUTO_TEST_CASE( cellCountsAgree )
+{
+  size_t numGpsSamples = 0;
+  const std::shared_ptr<MeasurementInfo> info = make_survey( numGpsSamples );
+
+  //numCells(...) is checked before the cells are cached, as otherwise it
+  //  just returns the cached size.
+  const TestIndex uncached( info );
+  const TestIndex index( info );
+
+  BOOST_REQUIRE_EQUAL( index.samples().size(), numGpsSamples );
+
+  size_t previous = 0;
+  for( int level = 0; level <= GpsCountRateIndex::sm_maxLevel; ++level )
+  {
+    const vector<GpsCountRateIndex::Cell> &cells = index.cells( level );
+    BOOST_CHECK_EQUAL( uncached.numCells( level ), cells.size() );
+    BOOST_CHECK_GE( cells.size(), previous );
+    previous = cells.size();
+
+    size_t nsamples = 0, expectedBegin = 0;
+    for( size_t i = 0; i < cells.size(); ++i )
+    {
+      BOOST_CHECK_EQUAL( cells[i].beginSample, expectedBegin );
+      BOOST_CHECK_EQUAL( cells[i].endSample - cells[i].beginSample, cells[i].numSamples );
+      BOOST_CHECK( i == 0 || cells[i-1].geohash < cells[i].geohash );
+      expectedBegin = cells[i].endSample;
+      nsamples += cells[i].numSamples;
+    }
+    BOOST_CHECK_EQUAL( nsamples, numGpsSamples );
+  }//for( loop over levels )
+
+  BOOST_CHECK_EQUAL( index.cells( 0 ).size(), 1 );
+
+  for( const size_t maxCells : { size_t(1), size_t(2), size_t(3), size_t(10), size_t(50), size_t(100000) } )
+  {
+    const int level = TestIndex( info ).finestLevelWithAtMost( maxCells );
+    BOOST_CHECK_LE( index.cells( level ).size(), maxCells );
+    if( level < GpsCountRateIndex::sm_maxLevel )
+      BOOST_CHECK_GT( index.cells( level + 1 ).size(), maxCells );
+  }
+
+  BOOST_CHECK_THROW( index.cells( -1 ), std::exception );
+  BOOST_CHECK_THROW( index.cells( GpsCountRateIndex::sm_maxLevel + 1 ), std::exception );
+}//BOOST_AUTO_TEST_CASE( cellCountsAgree )
+
+
+BOOST_AUTO_TEST_CASE( queryMatchesBruteForce )
+{
+  size_t numGpsSamples = 0;
+  const std::shared_ptr<MeasurementInfo> info = make_survey( numGpsSamples );
+  const GpsCountRateIndex index( info );
+
+  typedef GpsCountRateIndex::Extent Extent;
+  const Extent viewports[] = {
+    index.extent(),
+    { 35.0850, -106.6510, 35.0860, -106.6500 },  //part of the path
+    { 35.0844, -106.6504, 35.0874, -106.6499 },  //starts on a sample
+    { 0.0, 0.0, 10.0, 10.0 },                    //no samples
+    { -18.0, 179.9985, -16.0, -179.9 },          //crosses the antimeridian
+    { -90.0, -180.0, 90.0, 180.0 }               //whole world
+  };
+
+  for( const Extent &viewport : viewports )
+  {
+    for( int level = 0; level <= GpsCountRateIndex::sm_maxLevel; ++level )
+    {
+      int usedLevel = level;
+      const vector<GpsCountRateIndex::Cell> cells = index.query( viewport, usedLevel );
+      BOOST_CHECK_EQUAL( usedLevel, level );
+
+      vector<std::uint64_t> hashes;
+      for( const GpsCountRateIndex::Cell &cell : cells )
+        hashes.push_back( cell.geohash );
+
+      const vector<std::uint64_t> expected = brute_force_query( index, viewport, level );
+      BOOST_CHECK_MESSAGE( hashes == expected,
+                           "query() at level " << level << " gave " << hashes.size()
+                           << " cells, but " << expected.size() << " expected" );
+    }//for( loop over levels )
+  }//for( loop over viewports )
+
+  //The antimeridian viewport has a sample on each side of the antimeridian,
+  //  and misses the one just west of it.
+  int level = GpsCountRateIndex::sm_maxLevel;
+  BOOST_CHECK_EQUAL( index.query( viewports[4], level ).size(), 2 );
+
+  //Coarsens until there are at most maxCells cells.
+  for( const size_t maxCells : { size_t(1), size_t(4), size_t(25), size_t(100) } )
+  {
+    for( const Extent &viewport : { viewports[0], viewports[5] } )
+    {
+      int usedLevel = GpsCountRateIndex::sm_maxLevel;
+      const vector<GpsCountRateIndex::Cell> cells = index.query( viewport, usedLevel, maxCells );
+      BOOST_CHECK( cells.size() <= maxCells || usedLevel == 0 );
+      BOOST_CHECK_EQUAL( cells.size(), brute_force_query( index, viewport, usedLevel ).size() );
+
+      //The next finer level would have been too many.
+      if( usedLevel < GpsCountRateIndex::sm_maxLevel )
+        BOOST_CHECK_GT( brute_force_query( index, viewport, usedLevel + 1 ).size(), maxCells );
+    }
+  }//for( loop over maxCells )
+
+  //Invalid levels are clamped.
+  level = 100;
+  index.query( viewports[0], level );
+  BOOST_CHECK_EQUAL( level, GpsCountRateIndex::sm_maxLevel );
+}//BOOST_AUTO_TEST_CASE( queryMatchesBruteForce )
+
+
+BOOST_AUTO_TEST_CASE( exportCsvAndGeoJson )
+{
+  size_t numGpsSamples = 0;
+  const std::shared_ptr<MeasurementInfo> info = make_survey( numGpsSamples );
+  const GpsCountRateIndex index( info );
+
+  //Per-sample CSV: a header line, then a line per sample.
+  stringstream csv;
+  BOOST_CHECK( index.writeCsv( csv ) );
+  const string csvstr = csv.str();
+  BOOST_CHECK_EQUAL( count_occurrences( csvstr, "\r\n" ), numGpsSamples + 1 );
+  BOOST_CHECK( csvstr.find( "SampleNumber,StartTime,Latitude,Longitude" ) == 0 );
+  BOOST_CHECK( csvstr.find( "\r\n" + std::to_string(sm_hotSample) + "," ) != string::npos );
+  BOOST_CHECK( csvstr.find( "2019-06-01T10:00:00" ) != string::npos );
+  BOOST_CHECK( csvstr.find( ",5000," ) != string::npos );
+  BOOST_CHECK( csvstr.find( "\r\n" + std::to_string(numGpsSamples + 1) + "," ) == string::npos );
+
+  //Per-cell CSV.
+  const int level = 12;
+  stringstream cellcsv;
+  BOOST_CHECK( index.writeCsv( cellcsv, level ) );
+  BOOST_CHECK_EQUAL( count_occurrences( cellcsv.str(), "\r\n" ), index.cells( level ).size() + 1 );
+  BOOST_CHECK( cellcsv.str().find( "Level,Latitude,Longitude,NumSamples" ) == 0 );
+
+  //GeoJSON, per-sample and per-cell.
+  stringstream geojson;
+  BOOST_CHECK( index.writeGeoJson( geojson ) );
+  const string geojsonstr = geojson.str();
+  BOOST_CHECK( geojsonstr.find( "{\"type\":\"FeatureCollection\",\"features\":[" ) == 0 );
+  BOOST_CHECK_EQUAL( count_occurrences( geojsonstr, "{\"type\":\"Feature\"," ), numGpsSamples );
+  BOOST_CHECK_EQUAL( count_occurrences( geojsonstr, "\"neutronCounts\":" ), numGpsSamples );
+  BOOST_CHECK( geojsonstr.find( "\"coordinates\":[179.9990000,-17.0000000]" ) != string::npos );
+  BOOST_CHECK( geojsonstr.find( "\"sampleNumber\":" + std::to_string(sm_hotSample) + "," ) != string::npos );
+  BOOST_CHECK( geojsonstr.find( "nan" ) == string::npos );
+  BOOST_CHECK( geojsonstr.find( "\n]}\n" ) == geojsonstr.size() - 4 );
+
+  stringstream cellgeojson;
+  BOOST_CHECK( index.writeGeoJson( cellgeojson, level ) );
+  BOOST_CHECK_EQUAL( count_occurrences( cellgeojson.str(), "{\"type\":\"Feature\"," ), index.cells( level ).size() );
+  BOOST_CHECK_EQUAL( count_occurrences( cellgeojson.str(), "\"level\":12," ), index.cells( level ).size() );
+
+  //A file without GPS still gives a header, or an empty collection.
+  const GpsCountRateIndex empty( nullptr );
+  stringstream emptycsv, emptyjson;
+  BOOST_CHECK( !empty.writeCsv( emptycsv ) );
+  BOOST_CHECK_EQUAL( count_occurrences( emptycsv.str(), "\r\n" ), 1 );
+  BOOST_CHECK( !empty.writeGeoJson( emptyjson ) );
+  BOOST_CHECK_EQUAL( emptyjson.str(), "{\"type\":\"FeatureCollection\",\"features\":[\n]}\n" );
+}//BOOST_AUTO_TEST_CASE( exportCsvAndGeoJson )
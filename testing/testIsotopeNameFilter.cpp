@@ -0,0 +1,186 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testIsotopeNameFilter
+#include <boost/test/unit_test.hpp>
+
+#include <boost/any.hpp>
+
+#include <Wt/WString>
+#include <Wt/WApplication>
+#include <Wt/WModelIndex>
+#include <Wt/Test/WTestEnvironment>
+
+#include "SandiaDecay/SandiaDecay.h"
+#include "InterSpec/ReactionGamma.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/IsotopeNameFilterModel.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Benchmarks the type-ahead suggestions of IsotopeNameFilterModel::filter(...)
+//  as a user types out nuclide, element, and reaction names one keystroke at a
+//  time, and checks the expected suggestions are given.
+
+namespace
+{
+  struct NameFilterFixture
+  {
+    NameFilterFixture()
+      : env( Wt::Application ),
+        app( env ),
+        model( nullptr )
+    {
+      const string datadir = data_directory();
+      const string decayxml = UtilityFunctions::append_path( datadir, "sandia.decay.xml" );
+      const string rctnxml = UtilityFunctions::append_path( datadir, "sandia.reactiongamma.xml" );
+      
+      BOOST_REQUIRE_MESSAGE( UtilityFunctions::is_file( decayxml ),
+                             "Could not find " + decayxml + "; use --datadir=..." );
+      
+      //The fixture is constructed for each test case, but the databases can
+      //  only be configured once.
+      static bool configured = false;
+      if( !configured )
+      {
+        configured = true;
+        DecayDataBaseServer::setDecayXmlFile( decayxml );
+        ReactionGammaServer::set_xml_file_location( rctnxml );
+        ReactionGammaServer::set_binary_cache_location( "" );
+      }//if( !configured )
+      
+      BOOST_REQUIRE( DecayDataBaseServer::database() );
+      BOOST_REQUIRE( ReactionGammaServer::database() );
+    }//NameFilterFixture()
+    
+    //The current suggestions, in order.
+    vector<string> suggestions() const
+    {
+      vector<string> answer;
+      const int nrow = model.rowCount();
+      for( int row = 0; row < nrow; ++row )
+      {
+        const boost::any value = model.data( model.index( row, 0 ) );
+        answer.push_back( boost::any_cast<Wt::WString>( value ).toUTF8() );
+      }
+      return answer;
+    }//suggestions()
+    
+    bool suggested( const string &name ) const
+    {
+      const vector<string> current = suggestions();
+      return std::find( current.begin(), current.end(), name ) != current.end();
+    }
+    
+    Wt::Test::WTestEnvironment env;
+    Wt::WApplication app;
+    IsotopeNameFilterModel model;
+  };//struct NameFilterFixture
+}//namespace
+
+
+BOOST_FIXTURE_TEST_CASE( testSuggestions, NameFilterFixture )
+{
+  model.filter( "Co60" );
+  BOOST_CHECK( suggested( "Co60" ) );
+  BOOST_CHECK( !suggested( "Co59" ) );  //Stable isotopes are not suggested
+  
+  model.filter( "cobalt 60" );
+  BOOST_CHECK( suggested( "Co60" ) );
+  
+  model.filter( "Ba" );
+  BOOST_CHECK( suggested( "Ba133" ) );
+  BOOST_CHECK( suggested( "Ba" ) );  //The element, for x-rays
+  
+  model.filter( "133" );
+  BOOST_CHECK( suggested( "Ba133" ) );
+  
+  model.filter( "Tc99m" );
+  BOOST_CHECK( suggested( "Tc99m" ) );
+  
+  model.filter( "U235" );
+  BOOST_CHECK( suggested( "U235" ) );
+  BOOST_CHECK( !suggested( "Ba133" ) );
+  
+  model.filter( "Fe(n" );
+  const vector<string> reactions = suggestions();
+  BOOST_REQUIRE( !reactions.empty() );
+  for( const string &rctn : reactions )
+    BOOST_CHECK_MESSAGE( rctn.find( "(n" ) != string::npos, "'" + rctn + "' is not a neutron reaction" );
+  
+  model.filter( "" );
+  BOOST_CHECK_EQUAL( model.rowCount(), 0 );
+}//BOOST_FIXTURE_TEST_CASE( testSuggestions, NameFilterFixture )
+
+
+BOOST_FIXTURE_TEST_CASE( benchmarkTypeAhead, NameFilterFixture )
+{
+  const vector<string> typed = {
+    "Ba133", "Cobalt60", "U235", "U-238", "Th232", "Am241", "Cs137", "Tc99m",
+    "I131", "Eu152", "133", "60", "K40", "Pu239", "Fe(n,g)", "H(n,g)", "Pb",
+    "S.E. Co60", "Ra226", "Na22"
+  };
+  
+  //Build the name index outside of the timing.
+  model.filter( "a" );
+  
+  const size_t nrepeat = 20;
+  size_t nkeystrokes = 0, nsuggestions = 0;
+  
+  const auto start = std::chrono::steady_clock::now();
+  for( size_t i = 0; i < nrepeat; ++i )
+  {
+    for( const string &word : typed )
+    {
+      for( size_t len = 1; len <= word.size(); ++len )
+      {
+        model.filter( Wt::WString::fromUTF8( word.substr( 0, len ) ) );
+        nsuggestions += model.rowCount();
+        ++nkeystrokes;
+      }
+    }//for( const string &word : typed )
+  }//for( size_t i = 0; i < nrepeat; ++i )
+  const auto end = std::chrono::steady_clock::now();
+  
+  const double seconds = std::chrono::duration<double>( end - start ).count();
+  
+  BOOST_CHECK( nsuggestions > 0 );
+  
+  stringstream msg;
+  msg << "Filtering took " << 1.0E6*seconds/nkeystrokes << " us per keystroke ("
+      << nkeystrokes << " keystrokes, average of "
+      << double(nsuggestions)/nkeystrokes << " suggestions)";
+  BOOST_TEST_MESSAGE( msg.str() );
+}//BOOST_FIXTURE_TEST_CASE( benchmarkTypeAhead, NameFilterFixture )
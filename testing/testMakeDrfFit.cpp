@@ -0,0 +1,217 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testMakeDrfFit
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks the efficiency and FWHM fits of MakeDrfFit recover the equations
+//  synthetic data was generated from, that starting from a previous solution
+//  gives the same answer, and that the scans over functional forms pick the
+//  candidate with the lowest BIC.
+
+namespace
+{
+  //Intrinsic efficiency equation (energy in MeV) the data is generated from.
+  const vector<float> sm_true_eff = { -2.7f, -1.2f, -0.18f };
+  
+  //GADRAS FWHM equation (for a NaI-like detector) the peaks are generated from.
+  const vector<float> sm_true_fwhm = { -6.0f, 7.0f, 0.5f };
+  
+  vector<MakeDrfFit::DetEffDataPoint> efficiency_data()
+  {
+    vector<MakeDrfFit::DetEffDataPoint> data;
+    for( int i = 0; i < 20; ++i )
+    {
+      const double energy = 0.05 * std::pow( 60.0, i / 19.0 );  //50 keV to 3 MeV
+      const double logx = std::log( energy );
+      const double eff = std::exp( sm_true_eff[0] + sm_true_eff[1]*logx + sm_true_eff[2]*logx*logx );
+      
+      MakeDrfFit::DetEffDataPoint point;
+      point.energy = static_cast<float>( energy );
+      point.efficiency = static_cast<float>( eff );
+      point.efficiency_uncert = static_cast<float>( 0.02*eff );
+      data.push_back( point );
+    }//for( int i = 0; i < 20; ++i )
+    
+    return data;
+  }//efficiency_data()
+  
+  
+  std::shared_ptr<const deque<std::shared_ptr<const PeakDef>>> fwhm_peaks()
+  {
+    auto peaks = std::make_shared<deque<std::shared_ptr<const PeakDef>>>();
+    for( const double energy : { 59.5, 81.0, 122.1, 186.2, 356.0, 511.0, 661.7,
+                                 911.2, 1173.2, 1332.5, 1460.8, 1764.5, 2614.5 } )
+    {
+      const float sigma = DetectorPeakResponse::peakResolutionSigma( static_cast<float>(energy),
+                                                DetectorPeakResponse::kGadrasResolutionFcn,
+                                                sm_true_fwhm );
+      peaks->push_back( std::make_shared<const PeakDef>( energy, sigma, 1000.0 ) );
+    }
+    
+    return peaks;
+  }//fwhm_peaks()
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testEfficiencyFitAndWarmStart )
+{
+  const vector<MakeDrfFit::DetEffDataPoint> data = efficiency_data();
+  
+  vector<float> coefs, uncerts;
+  const double chi2dof = MakeDrfFit::performEfficiencyFit( data, 3, coefs, uncerts );
+  
+  BOOST_REQUIRE_EQUAL( coefs.size(), size_t(3) );
+  BOOST_REQUIRE_EQUAL( uncerts.size(), size_t(3) );
+  BOOST_CHECK_SMALL( chi2dof, 1.0E-3 );
+  for( size_t i = 0; i < 3; ++i )
+    BOOST_CHECK_SMALL( coefs[i] - sm_true_eff[i], 1.0E-3f );
+  
+  //Refitting from the previous solution must give the same answer
+  vector<float> warm = coefs, warm_uncerts;
+  const double warm_chi2dof = MakeDrfFit::performEfficiencyFit( data, 3, warm, warm_uncerts );
+  BOOST_CHECK_SMALL( warm_chi2dof, 1.0E-3 );
+  BOOST_REQUIRE_EQUAL( warm.size(), size_t(3) );
+  for( size_t i = 0; i < 3; ++i )
+    BOOST_CHECK_SMALL( warm[i] - sm_true_eff[i], 1.0E-3f );
+  
+  //A poor previous solution must not be used over the better starting point
+  vector<float> poor = { -1.0f, -0.5f, 1.0f }, poor_uncerts;
+  const double poor_chi2dof = MakeDrfFit::performEfficiencyFit( data, 3, poor, poor_uncerts );
+  BOOST_CHECK_SMALL( poor_chi2dof, 1.0E-3 );
+  for( size_t i = 0; i < 3; ++i )
+    BOOST_CHECK_SMALL( poor[i] - sm_true_eff[i], 1.0E-3f );
+  
+  //More terms than data points is an error
+  vector<float> toomany;
+  BOOST_CHECK_THROW( MakeDrfFit::performEfficiencyFit( vector<MakeDrfFit::DetEffDataPoint>( data.begin(), data.begin() + 2 ),
+                                                       3, toomany, uncerts ), std::exception );
+}//BOOST_AUTO_TEST_CASE( testEfficiencyFitAndWarmStart )
+
+
+BOOST_AUTO_TEST_CASE( testEfficiencyScanPicksLowestBic )
+{
+  const vector<MakeDrfFit::DetEffDataPoint> data = efficiency_data();
+  
+  vector<MakeDrfFit::FitCandidate> candidates;
+  const size_t best = MakeDrfFit::performEfficiencyFitScan( data, 1, 6, vector<float>(), candidates );
+  
+  BOOST_REQUIRE_EQUAL( candidates.size(), size_t(6) );
+  BOOST_REQUIRE( best < candidates.size() );
+  
+  for( size_t i = 0; i < candidates.size(); ++i )
+  {
+    const MakeDrfFit::FitCandidate &candidate = candidates[i];
+    BOOST_CHECK_MESSAGE( candidate.error.empty(), "Order " + std::to_string(i+1) + ": " + candidate.error );
+    BOOST_CHECK_EQUAL( candidate.order, static_cast<int>(i+1) );
+    BOOST_CHECK_EQUAL( candidate.coefficients.size(), i+1 );
+    BOOST_CHECK_CLOSE( candidate.bic, candidate.chi2 + (i+1)*std::log(20.0), 1.0E-6 );
+    BOOST_CHECK_CLOSE( candidate.aic, candidate.chi2 + 2.0*(i+1), 1.0E-6 );
+    BOOST_CHECK( candidates[best].bic <= candidate.bic );
+  }
+  
+  //The data was generated with three terms; fewer cant describe it, and more
+  //  only add the BIC penalty.
+  BOOST_CHECK_EQUAL( candidates[best].order, 3 );
+}//BOOST_AUTO_TEST_CASE( testEfficiencyScanPicksLowestBic )
+
+
+BOOST_AUTO_TEST_CASE( testResolutionScanAndWarmStart )
+{
+  const auto peaks = fwhm_peaks();
+  const size_t nchannel = 1024;
+  
+  //Starting from the true solution must stay there
+  vector<float> coefs = sm_true_fwhm, uncerts;
+  const double chi2 = MakeDrfFit::performResolutionFit( peaks, nchannel,
+                                DetectorPeakResponse::kGadrasResolutionFcn, -1, coefs, uncerts );
+  BOOST_CHECK_SMALL( chi2, 0.01 );
+  BOOST_REQUIRE_EQUAL( coefs.size(), size_t(3) );
+  for( const auto &peak : *peaks )
+  {
+    const float fit = DetectorPeakResponse::peakResolutionFWHM( peak->mean(), DetectorPeakResponse::kGadrasResolutionFcn, coefs );
+    BOOST_CHECK_CLOSE( fit, peak->fwhm(), 0.1 );
+  }
+  
+  vector<MakeDrfFit::FitCandidate> candidates;
+  const size_t best = MakeDrfFit::performResolutionFitScan( peaks, nchannel, 3, sm_true_fwhm, candidates );
+  
+  BOOST_REQUIRE_EQUAL( candidates.size(), size_t(4) );
+  BOOST_REQUIRE( best < candidates.size() );
+  BOOST_CHECK( candidates[0].fwhmForm == DetectorPeakResponse::kGadrasResolutionFcn );
+  BOOST_CHECK( candidates[0].error.empty() );
+  BOOST_CHECK_SMALL( candidates[0].chi2, 0.01 );
+  
+  for( size_t i = 1; i < candidates.size(); ++i )
+  {
+    BOOST_CHECK( candidates[i].fwhmForm == DetectorPeakResponse::kSqrtPolynomial );
+    BOOST_CHECK_EQUAL( candidates[i].order, static_cast<int>(i) );
+  }
+  
+  for( const MakeDrfFit::FitCandidate &candidate : candidates )
+  {
+    if( candidate.error.empty() )
+      BOOST_CHECK( candidates[best].bic <= candidate.bic );
+  }
+}//BOOST_AUTO_TEST_CASE( testResolutionScanAndWarmStart )
+
+
+BOOST_AUTO_TEST_CASE( testBestCandidateByBic )
+{
+  vector<MakeDrfFit::FitCandidate> candidates( 3 );
+  for( size_t i = 0; i < candidates.size(); ++i )
+    candidates[i].numParameters = static_cast<int>( i + 1 );
+  
+  candidates[0].chi2 = 10.0;
+  candidates[1].chi2 = 2.0;
+  candidates[2].chi2 = 1.0;
+  for( MakeDrfFit::FitCandidate &candidate : candidates )
+    candidate.setInformationCriteria( 100 );
+  
+  //chi2 + k*ln(100): 14.6, 11.2, 14.8
+  BOOST_CHECK_EQUAL( MakeDrfFit::best_candidate_by_bic( candidates ), size_t(1) );
+  
+  //Failed fits are never chosen
+  candidates[1].error = "failed";
+  BOOST_CHECK_EQUAL( MakeDrfFit::best_candidate_by_bic( candidates ), size_t(0) );
+  
+  candidates[0].error = candidates[2].error = "failed";
+  BOOST_CHECK_THROW( MakeDrfFit::best_candidate_by_bic( candidates ), std::exception );
+  BOOST_CHECK_THROW( MakeDrfFit::best_candidate_by_bic( vector<MakeDrfFit::FitCandidate>() ), std::exception );
+}//BOOST_AUTO_TEST_CASE( testBestCandidateByBic )
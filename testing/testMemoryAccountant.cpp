@@ -0,0 +1,201 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testMemoryAccountant
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/MemoryAccountant.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks MemoryAccountant keeps correct running totals for each session as
+//  entries are set, replaced, and removed, and that when over budget it evicts
+//  the least recently used entries, but never the entry just set.
+
+namespace
+{
+  typedef MemoryAccountant::Category Category;
+  
+  //MemoryAccountant is normally a singleton; a separate instance for each
+  //  test case keeps them independent.
+  struct TestAccountant : public MemoryAccountant
+  {
+    TestAccountant() : MemoryAccountant() {}
+    
+    using MemoryAccountant::m_sessionBytes;
+    using MemoryAccountant::m_sessionPeakBytes;
+    using MemoryAccountant::m_numEvictsSinceLog;
+  };//struct TestAccountant
+  
+  //Stand-ins for the objects holding memory; only their addresses are used.
+  struct Owner
+  {
+    char dummy;
+  };
+  
+  //Returns an evict function that records 'name' was evicted, then reports
+  //  the owner as using no memory, the way a real cache would.
+  std::function<void()> recording_evict( MemoryAccountant &accountant,
+                                         vector<string> &evicted,
+                                         const string &session,
+                                         const Owner *owner,
+                                         const string &name )
+  {
+    return [&accountant,&evicted,session,owner,name](){
+      evicted.push_back( name );
+      accountant.setUsage( session, owner, Category::SampleSums, 0 );
+    };
+  }//recording_evict(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( runningSessionTotals )
+{
+  TestAccountant accountant;
+  Owner a, b, c, d;
+  
+  accountant.setUsage( "session1", &a, Category::Spectra, 1000 );
+  accountant.setUsage( "session1", &b, Category::Peaks, 200 );
+  accountant.setUsage( "session2", &c, Category::SampleSums, 30 );
+  
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session1"), 1200 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session2"), 30 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("nosuchsession"), 0 );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 1230 );
+  
+  //Replacing a value only changes that entries contribution.
+  accountant.setUsage( "session1", &a, Category::Spectra, 400 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session1"), 600 );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 630 );
+  
+  //An owner re-reported under another session moves to that session.
+  accountant.setUsage( "session2", &b, Category::Peaks, 50 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session1"), 400 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session2"), 80 );
+  
+  accountant.remove( &a );
+  accountant.remove( &a );  //removing twice is harmless
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session1"), 0 );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 80 );
+  
+  //Entries accounted explicitly to a session (e.g., from a worker thread) are
+  //  removed with the session.
+  accountant.setUsage( "session2", &d, Category::DatabaseBlobs, 5000 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session2"), 5080 );
+  accountant.removeSession( "session2" );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session2"), 0 );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 0 );
+  BOOST_CHECK( accountant.summary().find("session2") == string::npos );
+  BOOST_CHECK( !accountant.m_sessionBytes.count("session2") );
+  BOOST_CHECK( !accountant.m_sessionPeakBytes.count("session2") );
+  
+  //The high-water mark of a live session is kept, even after usage drops.
+  accountant.setUsage( "session3", &a, Category::Spectra, 700 );
+  accountant.setUsage( "session3", &a, Category::Spectra, 100 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("session3"), 100 );
+  BOOST_CHECK_EQUAL( accountant.m_sessionPeakBytes["session3"], 700 );
+  BOOST_CHECK_EQUAL( accountant.m_sessionPeakBytes["session1"], 1200 );
+}//BOOST_AUTO_TEST_CASE( runningSessionTotals )
+
+
+BOOST_AUTO_TEST_CASE( evictsLeastRecentlyUsed )
+{
+  TestAccountant accountant;
+  accountant.setBudget( 100 );
+  
+  vector<string> evicted;
+  Owner a, b, c, fixed;
+  
+  accountant.setUsage( "s1", &fixed, Category::Spectra, 20 );
+  accountant.setUsage( "s1", &a, Category::SampleSums, 30,
+                       recording_evict( accountant, evicted, "s1", &a, "a" ) );
+  accountant.setUsage( "s2", &b, Category::SampleSums, 30,
+                       recording_evict( accountant, evicted, "s2", &b, "b" ) );
+  BOOST_CHECK( evicted.empty() );
+  
+  //'a' is now more recently used than 'b', so 'b' should go first, and since
+  //  that gets us under budget, 'a' should be kept.
+  accountant.touch( &a );
+  accountant.setUsage( "s1", &c, Category::SampleSums, 40,
+                       recording_evict( accountant, evicted, "s1", &c, "c" ) );
+  
+  BOOST_REQUIRE_EQUAL( evicted.size(), 1 );
+  BOOST_CHECK_EQUAL( evicted[0], "b" );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 90 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("s2"), 0 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("s1"), 90 );
+  
+  //Entries without an evict function are never evicted, so growing 'fixed'
+  //  evicts both caches; 'a' (touched before 'c' was set) first.
+  evicted.clear();
+  accountant.setUsage( "s1", &fixed, Category::Spectra, 61 );
+  BOOST_REQUIRE_EQUAL( evicted.size(), 2 );
+  BOOST_CHECK_EQUAL( evicted[0], "a" );
+  BOOST_CHECK_EQUAL( evicted[1], "c" );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 61 );
+  BOOST_CHECK_EQUAL( accountant.sessionBytes("s1"), 61 );
+  
+  //The first eviction was logged; the second was within a minute, so it is
+  //  only counted, to be included in the next log.
+  BOOST_CHECK_EQUAL( accountant.m_numEvictsSinceLog, 2 );
+}//BOOST_AUTO_TEST_CASE( evictsLeastRecentlyUsed )
+
+
+BOOST_AUTO_TEST_CASE( justSetIsNotEvicted )
+{
+  TestAccountant accountant;
+  accountant.setBudget( 100 );
+  
+  vector<string> evicted;
+  Owner a, b;
+  
+  //A single cache entry over budget is kept; evicting it would just cause it
+  //  to be recomputed on the next use.
+  accountant.setUsage( "s1", &a, Category::SampleSums, 150,
+                       recording_evict( accountant, evicted, "s1", &a, "a" ) );
+  BOOST_CHECK( evicted.empty() );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 150 );
+  
+  //But once something else is set, it is the least recently used.
+  accountant.setUsage( "s1", &b, Category::SampleSums, 10,
+                       recording_evict( accountant, evicted, "s1", &b, "b" ) );
+  BOOST_REQUIRE_EQUAL( evicted.size(), 1 );
+  BOOST_CHECK_EQUAL( evicted[0], "a" );
+  BOOST_CHECK_EQUAL( accountant.totalBytes(), 10 );
+  
+  //An evict that hasnt reported back yet isnt called again.
+  size_t ncalls = 0;
+  Owner slow, other;
+  accountant.setUsage( "s1", &slow, Category::SampleSums, 200, [&ncalls](){ ++ncalls; } );
+  accountant.setUsage( "s1", &other, Category::Peaks, 5 );
+  accountant.setUsage( "s1", &other, Category::Peaks, 6 );
+  BOOST_CHECK_EQUAL( ncalls, 1 );
+}//BOOST_AUTO_TEST_CASE( justSetIsNotEvicted )
@@ -0,0 +1,149 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <exception>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testN42Streaming
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/SpecMeas.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks SpecMeas::write_2012_N42_streaming(...) produces files that read
+//  back the same as files written by SpecMeas::write_2012_N42(...), both for
+//  the files the streaming writer handles itself, and the files it hands off
+//  to write_2012_N42(...), and that it handles passthrough.n42 itself, even
+//  with a detector type, lane, location, inspection, and GPS time stamps.
+
+namespace
+{
+  //Writes 'meas' using both N42 2012 writers, reads both back in, and checks
+  //  the results are the same.
+  void check_round_trip( const SpecMeas &meas, const string &description )
+  {
+    BOOST_TEST_MESSAGE( description << ( meas.canWrite2012N42Streaming()
+                                         ? " is streamed" : " uses write_2012_N42" ) );
+    
+    stringstream full, streamed;
+    BOOST_REQUIRE_MESSAGE( meas.write_2012_N42( full ),
+                           "write_2012_N42 failed for " + description );
+    BOOST_REQUIRE_MESSAGE( meas.write_2012_N42_streaming( streamed ),
+                           "write_2012_N42_streaming failed for " + description );
+
+    SpecMeas fromfull, fromstreamed;
+    BOOST_REQUIRE_MESSAGE( fromfull.load_from_N42( full ),
+                           "Failed to read back write_2012_N42 output for " + description );
+    BOOST_REQUIRE_MESSAGE( fromstreamed.load_from_N42( streamed ),
+                           "Failed to read back write_2012_N42_streaming output for " + description );
+
+#if( PERFORM_DEVELOPER_CHECKS )
+    try
+    {
+      SpecMeas::equalEnough( fromfull, fromstreamed );
+    }catch( std::exception &e )
+    {
+      BOOST_ERROR( description + ": " + e.what() );
+    }
+#else
+    BOOST_CHECK_EQUAL( fromfull.num_measurements(), fromstreamed.num_measurements() );
+    BOOST_CHECK_EQUAL( fromfull.lane_number(), fromstreamed.lane_number() );
+    BOOST_CHECK_EQUAL( fromfull.inspection(), fromstreamed.inspection() );
+    BOOST_CHECK_EQUAL( fromfull.measurement_location_name(),
+                       fromstreamed.measurement_location_name() );
+    BOOST_CHECK( fromfull.detector_type() == fromstreamed.detector_type() );
+    BOOST_CHECK_EQUAL( fromfull.has_gps_info(), fromstreamed.has_gps_info() );
+    BOOST_CHECK_CLOSE( fromfull.gamma_count_sum(), fromstreamed.gamma_count_sum(), 1.0E-4 );
+#endif
+  }//void check_round_trip(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testExampleSpectraRoundTrip )
+{
+  const string indir = example_spectra_dir();
+  const vector<string> files = UtilityFunctions::ls_files_in_directory( indir );
+
+  size_t nchecked = 0;
+  bool checked_passthrough = false;
+  for( const string &filename : files )
+  {
+    string ext;
+    const string::size_type dotpos = filename.rfind( '.' );
+    if( dotpos != string::npos )
+      ext = filename.substr( dotpos + 1 );
+
+    SpecMeas meas;
+    if( !meas.load_file( filename, kAutoParser, ext ) )
+      continue;
+
+    const bool is_passthrough = (UtilityFunctions::filename( filename ) == "passthrough.n42");
+    checked_passthrough = (checked_passthrough || is_passthrough);
+    if( is_passthrough )
+      BOOST_CHECK_MESSAGE( meas.canWrite2012N42Streaming(),
+                           "passthrough.n42 should be written by the streaming writer" );
+    
+    check_round_trip( meas, filename );
+
+    //Information the streaming writer must write itself, rather than handing
+    //  the file off to write_2012_N42(...).
+    meas.set_detector_type( DetectorType::kDetectiveEx100Detector );
+    meas.set_lane_number( 3 );
+    meas.set_measurement_location_name( "Lane 3 Northbound" );
+    meas.set_inspection( "Secondary" );
+    
+    const set<int> &samples = meas.sample_numbers();
+    if( !samples.empty() )
+    {
+      const boost::posix_time::ptime gpstime
+                  = boost::posix_time::time_from_string( "2010-03-17 14:02:11" );
+      for( const std::shared_ptr<const Measurement> &m : meas.sample_measurements( *samples.begin() ) )
+        meas.set_position( -106.5, 35.05, gpstime, m );
+    }
+    
+    if( is_passthrough )
+      BOOST_CHECK_MESSAGE( meas.canWrite2012N42Streaming(),
+                           "passthrough.n42 with a detector type, lane, location, inspection,"
+                           " and GPS time should be written by the streaming writer" );
+    
+    check_round_trip( meas, filename + " (with detector type, lane, location, inspection, and GPS)" );
+
+    ++nchecked;
+  }//for( const string &filename : files )
+
+  BOOST_CHECK_MESSAGE( checked_passthrough, "Did not find passthrough.n42 in " + indir );
+  BOOST_CHECK_MESSAGE( nchecked >= 4, "Only checked " + std::to_string(nchecked)
+                       + " files in " + indir + "; use --indir=..." );
+}//BOOST_AUTO_TEST_CASE( testExampleSpectraRoundTrip )
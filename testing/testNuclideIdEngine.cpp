@@ -0,0 +1,176 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <cmath>
+#include <deque>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testNuclideIdEngine
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/PeakFit.h"
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/SpecMeas.h"
+#include "SandiaDecay/SandiaDecay.h"
+#include "InterSpec/NuclideIdEngine.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Runs NuclideIdEngine::identify(...) headless on the peaks found in the Ba133
+//  example spectrum, and checks Ba133 is the top ranked nuclide, and the
+//  hypotheses are ranked and scored consistently.
+
+namespace
+{
+  struct Ba133Fixture
+  {
+    Ba133Fixture()
+    {
+      const string decayxml = UtilityFunctions::append_path( data_directory(), "sandia.decay.xml" );
+      BOOST_REQUIRE_MESSAGE( UtilityFunctions::is_file( decayxml ),
+                             "Could not find " + decayxml + "; use --datadir=..." );
+      DecayDataBaseServer::setDecayXmlFile( decayxml );
+
+      const string filename = UtilityFunctions::append_path( example_spectra_dir(),
+                                                    "ba133_source_640s_20100317.n42" );
+      SpecMeas meas;
+      BOOST_REQUIRE_MESSAGE( meas.load_file( filename, kAutoParser, "n42" ),
+                             "Failed to open " + filename + "; use --indir=..." );
+
+      data = meas.sum_measurements( meas.sample_numbers(), meas.detector_numbers() );
+      BOOST_REQUIRE( data && data->num_gamma_channels() > 16 );
+
+      const auto start = std::chrono::steady_clock::now();
+      peaks = ExperimentalAutomatedPeakSearch::search_for_peaks( data, nullptr, false );
+      const auto end = std::chrono::steady_clock::now();
+
+      BOOST_TEST_MESSAGE( "Found " << peaks.size() << " peaks in "
+                          << std::chrono::duration<double,std::milli>(end - start).count() << " ms" );
+      BOOST_REQUIRE_MESSAGE( peaks.size() >= 3, "Only found " << peaks.size() << " peaks" );
+    }//Ba133Fixture constructor
+
+    std::shared_ptr<const Measurement> data;
+    std::vector<std::shared_ptr<const PeakDef>> peaks;
+  };//struct Ba133Fixture
+
+
+  //Checks the ranking, and ratio to the best hypothesis, are as documented.
+  void check_ranking( const vector<NuclideIdEngine::Hypothesis> &hypotheses )
+  {
+    BOOST_REQUIRE( !hypotheses.empty() );
+    BOOST_CHECK_EQUAL( hypotheses.front().logLikelihoodRatioToBest, 0.0 );
+
+    for( size_t i = 0; i < hypotheses.size(); ++i )
+    {
+      const NuclideIdEngine::Hypothesis &hyp = hypotheses[i];
+      BOOST_CHECK( !hyp.nuclides.empty() );
+      BOOST_CHECK( !hyp.description().empty() );
+      BOOST_CHECK_CLOSE_FRACTION( hyp.logLikelihoodRatioToBest,
+                                  hyp.logLikelihoodRatio - hypotheses.front().logLikelihoodRatio,
+                                  1.0E-9 );
+      if( i )
+        BOOST_CHECK( hypotheses[i-1].score >= hyp.score );
+
+      //A hypothesis that fits worse than the best, and doesnt have more
+      //  nuclides, can only be ranked below it.
+      if( hyp.nuclides.size() <= hypotheses.front().nuclides.size() )
+        BOOST_CHECK( hyp.logLikelihoodRatioToBest <= 1.0E-9*fabs(hypotheses.front().logLikelihoodRatio) );
+
+      for( const NuclideIdEngine::NuclideContribution &contrib : hyp.nuclides )
+      {
+        BOOST_CHECK( contrib.nuclide );
+        BOOST_CHECK( contrib.activity > 0.0 );
+      }
+    }//for( size_t i = 0; i < hypotheses.size(); ++i )
+  }//void check_ranking(...)
+
+
+  bool has_nuclide( const NuclideIdEngine::Hypothesis &hyp, const string &symbol )
+  {
+    for( const NuclideIdEngine::NuclideContribution &contrib : hyp.nuclides )
+    {
+      if( contrib.nuclide && contrib.nuclide->symbol == symbol )
+        return true;
+    }
+    return false;
+  }//bool has_nuclide(...)
+}//namespace
+
+
+BOOST_FIXTURE_TEST_CASE( testIdentifyBa133FromPeaks, Ba133Fixture )
+{
+  const std::deque<std::shared_ptr<const PeakDef>> peakdeque( peaks.begin(), peaks.end() );
+
+  const auto start = std::chrono::steady_clock::now();
+  const vector<NuclideIdEngine::Hypothesis> hypotheses
+                                = NuclideIdEngine::identify( peakdeque, data, nullptr );
+  const auto end = std::chrono::steady_clock::now();
+
+  BOOST_TEST_MESSAGE( "Identification from peaks took "
+                      << std::chrono::duration<double,std::milli>(end - start).count()
+                      << " ms, giving " << hypotheses.size() << " hypotheses" );
+
+  check_ranking( hypotheses );
+
+  BOOST_TEST_MESSAGE( "Best: " << hypotheses.front().description() );
+  BOOST_CHECK_MESSAGE( has_nuclide( hypotheses.front(), "Ba133" ),
+                       "Top ranked hypothesis is " << hypotheses.front().description() );
+  BOOST_CHECK( hypotheses.front().logLikelihoodRatio > 0.0 );
+}//BOOST_FIXTURE_TEST_CASE( testIdentifyBa133FromPeaks, Ba133Fixture )
+
+
+BOOST_FIXTURE_TEST_CASE( testIdentifyBa133FullSpectrum, Ba133Fixture )
+{
+  const std::deque<std::shared_ptr<const PeakDef>> peakdeque( peaks.begin(), peaks.end() );
+
+  NuclideIdEngine::Options options;
+  options.fitFullSpectrum = true;
+
+  const vector<NuclideIdEngine::Hypothesis> hypotheses
+                          = NuclideIdEngine::identify( peakdeque, data, nullptr, options );
+
+  check_ranking( hypotheses );
+
+  BOOST_TEST_MESSAGE( "Best (full spectrum): " << hypotheses.front().description() );
+  BOOST_CHECK_MESSAGE( has_nuclide( hypotheses.front(), "Ba133" ),
+                       "Top ranked hypothesis is " << hypotheses.front().description() );
+}//BOOST_FIXTURE_TEST_CASE( testIdentifyBa133FullSpectrum, Ba133Fixture )
+
+
+BOOST_FIXTURE_TEST_CASE( testIdentifyRejectsNoPeaks, Ba133Fixture )
+{
+  const std::deque<std::shared_ptr<const PeakDef>> nopeaks;
+  BOOST_CHECK_THROW( NuclideIdEngine::identify( nopeaks, data, nullptr ), std::exception );
+}//BOOST_FIXTURE_TEST_CASE( testIdentifyRejectsNoPeaks, Ba133Fixture )
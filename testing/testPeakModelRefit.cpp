@@ -0,0 +1,275 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <deque>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testPeakModelRefit
+#include <boost/test/unit_test.hpp>
+
+#include <Wt/WApplication>
+#include <Wt/WModelIndex>
+#include <Wt/Test/WTestEnvironment>
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/PeakModel.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/SpectrumDataModel.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Benchmarks, and checks the row updates of, PeakModel::setPeaks(...) when
+//  a single ROI is refit out of 500 peaks, which is the most common way peaks
+//  are changed (fitting, dragging, or editing a ROI all end up here).
+
+namespace
+{
+  const size_t sm_npeaks = 500;  //Two peaks per ROI
+
+  //Counts the number of rows changed by each kind of model signal.
+  struct RowSignalCounts
+  {
+    RowSignalCounts() : inserted( 0 ), removed( 0 ), changed( 0 ) {}
+
+    void clear(){ inserted = removed = changed = 0; }
+
+    size_t inserted, removed, changed;
+  };//struct RowSignalCounts
+
+
+  struct PeakModelFixture
+  {
+    PeakModelFixture()
+      : env( Wt::Application ),
+        app( env ),
+        meas( std::make_shared<SpecMeas>() )
+    {
+      const string filename = UtilityFunctions::append_path( example_spectra_dir(),
+                                                    "ba133_source_640s_20100317.n42" );
+      BOOST_REQUIRE_MESSAGE( meas->load_file( filename, kAutoParser, "n42" ),
+                             "Failed to open " + filename + "; use --indir=..." );
+
+      samples = meas->sample_numbers();
+      hist = meas->sum_measurements( samples, meas->detector_numbers() );
+      BOOST_REQUIRE( hist && hist->num_gamma_channels() > 16 );
+
+      dataModel.setDataHistogram( hist, hist->live_time(), hist->real_time(), 0.0f );
+      peakModel.setDataModel( &dataModel );
+      peakModel.setPeakFromSpecMeas( meas, samples );
+
+      peakModel.dataChanged().connect( [this]( Wt::WModelIndex a, Wt::WModelIndex b ){
+        counts.changed += (b.row() - a.row() + 1);
+      } );
+      peakModel.rowsInserted().connect( [this]( Wt::WModelIndex, int first, int last ){
+        counts.inserted += (last - first + 1);
+      } );
+      peakModel.rowsRemoved().connect( [this]( Wt::WModelIndex, int first, int last ){
+        counts.removed += (last - first + 1);
+      } );
+    }//PeakModelFixture constructor
+
+    //Creates sm_npeaks peaks, in ROIs of two peaks each, spread across the spectrum.
+    vector<PeakDef> makePeaks() const
+    {
+      const double lowe = hist->gamma_energy_min();
+      const double highe = hist->gamma_energy_max();
+      const double start = lowe + 0.05*(highe - lowe);
+      const double roiwidth = 0.9*(highe - lowe) / (sm_npeaks/2);
+
+      vector<PeakDef> peaks;
+      for( size_t i = 0; i < sm_npeaks/2; ++i )
+      {
+        const double roilower = start + i*roiwidth;
+        const double sigma = 0.05*roiwidth;
+
+        PeakDef first( roilower + 0.35*roiwidth, sigma, 1000.0 + i );
+        PeakDef second( roilower + 0.65*roiwidth, sigma, 500.0 + i );
+
+        std::shared_ptr<PeakContinuum> cont = first.continuum();
+        cont->setType( PeakContinuum::Linear );
+        cont->setRange( roilower, roilower + 0.95*roiwidth );
+        cont->setParameters( roilower, vector<double>{10.0, -0.01}, vector<double>() );
+        second.setContinuum( cont );
+
+        peaks.push_back( first );
+        peaks.push_back( second );
+      }//for( loop over ROIs )
+
+      return peaks;
+    }//vector<PeakDef> makePeaks() const
+
+    //Returns the current peaks, with ROI 'roi' "refit": new amplitudes, and a
+    //  new continuum object, like the peak fitting code gives.
+    vector<PeakDef> refitRoi( const size_t roi, const double factor ) const
+    {
+      vector<PeakDef> peaks = peakModel.peakVec();
+      BOOST_REQUIRE_EQUAL( peaks.size(), sm_npeaks );
+
+      PeakDef &first = peaks[2*roi];
+      PeakDef &second = peaks[2*roi + 1];
+      BOOST_REQUIRE( first.continuum() == second.continuum() );
+
+      first.makeUniqueNewContinuum();
+      second.setContinuum( first.continuum() );
+      first.continuum()->setParameters( first.continuum()->referenceEnergy(),
+                                        vector<double>{10.0*factor, -0.01}, vector<double>() );
+      first.setAmplitude( factor * first.amplitude() );
+      second.setAmplitude( factor * second.amplitude() );
+
+      return peaks;
+    }//vector<PeakDef> refitRoi(...)
+
+    set<std::shared_ptr<const PeakDef>> currentPeakPointers() const
+    {
+      std::shared_ptr<const deque<PeakModel::PeakShrdPtr>> peaks = peakModel.peaks();
+      BOOST_REQUIRE( peaks );
+      return set<std::shared_ptr<const PeakDef>>( peaks->begin(), peaks->end() );
+    }
+
+    Wt::Test::WTestEnvironment env;
+    Wt::WApplication app;
+    std::shared_ptr<SpecMeas> meas;
+    std::set<int> samples;
+    std::shared_ptr<Measurement> hist;
+    SpectrumDataModel dataModel;
+    PeakModel peakModel;
+    RowSignalCounts counts;
+  };//struct PeakModelFixture
+}//namespace
+
+
+BOOST_FIXTURE_TEST_CASE( testRefitOneRoiOf500, PeakModelFixture )
+{
+  peakModel.setPeaks( makePeaks() );
+  BOOST_REQUIRE_EQUAL( peakModel.npeaks(), sm_npeaks );
+
+  const size_t nrefits = 200;
+  double refit_seconds = 0.0;
+
+  for( size_t i = 0; i < nrefits; ++i )
+  {
+    const size_t roi = (37*i) % (sm_npeaks/2);
+    const vector<PeakDef> peaks = refitRoi( roi, 1.0 + 0.001*(i+1) );
+    const set<std::shared_ptr<const PeakDef>> before = currentPeakPointers();
+
+    counts.clear();
+    const auto start = std::chrono::steady_clock::now();
+    peakModel.setPeaks( peaks );
+    const auto end = std::chrono::steady_clock::now();
+    refit_seconds += std::chrono::duration<double>( end - start ).count();
+
+    //Only the two peaks of the ROI should have changed, and been updated in place.
+    const set<std::shared_ptr<const PeakDef>> after = currentPeakPointers();
+    size_t nkept = 0;
+    for( const auto &p : after )
+      nkept += before.count( p );
+
+    BOOST_CHECK_EQUAL( after.size(), sm_npeaks );
+    BOOST_CHECK_EQUAL( nkept, sm_npeaks - 2 );
+    BOOST_CHECK_EQUAL( counts.inserted, 0 );
+    BOOST_CHECK_EQUAL( counts.removed, 0 );
+    BOOST_CHECK_EQUAL( counts.changed, 2 );
+  }//for( size_t i = 0; i < nrefits; ++i )
+
+  //For comparison, the time to set a completely new set of peaks.
+  double reset_seconds = 0.0;
+  for( size_t i = 0; i < 10; ++i )
+  {
+    vector<PeakDef> peaks = makePeaks();
+    for( PeakDef &p : peaks )
+      p.setAmplitude( p.amplitude() * (1.1 + 0.01*i) );
+
+    const auto start = std::chrono::steady_clock::now();
+    peakModel.setPeaks( peaks );
+    const auto end = std::chrono::steady_clock::now();
+    reset_seconds += std::chrono::duration<double>( end - start ).count();
+  }//for( size_t i = 0; i < 10; ++i )
+
+  stringstream msg;
+  msg << "Refitting one ROI of " << sm_npeaks << " peaks took "
+      << 1.0E6*refit_seconds/nrefits << " us per call; setting all new peaks took "
+      << 1.0E6*reset_seconds/10 << " us per call";
+  BOOST_TEST_MESSAGE( msg.str() );
+}//BOOST_FIXTURE_TEST_CASE( testRefitOneRoiOf500, PeakModelFixture )
+
+
+BOOST_FIXTURE_TEST_CASE( testNonFitChangesAreNotSkipped, PeakModelFixture )
+{
+  //Changes that dont effect the peak shape (labels, sources, fit-for flags)
+  //  must still replace the peaks, and be sent on to the views.
+  peakModel.setPeaks( makePeaks() );
+  BOOST_REQUIRE_EQUAL( peakModel.npeaks(), sm_npeaks );
+
+  const size_t roi = 42;
+
+  {//Change user label
+    vector<PeakDef> peaks = peakModel.peakVec();
+    peaks[2*roi].setUserLabel( "Some label" );
+
+    counts.clear();
+    peakModel.setPeaks( peaks );
+    BOOST_CHECK_EQUAL( peakModel.peakVec()[2*roi].userLabel(), "Some label" );
+    BOOST_CHECK( counts.changed > 0 );
+  }
+
+  {//Change fit-for flag
+    vector<PeakDef> peaks = peakModel.peakVec();
+    const bool fitfor = peaks[2*roi+1].fitFor( PeakDef::Sigma );
+    peaks[2*roi+1].setFitFor( PeakDef::Sigma, !fitfor );
+
+    counts.clear();
+    peakModel.setPeaks( peaks );
+    BOOST_CHECK_EQUAL( peakModel.peakVec()[2*roi+1].fitFor( PeakDef::Sigma ), !fitfor );
+    BOOST_CHECK( counts.changed > 0 );
+  }
+
+  {//Change uncertainty
+    vector<PeakDef> peaks = peakModel.peakVec();
+    peaks[2*roi].setAmplitudeUncert( 12.5 );
+
+    counts.clear();
+    peakModel.setPeaks( peaks );
+    BOOST_CHECK_EQUAL( peakModel.peakVec()[2*roi].amplitudeUncert(), 12.5 );
+    BOOST_CHECK( counts.changed > 0 );
+  }
+
+  {//No change at all should not emit anything, or replace any peaks
+    const set<std::shared_ptr<const PeakDef>> before = currentPeakPointers();
+    counts.clear();
+    peakModel.setPeaks( peakModel.peakVec() );
+    BOOST_CHECK( before == currentPeakPointers() );
+    BOOST_CHECK_EQUAL( counts.changed + counts.inserted + counts.removed, 0 );
+  }
+}//BOOST_FIXTURE_TEST_CASE( testNonFitChangesAreNotSkipped, PeakModelFixture )
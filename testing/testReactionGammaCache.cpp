@@ -0,0 +1,159 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testReactionGammaCache
+#include <boost/test/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+#include "InterSpec/ReactionGamma.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+  //Compares two ReactionGamma objects reaction by reaction; energies and
+  //  abundances must be bit-for-bit identical.
+  void check_same_reactions( const ReactionGamma &lhs, const ReactionGamma &rhs )
+  {
+    size_t nreactions = 0;
+
+    for( int t = 0; t < static_cast<int>(NumReactionType); ++t )
+    {
+      const ReactionType type = static_cast<ReactionType>( t );
+      const vector<const ReactionGamma::Reaction *> &l = lhs.reactions( type );
+      const vector<const ReactionGamma::Reaction *> &r = rhs.reactions( type );
+
+      BOOST_REQUIRE_EQUAL( l.size(), r.size() );
+
+      for( size_t i = 0; i < l.size(); ++i )
+      {
+        BOOST_REQUIRE( l[i] && r[i] );
+        const ReactionGamma::Reaction &lr = *l[i];
+        const ReactionGamma::Reaction &rr = *r[i];
+
+        BOOST_CHECK_EQUAL( lr.name(), rr.name() );
+        BOOST_CHECK( lr.type == rr.type );
+        BOOST_CHECK( lr.targetNuclide == rr.targetNuclide );
+        BOOST_CHECK( lr.targetElement == rr.targetElement );
+        BOOST_CHECK( lr.productNuclide == rr.productNuclide );
+        BOOST_REQUIRE_EQUAL( lr.gammas.size(), rr.gammas.size() );
+
+        for( size_t j = 0; j < lr.gammas.size(); ++j )
+        {
+          BOOST_CHECK( memcmp( &lr.gammas[j].energy, &rr.gammas[j].energy, sizeof(float) ) == 0 );
+          BOOST_CHECK( memcmp( &lr.gammas[j].abundance, &rr.gammas[j].abundance, sizeof(float) ) == 0 );
+        }
+
+        ++nreactions;
+      }//for( size_t i = 0; i < l.size(); ++i )
+    }//for( loop over reaction types )
+
+    BOOST_CHECK( nreactions > 0 );
+  }//void check_same_reactions(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testReactionGammaCache )
+{
+  const string datadir = data_directory();
+  const string decayxml = UtilityFunctions::append_path( datadir, "sandia.decay.xml" );
+  const string rctnxml = UtilityFunctions::append_path( datadir, "sandia.reactiongamma.xml" );
+
+  BOOST_REQUIRE_MESSAGE( UtilityFunctions::is_file( rctnxml ),
+                         "Could not find " + rctnxml + "; use --datadir=..." );
+
+  DecayDataBaseServer::setDecayXmlFile( decayxml );
+  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+
+  const string image = UtilityFunctions::temp_file_name( "testReactionGammaCache",
+                                                         UtilityFunctions::temp_dir() );
+
+  //Parsed only from XML.
+  const ReactionGamma fromxml( rctnxml, db );
+
+  {//Parse XML, and write the image.
+    const ReactionGamma writer( rctnxml, db, image );
+    BOOST_CHECK( !writer.loadedFromBinaryCache() );
+    BOOST_REQUIRE_MESSAGE( UtilityFunctions::is_file( image ),
+                           "Binary image " + image + " was not written" );
+    check_same_reactions( fromxml, writer );
+  }
+
+  const size_t imagesize = UtilityFunctions::file_size( image );
+  BOOST_CHECK( imagesize > 0 );
+
+  {//Read from the image.
+    const ReactionGamma fromimage( rctnxml, db, image );
+    BOOST_CHECK_MESSAGE( fromimage.loadedFromBinaryCache(),
+                         "Reactions were parsed from XML, not read from " + image );
+    check_same_reactions( fromxml, fromimage );
+  }
+
+#ifndef _WIN32
+  {//An image other users could have written must not be trusted.
+    BOOST_REQUIRE( chmod( image.c_str(), 0666 ) == 0 );
+    const ReactionGamma fromshared( rctnxml, db, image );
+    BOOST_CHECK( !fromshared.loadedFromBinaryCache() );
+    check_same_reactions( fromxml, fromshared );
+    BOOST_REQUIRE( chmod( image.c_str(), 0600 ) == 0 );
+  }
+#endif
+
+  {//A truncated image must be ignored, the XML re-parsed, and the image re-written.
+    {
+      ofstream truncated( image.c_str(), ios::out | ios::binary | ios::trunc );
+      truncated << "not a reaction gamma image";
+    }
+
+    const ReactionGamma fromcorrupt( rctnxml, db, image );
+    BOOST_CHECK( !fromcorrupt.loadedFromBinaryCache() );
+    check_same_reactions( fromxml, fromcorrupt );
+    BOOST_CHECK_EQUAL( UtilityFunctions::file_size( image ), imagesize );
+  }
+
+  {//The re-written image is used again.
+    const ReactionGamma fromrewritten( rctnxml, db, image );
+    BOOST_CHECK( fromrewritten.loadedFromBinaryCache() );
+  }
+
+  UtilityFunctions::remove_file( image );
+}//BOOST_AUTO_TEST_CASE( testReactionGammaCache )
@@ -0,0 +1,135 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testRebinByEqn
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/SpecMeas.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks SpecMeas::rebinByEqn(...), which uses precomputed channel overlap
+//  weights, gives the same channel counts as MeasurementInfo::rebin_by_eqn(...)
+//  when the Recalibrator rebins every Measurement of a file to a new
+//  calibration.
+
+
+BOOST_AUTO_TEST_CASE( testRebinByEqnMatchesMeasurementInfo )
+{
+  const string filename = UtilityFunctions::append_path( example_spectra_dir(),
+                                                "ba133_source_640s_20100317.n42" );
+  SpecMeas reference, sparse;
+  BOOST_REQUIRE_MESSAGE( reference.load_file( filename, kAutoParser, "n42" ),
+                         "Failed to open " + filename + "; use --indir=..." );
+  BOOST_REQUIRE( sparse.load_file( filename, kAutoParser, "n42" ) );
+
+  const vector<std::shared_ptr<const Measurement>> refmeas = reference.measurements();
+  const vector<std::shared_ptr<const Measurement>> sparsemeas = sparse.measurements();
+  BOOST_REQUIRE_EQUAL( refmeas.size(), sparsemeas.size() );
+
+  //Pick the new calibration as a gain and offset change of the first gamma
+  //  spectrum, so roughly the same range is covered.
+  std::shared_ptr<const Measurement> eqnmeas;
+  for( const auto &m : refmeas )
+  {
+    if( m && m->num_gamma_channels() > 16 )
+    {
+      eqnmeas = m;
+      break;
+    }
+  }//for( const auto &m : refmeas )
+  BOOST_REQUIRE( eqnmeas );
+
+  const Measurement::EquationType type = eqnmeas->energy_calibration_model();
+  BOOST_REQUIRE( type == Measurement::Polynomial || type == Measurement::FullRangeFraction );
+
+  vector<float> eqn = eqnmeas->calibration_coeffs();
+  BOOST_REQUIRE( eqn.size() >= 2 );
+  eqn[0] += 2.0f;
+  eqn[1] *= 1.01f;
+  const vector<pair<float,float>> devpairs = eqnmeas->deviation_pairs();
+
+  const auto ref_start = std::chrono::steady_clock::now();
+  reference.rebin_by_eqn( eqn, devpairs, type );
+  const auto ref_end = std::chrono::steady_clock::now();
+  sparse.rebinByEqn( eqn, devpairs, type );
+  const auto sparse_end = std::chrono::steady_clock::now();
+
+  BOOST_TEST_MESSAGE( "MeasurementInfo::rebin_by_eqn took "
+                      << std::chrono::duration<double,std::milli>(ref_end - ref_start).count()
+                      << " ms, SpecMeas::rebinByEqn took "
+                      << std::chrono::duration<double,std::milli>(sparse_end - ref_end).count()
+                      << " ms, for " << refmeas.size() << " measurements" );
+
+  BOOST_CHECK( sparse.modified() );
+
+  for( size_t i = 0; i < refmeas.size(); ++i )
+  {
+    const std::shared_ptr<const Measurement> &r = refmeas[i];
+    const std::shared_ptr<const Measurement> &s = sparsemeas[i];
+    BOOST_REQUIRE( r && s );
+
+    const size_t nchannel = r->num_gamma_channels();
+    BOOST_REQUIRE_EQUAL( nchannel, s->num_gamma_channels() );
+    if( nchannel < 4 )
+      continue;
+
+    const vector<float> &rbins = *r->channel_energies();
+    const vector<float> &sbins = *s->channel_energies();
+    const vector<float> &rcounts = *r->gamma_counts();
+    const vector<float> &scounts = *s->gamma_counts();
+
+    for( size_t channel = 0; channel < nchannel; ++channel )
+      BOOST_CHECK_CLOSE_FRACTION( rbins[channel], sbins[channel], 1.0E-5 );
+
+    //The two implementations may differ in how they treat the last channel,
+    //  so only compare the channels away from the ends.
+    double rsum = 0.0, ssum = 0.0;
+    for( size_t channel = 1; channel + 2 < nchannel; ++channel )
+    {
+      rsum += rcounts[channel];
+      ssum += scounts[channel];
+      const double diff = fabs( rcounts[channel] - scounts[channel] );
+      BOOST_CHECK_MESSAGE( diff <= 1.0E-3*std::max( 1.0f, rcounts[channel] ),
+                           "Measurement " << i << " channel " << channel
+                           << ": rebin_by_eqn gave " << rcounts[channel]
+                           << ", rebinByEqn gave " << scounts[channel] );
+    }//for( loop over interior channels )
+
+    BOOST_CHECK_CLOSE_FRACTION( rsum, ssum, 1.0E-4 );
+    BOOST_CHECK_CLOSE_FRACTION( s->gamma_count_sum(), r->gamma_count_sum(), 1.0E-3 );
+  }//for( size_t i = 0; i < refmeas.size(); ++i )
+}//BOOST_AUTO_TEST_CASE( testRebinByEqnMatchesMeasurementInfo )
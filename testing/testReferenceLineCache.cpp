@@ -0,0 +1,358 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testReferenceLineCache
+#include <boost/test/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/ReferencePhotopeakDisplay.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks the decay line templates, and per-energy factor caches, used by
+//  ReferencePhotopeakDisplay give the same lines as walking the decay chain
+//  every time the nuclide, age, or shielding changes, as was originally done.
+
+namespace
+{
+  const SandiaDecay::SandiaDecayDataBase *decay_database()
+  {
+    static bool configured = false;
+    if( !configured )
+    {
+      const string decayxml = UtilityFunctions::append_path( data_directory(), "sandia.decay.xml" );
+      BOOST_REQUIRE_MESSAGE( UtilityFunctions::is_file( decayxml ),
+                             "Could not find " + decayxml + "; use --datadir=..." );
+      DecayDataBaseServer::setDecayXmlFile( decayxml );
+      configured = true;
+    }
+
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    BOOST_REQUIRE( db );
+    return db;
+  }//decay_database()
+
+
+  //Gives access to the protected cache types and functions; never created.
+  struct ReferenceDisplayAccess : public ReferencePhotopeakDisplay
+  {
+    using ReferencePhotopeakDisplay::DecayLineTemplate;
+    using ReferencePhotopeakDisplay::LineFactorCache;
+    using ReferencePhotopeakDisplay::cachedLineFactor;
+  };//struct ReferenceDisplayAccess
+
+  typedef ReferenceDisplayAccess::DecayLineTemplate DecayLineTemplate;
+
+
+  struct DecayLines
+  {
+    vector<const SandiaDecay::Transition *> transitions;
+    vector<double> energies, branchratios;
+    vector<SandiaDecay::ProductType> types;
+    vector<DecayParticleModel::RowData> rows;
+  };//struct DecayLines
+
+
+  //The lines ReferencePhotopeakDisplay::updateDisplayChange() computed before
+  //  the templates were added: a walk through every transition of the decay
+  //  chain at 'age'.
+  DecayLines walk_decay_chain( const SandiaDecay::Nuclide *nuc, const bool promptOnly,
+                               const vector<SandiaDecay::ProductType> &types,
+                               const double age )
+  {
+    DecayLines answer;
+
+    SandiaDecay::NuclideMixture mixture;
+    if( promptOnly )
+      mixture.addNuclideInPromptEquilibrium( nuc, 1.0E-3 * SandiaDecay::curie );
+    else
+      mixture.addNuclideByActivity( nuc, 1.0E-3 * SandiaDecay::curie );
+
+    const vector<SandiaDecay::NuclideActivityPair> activities = mixture.activity( age );
+    const double parent_activity = mixture.activity( age, nuc );
+
+    DecayParticleModel::RowData positronrow;
+    positronrow.energy      = static_cast<float>( 510.9989 * PhysicalUnits::keV );
+    positronrow.branchRatio = 0.0f;
+    positronrow.particle    = SandiaDecay::GammaParticle;
+    positronrow.responsibleNuc = 0;
+    set<const SandiaDecay::Nuclide *> positronparents;
+    set<const SandiaDecay::Transition *> positrontrans;
+
+    for( SandiaDecay::ProductType type : types )
+    {
+      for( const SandiaDecay::NuclideActivityPair &nap : activities )
+      {
+        for( const SandiaDecay::Transition *transition : nap.nuclide->decaysToChildren )
+        {
+          for( const SandiaDecay::RadParticle &particle : transition->products )
+          {
+            const double br = nap.activity * particle.intensity
+                                    * transition->branchRatio / parent_activity;
+
+            if( type == SandiaDecay::PositronParticle && particle.type == SandiaDecay::PositronParticle )
+            {
+              positronrow.branchRatio += 2.0*br;
+              positronrow.decayMode = transition->mode;
+              positronparents.insert( transition->parent );
+              positrontrans.insert( transition );
+            }else if( (particle.type == type) && (particle.type == SandiaDecay::XrayParticle) )
+            {
+              size_t index = 0;
+              for( ; index < answer.energies.size(); ++index )
+              {
+                if( fabs(answer.energies[index] - particle.energy) < 1.0E-6 )
+                  break;
+              }
+
+              if( index < answer.energies.size() )
+              {
+                answer.branchratios[index] += br;
+                answer.rows[index].branchRatio += br;
+              }else
+              {
+                DecayParticleModel::RowData row;
+                row.energy      = particle.energy;
+                row.branchRatio = br;
+                row.particle    = SandiaDecay::XrayParticle;
+                row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
+                row.responsibleNuc = nuc;
+
+                answer.transitions.push_back( NULL );
+                answer.energies.push_back( particle.energy );
+                answer.branchratios.push_back( br );
+                answer.types.push_back( SandiaDecay::XrayParticle );
+                answer.rows.push_back( row );
+              }
+            }else if( particle.type == type )
+            {
+              DecayParticleModel::RowData row;
+              row.energy      = particle.energy;
+              row.branchRatio = br;
+              row.particle    = particle.type;
+              row.decayMode   = transition->mode;
+              row.responsibleNuc = transition->parent;
+
+              answer.transitions.push_back( transition );
+              answer.energies.push_back( particle.energy );
+              answer.branchratios.push_back( br );
+              answer.types.push_back( type );
+              answer.rows.push_back( row );
+            }//if( positron ) / else if( xray ) / else if( particle.type == type )
+          }//for( loop over products )
+        }//for( loop over transitions )
+      }//for( loop over chain nuclides )
+    }//for( SandiaDecay::ProductType type : types )
+
+    if( positronrow.branchRatio > 0.0 )
+    {
+      if( positronparents.size() == 1 )
+        positronrow.responsibleNuc = *positronparents.begin();
+
+      answer.transitions.push_back( positrontrans.size() == 1 ? *positrontrans.begin() : NULL );
+      answer.energies.push_back( positronrow.energy );
+      answer.branchratios.push_back( positronrow.branchRatio );
+      answer.types.push_back( SandiaDecay::GammaParticle );
+      answer.rows.push_back( positronrow );
+    }//if( positronrow.branchRatio > 0.0 )
+
+    return answer;
+  }//walk_decay_chain(...)
+
+
+  void check_same_lines( const DecayLines &expected, const DecayLines &actual,
+                         const string &desc )
+  {
+    BOOST_REQUIRE_MESSAGE( expected.energies.size() == actual.energies.size(),
+                           desc << ": expected " << expected.energies.size()
+                           << " lines, got " << actual.energies.size() );
+    BOOST_REQUIRE_EQUAL( actual.transitions.size(), actual.energies.size() );
+    BOOST_REQUIRE_EQUAL( actual.branchratios.size(), actual.energies.size() );
+    BOOST_REQUIRE_EQUAL( actual.types.size(), actual.energies.size() );
+    BOOST_REQUIRE_EQUAL( actual.rows.size(), actual.energies.size() );
+
+    for( size_t i = 0; i < expected.energies.size(); ++i )
+    {
+      //Lines are summed in the same order, so the results must be identical.
+      BOOST_CHECK_MESSAGE( expected.energies[i] == actual.energies[i]
+                           && expected.branchratios[i] == actual.branchratios[i]
+                           && expected.types[i] == actual.types[i]
+                           && expected.transitions[i] == actual.transitions[i],
+                           desc << ": line " << i << " differs; expected "
+                           << expected.energies[i] << " keV with BR "
+                           << expected.branchratios[i] << ", got "
+                           << actual.energies[i] << " keV with BR "
+                           << actual.branchratios[i] );
+
+      const DecayParticleModel::RowData &lhs = expected.rows[i];
+      const DecayParticleModel::RowData &rhs = actual.rows[i];
+      BOOST_CHECK( lhs.energy == rhs.energy );
+      BOOST_CHECK( lhs.branchRatio == rhs.branchRatio );
+      BOOST_CHECK( lhs.decayMode == rhs.decayMode );
+      BOOST_CHECK( lhs.particle == rhs.particle );
+      BOOST_CHECK( lhs.responsibleNuc == rhs.responsibleNuc );
+    }//for( size_t i = 0; i < expected.energies.size(); ++i )
+  }//void check_same_lines(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testDecayLineTemplateMatchesChainWalk )
+{
+  const SandiaDecay::SandiaDecayDataBase *db = decay_database();
+
+  const vector<SandiaDecay::ProductType> types{
+    SandiaDecay::GammaParticle, SandiaDecay::PositronParticle,
+    SandiaDecay::AlphaParticle, SandiaDecay::BetaParticle, SandiaDecay::XrayParticle
+  };
+
+  const double ages[] = { 0.0, 1.0*PhysicalUnits::day, 0.5*PhysicalUnits::year,
+                          5.0*PhysicalUnits::year, 20.0*PhysicalUnits::year };
+
+  //Includes nuclides with xrays from several chain members (U238, Th232),
+  //  positrons (Na22), and short lived descendants (Cs137).
+  const char *nuclides[] = { "Co60", "Ba133", "Cs137", "Na22", "Eu152",
+                             "U235", "U238", "Th232", "Ra226" };
+
+  double walk_seconds = 0.0, eval_seconds = 0.0;
+  size_t nevaluations = 0, nrebuilds = 0;
+
+  for( const char *name : nuclides )
+  {
+    const SandiaDecay::Nuclide *nuc = db->nuclide( name );
+    BOOST_REQUIRE_MESSAGE( nuc, "Nuclide " << name << " not in decay database" );
+
+    for( const bool promptOnly : { false, true } )
+    {
+      //Built once, at the first age, and then re-used for every age, as
+      //  ReferencePhotopeakDisplay does when only the age changes.
+      std::shared_ptr<const DecayLineTemplate> tmplt
+            = std::make_shared<const DecayLineTemplate>( nuc, promptOnly, types, ages[0] );
+
+      for( const double age : ages )
+      {
+        //The display uses an age of zero for prompt-only lines.
+        const double lineage = promptOnly ? 0.0 : age;
+        const string desc = string(name) + (promptOnly ? " prompt" : "")
+                            + " at " + std::to_string( lineage / PhysicalUnits::day ) + " days";
+
+        const auto walk_start = std::chrono::steady_clock::now();
+        const DecayLines expected = walk_decay_chain( nuc, promptOnly, types, lineage );
+        const auto walk_end = std::chrono::steady_clock::now();
+
+        DecayLines actual;
+        bool evaluated = tmplt->evaluate( lineage, actual.transitions, actual.energies,
+                                          actual.branchratios, actual.types, actual.rows );
+        const auto eval_end = std::chrono::steady_clock::now();
+
+        if( !evaluated )
+        {
+          //The chain present changed with age; the display rebuilds the
+          //  template in this case.
+          BOOST_CHECK( actual.energies.empty() );
+          ++nrebuilds;
+          tmplt = std::make_shared<const DecayLineTemplate>( nuc, promptOnly, types, lineage );
+          evaluated = tmplt->evaluate( lineage, actual.transitions, actual.energies,
+                                       actual.branchratios, actual.types, actual.rows );
+          BOOST_REQUIRE_MESSAGE( evaluated, desc << ": template built at this age couldnt be evaluated" );
+        }else
+        {
+          walk_seconds += std::chrono::duration<double>(walk_end - walk_start).count();
+          eval_seconds += std::chrono::duration<double>(eval_end - walk_end).count();
+          ++nevaluations;
+        }//if( !evaluated ) / else
+
+        BOOST_CHECK( !expected.energies.empty() );
+        check_same_lines( expected, actual, desc );
+      }//for( const double age : ages )
+    }//for( const bool promptOnly : { false, true } )
+  }//for( const char *name : nuclides )
+
+  BOOST_CHECK( nevaluations > nrebuilds );
+
+  BOOST_TEST_MESSAGE( "Walking the decay chain took " << 1.0E6*walk_seconds/nevaluations
+                      << " us per update, evaluating the template took "
+                      << 1.0E6*eval_seconds/nevaluations << " us (" << nrebuilds
+                      << " of " << (nevaluations + nrebuilds) << " needed a rebuild)" );
+}//BOOST_AUTO_TEST_CASE( testDecayLineTemplateMatchesChainWalk )
+
+
+BOOST_AUTO_TEST_CASE( testCachedLineFactor )
+{
+  ReferenceDisplayAccess::LineFactorCache cache;
+
+  size_t ncalls = 0;
+  const std::function<double(double)> fcn = [&ncalls]( double energy ) -> double {
+    ++ncalls;
+    return 1.0 / (1.0 + energy);
+  };
+
+  const double energies[] = { 59.54, 122.06, 661.66, 1173.23, 1332.49 };
+
+  //First DRF: each energy is computed once, and then taken from the cache.
+  for( int pass = 0; pass < 3; ++pass )
+  {
+    for( const double energy : energies )
+    {
+      const double value = ReferenceDisplayAccess::cachedLineFactor( cache, "drf-a", energy, fcn );
+      BOOST_CHECK_EQUAL( value, 1.0 / (1.0 + energy) );
+    }
+  }
+  BOOST_CHECK_EQUAL( ncalls, sizeof(energies)/sizeof(energies[0]) );
+
+  //Changing the key (i.e., the DRF or shielding changed) must recompute.
+  const std::function<double(double)> otherfcn = [&ncalls]( double energy ) -> double {
+    ++ncalls;
+    return 2.0 * energy;
+  };
+
+  ncalls = 0;
+  for( const double energy : energies )
+  {
+    const double value = ReferenceDisplayAccess::cachedLineFactor( cache, "drf-b", energy, otherfcn );
+    BOOST_CHECK_EQUAL( value, 2.0 * energy );
+  }
+  BOOST_CHECK_EQUAL( ncalls, sizeof(energies)/sizeof(energies[0]) );
+  BOOST_CHECK_EQUAL( cache.key, "drf-b" );
+  BOOST_CHECK_EQUAL( cache.values.size(), sizeof(energies)/sizeof(energies[0]) );
+
+  //Going back to the first key doesnt give stale values from the second.
+  ncalls = 0;
+  BOOST_CHECK_EQUAL( ReferenceDisplayAccess::cachedLineFactor( cache, "drf-a", energies[0], fcn ),
+                     1.0 / (1.0 + energies[0]) );
+  BOOST_CHECK_EQUAL( ncalls, size_t(1) );
+}//BOOST_AUTO_TEST_CASE( testCachedLineFactor )
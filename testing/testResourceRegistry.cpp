@@ -0,0 +1,149 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testResourceRegistry
+#include <boost/test/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/MaterialDB.h"
+#include "InterSpec/GadrasSpecFunc.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "InterSpec/ResourceRegistry.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Simulates many sessions starting up at once, each wanting the material
+//  database and GADRAS scatter table, and checks the files are only parsed
+//  once, that every session gets the same copy, and that sessions adding their
+//  own materials, and then going away, dont effect the other sessions.
+
+namespace
+{
+  //What a simulated session gets from the registry.
+  struct SessionResources
+  {
+    std::shared_ptr<const MaterialDB> sharedMaterials;
+    std::shared_ptr<MaterialDB> sessionMaterials;
+    std::shared_ptr<const GadrasScatterTable> scatter;
+    const Material *userMaterial = nullptr;
+    string error;
+  };//struct SessionResources
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testSessionsShareOneParse )
+{
+  const string datadir = data_directory();
+  BOOST_REQUIRE_MESSAGE( UtilityFunctions::is_file( UtilityFunctions::append_path(datadir, "MaterialDataBase.txt") ),
+                         "Could not find MaterialDataBase.txt in '" + datadir + "'; use --datadir=..." );
+  
+  InterSpec::setStaticDataDirectory( datadir );
+  DecayDataBaseServer::setDecayXmlFile( UtilityFunctions::append_path(datadir, "sandia.decay.xml") );
+  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  const size_t nsessions = 16;
+  vector<SessionResources> sessions( nsessions );
+  
+  {//Begin simulating sessions starting at the same time
+    vector<std::thread> threads;
+    for( size_t i = 0; i < nsessions; ++i )
+    {
+      SessionResources &session = sessions[i];
+      threads.emplace_back( [&session,db,i](){
+        try
+        {
+          session.sharedMaterials = ResourceRegistry::materialDB();
+          session.scatter = ResourceRegistry::gadrasScatterTable();
+          
+          session.sessionMaterials = std::make_shared<MaterialDB>();
+          session.sessionMaterials->addSharedMaterials( session.sharedMaterials );
+          
+          //Each session adds its own material, which the others must not see.
+          const string formula = "C" + std::to_string(i+1) + "H2 d=1.5";
+          session.userMaterial = session.sessionMaterials->parseChemicalFormula( formula, db );
+        }catch( std::exception &e )
+        {
+          session.error = e.what();
+        }
+      } );
+    }//for( size_t i = 0; i < nsessions; ++i )
+    
+    for( std::thread &t : threads )
+      t.join();
+  }//End simulating sessions starting at the same time
+  
+  BOOST_CHECK_EQUAL( ResourceRegistry::numTimesLoaded( ResourceRegistry::MaterialDataBase ), size_t(1) );
+  BOOST_CHECK_EQUAL( ResourceRegistry::numTimesLoaded( ResourceRegistry::GadrasScatter ), size_t(1) );
+  
+  for( size_t i = 0; i < nsessions; ++i )
+  {
+    const SessionResources &session = sessions[i];
+    BOOST_REQUIRE_MESSAGE( session.error.empty(), "Session " + std::to_string(i) + ": " + session.error );
+    BOOST_CHECK( session.sharedMaterials == sessions[0].sharedMaterials );
+    BOOST_CHECK( session.scatter == sessions[0].scatter );
+    BOOST_REQUIRE( session.userMaterial );
+    
+    //The shared materials are the same objects in every session.
+    BOOST_CHECK( session.sessionMaterials->material( "Fe" ) == sessions[0].sessionMaterials->material( "Fe" ) );
+    BOOST_CHECK( session.sessionMaterials->material( "Fe" ) == session.sharedMaterials->material( "Fe" ) );
+    
+    //User materials are only in the session that added them.
+    BOOST_CHECK( session.sessionMaterials->material( session.userMaterial->name ) == session.userMaterial );
+    BOOST_CHECK( session.sharedMaterials->names().size() < session.sessionMaterials->names().size() );
+  }//for( size_t i = 0; i < nsessions; ++i )
+  
+  //Sessions ending must not delete the shared materials.
+  const std::shared_ptr<const MaterialDB> shared = sessions[0].sharedMaterials;
+  const Material * const iron = shared->material( "Fe" );
+  sessions.clear();
+  
+  BOOST_CHECK( shared->material( "Fe" ) == iron );
+  BOOST_CHECK( !iron->name.empty() );
+  BOOST_CHECK( iron->density > 0.0f );
+  
+  //New sessions still get the same copy, without parsing again.
+  BOOST_CHECK( ResourceRegistry::materialDB() == shared );
+  BOOST_CHECK_EQUAL( ResourceRegistry::numTimesLoaded( ResourceRegistry::MaterialDataBase ), size_t(1) );
+  
+  //After a release, the next request parses the file again.
+  ResourceRegistry::release( ResourceRegistry::MaterialDataBase );
+  const std::shared_ptr<const MaterialDB> reloaded = ResourceRegistry::materialDB();
+  BOOST_CHECK( reloaded && reloaded != shared );
+  BOOST_CHECK_EQUAL( ResourceRegistry::numTimesLoaded( ResourceRegistry::MaterialDataBase ), size_t(2) );
+}//BOOST_AUTO_TEST_CASE( testSessionsShareOneParse )
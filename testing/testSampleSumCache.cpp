@@ -0,0 +1,180 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testSampleSumCache
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/SampleSumCache.h"
+#include "SpecUtils/UtilityFunctions.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+#include "testing/TestDataDirectories.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks SampleSumCache::sum(...) gives the same counts, times, and
+//  meta-information as SpecMeas::sum_measurements(...), for the kinds of
+//  sample selections the spectrum file manager makes, on the example spectra.
+
+namespace
+{
+  //Gives access to whether the cache, or sum_measurements(...), was used.
+  struct SampleSumCacheAccess : public SampleSumCache
+  {
+    using SampleSumCache::m_usable;
+  };//struct SampleSumCacheAccess
+
+
+  void check_same_sum( const std::shared_ptr<Measurement> &expected,
+                       const std::shared_ptr<Measurement> &actual,
+                       const string &desc )
+  {
+    BOOST_REQUIRE_MESSAGE( expected && actual, desc << ": missing sum" );
+    BOOST_REQUIRE_EQUAL( expected->num_gamma_channels(), actual->num_gamma_channels() );
+
+    const vector<float> &ecounts = *expected->gamma_counts();
+    const vector<float> &acounts = *actual->gamma_counts();
+    size_t ndiffer = 0;
+    for( size_t i = 0; i < ecounts.size(); ++i )
+    {
+      if( fabs( ecounts[i] - acounts[i] ) > 1.0E-5*std::max( 1.0f, fabs(ecounts[i]) ) )
+        ++ndiffer;
+    }
+    BOOST_CHECK_MESSAGE( ndiffer == 0, desc << ": " << ndiffer << " channels differ" );
+
+    BOOST_CHECK_CLOSE_FRACTION( expected->gamma_count_sum(), actual->gamma_count_sum(), 1.0E-5 );
+    BOOST_CHECK_CLOSE_FRACTION( expected->live_time(), actual->live_time(), 1.0E-5 );
+    BOOST_CHECK_CLOSE_FRACTION( expected->real_time(), actual->real_time(), 1.0E-5 );
+    BOOST_CHECK_EQUAL( expected->contained_neutron(), actual->contained_neutron() );
+    if( expected->contained_neutron() )
+      BOOST_CHECK_CLOSE_FRACTION( expected->neutron_counts_sum(), actual->neutron_counts_sum(), 1.0E-5 );
+
+    BOOST_CHECK_MESSAGE( expected->start_time() == actual->start_time(),
+                         desc << ": start time " << actual->start_time()
+                         << " instead of " << expected->start_time() );
+    BOOST_CHECK_MESSAGE( expected->title() == actual->title(),
+                         desc << ": title '" << actual->title()
+                         << "' instead of '" << expected->title() << "'" );
+    BOOST_CHECK_EQUAL( expected->has_gps_info(), actual->has_gps_info() );
+    if( expected->has_gps_info() && actual->has_gps_info() )
+    {
+      BOOST_CHECK_CLOSE_FRACTION( expected->latitude(), actual->latitude(), 1.0E-9 );
+      BOOST_CHECK_CLOSE_FRACTION( expected->longitude(), actual->longitude(), 1.0E-9 );
+    }
+  }//void check_same_sum(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testSumMatchesSumMeasurements )
+{
+  const string indir = example_spectra_dir();
+  const vector<string> files = UtilityFunctions::recursive_ls( indir, ".n42" );
+  BOOST_REQUIRE_MESSAGE( !files.empty(), "No N42 files in " + indir + "; use --indir=..." );
+
+  size_t nfilesCached = 0;
+  double direct_seconds = 0.0, cached_seconds = 0.0;
+
+  for( const string &filename : files )
+  {
+    auto meas = std::make_shared<SpecMeas>();
+    BOOST_REQUIRE_MESSAGE( meas->load_file( filename, kAutoParser, "n42" ),
+                           "Failed to open " + filename );
+
+    const vector<int> samples( meas->sample_numbers().begin(), meas->sample_numbers().end() );
+    const vector<bool> detectors( meas->detector_numbers().size(), true );
+    BOOST_REQUIRE( !samples.empty() );
+
+    //The selections the file manager makes: everything, a single sample,
+    //  a window sliding by one sample at a time, a jump to somewhere else, and
+    //  a non-contiguous selection.
+    vector<set<int>> selections;
+    selections.push_back( set<int>( samples.begin(), samples.end() ) );
+    selections.push_back( set<int>{ samples[samples.size()/2] } );
+
+    const size_t window = std::max( size_t(1), samples.size()/4 );
+    for( size_t start = 0; start + window <= samples.size() && start < 20; ++start )
+      selections.push_back( set<int>( samples.begin() + start, samples.begin() + start + window ) );
+
+    selections.push_back( set<int>( samples.begin() + samples.size()/2, samples.end() ) );
+
+    set<int> everyThird;
+    for( size_t i = 0; i < samples.size(); i += 3 )
+      everyThird.insert( samples[i] );
+    selections.push_back( everyThird );
+
+    SampleSumCacheAccess cache;
+
+    for( size_t i = 0; i < selections.size(); ++i )
+    {
+      const auto start = std::chrono::steady_clock::now();
+      const std::shared_ptr<Measurement> expected = meas->sum_measurements( selections[i], detectors );
+      const auto mid = std::chrono::steady_clock::now();
+      const std::shared_ptr<Measurement> actual = cache.sum( meas, selections[i], detectors );
+      const auto end = std::chrono::steady_clock::now();
+
+      direct_seconds += std::chrono::duration<double>(mid - start).count();
+      cached_seconds += std::chrono::duration<double>(end - mid).count();
+
+      check_same_sum( expected, actual, UtilityFunctions::filename(filename)
+                                        + " selection " + std::to_string(i) );
+    }//for( size_t i = 0; i < selections.size(); ++i )
+
+    //Editing the meta-information doesnt change the counts or binning, so
+    //  the index stays valid, but the sum must still reflect the edit.
+    const std::shared_ptr<const Measurement> first = meas->measurement( samples.front(),
+                                                       meas->detector_numbers().front() );
+    if( first )
+    {
+      const boost::posix_time::ptime newtime = first->start_time().is_special()
+                 ? boost::posix_time::time_from_string( "2010-03-17 12:00:00" )
+                 : first->start_time() - boost::posix_time::hours( 24 );
+      meas->set_start_time( newtime, first );
+      meas->set_title( "Edited title", first );
+
+      const set<int> firstSamples( samples.begin(), samples.begin() + std::min( samples.size(), size_t(40) ) );
+      check_same_sum( meas->sum_measurements( firstSamples, detectors ),
+                      cache.sum( meas, firstSamples, detectors ),
+                      UtilityFunctions::filename(filename) + " after editing" );
+    }//if( first )
+
+    if( cache.m_usable )
+      ++nfilesCached;
+  }//for( const string &filename : files )
+
+  //passthrough.n42 has enough samples for the cache to be used.
+  BOOST_CHECK( nfilesCached > 0 );
+
+  BOOST_TEST_MESSAGE( "sum_measurements took " << 1000*direct_seconds
+                      << " ms, SampleSumCache took " << 1000*cached_seconds << " ms" );
+}//BOOST_AUTO_TEST_CASE( testSumMatchesSumMeasurements )
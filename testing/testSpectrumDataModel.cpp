@@ -0,0 +1,214 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testSpectrumDataModel
+#include <boost/test/unit_test.hpp>
+
+#include <boost/any.hpp>
+
+#include <Wt/WApplication>
+#include <Wt/WModelIndex>
+#include <Wt/Test/WTestEnvironment>
+
+#include "InterSpec/SpectrumDataModel.h"
+#include "SpecUtils/SpectrumDataStructs.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks the cached columns of SpectrumDataModel (columnValues(), rowLowEdges(),
+//  rowWidths()) give the same values as summing the channels directly, with
+//  rebinning, live time normalization, and background subtraction, and that
+//  they are re-computed when the spectra or how they are displayed change.
+
+namespace
+{
+  //Spectrum with 'nchannel' channels evenly spaced over [0,3000] keV, with
+  //  counts given by 'counts(channel)'.
+  template<class Func>
+  std::shared_ptr<Measurement> make_spectrum( const size_t nchannel,
+                                              const float live_time,
+                                              Func counts )
+  {
+    auto energies = std::make_shared<vector<float>>( nchannel );
+    auto contents = std::make_shared<vector<float>>( nchannel );
+    for( size_t i = 0; i < nchannel; ++i )
+    {
+      (*energies)[i] = 3000.0f * i / nchannel;
+      (*contents)[i] = counts( i );
+    }
+    
+    auto meas = std::make_shared<Measurement>();
+    meas->set_channel_energies( energies );
+    meas->set_gamma_counts( contents, live_time, live_time );
+    return meas;
+  }//make_spectrum(...)
+  
+  
+  struct DataModelFixture
+  {
+    DataModelFixture()
+      : env( Wt::Application ),
+        app( env )
+    {
+      foreground = make_spectrum( 1024, 300.0f, []( size_t i ){ return float(i % 7 + 1); } );
+      background = make_spectrum( 1024, 600.0f, []( size_t i ){ return float(i % 3); } );
+      model.setDataHistogram( foreground, 300.0f, 300.0f, 0.0f );
+    }
+    
+    Wt::Test::WTestEnvironment env;
+    Wt::WApplication app;
+    SpectrumDataModel model;
+    std::shared_ptr<Measurement> foreground, background;
+  };//struct DataModelFixture
+  
+  
+  //Sum of channels [row*rebin, row*rebin + rebin) of 'meas'.
+  double channel_sum( const std::shared_ptr<Measurement> &meas, const int row, const int rebin )
+  {
+    const vector<float> &contents = *meas->gamma_channel_contents();
+    double sum = 0.0;
+    for( int i = row*rebin; i < (row+1)*rebin; ++i )
+      sum += contents[i];
+    return sum;
+  }//channel_sum(...)
+}//namespace
+
+
+BOOST_FIXTURE_TEST_CASE( testColumnsMatchChannelSums, DataModelFixture )
+{
+  for( const int rebin : { 1, 4 } )
+  {
+    model.setRebinFactor( rebin );
+    
+    const int nrows = model.rowCount();
+    BOOST_REQUIRE_EQUAL( nrows, 1024 / rebin );
+    
+    const vector<double> &x = model.columnValues( SpectrumDataModel::X_AXIS_COLUMN );
+    const vector<double> &y = model.columnValues( SpectrumDataModel::DATA_COLUMN );
+    const vector<double> &edges = model.rowLowEdges();
+    const vector<double> &widths = model.rowWidths();
+    
+    BOOST_REQUIRE_EQUAL( x.size(), size_t(nrows) );
+    BOOST_REQUIRE_EQUAL( y.size(), size_t(nrows) );
+    BOOST_REQUIRE_EQUAL( edges.size(), size_t(nrows) );
+    BOOST_REQUIRE_EQUAL( widths.size(), size_t(nrows) );
+    
+    //No second or background spectrum set, so these columns are empty.
+    BOOST_CHECK( model.columnValues( SpectrumDataModel::SECOND_DATA_COLUMN ).empty() );
+    BOOST_CHECK( model.columnValues( SpectrumDataModel::BACKGROUND_COLUMN ).empty() );
+    
+    for( int row = 0; row < nrows; ++row )
+    {
+      BOOST_CHECK_CLOSE( y[row], channel_sum( foreground, row, rebin ), 1.0E-6 );
+      BOOST_CHECK_CLOSE( edges[row], foreground->gamma_channel_lower( row*rebin ), 1.0E-4 );
+      BOOST_CHECK_CLOSE( widths[row], rebin * 3000.0 / 1024, 1.0E-3 );
+      BOOST_CHECK_CLOSE( x[row], edges[row] + 0.5*widths[row], 1.0E-4 );
+      
+      //The scalar and WAbstractItemModel accessors must agree with the arrays
+      BOOST_CHECK_EQUAL( model.data( row, SpectrumDataModel::DATA_COLUMN ), y[row] );
+      BOOST_CHECK_EQUAL( model.rowLowEdge( row ), edges[row] );
+      BOOST_CHECK_EQUAL( model.rowWidth( row ), widths[row] );
+      
+      const boost::any value = model.data( model.index( row, SpectrumDataModel::DATA_COLUMN ) );
+      BOOST_REQUIRE( !value.empty() );
+      BOOST_CHECK_EQUAL( boost::any_cast<double>( value ), y[row] );
+    }//for( int row = 0; row < nrows; ++row )
+  }//for( const int rebin : { 1, 4 } )
+}//BOOST_FIXTURE_TEST_CASE( testColumnsMatchChannelSums, DataModelFixture )
+
+
+BOOST_FIXTURE_TEST_CASE( testBackgroundScalingAndSubtraction, DataModelFixture )
+{
+  model.setBackgroundHistogram( background, 600.0f, 600.0f, 0.0f );
+  
+  //Background has twice the live time of the foreground
+  BOOST_CHECK_CLOSE( model.backgroundScaledBy(), 0.5, 1.0E-6 );
+  
+  const int nrows = model.rowCount();
+  {
+    const vector<double> &y = model.columnValues( SpectrumDataModel::DATA_COLUMN );
+    const vector<double> &back = model.columnValues( SpectrumDataModel::BACKGROUND_COLUMN );
+    BOOST_REQUIRE_EQUAL( back.size(), size_t(nrows) );
+    for( int row = 0; row < nrows; ++row )
+    {
+      BOOST_CHECK_CLOSE( y[row], channel_sum( foreground, row, 1 ), 1.0E-6 );
+      BOOST_CHECK_SMALL( back[row] - 0.5*channel_sum( background, row, 1 ), 1.0E-6 );
+    }
+  }
+  
+  model.setBackgroundSubtract( true );
+  {
+    const vector<double> &y = model.columnValues( SpectrumDataModel::DATA_COLUMN );
+    for( int row = 0; row < nrows; ++row )
+    {
+      const double expected = channel_sum( foreground, row, 1 ) - 0.5*channel_sum( background, row, 1 );
+      BOOST_CHECK_SMALL( y[row] - expected, 1.0E-6 );
+    }
+  }
+  
+  //Changing the scale factor must invalidate the cache
+  model.setBackgroundDataScaleFactor( 2.0f );
+  BOOST_CHECK_CLOSE( model.backgroundScaledBy(), 2.0, 1.0E-6 );
+  {
+    const vector<double> &y = model.columnValues( SpectrumDataModel::DATA_COLUMN );
+    for( int row = 0; row < nrows; ++row )
+    {
+      const double expected = channel_sum( foreground, row, 1 ) - 2.0*channel_sum( background, row, 1 );
+      BOOST_CHECK_SMALL( y[row] - expected, 1.0E-6 );
+    }
+  }
+  
+  model.setBackgroundSubtract( false );
+  BOOST_CHECK_CLOSE( model.columnValues( SpectrumDataModel::DATA_COLUMN )[10],
+                     channel_sum( foreground, 10, 1 ), 1.0E-6 );
+}//BOOST_FIXTURE_TEST_CASE( testBackgroundScalingAndSubtraction, DataModelFixture )
+
+
+BOOST_FIXTURE_TEST_CASE( testCacheFollowsSpectrumChanges, DataModelFixture )
+{
+  const double before = model.columnValues( SpectrumDataModel::DATA_COLUMN )[100];
+  BOOST_CHECK_CLOSE( before, channel_sum( foreground, 100, 1 ), 1.0E-6 );
+  
+  //Replacing the counts of the displayed Measurement (e.g., a different
+  //  sample being summed into it) must be picked up.
+  auto newcounts = std::make_shared<vector<float>>( 1024, 10.0f );
+  foreground->set_gamma_counts( newcounts, 300.0f, 300.0f );
+  BOOST_CHECK_CLOSE( model.columnValues( SpectrumDataModel::DATA_COLUMN )[100], 10.0, 1.0E-6 );
+  
+  //As must setting a new foreground spectrum with a different binning
+  auto coarse = make_spectrum( 256, 300.0f, []( size_t ){ return 5.0f; } );
+  model.setDataHistogram( coarse, 300.0f, 300.0f, 0.0f );
+  BOOST_REQUIRE_EQUAL( model.rowCount(), 256 );
+  BOOST_CHECK_EQUAL( model.columnValues( SpectrumDataModel::DATA_COLUMN ).size(), size_t(256) );
+  BOOST_CHECK_EQUAL( model.rowLowEdges().size(), size_t(256) );
+  BOOST_CHECK_CLOSE( model.rowWidths()[0], 3000.0/256, 1.0E-3 );
+  BOOST_CHECK_CLOSE( model.columnValues( SpectrumDataModel::DATA_COLUMN )[0], 5.0, 1.0E-6 );
+}//BOOST_FIXTURE_TEST_CASE( testCacheFollowsSpectrumChanges, DataModelFixture )
@@ -0,0 +1,125 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+#include <thread>
+#include <sstream>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testTracing
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/Tracing.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//Checks spans are attributed to the session they were recorded in, and that
+//  exporting the trace for a session gives exactly its spans, including for
+//  session IDs longer than the default Wt length.
+
+namespace
+{
+  //Number of spans named 'name' in the exported trace.
+  size_t count_spans( const string &trace, const string &name )
+  {
+    const string key = "\"name\":\"" + name + "\"";
+    size_t n = 0;
+    for( size_t pos = trace.find( key ); pos != string::npos; pos = trace.find( key, pos + 1 ) )
+      ++n;
+    return n;
+  }//count_spans(...)
+  
+  
+  string trace_for( const string &sessionId )
+  {
+    stringstream output;
+    Tracing::writeChromeTrace( output, sessionId );
+    return output.str();
+  }//trace_for(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( filterBySession )
+{
+  Tracing::clear();
+  
+  //A default length Wt session ID, one with a prefix (longer than the 32
+  //  characters that used to be kept), and one longer than Event::session.
+  const string shortid = "k3Jd9sLq0aZx7WbP";
+  const string prefixed = "interspec-server-node-07-" + shortid + "-x";
+  const string longid( 2*sizeof(Tracing::Event::session), 'a' );
+  
+  BOOST_REQUIRE_GT( prefixed.size(), 32 );
+  BOOST_REQUIRE_LT( prefixed.size(), sizeof(Tracing::Event::session) );
+  
+  {
+    INTERSPEC_TRACE_SESSION( shortid );
+    INTERSPEC_TRACE_SPAN( "shortSpan" );
+  }
+  
+  //Spans recorded from other threads (e.g., worker threads) too.
+  std::thread worker( [&prefixed](){
+    INTERSPEC_TRACE_SESSION( prefixed );
+    INTERSPEC_TRACE_SPAN( "prefixedSpan" );
+  } );
+  worker.join();
+  
+  {
+    INTERSPEC_TRACE_SESSION( longid );
+    INTERSPEC_TRACE_SPAN( "longSpan" );
+  }
+  
+  {
+    INTERSPEC_TRACE_SPAN( "noSessionSpan" );
+  }
+  
+  const string all = trace_for( "" );
+  BOOST_CHECK_EQUAL( count_spans( all, "shortSpan" ), 1 );
+  BOOST_CHECK_EQUAL( count_spans( all, "prefixedSpan" ), 1 );
+  BOOST_CHECK_EQUAL( count_spans( all, "longSpan" ), 1 );
+  BOOST_CHECK_EQUAL( count_spans( all, "noSessionSpan" ), 1 );
+  BOOST_CHECK( all.find( "\"session\":\"" + prefixed + "\"" ) != string::npos );
+  
+  const string shorttrace = trace_for( shortid );
+  BOOST_CHECK_EQUAL( count_spans( shorttrace, "shortSpan" ), 1 );
+  BOOST_CHECK_EQUAL( count_spans( shorttrace, "prefixedSpan" ), 0 );
+  BOOST_CHECK_EQUAL( count_spans( shorttrace, "longSpan" ), 0 );
+  BOOST_CHECK_EQUAL( count_spans( shorttrace, "noSessionSpan" ), 0 );
+  
+  const string prefixedtrace = trace_for( prefixed );
+  BOOST_CHECK_EQUAL( count_spans( prefixedtrace, "prefixedSpan" ), 1 );
+  BOOST_CHECK_EQUAL( count_spans( prefixedtrace, "shortSpan" ), 0 );
+  
+  //A session ID that is a prefix of another must not match it.
+  BOOST_CHECK_EQUAL( count_spans( trace_for( prefixed.substr(0, 32) ), "prefixedSpan" ), 0 );
+  
+  const string longtrace = trace_for( longid );
+  BOOST_CHECK_EQUAL( count_spans( longtrace, "longSpan" ), 1 );
+  BOOST_CHECK_EQUAL( count_spans( longtrace, "shortSpan" ), 0 );
+  
+  Tracing::clear();
+  BOOST_CHECK_EQUAL( count_spans( trace_for( "" ), "shortSpan" ), 0 );
+}//BOOST_AUTO_TEST_CASE( filterBySession )
@@ -0,0 +1,313 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <random>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE testUndoRedoManager
+#include <boost/test/unit_test.hpp>
+
+#include "InterSpec/UndoRedoManager.h"
+
+using namespace std;
+using namespace boost::unit_test;
+
+//These tests replay long sequences of edits, undos, and redos against a
+//  stand-in for the peaks of a spectrum (a multiset of ints, where each step
+//  removes and adds a few values, like UndoRedoManager::restorePeaks(...)
+//  does), and check that after every action the state matches the state the
+//  history says it should be in.
+
+namespace
+{
+  typedef multiset<int> State;
+
+  //Removes 'remove' from, and adds 'add' to, 'state'.
+  void apply_delta( State &state, const vector<int> &remove, const vector<int> &add )
+  {
+    for( const int v : remove )
+    {
+      const auto pos = state.find( v );
+      BOOST_REQUIRE( pos != end(state) );
+      state.erase( pos );
+    }
+
+    state.insert( begin(add), end(add) );
+  }//void apply_delta(...)
+
+
+  //The part of the state the journaled steps act on (non-negative values);
+  //  negative values are used for untracked changes.
+  State tracked( const State &state )
+  {
+    return State( state.lower_bound(0), end(state) );
+  }
+
+
+  class Replayer
+  {
+  public:
+    Replayer( const size_t max_steps )
+      : m_manager( nullptr ),
+        m_state( std::make_shared<State>() ),
+        m_history( 1, State() ),
+        m_position( 0 ),
+        m_nextValue( 0 ),
+        m_nextUntracked( -1 ),
+        m_maxSteps( max_steps )
+    {
+      m_manager.setMaxSteps( max_steps );
+      m_manager.setMemoryBudget( 1024*1024*1024 );
+    }
+
+    //Makes a recorded edit that removes up to 'nremove' existing values, and
+    //  adds 'nadd' new ones.
+    void edit( std::mt19937 &rng, const size_t nremove, const size_t nadd )
+    {
+      const State current = tracked( *m_state );
+      vector<int> remove( begin(current), end(current) );
+      std::shuffle( begin(remove), end(remove), rng );
+      remove.resize( std::min( nremove, remove.size() ) );
+
+      vector<int> add;
+      for( size_t i = 0; i < nadd; ++i )
+        add.push_back( m_nextValue++ );
+
+      apply_delta( *m_state, remove, add );
+
+      std::shared_ptr<State> state = m_state;
+      auto undo = [state,remove,add](){ apply_delta( *state, add, remove ); };
+      auto redo = [state,remove,add](){ apply_delta( *state, remove, add ); };
+      m_manager.addUndoRedoStep( undo, redo, "edit", sizeof(int)*(remove.size() + add.size()) );
+
+      m_history.resize( m_position + 1 );
+      m_history.push_back( tracked(*m_state) );
+      m_position += 1;
+
+      //Only the most recent m_maxSteps can be undone.
+      if( m_history.size() > (m_maxSteps + 1) )
+      {
+        m_history.erase( begin(m_history) );
+        m_position -= 1;
+      }
+
+      check();
+    }//void edit(...)
+
+    void undo()
+    {
+      const bool could = m_manager.canUndo();
+      BOOST_CHECK_EQUAL( could, (m_position > 0) );
+
+      m_manager.undo();
+      if( could )
+        m_position -= 1;
+
+      check();
+    }//void undo()
+
+    void redo()
+    {
+      const bool could = m_manager.canRedo();
+      BOOST_CHECK_EQUAL( could, ((m_position + 1) < m_history.size()) );
+
+      m_manager.redo();
+      if( could )
+        m_position += 1;
+
+      check();
+    }//void redo()
+
+    //A change that is not recorded as a step (e.g., made inside of a
+    //  BlockUndoRedoInserts); the redo steps no longer apply.
+    void untrackedChange()
+    {
+      m_state->insert( m_nextUntracked-- );
+      m_manager.clearRedoSteps();
+      m_history.resize( m_position + 1 );
+
+      BOOST_CHECK( !m_manager.canRedo() );
+      check();
+    }//void untrackedChange()
+
+    void check()
+    {
+      BOOST_REQUIRE( m_position < m_history.size() );
+      BOOST_REQUIRE( tracked(*m_state) == m_history[m_position] );
+      BOOST_CHECK_EQUAL( m_manager.numUndoSteps(), m_position );
+      BOOST_CHECK_EQUAL( m_manager.numRedoSteps(), m_history.size() - m_position - 1 );
+    }//void check()
+
+    UndoRedoManager m_manager;
+    std::shared_ptr<State> m_state;
+    vector<State> m_history;
+    size_t m_position;
+    int m_nextValue;
+    int m_nextUntracked;
+    const size_t m_maxSteps;
+  };//class Replayer
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( testLongEditSequence )
+{
+  std::mt19937 rng( 1234 );
+  std::uniform_int_distribution<int> action( 0, 99 );
+  std::uniform_int_distribution<int> count( 0, 4 );
+
+  Replayer replay( 100000 );
+
+  for( size_t i = 0; i < 5000; ++i )
+  {
+    const int a = action( rng );
+    if( a < 50 )
+      replay.edit( rng, 1 + count(rng), 1 + count(rng) );
+    else if( a < 75 )
+      replay.undo();
+    else
+      replay.redo();
+  }//for( size_t i = 0; i < 5000; ++i )
+
+  //Undo all the way back to the beginning, and then redo everything.
+  while( replay.m_manager.canUndo() )
+    replay.undo();
+  BOOST_CHECK( replay.m_state->empty() );
+
+  while( replay.m_manager.canRedo() )
+    replay.redo();
+  BOOST_CHECK_EQUAL( replay.m_position, replay.m_history.size() - 1 );
+}//BOOST_AUTO_TEST_CASE( testLongEditSequence )
+
+
+BOOST_AUTO_TEST_CASE( testUntrackedChangeClearsRedo )
+{
+  std::mt19937 rng( 5678 );
+  std::uniform_int_distribution<int> action( 0, 99 );
+  std::uniform_int_distribution<int> count( 0, 3 );
+
+  Replayer replay( 100000 );
+
+  for( size_t i = 0; i < 20; ++i )
+    replay.edit( rng, 1 + count(rng), 1 + count(rng) );
+
+  for( size_t i = 0; i < 5; ++i )
+    replay.undo();
+  BOOST_CHECK_EQUAL( replay.m_manager.numRedoSteps(), 5 );
+
+  replay.untrackedChange();
+  BOOST_CHECK_EQUAL( replay.m_manager.numRedoSteps(), 0 );
+  BOOST_CHECK_EQUAL( replay.m_manager.numUndoSteps(), 15 );
+
+  //Redoing now does nothing, and the earlier steps can still be undone.
+  replay.redo();
+  for( size_t i = 0; i < 15; ++i )
+    replay.undo();
+  BOOST_CHECK( tracked(*replay.m_state).empty() );
+
+  for( size_t i = 0; i < 5000; ++i )
+  {
+    const int a = action( rng );
+    if( a < 45 )
+      replay.edit( rng, 1 + count(rng), 1 + count(rng) );
+    else if( a < 70 )
+      replay.undo();
+    else if( a < 95 )
+      replay.redo();
+    else
+      replay.untrackedChange();
+  }//for( size_t i = 0; i < 5000; ++i )
+}//BOOST_AUTO_TEST_CASE( testUntrackedChangeClearsRedo )
+
+
+BOOST_AUTO_TEST_CASE( testStepLimit )
+{
+  std::mt19937 rng( 91011 );
+  std::uniform_int_distribution<int> action( 0, 99 );
+  std::uniform_int_distribution<int> count( 0, 3 );
+
+  Replayer replay( 25 );
+
+  for( size_t i = 0; i < 5000; ++i )
+  {
+    const int a = action( rng );
+    if( a < 60 )
+      replay.edit( rng, 1 + count(rng), 1 + count(rng) );
+    else if( a < 85 )
+      replay.undo();
+    else
+      replay.redo();
+
+    BOOST_REQUIRE( replay.m_manager.numUndoSteps() <= 25 );
+  }//for( size_t i = 0; i < 5000; ++i )
+
+  replay.m_manager.clearHistory();
+  BOOST_CHECK_EQUAL( replay.m_manager.memoryUsed(), 0 );
+  BOOST_CHECK( !replay.m_manager.canUndo() && !replay.m_manager.canRedo() );
+}//BOOST_AUTO_TEST_CASE( testStepLimit )
+
+
+BOOST_AUTO_TEST_CASE( testMemoryBudget )
+{
+  UndoRedoManager manager( nullptr );
+  manager.setMemoryBudget( 64*1024 );
+
+  int value = 0;
+  for( int i = 0; i < 1000; ++i )
+  {
+    auto undo = [&value,i](){ value = i; };
+    auto redo = [&value,i](){ value = i + 1; };
+    value = i + 1;
+    manager.addUndoRedoStep( undo, redo, "step", 1024 );
+
+    BOOST_REQUIRE( manager.memoryUsed() <= manager.memoryBudget() );
+  }
+
+  const size_t nundo = manager.numUndoSteps();
+  BOOST_CHECK( nundo > 0 && nundo < 64 );
+
+  for( size_t i = 0; i < nundo; ++i )
+    manager.undo();
+  BOOST_CHECK_EQUAL( value, static_cast<int>(1000 - nundo) );
+  BOOST_CHECK_EQUAL( manager.numRedoSteps(), nundo );
+
+  //Shrinking the budget drops redo steps too, furthest from the current state first.
+  manager.setMemoryBudget( 8*1024 );
+  BOOST_CHECK( manager.memoryUsed() <= manager.memoryBudget() );
+  BOOST_CHECK( manager.numRedoSteps() < nundo );
+
+  const size_t nredo = manager.numRedoSteps();
+  for( size_t i = 0; i < nredo; ++i )
+    manager.redo();
+  BOOST_CHECK_EQUAL( value, static_cast<int>(1000 - nundo + nredo) );
+
+  manager.clearRedoSteps();
+  manager.clearHistory();
+  BOOST_CHECK_EQUAL( manager.memoryUsed(), 0 );
+}//BOOST_AUTO_TEST_CASE( testMemoryBudget )